@@ -0,0 +1,722 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// Include SOIL
+#include <SOIL.h>
+
+#include "atlas.h"
+#include "image.h"
+#include "glstate.h"
+
+#define ATLAS_PATH_LENGTH	512
+
+static struct s_sprite *newSprite(struct s_atlas *atlas, const char *name);
+static int packSprite(struct s_atlas *atlas, struct s_sprite *sprite);
+static int findSkylinePosition(const struct s_skyline *skyline, int pageSize, int width, int height, int *x, int *y);
+static int fitSkyline(const struct s_skyline *skyline, int pageSize, int index, int width, int height);
+static void addSkylineLevel(struct s_skyline *skyline, int index, int x, int y, int width, int height);
+static int addPage(struct s_atlas *atlas);
+static void copySprite(struct s_atlas *atlas, struct s_sprite *sprite);
+static void setSpriteCoords(struct s_atlas *atlas, struct s_sprite *sprite);
+static int isImageFile(const char *name);
+static int compareNames(const void *a, const void *b);
+static int compareHeights(const void *a, const void *b);
+
+void initAtlas(struct s_atlas *atlas, int pageSize)
+{
+	memset(atlas, 0, sizeof(*atlas));
+	atlas->pageSize = pageSize;
+}
+
+int addAtlasImage(struct s_atlas *atlas, const char *name, const unsigned char *rgba, int width, int height)
+{
+	struct s_sprite *sprite;
+
+	if (width + 2 * ATLAS_PADDING > atlas->pageSize || height + 2 * ATLAS_PADDING > atlas->pageSize)
+	{
+		fprintf(stderr, "%s is %dx%d, too big for a %d atlas page\n", name, width, height, atlas->pageSize);
+		return -1;
+	}
+	if (atlas->built)
+	{
+		fprintf(stderr, "Can't add %s, the atlas is already built\n", name);
+		return -1;
+	}
+
+	sprite = newSprite(atlas, name);
+	if (sprite == NULL)
+	{
+		return -1;
+	}
+	sprite->pixels = malloc((size_t)width * height * 4);
+	if (sprite->pixels == NULL)
+	{
+		atlas->spriteCount--;
+		return -1;
+	}
+	memcpy(sprite->pixels, rgba, (size_t)width * height * 4);
+	sprite->width = width;
+	sprite->height = height;
+
+	return atlas->spriteCount - 1;
+}
+
+int addAtlasFile(struct s_atlas *atlas, const char *path)
+{
+	const char *name = path;
+	const char *c;
+	int width;
+	int height;
+	int index;
+
+	unsigned char *image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image == NULL)
+	{
+		fprintf(stderr, "Failed to load %s\n", path);
+		return -1;
+	}
+
+	// Sprites are named after the file, without the directory.
+	for (c = path; *c != '\0'; c++)
+	{
+		if (*c == '/' || *c == '\\')
+		{
+			name = c + 1;
+		}
+	}
+	index = addAtlasImage(atlas, name, image, width, height);
+	SOIL_free_image_data(image);
+	return index;
+}
+
+int addAtlasDirectory(struct s_atlas *atlas, const char *path)
+{
+	char **files;
+	int fileCount = listImageFiles(path, &files);
+	int added = 0;
+	int i;
+
+	if (fileCount < 0)
+	{
+		return -1;
+	}
+	for (i = 0; i < fileCount; i++)
+	{
+		if (addAtlasFile(atlas, files[i]) >= 0)
+		{
+			added++;
+		}
+	}
+	freeImageFiles(files, fileCount);
+
+	return added;
+}
+
+int listImageFiles(const char *path, char ***files)
+{
+	char **names = NULL;
+	int nameCount = 0;
+	int nameCapacity = 0;
+	int i;
+
+	// Collect the names first, directories aren't listed in any particular order and the packing should be the same every run.
+#ifdef _WIN32
+	char pattern[ATLAS_PATH_LENGTH];
+	WIN32_FIND_DATAA found;
+	HANDLE find;
+
+	snprintf(pattern, sizeof(pattern), "%s\\*", path);
+	find = FindFirstFileA(pattern, &found);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Failed to open directory %s\n", path);
+		return -1;
+	}
+	do
+	{
+		const char *name = found.cFileName;
+#else
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+
+	if (dir == NULL)
+	{
+		fprintf(stderr, "Failed to open directory %s\n", path);
+		return -1;
+	}
+	while ((entry = readdir(dir)) != NULL)
+	{
+		const char *name = entry->d_name;
+#endif
+		if (isImageFile(name))
+		{
+			if (nameCount == nameCapacity)
+			{
+				nameCapacity = nameCapacity == 0 ? 16 : nameCapacity * 2;
+				names = realloc(names, sizeof(char *) * nameCapacity);
+			}
+			names[nameCount++] = strdup(name);
+		}
+#ifdef _WIN32
+	} while (FindNextFileA(find, &found));
+	FindClose(find);
+#else
+	}
+	closedir(dir);
+#endif
+
+	qsort(names, nameCount, sizeof(char *), compareNames);
+	for (i = 0; i < nameCount; i++)
+	{
+		char *file = malloc(strlen(path) + strlen(names[i]) + 2);
+		sprintf(file, "%s/%s", path, names[i]);
+		free(names[i]);
+		names[i] = file;
+	}
+
+	*files = names;
+	return nameCount;
+}
+
+void freeImageFiles(char **files, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		free(files[i]);
+	}
+	free(files);
+}
+
+int placeAtlasSprite(struct s_atlas *atlas, const char *name, int page, int x, int y, int width, int height)
+{
+	struct s_sprite *sprite = newSprite(atlas, name);
+
+	if (sprite == NULL)
+	{
+		return -1;
+	}
+	sprite->page = page;
+	sprite->x = x;
+	sprite->y = y;
+	sprite->width = width;
+	sprite->height = height;
+	setSpriteCoords(atlas, sprite);
+
+	return atlas->spriteCount - 1;
+}
+
+int buildAtlas(struct s_atlas *atlas)
+{
+	struct s_sprite **order;
+	int ok = 1;
+	int i;
+
+	if (atlas->built)
+	{
+		return 1;
+	}
+
+	// Tallest first keeps the skyline flat, which wastes less space under it. The sprites keep their indices.
+	order = malloc(sizeof(struct s_sprite *) * atlas->spriteCount);
+	if (order == NULL)
+	{
+		return 0;
+	}
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		order[i] = &atlas->sprites[i];
+	}
+	qsort(order, atlas->spriteCount, sizeof(struct s_sprite *), compareHeights);
+
+	for (i = 0; i < atlas->spriteCount && ok; i++)
+	{
+		ok = packSprite(atlas, order[i]);
+	}
+	free(order);
+
+	for (i = 0; i < atlas->pageCount; i++)
+	{
+		free(atlas->skylines[i].nodes);
+		atlas->skylines[i].nodes = NULL;
+	}
+	atlas->built = ok;
+	return ok;
+}
+
+int findAtlasSprite(const struct s_atlas *atlas, const char *name)
+{
+	int i;
+
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		if (strcmp(atlas->sprites[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+GLuint uploadAtlas(struct s_atlas *atlas)
+{
+	int i;
+
+	if (atlas->spriteCount == 0)
+	{
+		fprintf(stderr, "Atlas has no sprites\n");
+		return 0;
+	}
+	if (!buildAtlas(atlas))
+	{
+		return 0;
+	}
+
+	glGenTextures(1, &atlas->texture);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, atlas->texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, atlas->pageSize, atlas->pageSize, atlas->pageCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	for (i = 0; i < atlas->pageCount; i++)
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, atlas->pageSize, atlas->pageSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, atlas->pages[i]);
+		free(atlas->pages[i]);
+		atlas->pages[i] = NULL;
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	return atlas->texture;
+}
+
+int saveAtlas(const struct s_atlas *atlas, const char *path)
+{
+	char base[ATLAS_PATH_LENGTH];
+	char page[ATLAS_PATH_LENGTH + 16];
+	const char *pageName = base;
+	const char *c;
+	size_t length = strlen(path);
+	FILE *file;
+	int i;
+
+	if (!atlas->built || atlas->pages[0] == NULL)
+	{
+		fprintf(stderr, "Only a built atlas that hasn't been uploaded yet can be saved\n");
+		return 0;
+	}
+
+	// Pages go next to the table as <table name>_<page>.png, the table refers to them by file name only.
+	snprintf(base, sizeof(base), "%.*s", (int)(length > 4 && strcmp(path + length - 4, ".txt") == 0 ? length - 4 : length), path);
+	for (c = base; *c != '\0'; c++)
+	{
+		if (*c == '/' || *c == '\\')
+		{
+			pageName = c + 1;
+		}
+	}
+
+	file = fopen(path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+		return 0;
+	}
+	fprintf(file, "atlas %d %d %d\n", atlas->pageSize, atlas->pageCount, atlas->spriteCount);
+	for (i = 0; i < atlas->pageCount; i++)
+	{
+		snprintf(page, sizeof(page), "%s_%d.png", base, i);
+		if (!writeImagePNGAlpha(page, atlas->pageSize, atlas->pageSize, atlas->pages[i]))
+		{
+			fclose(file);
+			return 0;
+		}
+		fprintf(file, "page %s_%d.png\n", pageName, i);
+	}
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		const struct s_sprite *sprite = &atlas->sprites[i];
+		fprintf(file, "sprite %s %d %d %d %d %d\n", sprite->name, sprite->page, sprite->x, sprite->y, sprite->width, sprite->height);
+	}
+	return fclose(file) == 0;
+}
+
+int loadAtlas(struct s_atlas *atlas, const char *path)
+{
+	char directory[ATLAS_PATH_LENGTH];
+	char name[ATLAS_NAME_LENGTH];
+	char page[ATLAS_PATH_LENGTH];
+	int pageSize;
+	int pageCount;
+	int spriteCount;
+	int directoryLength = 0;
+	int i;
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open atlas %s\n", path);
+		return 0;
+	}
+	if (fscanf(file, " atlas %d %d %d", &pageSize, &pageCount, &spriteCount) != 3 || pageCount < 1 || pageCount > ATLAS_MAX_PAGES)
+	{
+		fprintf(stderr, "%s is not an atlas\n", path);
+		fclose(file);
+		return 0;
+	}
+	initAtlas(atlas, pageSize);
+
+	// Page files are relative to the table.
+	for (i = 0; path[i] != '\0'; i++)
+	{
+		if (path[i] == '/' || path[i] == '\\')
+		{
+			directoryLength = i + 1;
+		}
+	}
+	snprintf(directory, sizeof(directory), "%.*s", directoryLength, path);
+
+	for (i = 0; i < pageCount; i++)
+	{
+		char pagePath[ATLAS_PATH_LENGTH * 2];
+		int width;
+		int height;
+
+		if (fscanf(file, " page %511s", page) != 1 || !addPage(atlas))
+		{
+			break;
+		}
+		snprintf(pagePath, sizeof(pagePath), "%s%s", directory, page);
+		unsigned char *image = SOIL_load_image(pagePath, &width, &height, 0, SOIL_LOAD_RGBA);
+		if (image == NULL || width != pageSize || height != pageSize)
+		{
+			fprintf(stderr, "Failed to load atlas page %s\n", pagePath);
+			SOIL_free_image_data(image);
+			break;
+		}
+		memcpy(atlas->pages[i], image, (size_t)pageSize * pageSize * 4);
+		SOIL_free_image_data(image);
+		free(atlas->skylines[i].nodes);
+		atlas->skylines[i].nodes = NULL;
+	}
+
+	while (i == pageCount && atlas->spriteCount < spriteCount)
+	{
+		int page;
+		int x;
+		int y;
+		int width;
+		int height;
+
+		if (fscanf(file, " sprite %63s %d %d %d %d %d", name, &page, &x, &y, &width, &height) != 6 || page < 0 || page >= pageCount
+			|| placeAtlasSprite(atlas, name, page, x, y, width, height) < 0)
+		{
+			break;
+		}
+	}
+	fclose(file);
+
+	if (atlas->spriteCount != spriteCount)
+	{
+		fprintf(stderr, "Failed to read atlas %s\n", path);
+		freeAtlas(atlas);
+		return 0;
+	}
+	atlas->built = 1;
+	return 1;
+}
+
+void freeAtlas(struct s_atlas *atlas)
+{
+	int i;
+
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		free(atlas->sprites[i].pixels);
+	}
+	for (i = 0; i < atlas->pageCount; i++)
+	{
+		free(atlas->pages[i]);
+		free(atlas->skylines[i].nodes);
+	}
+	free(atlas->sprites);
+	if (atlas->texture != 0)
+	{
+		stateDeleteTextures(1, &atlas->texture);
+	}
+	initAtlas(atlas, atlas->pageSize);
+}
+
+// Appends an empty sprite, growing the array when it is full.
+static struct s_sprite *newSprite(struct s_atlas *atlas, const char *name)
+{
+	struct s_sprite *sprite;
+	char *c;
+
+	if (atlas->spriteCount == atlas->spriteCapacity)
+	{
+		int capacity = atlas->spriteCapacity == 0 ? 16 : atlas->spriteCapacity * 2;
+		struct s_sprite *sprites = realloc(atlas->sprites, sizeof(struct s_sprite) * capacity);
+		if (sprites == NULL)
+		{
+			return NULL;
+		}
+		atlas->sprites = sprites;
+		atlas->spriteCapacity = capacity;
+	}
+
+	sprite = &atlas->sprites[atlas->spriteCount++];
+	memset(sprite, 0, sizeof(*sprite));
+	sprite->page = -1;
+
+	// The sprite table is split on spaces, so they can't be part of a name.
+	strncpy(sprite->name, name, ATLAS_NAME_LENGTH - 1);
+	for (c = sprite->name; *c != '\0'; c++)
+	{
+		*c = isspace((unsigned char)*c) ? '_' : *c;
+	}
+	return sprite;
+}
+
+// Puts the sprite in the first page with room, starting a new page when none has any.
+static int packSprite(struct s_atlas *atlas, struct s_sprite *sprite)
+{
+	int width = sprite->width + 2 * ATLAS_PADDING;
+	int height = sprite->height + 2 * ATLAS_PADDING;
+	int page;
+	int x;
+	int y;
+
+	for (page = 0; page <= atlas->pageCount; page++)
+	{
+		if (page == atlas->pageCount && !addPage(atlas))
+		{
+			fprintf(stderr, "Atlas is out of pages at %s\n", sprite->name);
+			return 0;
+		}
+
+		int index = findSkylinePosition(&atlas->skylines[page], atlas->pageSize, width, height, &x, &y);
+		if (index >= 0)
+		{
+			addSkylineLevel(&atlas->skylines[page], index, x, y, width, height);
+			sprite->page = page;
+			sprite->x = x + ATLAS_PADDING;
+			sprite->y = y + ATLAS_PADDING;
+			copySprite(atlas, sprite);
+			setSpriteCoords(atlas, sprite);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Bottom left rule, the spot where the rect's top ends up lowest, narrower skyline levels breaking ties.
+// Returns the skyline node the rect starts at, or -1 when it doesn't fit in this page.
+static int findSkylinePosition(const struct s_skyline *skyline, int pageSize, int width, int height, int *x, int *y)
+{
+	int bestIndex = -1;
+	int bestTop = pageSize + 1;
+	int bestWidth = pageSize + 1;
+	int i;
+
+	for (i = 0; i < skyline->nodeCount; i++)
+	{
+		int top = fitSkyline(skyline, pageSize, i, width, height);
+		if (top < 0)
+		{
+			continue;
+		}
+		top += height;
+		if (top < bestTop || (top == bestTop && skyline->nodes[i].width < bestWidth))
+		{
+			bestIndex = i;
+			bestTop = top;
+			bestWidth = skyline->nodes[i].width;
+			*x = skyline->nodes[i].x;
+			*y = top - height;
+		}
+	}
+	return bestIndex;
+}
+
+// Height the rect has to sit at when its left edge is on node index, or -1 if it runs off the page.
+static int fitSkyline(const struct s_skyline *skyline, int pageSize, int index, int width, int height)
+{
+	int y = 0;
+	int widthLeft = width;
+
+	if (skyline->nodes[index].x + width > pageSize)
+	{
+		return -1;
+	}
+	while (widthLeft > 0)
+	{
+		const struct s_skylineNode *node = &skyline->nodes[index];
+		y = node->y > y ? node->y : y;
+		if (y + height > pageSize)
+		{
+			return -1;
+		}
+		widthLeft -= node->width;
+		index++;
+	}
+	return y;
+}
+
+// Raises the skyline under the new rect, trims the levels it covers and merges levels of the same height.
+static void addSkylineLevel(struct s_skyline *skyline, int index, int x, int y, int width, int height)
+{
+	struct s_skylineNode *nodes = skyline->nodes;
+	int i;
+
+	memmove(&nodes[index + 1], &nodes[index], sizeof(struct s_skylineNode) * (skyline->nodeCount - index));
+	nodes[index].x = x;
+	nodes[index].y = y + height;
+	nodes[index].width = width;
+	skyline->nodeCount++;
+
+	for (i = index + 1; i < skyline->nodeCount; )
+	{
+		int right = nodes[i - 1].x + nodes[i - 1].width;
+		if (nodes[i].x >= right)
+		{
+			break;
+		}
+		int shrink = right - nodes[i].x;
+		nodes[i].x += shrink;
+		nodes[i].width -= shrink;
+		if (nodes[i].width > 0)
+		{
+			break;
+		}
+		memmove(&nodes[i], &nodes[i + 1], sizeof(struct s_skylineNode) * (skyline->nodeCount - i - 1));
+		skyline->nodeCount--;
+	}
+
+	for (i = 0; i + 1 < skyline->nodeCount; )
+	{
+		if (nodes[i].y == nodes[i + 1].y)
+		{
+			nodes[i].width += nodes[i + 1].width;
+			memmove(&nodes[i + 1], &nodes[i + 2], sizeof(struct s_skylineNode) * (skyline->nodeCount - i - 2));
+			skyline->nodeCount--;
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+static int addPage(struct s_atlas *atlas)
+{
+	int page = atlas->pageCount;
+
+	if (page == ATLAS_MAX_PAGES)
+	{
+		return 0;
+	}
+	// Every rect adds at most one level, so the skyline never needs more nodes than the page is wide.
+	atlas->pages[page] = calloc((size_t)atlas->pageSize * atlas->pageSize, 4);
+	atlas->skylines[page].nodes = malloc(sizeof(struct s_skylineNode) * (atlas->pageSize + 1));
+	if (atlas->pages[page] == NULL || atlas->skylines[page].nodes == NULL)
+	{
+		free(atlas->pages[page]);
+		free(atlas->skylines[page].nodes);
+		atlas->pages[page] = NULL;
+		atlas->skylines[page].nodes = NULL;
+		return 0;
+	}
+	atlas->skylines[page].nodes[0].x = 0;
+	atlas->skylines[page].nodes[0].y = 0;
+	atlas->skylines[page].nodes[0].width = atlas->pageSize;
+	atlas->skylines[page].nodeCount = 1;
+	atlas->pageCount++;
+	return 1;
+}
+
+// Copies the sprite into its page and repeats its outer pixels out into the padding.
+static void copySprite(struct s_atlas *atlas, struct s_sprite *sprite)
+{
+	unsigned char *page = atlas->pages[sprite->page];
+	size_t stride = (size_t)atlas->pageSize * 4;
+	int x;
+	int y;
+
+	for (y = -ATLAS_PADDING; y < sprite->height + ATLAS_PADDING; y++)
+	{
+		int sourceY = y < 0 ? 0 : (y >= sprite->height ? sprite->height - 1 : y);
+		const unsigned char *source = sprite->pixels + (size_t)sourceY * sprite->width * 4;
+		unsigned char *row = page + (sprite->y + y) * stride + (size_t)(sprite->x - ATLAS_PADDING) * 4;
+
+		for (x = 0; x < ATLAS_PADDING; x++)
+		{
+			memcpy(row + x * 4, source, 4);
+			memcpy(row + (ATLAS_PADDING + sprite->width + x) * 4, source + (sprite->width - 1) * 4, 4);
+		}
+		memcpy(row + ATLAS_PADDING * 4, source, (size_t)sprite->width * 4);
+	}
+
+	free(sprite->pixels);
+	sprite->pixels = NULL;
+}
+
+static void setSpriteCoords(struct s_atlas *atlas, struct s_sprite *sprite)
+{
+	sprite->u = (GLfloat)sprite->x / atlas->pageSize;
+	sprite->v = (GLfloat)sprite->y / atlas->pageSize;
+	sprite->w = (GLfloat)sprite->width / atlas->pageSize;
+	sprite->h = (GLfloat)sprite->height / atlas->pageSize;
+}
+
+static int isImageFile(const char *name)
+{
+	static const char *extensions[] = { ".png", ".bmp", ".tga", ".jpg" };
+	size_t length = strlen(name);
+	size_t i;
+	int c;
+
+	if (length < 5)
+	{
+		return 0;
+	}
+	for (i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+	{
+		for (c = 0; c < 4 && tolower((unsigned char)name[length - 4 + c]) == extensions[i][c]; c++)
+		{
+		}
+		if (c == 4)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int compareHeights(const void *a, const void *b)
+{
+	const struct s_sprite *x = *(const struct s_sprite *const *)a;
+	const struct s_sprite *y = *(const struct s_sprite *const *)b;
+
+	// Ties keep the order the sprites were added in, qsort isn't stable on its own.
+	if (x->height != y->height)
+	{
+		return y->height - x->height;
+	}
+	return (x > y) - (x < y);
+}
@@ -0,0 +1,74 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#define ATLAS_PAGE_SIZE		1024	// width and height of a page, a sprite bigger than this can't be packed
+#define ATLAS_MAX_PAGES		16
+#define ATLAS_PADDING		2	// sprite edges are repeated this far out so filtering and mipmaps don't pick up the neighbours
+#define ATLAS_NAME_LENGTH	64
+
+// One image in the atlas, the page is the layer of the texture array it ended up in.
+struct s_sprite {
+	char name[ATLAS_NAME_LENGTH];
+	int page;
+	int x, y, width, height;	// pixels in the page, without the padding
+	GLfloat u, v, w, h;	// the same rect in 0-1 texture coordinates, ready for an instance rect
+	unsigned char *pixels;	// rgba source, only until buildAtlas copies it into its page
+};
+
+// Top edge of the packed area of a page, as runs of equal height from left to right.
+struct s_skylineNode {
+	int x, y, width;
+};
+
+struct s_skyline {
+	struct s_skylineNode *nodes;
+	int nodeCount;
+};
+
+// Packs many images into a few big pages so a scene of different sprites can be drawn with one texture bound.
+// Images are added first and packed together by buildAtlas, tallest first, with a bottom left skyline packer.
+// The pages go to the gpu as a GL_TEXTURE_2D_ARRAY, a sprite's rect and page are all an instance needs to draw it.
+// saveAtlas and loadAtlas let the packing be done once offline and only loaded at runtime.
+struct s_atlas {
+	struct s_sprite *sprites;
+	int spriteCount;
+	int spriteCapacity;
+	int pageSize;
+	int pageCount;
+	unsigned char *pages[ATLAS_MAX_PAGES];	// rgba, top row first
+	struct s_skyline skylines[ATLAS_MAX_PAGES];
+	int built;
+	GLuint texture;
+};
+
+//sets up an empty atlas with pages of pageSize x pageSize
+void initAtlas(struct s_atlas *atlas, int pageSize);
+//copies an rgba image into the atlas. Returns the sprite index or -1 on failure.
+int addAtlasImage(struct s_atlas *atlas, const char *name, const unsigned char *rgba, int width, int height);
+//loads an image through SOIL and adds it, named after the file. Returns the sprite index or -1 on failure.
+int addAtlasFile(struct s_atlas *atlas, const char *path);
+//adds every png, bmp, tga and jpg in the directory in name order. Returns how many were added or -1 on failure.
+int addAtlasDirectory(struct s_atlas *atlas, const char *path);
+//lists the png, bmp, tga and jpg files in a directory, sorted by name, as paths to free with freeImageFiles. Returns the count or -1.
+int listImageFiles(const char *path, char ***files);
+//frees a list from listImageFiles
+void freeImageFiles(char **files, int count);
+//adds a sprite that is already packed at x, y on page, for atlases packed earlier. Returns the sprite index or -1 on failure.
+int placeAtlasSprite(struct s_atlas *atlas, const char *name, int page, int x, int y, int width, int height);
+//packs every sprite added so far into pages. Returns 0 if one doesn't fit.
+int buildAtlas(struct s_atlas *atlas);
+//returns the index of the sprite called name, or -1
+int findAtlasSprite(const struct s_atlas *atlas, const char *name);
+//creates the texture array, a layer per page, and frees the cpu copy of the pages. Returns the texture.
+GLuint uploadAtlas(struct s_atlas *atlas);
+//writes the pages as pngs next to path and the sprite table to path. Returns 0 on failure.
+int saveAtlas(const struct s_atlas *atlas, const char *path);
+//reads an atlas written by saveAtlas, ready to upload. Returns 0 on failure.
+int loadAtlas(struct s_atlas *atlas, const char *path);
+//frees the pages, sprites and texture
+void freeAtlas(struct s_atlas *atlas);
+
+#endif
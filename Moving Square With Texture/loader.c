@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Include SOIL
+#include <SOIL.h>
+
+#include "loader.h"
+#include "timer.h"
+#include "glstate.h"
+
+static int initLoader(struct s_textureLoader *loader, struct s_atlas *atlas, int jobCount);
+static void decodeWorker(void *data);
+static int packSprites(struct s_textureLoader *loader);
+static int startStreaming(struct s_textureLoader *loader);
+static void uploadSprites(struct s_textureLoader *loader, int wait);
+static void finishStreaming(struct s_textureLoader *loader);
+static void setTableEntries(struct s_textureLoader *loader, int first, int count);
+
+int startTextureLoader(struct s_textureLoader *loader, struct s_atlas *atlas, char **files, int fileCount, int threadCount, const char *savePath)
+{
+	int i;
+
+	if (fileCount < 1 || !initLoader(loader, atlas, fileCount))
+	{
+		return 0;
+	}
+	loader->savePath = savePath;
+	for (i = 0; i < fileCount; i++)
+	{
+		loader->jobs[i].path = files[i];
+	}
+
+	if (threadCount > LOADER_MAX_THREADS)
+	{
+		threadCount = LOADER_MAX_THREADS;
+	}
+	if (threadCount > fileCount)
+	{
+		threadCount = fileCount;
+	}
+	for (loader->threadCount = 0; loader->threadCount < threadCount; loader->threadCount++)
+	{
+		if (!startThread(&loader->threads[loader->threadCount], decodeWorker, loader))
+		{
+			break;
+		}
+	}
+
+	// Without threads it all happens before the first frame, the way textures were loaded before there was a loader.
+	if (loader->threadCount == 0)
+	{
+		decodeWorker(loader);
+		updateTextureLoader(loader);
+		while (loader->state == LOADER_STREAMING)
+		{
+			uploadSprites(loader, 1);
+		}
+	}
+	return 1;
+}
+
+int startAtlasStream(struct s_textureLoader *loader, struct s_atlas *atlas)
+{
+	int i;
+
+	if (!initLoader(loader, atlas, atlas->spriteCount))
+	{
+		return 0;
+	}
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		loader->jobs[i].sprite = i;
+	}
+	loader->jobsDone = loader->jobCount;
+	loader->decodedTime = loader->startTime;
+	return startStreaming(loader);
+}
+
+int startCachedAtlas(struct s_textureLoader *loader, struct s_atlas *atlas, GLuint texture)
+{
+	int i;
+
+	if (!initLoader(loader, atlas, atlas->spriteCount))
+	{
+		return 0;
+	}
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		loader->jobs[i].sprite = i;
+	}
+	loader->jobsDone = loader->jobCount;
+	loader->nextUpload = loader->jobCount;
+	loader->texture = texture;
+	atlas->texture = texture;
+	setTableEntries(loader, 0, loader->jobCount);
+	loader->state = LOADER_DONE;
+	loader->decodedTime = timerNow();
+	loader->residentTime = loader->decodedTime;
+	return 1;
+}
+
+void updateTextureLoader(struct s_textureLoader *loader)
+{
+	int jobsDone;
+	int i;
+
+	if (loader->state == LOADER_DECODING)
+	{
+		lockMutex(&loader->mutex);
+		jobsDone = loader->jobsDone;
+		unlockMutex(&loader->mutex);
+		if (jobsDone < loader->jobCount)
+		{
+			return;
+		}
+
+		for (i = 0; i < loader->threadCount; i++)
+		{
+			joinThread(&loader->threads[i]);
+		}
+		loader->threadCount = 0;
+		loader->decodedTime = timerNow();
+		if (!packSprites(loader) || !startStreaming(loader))
+		{
+			// Everything stays on the placeholder.
+			loader->state = LOADER_DONE;
+			loader->residentTime = timerNow();
+			return;
+		}
+	}
+
+	if (loader->state == LOADER_STREAMING)
+	{
+		uploadSprites(loader, 0);
+	}
+}
+
+void bindLoaderTextures(struct s_textureLoader *loader)
+{
+	stateActiveTexture(GL_TEXTURE0);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, loader->texture);
+	stateActiveTexture(GL_TEXTURE1);
+	stateBindTexture(GL_TEXTURE_2D, loader->placeholder);
+	stateActiveTexture(GL_TEXTURE2);
+	stateBindTexture(GL_TEXTURE_BUFFER, loader->tableTexture);
+	stateActiveTexture(GL_TEXTURE0);
+}
+
+GLuint createPlaceholderTexture(GLubyte r, GLubyte g, GLubyte b)
+{
+	unsigned char checker[LOADER_PLACEHOLDER_SIZE * LOADER_PLACEHOLDER_SIZE * 4];
+	GLuint texture;
+	int i;
+
+	// The light squares are the color and the dark ones half of it.
+	for (i = 0; i < LOADER_PLACEHOLDER_SIZE * LOADER_PLACEHOLDER_SIZE; i++)
+	{
+		int light = ((i % LOADER_PLACEHOLDER_SIZE) / 2 + (i / LOADER_PLACEHOLDER_SIZE) / 2) % 2;
+		checker[i * 4 + 0] = light ? r : (unsigned char)(r * 128 / 255);
+		checker[i * 4 + 1] = light ? g : (unsigned char)(g * 128 / 255);
+		checker[i * 4 + 2] = light ? b : (unsigned char)(b * 128 / 255);
+		checker[i * 4 + 3] = 255;
+	}
+	glGenTextures(1, &texture);
+	stateBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, LOADER_PLACEHOLDER_SIZE, LOADER_PLACEHOLDER_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	stateBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+void freeTextureLoader(struct s_textureLoader *loader)
+{
+	int i;
+
+	for (i = 0; i < loader->threadCount; i++)
+	{
+		joinThread(&loader->threads[i]);
+	}
+	for (i = 0; i < loader->jobCount; i++)
+	{
+		SOIL_free_image_data(loader->jobs[i].pixels);
+	}
+	for (i = 0; i < LOADER_PBOS; i++)
+	{
+		if (loader->fences[i] != NULL)
+		{
+			glDeleteSync(loader->fences[i]);
+		}
+	}
+	stateDeleteBuffers(LOADER_PBOS, loader->pbos);
+	// Handed to the atlas once streaming finishes, before that it is still the loader's.
+	if (loader->texture != 0 && loader->texture != loader->atlas->texture)
+	{
+		stateDeleteTextures(1, &loader->texture);
+	}
+	stateDeleteTextures(1, &loader->tableTexture);
+	stateDeleteBuffers(1, &loader->tableBuffer);
+	stateDeleteTextures(1, &loader->placeholder);
+	freeMutex(&loader->mutex);
+	free(loader->jobs);
+	memset(loader, 0, sizeof(*loader));
+}
+
+// Sets up the placeholder and a sprite table with every sprite on it.
+static int initLoader(struct s_textureLoader *loader, struct s_atlas *atlas, int jobCount)
+{
+	int i;
+
+	memset(loader, 0, sizeof(*loader));
+	loader->startTime = timerNow();
+	loader->atlas = atlas;
+	loader->jobCount = jobCount;
+	loader->jobs = calloc(jobCount, sizeof(struct s_loadJob));
+	if (loader->jobs == NULL)
+	{
+		return 0;
+	}
+	for (i = 0; i < jobCount; i++)
+	{
+		loader->jobs[i].sprite = -1;
+	}
+	initMutex(&loader->mutex);
+
+	// Grey and white checker, obviously not a real sprite.
+	loader->placeholder = createPlaceholderTexture(255, 255, 255);
+
+	glGenBuffers(1, &loader->tableBuffer);
+	stateBindBuffer(GL_TEXTURE_BUFFER, loader->tableBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * 8 * jobCount, NULL, GL_DYNAMIC_DRAW);
+	glGenTextures(1, &loader->tableTexture);
+	stateBindTexture(GL_TEXTURE_BUFFER, loader->tableTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, loader->tableBuffer);
+	stateBindTexture(GL_TEXTURE_BUFFER, 0);
+	setTableEntries(loader, 0, jobCount);
+
+	return 1;
+}
+
+// Workers take the next file until there are none left. SOIL keeps its last error message in a global,
+// which the threads can overwrite for each other, everything else it does is per image.
+static void decodeWorker(void *data)
+{
+	struct s_textureLoader *loader = data;
+	struct s_loadJob *job;
+
+	for (;;)
+	{
+		lockMutex(&loader->mutex);
+		job = loader->nextJob < loader->jobCount ? &loader->jobs[loader->nextJob++] : NULL;
+		unlockMutex(&loader->mutex);
+		if (job == NULL)
+		{
+			return;
+		}
+
+		job->pixels = SOIL_load_image(job->path, &job->width, &job->height, 0, SOIL_LOAD_RGBA);
+		if (job->pixels == NULL)
+		{
+			fprintf(stderr, "Failed to load %s\n", job->path);
+		}
+
+		lockMutex(&loader->mutex);
+		loader->jobsDone++;
+		unlockMutex(&loader->mutex);
+	}
+}
+
+// Adds the decoded images to the atlas in file order and packs them.
+static int packSprites(struct s_textureLoader *loader)
+{
+	int i;
+
+	for (i = 0; i < loader->jobCount; i++)
+	{
+		struct s_loadJob *job = &loader->jobs[i];
+		const char *name = job->path;
+		const char *c;
+
+		if (job->pixels == NULL)
+		{
+			continue;
+		}
+		for (c = job->path; *c != '\0'; c++)
+		{
+			if (*c == '/' || *c == '\\')
+			{
+				name = c + 1;
+			}
+		}
+		job->sprite = addAtlasImage(loader->atlas, name, job->pixels, job->width, job->height);
+		SOIL_free_image_data(job->pixels);
+		job->pixels = NULL;
+	}
+
+	if (loader->atlas->spriteCount == 0 || !buildAtlas(loader->atlas))
+	{
+		return 0;
+	}
+	if (loader->savePath != NULL)
+	{
+		saveAtlas(loader->atlas, loader->savePath);
+	}
+	return 1;
+}
+
+// Creates the texture array and the pixel buffers the sprites are streamed through.
+static int startStreaming(struct s_textureLoader *loader)
+{
+	struct s_atlas *atlas = loader->atlas;
+	GLint framebuffer;
+	GLuint clearFbo;
+	int i;
+
+	glGenTextures(1, &loader->texture);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, loader->texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, atlas->pageSize, atlas->pageSize, atlas->pageCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	// Only the base level exists until everything is uploaded and the mipmaps are generated.
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Only the sprites are uploaded, so clear the gaps between them on the gpu for the mipmaps to average in.
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	glGenFramebuffers(1, &clearFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, clearFbo);
+	stateClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	for (i = 0; i < atlas->pageCount; i++)
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, loader->texture, 0, i);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glDeleteFramebuffers(1, &clearFbo);
+
+	// Big enough for the frame's budget, or for the biggest sprite in one go.
+	loader->pboSize = LOADER_UPLOAD_BYTES;
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		GLsizeiptr bytes = (GLsizeiptr)(atlas->sprites[i].width + 2 * ATLAS_PADDING) * (atlas->sprites[i].height + 2 * ATLAS_PADDING) * 4;
+		loader->pboSize = bytes > loader->pboSize ? bytes : loader->pboSize;
+	}
+	glGenBuffers(LOADER_PBOS, loader->pbos);
+	for (i = 0; i < LOADER_PBOS; i++)
+	{
+		stateBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader->pbos[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, loader->pboSize, NULL, GL_STREAM_DRAW);
+	}
+	stateBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	loader->state = LOADER_STREAMING;
+	return 1;
+}
+
+// Fills the next pbo with as many whole sprites, padding included, as fit and copies them into the texture from it.
+// A sprite can be drawn as soon as its copy is issued, gl runs the copy before any draw issued after it.
+static void uploadSprites(struct s_textureLoader *loader, int wait)
+{
+	struct s_atlas *atlas = loader->atlas;
+	GLsync *fence = &loader->fences[loader->pbo];
+	int first = loader->nextUpload;
+	GLintptr used = 0;
+	unsigned char *mapped;
+	int last;
+	int i;
+	int y;
+
+	if (*fence != NULL)
+	{
+		// Never wait on the gpu in the frame loop, the pbo is tried again next frame.
+		GLenum status = glClientWaitSync(*fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			return;
+		}
+		glDeleteSync(*fence);
+		*fence = NULL;
+	}
+
+	stateBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader->pbos[loader->pbo]);
+	mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, loader->pboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped == NULL)
+	{
+		stateBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return;
+	}
+
+	for (last = first; last < loader->jobCount; last++)
+	{
+		if (loader->jobs[last].sprite < 0)
+		{
+			continue;
+		}
+
+		struct s_sprite *sprite = &atlas->sprites[loader->jobs[last].sprite];
+		const unsigned char *page = atlas->pages[sprite->page];
+		int width = sprite->width + 2 * ATLAS_PADDING;
+		int height = sprite->height + 2 * ATLAS_PADDING;
+		if (used + (GLintptr)width * height * 4 > loader->pboSize)
+		{
+			break;
+		}
+		for (y = 0; y < height; y++)
+		{
+			size_t row = (size_t)(sprite->y - ATLAS_PADDING + y) * atlas->pageSize + sprite->x - ATLAS_PADDING;
+			memcpy(mapped + used, page + row * 4, (size_t)width * 4);
+			used += width * 4;
+		}
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// Same walk again, the sprites sit back to back in the pbo.
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, loader->texture);
+	used = 0;
+	for (i = first; i < last; i++)
+	{
+		if (loader->jobs[i].sprite < 0)
+		{
+			continue;
+		}
+
+		struct s_sprite *sprite = &atlas->sprites[loader->jobs[i].sprite];
+		int width = sprite->width + 2 * ATLAS_PADDING;
+		int height = sprite->height + 2 * ATLAS_PADDING;
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, sprite->x - ATLAS_PADDING, sprite->y - ATLAS_PADDING, sprite->page,
+			width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)used);
+		used += (GLintptr)width * height * 4;
+	}
+	// The array stays bound, it is what the next draw binds anyway. The pbo doesn't, uploads from memory would read from it.
+	stateBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	*fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	loader->pbo = (loader->pbo + 1) % LOADER_PBOS;
+	loader->bytesUploaded += used;
+	loader->nextUpload = last;
+	setTableEntries(loader, first, last - first);
+
+	if (loader->nextUpload == loader->jobCount)
+	{
+		finishStreaming(loader);
+	}
+}
+
+// Everything is on the gpu, so the mipmaps can be built and the cpu copy let go.
+static void finishStreaming(struct s_textureLoader *loader)
+{
+	struct s_atlas *atlas = loader->atlas;
+	int i;
+
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, loader->texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 1000);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	for (i = 0; i < atlas->pageCount; i++)
+	{
+		free(atlas->pages[i]);
+		atlas->pages[i] = NULL;
+	}
+	// The atlas owns the texture from here, freeAtlas deletes it.
+	atlas->texture = loader->texture;
+	loader->state = LOADER_DONE;
+	loader->residentTime = timerNow();
+}
+
+// Points count sprites starting at first at their atlas rect once uploaded, or at the placeholder before that.
+static void setTableEntries(struct s_textureLoader *loader, int first, int count)
+{
+	GLfloat *entries;
+	int i;
+
+	if (count <= 0)
+	{
+		return;
+	}
+	entries = malloc(sizeof(GLfloat) * 8 * count);
+	if (entries == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < count; i++)
+	{
+		struct s_loadJob *job = &loader->jobs[first + i];
+		GLfloat *entry = entries + i * 8;
+
+		if (first + i < loader->nextUpload && job->sprite >= 0)
+		{
+			struct s_sprite *sprite = &loader->atlas->sprites[job->sprite];
+			entry[0] = sprite->u;
+			entry[1] = sprite->v;
+			entry[2] = sprite->w;
+			entry[3] = sprite->h;
+			entry[4] = (GLfloat)sprite->page;
+		}
+		else
+		{
+			entry[0] = 0.0f;
+			entry[1] = 0.0f;
+			entry[2] = 1.0f;
+			entry[3] = 1.0f;
+			entry[4] = -1.0f;
+		}
+		entry[5] = 0.0f;
+		entry[6] = 0.0f;
+		entry[7] = 0.0f;
+	}
+
+	stateBindBuffer(GL_TEXTURE_BUFFER, loader->tableBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * 8 * first, sizeof(GLfloat) * 8 * count, entries);
+	free(entries);
+}
@@ -0,0 +1,81 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "atlas.h"
+#include "thread.h"
+
+#define LOADER_MAX_THREADS	8
+#define LOADER_PBOS			3	// uploads in flight, a pbo is only refilled once the gpu is done reading it
+#define LOADER_UPLOAD_BYTES	(4 * 1024 * 1024)	// pixels streamed per frame, a bigger sprite still goes up in one piece
+#define LOADER_PLACEHOLDER_SIZE	8
+
+enum loaderStates { LOADER_DECODING, LOADER_STREAMING, LOADER_DONE };
+
+// One image file, decoded on a worker thread.
+struct s_loadJob {
+	const char *path;
+	unsigned char *pixels;	// rgba from SOIL, NULL if it failed to load
+	int width;
+	int height;
+	int sprite;	// index in the atlas once it is packed, -1 if it failed
+};
+
+// Loads sprites into the atlas in the background while the example already renders.
+// Worker threads decode the files, then the main thread packs them and streams the pixels to the texture array
+// through a ring of pixel buffer objects, a few megabytes a frame, so no single frame stalls on it.
+// Instances refer to sprites through a table in a texture buffer, which points every sprite at a placeholder
+// checker until its pixels are on the gpu, so nothing needs to wait for the loading to finish.
+struct s_textureLoader {
+	enum loaderStates state;
+	struct s_atlas *atlas;
+	const char *savePath;	// the packed atlas is saved here when set, before the pages are freed
+
+	// decoding
+	struct s_loadJob *jobs;
+	int jobCount;
+	int nextJob;	// next job a worker picks up, guarded by mutex
+	int jobsDone;	// guarded by mutex
+	struct s_mutex mutex;
+	struct s_thread threads[LOADER_MAX_THREADS];
+	int threadCount;
+
+	// streaming
+	GLuint pbos[LOADER_PBOS];
+	GLsync fences[LOADER_PBOS];
+	int pbo;
+	GLsizeiptr pboSize;
+	int nextUpload;	// next job to upload, jobs go up in order
+
+	// drawing
+	GLuint texture;	// the atlas texture array, 0 until the sprites are packed
+	GLuint placeholder;
+	GLuint tableBuffer;	// two vec4 per sprite, the rect then the layer or -1 for the placeholder
+	GLuint tableTexture;
+
+	// stats
+	double startTime;
+	double decodedTime;
+	double residentTime;
+	unsigned long bytesUploaded;
+};
+
+//starts decoding the files into the atlas on threadCount threads, saving it to savePath once packed when that isn't NULL.
+//0 threads loads everything right away on this thread. Returns 0 on failure.
+int startTextureLoader(struct s_textureLoader *loader, struct s_atlas *atlas, char **files, int fileCount, int threadCount, const char *savePath);
+//streams an atlas that is already packed, like one from loadAtlas. Returns 0 on failure.
+int startAtlasStream(struct s_textureLoader *loader, struct s_atlas *atlas);
+//uses an atlas texture that is already complete, like one from the texture cache, every sprite is resident right away. Returns 0 on failure.
+int startCachedAtlas(struct s_textureLoader *loader, struct s_atlas *atlas, GLuint texture);
+//call once a frame, packs the sprites once they are all decoded and streams the next part of the pixels
+void updateTextureLoader(struct s_textureLoader *loader);
+//binds the atlas (or nothing yet) to texture unit 0, the placeholder to 1 and the sprite table to 2
+void bindLoaderTextures(struct s_textureLoader *loader);
+//makes an 8x8 checker of the color and half the color, like the placeholder the loader draws before a sprite is in
+GLuint createPlaceholderTexture(GLubyte r, GLubyte g, GLubyte b);
+//frees everything the loader made, the atlas itself is left to freeAtlas
+void freeTextureLoader(struct s_textureLoader *loader);
+
+#endif
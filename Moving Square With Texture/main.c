@@ -1,16 +1,26 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 // Include GLEW
 #include <GL/glew.h>
 
 // Include GLFW
 #include <glfw3.h>
-// Include SOIL
-#include <SOIL.h>
-
-#define GLSL(src) "#version 330 core\n" #src // writing glsl shaders directly into character arrays in-file for examples.
+#include "atlas.h"
+#include "loader.h"
+#include "texcache.h"
+#include "shader.h"
+#include "thread.h"
+#include "headless.h"
+#include "timer.h"
+#include "profiler.h"
+#include "overlay.h"
+#include "vertexformat.h"
+#include "renderqueue.h"
+#include "glstate.h"
 
 #define SCREEN_HEIGHT	480
 #define SCREEN_WIDTH	640
@@ -18,6 +28,11 @@
 
 #define SQUARE_SIZE		50
 
+#define MAX_INSTANCES	1000000
+#define REPORT_FRAMES	120 // frames between frame time reports
+#define MAX_MATERIALS	256
+#define MATERIAL_RUNS	4 // runs of instances per material, so the materials take turns across the screen
+
 struct s_polyF4 {
 	unsigned long *tag;
 	unsigned char r0, g0, b0;
@@ -28,6 +43,75 @@ struct s_polyF4 {
 	GLfloat x3, y3;
 };
 
+// Build with -DSPRITE_VERTEX_FORMAT=VERTEX_FORMAT_FLOAT for the float vertices and instances, to compare the two.
+#ifndef SPRITE_VERTEX_FORMAT
+#define SPRITE_VERTEX_FORMAT	VERTEX_FORMAT_COMPACT
+#endif
+
+#if SPRITE_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+// One corner of the quad, 8 bytes. The quad lies flat so it needs no z, and the shaders never read a vertex color.
+struct s_spriteVertex {
+	GLshort x, y;	// normalized, -1 to 1
+	GLhalf u, v;
+};
+
+// Per-instance attributes for the instanced quad, advanced once per instance with glVertexAttribDivisor. 16 bytes.
+struct s_instance {
+	GLshort offsetX, offsetY;	// where the center of the quad goes, normalized so it covers the screen
+	GLhalf scaleX, scaleY;	// size of the quad
+	GLubyte r, g, b, a;	// tint multiplied with the texture
+	GLushort sprite;	// entry in the loader's sprite table, which holds the rect and page to sample
+	GLushort padding;	// keeps the next instance 4 byte aligned
+};
+
+#define INSTANCE_MAX_SPRITES	65536
+
+static const struct s_vertexLayout g_spriteVertexLayout = { "sprite compact", sizeof(struct s_spriteVertex), 0, 2, {
+	{ "position", 2, GL_SHORT, GL_TRUE, GL_FALSE, offsetof(struct s_spriteVertex, x) },
+	{ "texCoord", 2, GL_HALF_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_spriteVertex, u) } } };
+
+static const struct s_vertexLayout g_instanceLayout = { "instance compact", sizeof(struct s_instance), 1, 4, {
+	{ "instanceOffset", 2, GL_SHORT, GL_TRUE, GL_FALSE, offsetof(struct s_instance, offsetX) },
+	{ "instanceScale", 2, GL_HALF_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_instance, scaleX) },
+	{ "instanceTint", 4, GL_UNSIGNED_BYTE, GL_TRUE, GL_FALSE, offsetof(struct s_instance, r) },
+	{ "instanceSprite", 1, GL_UNSIGNED_SHORT, GL_FALSE, GL_TRUE, offsetof(struct s_instance, sprite) } } };
+#else
+// One corner of the quad, 32 bytes.
+struct s_spriteVertex {
+	GLfloat x, y, z;
+	GLfloat r, g, b;
+	GLfloat u, v;
+};
+
+// Per-instance attributes for the instanced quad, advanced once per instance with glVertexAttribDivisor. 24 bytes.
+struct s_instance {
+	GLfloat offsetX, offsetY;	// where the center of the quad goes
+	GLfloat scaleX, scaleY;	// size of the quad
+	GLubyte r, g, b, a;	// tint multiplied with the texture
+	GLuint sprite;	// entry in the loader's sprite table, which holds the rect and page to sample
+};
+
+#define INSTANCE_MAX_SPRITES	0x7fffffff
+
+static const struct s_vertexLayout g_spriteVertexLayout = { "sprite float", sizeof(struct s_spriteVertex), 0, 3, {
+	{ "position", 3, GL_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_spriteVertex, x) },
+	{ "color", 3, GL_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_spriteVertex, r) },
+	{ "texCoord", 2, GL_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_spriteVertex, u) } } };
+
+static const struct s_vertexLayout g_instanceLayout = { "instance float", sizeof(struct s_instance), 1, 4, {
+	{ "instanceOffset", 2, GL_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_instance, offsetX) },
+	{ "instanceScale", 2, GL_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_instance, scaleX) },
+	{ "instanceTint", 4, GL_UNSIGNED_BYTE, GL_TRUE, GL_FALSE, offsetof(struct s_instance, r) },
+	{ "instanceSprite", 1, GL_UNSIGNED_INT, GL_FALSE, GL_TRUE, offsetof(struct s_instance, sprite) } } };
+#endif
+
+// Instances drawn together with one material, a command in the render queue.
+struct s_instanceRun {
+	int first;	// in the instance buffer
+	int count;
+	int material;
+};
+
 //to help translate input into a common type
 enum inputTypes { UP, DOWN, LEFT, RIGHT, UPLEFT, UPRIGHT, DOWNLEFT, DOWNRIGHT, CHANGE_COLOR, NONE };
 enum inputTypes g_decodedInput = NONE;
@@ -45,20 +129,169 @@ struct s_polyF4 genPrimitive();
 void movePrimitive(struct s_polyF4 *f4, enum inputTypes decodedInput);
 //converts psx coords to opengl array
 void convertPrimQuadVertices(struct s_polyF4 *f4, GLfloat *vertexArray);
+//packs the corners of the quad, given as x, y, z, r, g, b, u, v floats, into the vertex format
+void packSpriteQuad(const GLfloat *corners, struct s_spriteVertex *vertices);
+//lay count instances out in a grid covering the screen, cycling through spriteCount sprites
+void genInstanceGrid(struct s_instance *instances, int count, int spriteCount);
+//cuts the grid into runCount runs, run r with material r % materialCount, and copies them to instances with each material's runs together
+void orderInstanceRuns(const struct s_instance *grid, struct s_instance *instances, int count, struct s_instanceRun *runs, int runCount, int materialCount);
+//points the sprite shader's samplers at the texture units bindLoaderTextures uses
+void setSamplerUnits(GLuint program);
+//show the finished frame, swapping the window or reading back the offscreen frame when there is no window
+void presentFrame(void *window, struct s_headless *headless);
 //check if the display is still live.
 int displayLive(void *window);
+//appends the benchmark results to path as one json object per line
+static void writeResults(const char *path, int instanceCount, int frames, double seconds, double firstFrame, double allResident, const char *textureCache,
+	const struct s_shaderManager *shaders, int materialCount, const struct s_renderQueue *queue);
 //callback to decode input
 static void inputCallback(GLFWwindow *window, int key, int scanCode, int action, int mods);
 
-int main(void)
+int main(int argc, char **argv)
 {
-	void *window = initGraphics();
-	initInput(window);
+	double programStart = timerNow();
+	int instanceCount = 1;
+	int benchFrames = 0; // when set, run this many frames unthrottled and exit
+	int headless = 0;
+	const char *dumpPattern = NULL;
+	const char *profilePath = NULL;
+	int profileEvery = 0;
+	int showOverlay = 0;
+	const char *resultsPath = NULL;
+	const char *atlasPath = NULL;
+	const char *atlasOut = NULL;
+	int loadThreads = cpuCount();
+	const char *cacheDirectory = NULL;
+	int cacheFormat = TEXCACHE_RGBA;
+	const char *shaderCache = NULL;
+	int materialCount = 1;
+	enum renderQueueModes queueMode = RENDER_SORTED;
+	int glStateMode = GLSTATE_CACHED;
+	int frame;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-instances") == 0 && i + 1 < argc)
+		{
+			instanceCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+		{
+			benchFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-headless") == 0)
+		{
+			headless = 1; // render offscreen, no window or display needed
+		}
+		else if (strcmp(argv[i], "-dump") == 0 && i + 1 < argc)
+		{
+			dumpPattern = argv[++i]; // headless frames are written to this printf pattern, .ppm or .png
+		}
+		else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+		{
+			profilePath = argv[++i]; // stage timings are logged here, .csv or .json
+		}
+		else if (strcmp(argv[i], "-profile-every") == 0 && i + 1 < argc)
+		{
+			profileEvery = atoi(argv[++i]); // frames between profiler reports
+		}
+		else if (strcmp(argv[i], "-overlay") == 0)
+		{
+			showOverlay = 1; // draw the profiler stats over the scene
+		}
+		else if (strcmp(argv[i], "-atlas") == 0 && i + 1 < argc)
+		{
+			atlasPath = argv[++i]; // a directory of images to pack, or an atlas .txt saved with -atlas-out
+		}
+		else if (strcmp(argv[i], "-atlas-out") == 0 && i + 1 < argc)
+		{
+			atlasOut = argv[++i]; // save the packed atlas here, to load it later without packing again
+		}
+		else if (strcmp(argv[i], "-load-threads") == 0 && i + 1 < argc)
+		{
+			loadThreads = atoi(argv[++i]); // threads decoding the sprites, 0 loads them all before the first frame
+		}
+		else if (strcmp(argv[i], "-texture-cache") == 0 && i + 1 < argc)
+		{
+			cacheDirectory = argv[++i]; // keep the packed and mipmapped atlas here, later runs map it instead of loading the images
+		}
+		else if (strcmp(argv[i], "-cache-format") == 0 && i + 1 < argc && (cacheFormat = parseTextureCacheFormat(argv[i + 1])) >= 0)
+		{
+			i++; // rgba, or bc1 or bc3 compressed
+		}
+		else if (strcmp(argv[i], "-shader-cache") == 0 && i + 1 < argc)
+		{
+			shaderCache = argv[++i]; // keep linked shader binaries here, later runs load them instead of compiling
+		}
+		else if (strcmp(argv[i], "-materials") == 0 && i + 1 < argc)
+		{
+			materialCount = atoi(argv[++i]); // split the instances into draws cycling through this many texture sets
+		}
+		else if (strcmp(argv[i], "-render-queue") == 0 && i + 1 < argc && parseRenderQueueMode(argv[i + 1]) >= 0)
+		{
+			// sorted (default) or immediate, which binds everything for every draw as it is submitted
+			queueMode = (enum renderQueueModes)parseRenderQueueMode(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-results") == 0 && i + 1 < argc)
+		{
+			resultsPath = argv[++i]; // with -frames, append the results to this file as a json line
+		}
+		else if (strcmp(argv[i], "-gl-state") == 0 && i + 1 < argc && (glStateMode = parseGLStateMode(argv[i + 1])) >= 0)
+		{
+			i++; // skip redundant binds, make them all, or check the cache against glGet
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-instances 1-%d] [-frames count] [-headless] [-dump frame%%04d.png] [-profile log.csv|log.json] [-profile-every frames] [-overlay] [-results file.json] [-atlas dir|atlas.txt] [-atlas-out atlas.txt] [-load-threads count] [-texture-cache dir] [-cache-format rgba|bc1|bc3] [-shader-cache dir] [-materials 1-%d] [-render-queue sorted|immediate] [-gl-state cached|direct|check]\n", argv[0], MAX_INSTANCES, MAX_MATERIALS);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (instanceCount < 1 || instanceCount > MAX_INSTANCES)
+	{
+		fprintf(stderr, "Instance count must be between 1 and %d\n", MAX_INSTANCES);
+		exit(EXIT_FAILURE);
+	}
+	if (materialCount < 1 || materialCount > MAX_MATERIALS)
+	{
+		fprintf(stderr, "Material count must be between 1 and %d\n", MAX_MATERIALS);
+		exit(EXIT_FAILURE);
+	}
+
+	initGLState((enum glStateModes)glStateMode);
+
+	void *window = NULL;
+	struct s_headless offscreen;
+
+	if (headless)
+	{
+		if (!initHeadless(&offscreen, SCREEN_WIDTH, SCREEN_HEIGHT, dumpPattern))
+		{
+			exit(EXIT_FAILURE);
+		}
+		// There is no window to close, so headless always runs a set number of frames.
+		if (benchFrames == 0)
+		{
+			benchFrames = 1;
+		}
+	}
+	else
+	{
+		window = initGraphics();
+		initInput(window);
+	}
+
+	// Every run but the first starts partway into the instance buffer, which needs a base instance.
+	if (materialCount > 1 && !GLEW_ARB_base_instance)
+	{
+		fprintf(stderr, "-materials needs GL_ARB_base_instance, drawing with one material\n");
+		materialCount = 1;
+	}
 
 	/*struct s_polyF4 polyF4;
 	polyF4 = genPrimitive();*/
 	//GLfloat vertices[12];
-	GLfloat vertices[] = {
+	GLfloat corners[] = {
 		// Positions          // Colors R,G,B,   // Texture Coords
 		0.5f,  0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 1.0f,   // Top Right
 		0.5f, -0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f,   // Bottom Right
@@ -72,67 +305,31 @@ int main(void)
 		1, 2, 3  // Second Triangle
 	}; // Using indices and 
 	   // ***Begin Setup of Shaders***
-	   // Writing shaders in file for example, should be loaded from a separate file.
-	   // Create vertex shader
-	const char* vertexSource = GLSL(
-		layout(location = 0) in vec3 position;
-	layout(location = 1) in vec3 color;
-	layout(location = 2) in vec2 texCoord;
-
-	out vec3 ourColor;
-	out vec2 TexCoord;
-
-	void main()
+	// The shaders are in shaders/, compiled once and kept as binaries with -shader-cache, and reloaded when they change.
+	struct s_shaderManager shaders;
+	initShaderManager(&shaders, shaderCache);
+	int spriteShader = loadShaderProgram(&shaders, "shaders/sprite.vert", "shaders/sprite.frag");
+	if (spriteShader < 0)
 	{
-		gl_Position = vec4(position, 1.0f);
-		ourColor = color;
-		// We swap the y-axis by substracing our coordinates from 1. This is done because most images have the top y-axis inversed with OpenGL's top y-axis.
-		// TexCoord = texCoord;
-		TexCoord = vec2(texCoord.x, 1.0 - texCoord.y);
+		exit(EXIT_FAILURE);
 	}
-	);
-	// Create fragment shader
-	const char* fragmentSource = GLSL(
-		in vec3 ourColor;
-	in vec2 TexCoord;
-
-	out vec4 color;
-
-	// Texture samplers
-	uniform sampler2D ourTexture1;
-
-	void main()
+	setSamplerUnits(shaderProgram(&shaders, spriteShader));
+	if (window != NULL)
 	{
-		// ourColor that we declared in the verticies could be, but is not used in this shader. Instead we're just using the texture.
-		color = texture(ourTexture1, TexCoord);
+		watchShaderFiles(&shaders);
 	}
-	);
-
-
-	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexSource, NULL);
-	glCompileShader(vertexShader);
-	// Fragment Shader
-	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-	glCompileShader(fragmentShader);
-
-	// Link the vertex and fragment shader into a shader program
-	GLuint shaderProgram = glCreateProgram();
-	glAttachShader(shaderProgram, vertexShader);
-	glAttachShader(shaderProgram, fragmentShader);
-	glLinkProgram(shaderProgram);
-	glUseProgram(shaderProgram);
 	// ***End Setup of Shaders***
 
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	stateBindVertexArray(vao);
 
 	// Create a Vertex Buffer Object and copy the vertex data to it
 	GLuint vbo;
 	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	stateBindBuffer(GL_ARRAY_BUFFER, vbo);
+	struct s_spriteVertex vertices[4];
+	packSpriteQuad(corners, vertices);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
 	// Create an Element Buffer Object, and copy the indicies data into it
@@ -142,81 +339,319 @@ int main(void)
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
 
-	// Now we need to declare where our attributes are located in our vertex array object
-	// glVertexAttribPointer(index, size, type, normalized, stride, offset)
-	// index is the index to the generic vertex attribute to be modified. Used in glEnableVertexAttribArray(index);
+	// Now we need to declare where our attributes are located in our vertex array object.
+	// The layout has the type, size and offset of each attribute for the format the example was built with,
+	// and looks up where the shader put them.
+	applyVertexLayout(&g_spriteVertexLayout, shaderProgram(&shaders, spriteShader));
 
-	// Position is three floats starting at 0 [x,y,z].
-	// The stride or the distance to next position is 32bytes or 8*sizeof(GLfloat).
-	// Position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
+	// Per-instance data gets its own buffer, the divisor of 1 moves each attribute forward once per instance instead of once per vertex.
+	struct s_instance *instances = malloc(sizeof(struct s_instance) * instanceCount);
+	if (instances == NULL)
+	{
+		fprintf(stderr, "Failed to allocate %d instances\n", instanceCount);
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
 
-	// Color is three floats, starting at an offset of 3 floats [R,G,B]
-	// The stride is 32bytes to the next color set
-	// Color attribute
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
+	// Every sprite is packed into one atlas, so instances with different images still share one texture and one draw.
+	// The loader decodes and uploads them in the background, until then the instances draw a placeholder.
+	// Without -atlas the atlas only holds batman.png.
+	struct s_atlas atlas;
+	struct s_textureLoader loader;
+	static char *defaultFiles[] = { "batman.png" };
+	char **files = defaultFiles;
+	int fileCount = 1;
+	size_t atlasPathLength = atlasPath != NULL ? strlen(atlasPath) : 0;
+	const char *cacheState = "off";
+	unsigned long long cacheKey = 0;
+	int loaderOk = 0;
+	initAtlas(&atlas, ATLAS_PAGE_SIZE);
+	if (cacheDirectory != NULL && !textureCacheFormatSupported(cacheFormat))
+	{
+		fprintf(stderr, "Compressed textures aren't supported here, caching rgba instead\n");
+		cacheFormat = TEXCACHE_RGBA;
+	}
+	if (atlasPathLength > 4 && strcmp(atlasPath + atlasPathLength - 4, ".txt") == 0)
+	{
+		fileCount = 0;
+		loaderOk = loadAtlas(&atlas, atlasPath) && startAtlasStream(&loader, &atlas);
+	}
+	else
+	{
+		if (atlasPath != NULL)
+		{
+			fileCount = listImageFiles(atlasPath, &files);
+		}
+		// A warm cache skips decoding, packing and mipmapping. -atlas-out needs the packing, so it always loads the images.
+		if (cacheDirectory != NULL && fileCount > 0 && atlasOut == NULL)
+		{
+			struct s_textureCache cache;
+			cacheKey = hashTextureSources(files, fileCount, ATLAS_PAGE_SIZE, cacheFormat);
+			if (openTextureCache(&cache, cacheDirectory, cacheKey))
+			{
+				GLuint cached = loadTextureCache(&cache, &atlas);
+				closeTextureCache(&cache);
+				loaderOk = cached != 0 && startCachedAtlas(&loader, &atlas, cached);
+			}
+			cacheState = loaderOk ? "warm" : "cold";
+		}
+		if (!loaderOk)
+		{
+			loaderOk = fileCount > 0 && startTextureLoader(&loader, &atlas, files, fileCount, loadThreads, atlasOut);
+		}
+	}
+	if (!loaderOk)
+	{
+		fprintf(stderr, "Failed to load the sprite atlas\n");
+		exit(EXIT_FAILURE);
+	}
 
-	// TexCoords are two floats, starting at an offset of 6 floats [x,y]
-	// The stride is 32 bytes to the next texture cord
-	// TexCoord attribute
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
+	// With several materials the grid is cut into runs that take turns between them, as a scene with many materials would.
+	// Each material's runs are stored one after the other, so once the queue sorts them together it draws them as one.
+	int runCount = materialCount == 1 ? 1 : materialCount * MATERIAL_RUNS < instanceCount ? materialCount * MATERIAL_RUNS : instanceCount;
+	struct s_instanceRun *runs = malloc(sizeof(struct s_instanceRun) * runCount);
+	struct s_instance *grid = runCount > 1 ? malloc(sizeof(struct s_instance) * instanceCount) : instances;
+	if (runs == NULL || grid == NULL)
+	{
+		fprintf(stderr, "Failed to allocate %d instance runs\n", runCount);
+		exit(EXIT_FAILURE);
+	}
+	genInstanceGrid(grid, instanceCount, loader.jobCount);
+	orderInstanceRuns(grid, instances, instanceCount, runs, runCount, materialCount);
+	if (grid != instances)
+	{
+		free(grid);
+	}
 
-	glBindVertexArray(0); // Unbind VAO
+	// Material 0 is the loader's own textures, the others swap in a placeholder of their own color.
+	GLuint materialTextures[MAX_MATERIALS];
+	materialTextures[0] = 0;
+	for (i = 1; i < materialCount; i++)
+	{
+		materialTextures[i] = createPlaceholderTexture((GLubyte)(96 + i * 89 % 160), (GLubyte)(96 + i * 53 % 160), (GLubyte)(96 + i * 31 % 160));
+	}
 
-						  // ***Begin Texture***
-	GLuint texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
+	// Units as bindLoaderTextures sets them, the atlas, the placeholder and the sprite table.
+	static const GLenum unitTargets[] = { GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D, GL_TEXTURE_BUFFER };
+	struct s_renderQueue queue;
+	if (!initRenderQueue(&queue, queueMode, runCount, unitTargets, 3))
+	{
+		exit(EXIT_FAILURE);
+	}
 
-	int width, height;
-	unsigned char* image = SOIL_load_image("batman.png", &width, &height, 0, SOIL_LOAD_RGB);
-	// Should Error Check for non-loaded texture.
+	GLuint instanceVbo;
+	glGenBuffers(1, &instanceVbo);
+	stateBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(struct s_instance) * instanceCount, instances, GL_STATIC_DRAW);
+	free(instances);
+
+	// Offset, scale, tint and sprite, the sprite is an integer so it goes through glVertexAttribIPointer.
+	applyVertexLayout(&g_instanceLayout, shaderProgram(&shaders, spriteShader));
+	printf("vertices: %s bytes/vertex: %d bytes/instance: %d instance KB: %.1f\n", g_spriteVertexLayout.name,
+		(int)g_spriteVertexLayout.stride, (int)g_instanceLayout.stride, g_instanceLayout.stride * (double)instanceCount / 1024.0);
+
+	stateBindVertexArray(0); // Unbind VAO
+
+	// Timers for each stage of the loop, the gpu one covers the clear and the instanced draw.
+	int uploadTimer = profRegister("upload", PROF_CPU);
+	int submitTimer = profRegister("submit", PROF_CPU);
+	int drawTimer = profRegister("draw", PROF_GPU);
+	int presentTimer = profRegister("present", PROF_CPU);
+	if (profilePath != NULL && !profOpenLog(profilePath, profileEvery))
+	{
+		exit(EXIT_FAILURE);
+	}
 
-	// Send texture information to our texture buffer and generate the mipmap.
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	SOIL_free_image_data(image); // We don't need the image loaded as a char array anymore, so we can free it.
-	glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture when done, so we won't accidentily mess up our texture.
-									 // **End Texture***
+	struct s_overlay overlay;
+	char report[1024];
+	if (showOverlay && !initOverlay(&overlay))
+	{
+		showOverlay = 0;
+	}
 
-	while (displayLive(window)) // Check if the window was closed
+	if (benchFrames > 0 && window != NULL)
+	{
+		glfwSwapInterval(0); // Don't let vsync cap the measurement.
+	}
+	double startTime = timerNow();
+	double reportStart = startTime;
+	resetGLStateStats();
+	double frameStart = reportStart;
+	double frameMin = 1e9;
+	double frameMax = 0.0;
+	int reportFrames = 0;
+	double firstFrame = 0.0;
+	int startupReported = 0;
+
+	for (frame = 0; displayLive(window); frame++) // Check if the window was closed
 	{
+		if (benchFrames > 0 && frame == benchFrames)
+		{
+			break;
+		}
+
 		// Check to see if we need to move the primitive
 		//movePrimitive(&polyF4, getInput());
 
+		// A reloaded program starts with its samplers on unit 0.
+		if (updateShaderManager(&shaders) > 0)
+		{
+			setSamplerUnits(shaderProgram(&shaders, spriteShader));
+		}
+
+		// Decode, pack or stream whatever is next, sprites are drawn from the atlas as soon as they are on the gpu.
+		profBegin(uploadTimer);
+		updateTextureLoader(&loader);
+		profEnd(uploadTimer);
+
 		// Clear the screen to greenish, our texture is black.
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		profBegin(drawTimer);
+		profBegin(submitTimer);
+		stateClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
 		// Do the vertex conversion, and send it to the gpu.
 		//convertPrimQuadVertices(&polyF4, vertices);
 
-		// Bind the texture and our vertex array
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glBindVertexArray(vao);
+		// Each run of instances is a command with the program, textures and vertex array it needs.
+		// The queue sorts them by material, binds only what changes and draws runs that follow on from each other in one call.
+		GLuint program = shaderProgram(&shaders, spriteShader);
+		for (i = 0; i < runCount; i++)
+		{
+			struct s_renderCommand command;
+			command.program = program;
+			command.vao = vao;
+			command.textures[0] = loader.texture;
+			command.textures[1] = runs[i].material == 0 ? loader.placeholder : materialTextures[runs[i].material];
+			command.textures[2] = loader.tableTexture;
+			command.textures[3] = 0;
+			command.mode = GL_TRIANGLES;
+			command.indexType = GL_UNSIGNED_INT;
+			command.count = 6;
+			command.first = 0;
+			command.instances = runs[i].count;
+			command.baseInstance = runs[i].first;
+			command.key = makeRenderKey(program, runs[i].material, vao, i);
+			submitRenderCommand(&queue, &command);
+		}
+		flushRenderQueue(&queue);
+		profEnd(submitTimer);
+		profEnd(drawTimer);
+
+		if (showOverlay)
+		{
+			drawOverlay(&overlay, SCREEN_WIDTH, SCREEN_HEIGHT);
+		}
 
-		// Draw using the elements we set up.
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0); // Unbind our vertex array object.
+		// Swap buffers and poll window events
+		profBegin(presentTimer);
+		presentFrame(window, &offscreen);
+		profEnd(presentTimer);
 
-							  // Swap buffers and poll window events
-		glfwSwapBuffers((GLFWwindow *)window);
-		glfwPollEvents();
+		// Startup is how long until something is on screen and how long until every sprite is.
+		if (frame == 0)
+		{
+			glFinish();
+			firstFrame = timerNow() - programStart;
+		}
+		if (!startupReported && loader.state == LOADER_DONE)
+		{
+			printf("startup: sprites: %d threads: %d texture cache: %s first frame ms: %.3f all resident ms: %.3f uploaded mb: %.1f\n",
+				loader.jobCount, fileCount > 0 ? loadThreads : 0, cacheState, firstFrame * 1000.0, (loader.residentTime - programStart) * 1000.0,
+				loader.bytesUploaded / (1024.0 * 1024.0));
+			printf("shaders: compiled: %d from binary: %d ms: %.3f\n", shaders.compiledCount, shaders.binaryCount, shaders.loadTime * 1000.0);
+			startupReported = 1;
+
+			// A cold start leaves the cache for the next run, once everything it needs is on the gpu.
+			if (strcmp(cacheState, "cold") == 0)
+			{
+				double writeStart = timerNow();
+				if (writeTextureCache(cacheDirectory, cacheKey, &atlas, cacheFormat))
+				{
+					printf("texture cache written in %.3f ms\n", (timerNow() - writeStart) * 1000.0);
+				}
+			}
+		}
+
+		profEndFrame();
+		if (glStateMode == GLSTATE_CHECK)
+		{
+			validateGLState();
+		}
+		if (showOverlay && (profReportReady() || frame == 0))
+		{
+			profFormatReport(report, sizeof(report));
+			setOverlayText(&overlay, report);
+		}
+
+		// Frame time report, min/avg/max over the last REPORT_FRAMES frames.
+		double now = timerNow();
+		double frameTime = now - frameStart;
+		frameStart = now;
+		frameMin = frameTime < frameMin ? frameTime : frameMin;
+		frameMax = frameTime > frameMax ? frameTime : frameMax;
+		reportFrames++;
+		if (reportFrames == REPORT_FRAMES || (benchFrames > 0 && frame + 1 == benchFrames))
+		{
+			printf("instances: %d frames: %d frame ms min: %.3f avg: %.3f max: %.3f instances/sec: %.0f\n",
+				instanceCount, reportFrames, frameMin * 1000.0, (now - reportStart) * 1000.0 / reportFrames, frameMax * 1000.0,
+				(double)instanceCount * reportFrames / (now - reportStart));
+			reportStart = now;
+			frameMin = 1e9;
+			frameMax = 0.0;
+			reportFrames = 0;
+		}
+	}
+
+	if (benchFrames > 0 && resultsPath != NULL)
+	{
+		glFinish();
+		writeResults(resultsPath, instanceCount, frame, timerNow() - startTime, firstFrame,
+			loader.state == LOADER_DONE ? loader.residentTime - programStart : -1.0, cacheState, &shaders, materialCount, &queue);
+	}
+	if (benchFrames > 0 && queue.frames > 0)
+	{
+		const struct s_renderStats *render = &queue.total;
+		printf("render: queue: %s materials: %d commands/frame: %.1f draws/frame: %.1f merged/frame: %.1f binds/frame: %.1f avoided/frame: %.1f sort ms/frame: %.4f\n",
+			g_renderQueueModeNames[queue.mode], materialCount, (double)render->commands / queue.frames,
+			(double)render->draws / queue.frames, (double)render->merged / queue.frames,
+			(double)(render->programBinds + render->vaoBinds + render->textureBinds) / queue.frames,
+			(double)render->bindsAvoided / queue.frames, render->sortSeconds * 1000.0 / queue.frames);
+		printf("gl state: %s calls/frame: %.2f skipped/frame: %.2f mismatches: %lu\n", g_glStateModeNames[g_glState.mode],
+			(double)g_glState.stats.calls / frame, (double)g_glState.stats.skipped / frame, g_glState.stats.mismatches);
 	}
 
 	// Delete allocated resources
-	glDeleteProgram(shaderProgram);
-	glDeleteShader(fragmentShader);
-	glDeleteShader(vertexShader);
-	glDeleteBuffers(1, &vbo);
-	glDeleteVertexArrays(1, &vao);
+	if (showOverlay)
+	{
+		freeOverlay(&overlay);
+	}
+	profShutdown();
+	freeShaderManager(&shaders);
+	freeRenderQueue(&queue);
+	free(runs);
+	stateDeleteTextures(materialCount - 1, &materialTextures[1]);
+	stateDeleteBuffers(1, &instanceVbo);
+	stateDeleteBuffers(1, &ebo);
+	stateDeleteBuffers(1, &vbo);
+	stateDeleteVertexArrays(1, &vao);
+	freeTextureLoader(&loader);
+	freeAtlas(&atlas);
+	if (files != defaultFiles)
+	{
+		freeImageFiles(files, fileCount);
+	}
 
 
-	// Close OpenGL window and terminate GLFW
-	glfwTerminate();
+	if (headless)
+	{
+		freeHeadless(&offscreen);
+	}
+	else
+	{
+		// Close OpenGL window and terminate GLFW
+		glfwTerminate();
+	}
 
 	return 0;
 }
@@ -299,6 +734,91 @@ struct s_polyF4 genPrimitive()
 	return temp;
 }
 
+void packSpriteQuad(const GLfloat *corners, struct s_spriteVertex *vertices)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		const GLfloat *corner = &corners[i * 8];
+#if SPRITE_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+		vertices[i].x = packSnorm16(corner[0]);
+		vertices[i].y = packSnorm16(corner[1]);
+		vertices[i].u = packHalf(corner[6]);
+		vertices[i].v = packHalf(corner[7]);
+#else
+		vertices[i].x = corner[0];
+		vertices[i].y = corner[1];
+		vertices[i].z = corner[2];
+		vertices[i].r = corner[3];
+		vertices[i].g = corner[4];
+		vertices[i].b = corner[5];
+		vertices[i].u = corner[6];
+		vertices[i].v = corner[7];
+#endif
+	}
+}
+
+void orderInstanceRuns(const struct s_instance *grid, struct s_instance *instances, int count, struct s_instanceRun *runs, int runCount, int materialCount)
+{
+	int next = 0;
+	int material;
+	int r;
+
+	for (material = 0; material < materialCount; material++)
+	{
+		for (r = material; r < runCount; r += materialCount)
+		{
+			int begin = (int)((long long)count * r / runCount);
+			int end = (int)((long long)count * (r + 1) / runCount);
+			runs[r].first = next;
+			runs[r].count = end - begin;
+			runs[r].material = material;
+			if (grid != instances)
+			{
+				memcpy(&instances[next], &grid[begin], sizeof(struct s_instance) * (end - begin));
+			}
+			next += end - begin;
+		}
+	}
+}
+
+void genInstanceGrid(struct s_instance *instances, int count, int spriteCount)
+{
+	int side = (int)ceil(sqrt((double)count));
+	GLfloat cell = 2.0f / side;
+	int i;
+
+	if (spriteCount > INSTANCE_MAX_SPRITES)
+	{
+		spriteCount = INSTANCE_MAX_SPRITES;
+	}
+	for (i = 0; i < count; i++)
+	{
+		GLfloat offsetX = -1.0f + (i % side + 0.5f) * cell;
+		GLfloat offsetY = -1.0f + (i / side + 0.5f) * cell;
+		// One instance keeps the original full size quad.
+		GLfloat scale = count == 1 ? 1.0f : cell * 0.9f;
+#if SPRITE_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+		instances[i].offsetX = packSnorm16(offsetX);
+		instances[i].offsetY = packSnorm16(offsetY);
+		instances[i].scaleX = packHalf(scale);
+		instances[i].padding = 0;
+#else
+		instances[i].offsetX = offsetX;
+		instances[i].offsetY = offsetY;
+		instances[i].scaleX = scale;
+#endif
+		instances[i].scaleY = instances[i].scaleX;
+		instances[i].r = count == 1 ? 255 : (GLubyte)(128 + 127 * (i % side) / side);
+		instances[i].g = count == 1 ? 255 : (GLubyte)(128 + 127 * (i / side) / side);
+		instances[i].b = 255;
+		instances[i].a = 255;
+		// Each instance takes the next sprite in the table.
+		instances[i].sprite = i % spriteCount;
+	}
+}
+
 enum inputTypes getInput()
 {
 	enum inputTypes temp = g_decodedInput;
@@ -401,11 +921,69 @@ void convertPrimQuadVertices(struct s_polyF4 *f4, GLfloat *vertexArray)
 	vertexArray[11] = f4->y1;
 }
 
+void setSamplerUnits(GLuint program)
+{
+	stateUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "ourTexture1"), 0);
+	glUniform1i(glGetUniformLocation(program, "placeholder"), 1);
+	glUniform1i(glGetUniformLocation(program, "spriteTable"), 2);
+	stateUseProgram(0);
+}
+
+void presentFrame(void *window, struct s_headless *headless)
+{
+	if (window == NULL)
+	{
+		endHeadlessFrame(headless);
+		return;
+	}
+
+	glfwSwapBuffers((GLFWwindow *)window);
+	glfwPollEvents();
+}
+
 int displayLive(void *window)
 {
+	// Headless has no window to close, it runs until its frame count.
+	if (window == NULL)
+	{
+		return 1;
+	}
 	return (glfwWindowShouldClose((GLFWwindow *)window) == 0 ? 1 : 0);
 }
 
+static void writeResults(const char *path, int instanceCount, int frames, double seconds, double firstFrame, double allResident, const char *textureCache,
+	const struct s_shaderManager *shaders, int materialCount, const struct s_renderQueue *queue)
+{
+	struct s_profStats frameStats;
+	FILE *file = fopen(path, "a");
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open results file %s\n", path);
+		return;
+	}
+
+	// Frame time stats cover the last PROF_SAMPLES frames, the throughput covers the whole run.
+	profGetStats(PROF_FRAME, &frameStats);
+	fprintf(file, "{\"example\":\"moving_square_texture\",\"instances\":%d,\"frames\":%d,\"seconds\":%.4f,\"instances_per_sec\":%.0f,"
+		"\"frame_ms_min\":%.4f,\"frame_ms_avg\":%.4f,\"frame_ms_p99\":%.4f,\"frame_ms_max\":%.4f,"
+		"\"first_frame_ms\":%.3f,\"all_resident_ms\":%.3f,\"texture_cache\":\"%s\",\"shader_ms\":%.3f,\"shaders_compiled\":%d,\"shaders_from_binary\":%d,"
+		"\"vertex_format\":\"%s\",\"vertex_bytes\":%d,\"instance_bytes\":%d,\"materials\":%d,\"render_queue\":\"%s\",\"draws_per_frame\":%.2f,"
+		"\"merged_per_frame\":%.2f,\"binds_per_frame\":%.2f,\"binds_avoided_per_frame\":%.2f,\"sort_ms_per_frame\":%.4f,"
+		"\"gl_state\":\"%s\",\"gl_calls_per_frame\":%.2f,\"gl_calls_skipped_per_frame\":%.2f,\"gl_state_mismatches\":%lu}\n",
+		instanceCount, frames, seconds, (double)instanceCount * frames / seconds,
+		frameStats.min, frameStats.avg, frameStats.p99, frameStats.max,
+		firstFrame * 1000.0, allResident < 0.0 ? -1.0 : allResident * 1000.0, textureCache,
+		shaders->loadTime * 1000.0, shaders->compiledCount, shaders->binaryCount, g_spriteVertexLayout.name,
+		(int)g_spriteVertexLayout.stride, (int)g_instanceLayout.stride, materialCount, g_renderQueueModeNames[queue->mode],
+		(double)queue->total.draws / frames, (double)queue->total.merged / frames,
+		(double)(queue->total.programBinds + queue->total.vaoBinds + queue->total.textureBinds) / frames,
+		(double)queue->total.bindsAvoided / frames, queue->total.sortSeconds * 1000.0 / frames, g_glStateModeNames[g_glState.mode],
+		(double)g_glState.stats.calls / frames, (double)g_glState.stats.skipped / frames, g_glState.stats.mismatches);
+	fclose(file);
+}
+
 //keyboard input callback to decode key pressed into are decoded type.
 static void inputCallback(GLFWwindow *window, int key, int scanCode, int action, int mods)
 {
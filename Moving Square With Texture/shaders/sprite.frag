@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec3 ourColor;
+in vec2 TexCoord;
+in vec4 Tint;
+flat in float Layer;
+
+out vec4 color;
+
+// Texture samplers, every sprite comes from one atlas with a layer per page, the placeholder stands in until it's loaded
+uniform sampler2DArray ourTexture1;
+uniform sampler2D placeholder;
+
+void main()
+{
+	// ourColor that we declared in the verticies could be, but is not used in this shader. Instead we are just using the texture.
+	// Layer is flat, so a whole quad takes the same branch.
+	color = (Layer < 0.0 ? texture(placeholder, TexCoord) : texture(ourTexture1, vec3(TexCoord, Layer))) * Tint;
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec2 texCoord;
+// Per-instance attributes
+layout(location = 3) in vec2 instanceOffset;
+layout(location = 4) in vec2 instanceScale;
+layout(location = 5) in vec4 instanceTint;
+layout(location = 6) in uint instanceSprite;
+
+out vec3 ourColor;
+out vec2 TexCoord;
+out vec4 Tint;
+flat out float Layer;
+
+// Two texels per sprite, the rect in the atlas then its page, or -1 while it is still loading.
+uniform samplerBuffer spriteTable;
+
+void main()
+{
+	vec4 instanceRect = texelFetch(spriteTable, int(instanceSprite) * 2);
+
+	gl_Position = vec4(position.xy * instanceScale + instanceOffset, position.z, 1.0f);
+	ourColor = color;
+	Tint = instanceTint;
+	// We swap the y-axis by substracing our coordinates from 1. This is done because most images have the top y-axis inversed with OpenGL's top y-axis.
+	// The instance rect then picks which part of the texture this quad shows.
+	TexCoord = instanceRect.xy + vec2(texCoord.x, 1.0 - texCoord.y) * instanceRect.zw;
+	Layer = texelFetch(spriteTable, int(instanceSprite) * 2 + 1).x;
+}
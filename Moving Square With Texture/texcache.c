@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "texcache.h"
+#include "glstate.h"
+
+#define FNV64_OFFSET	14695981039346656037ull
+#define FNV64_PRIME		1099511628211ull
+
+// From GL_EXT_texture_compression_s3tc, BC1 and BC3 are DXT1 and DXT5.
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT	0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT	0x83F3
+#endif
+
+static unsigned long long hashBytes(unsigned long long hash, const void *data, size_t length);
+static void cachePath(char *path, size_t size, const char *directory, unsigned long long key);
+static int levelCount(int pageSize);
+static size_t levelSize(enum texCacheFormats format, int pageSize, int pageCount, int level);
+static void compressLevel(enum texCacheFormats format, const unsigned char *rgba, int size, unsigned char *out);
+static void fetchBlock(const unsigned char *rgba, int size, int blockX, int blockY, unsigned char block[64]);
+static void encodeColorBlock(const unsigned char block[64], int punchAlpha, unsigned char out[8]);
+static void encodeAlphaBlock(const unsigned char block[64], unsigned char out[8]);
+static unsigned short packColor(int r, int g, int b);
+static void unpackColor(unsigned short color, int rgb[3]);
+
+unsigned long long hashTextureSources(char **files, int fileCount, int pageSize, enum texCacheFormats format)
+{
+	unsigned long long hash = FNV64_OFFSET;
+	unsigned int settings[4] = { TEXCACHE_VERSION, (unsigned int)pageSize, ATLAS_PADDING, (unsigned int)format };
+	unsigned char buffer[64 * 1024];
+	size_t length;
+	int i;
+
+	hash = hashBytes(hash, settings, sizeof(settings));
+	for (i = 0; i < fileCount; i++)
+	{
+		FILE *file = fopen(files[i], "rb");
+
+		hash = hashBytes(hash, files[i], strlen(files[i]) + 1);
+		if (file == NULL)
+		{
+			continue;
+		}
+		while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			hash = hashBytes(hash, buffer, length);
+		}
+		fclose(file);
+	}
+	return hash;
+}
+
+int openTextureCache(struct s_textureCache *cache, const char *directory, unsigned long long key)
+{
+	char path[TEXCACHE_PATH_LENGTH];
+	const struct s_texCacheHeader *header;
+	size_t expected;
+	int level;
+
+	memset(cache, 0, sizeof(*cache));
+	cachePath(path, sizeof(path), directory, key);
+
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+	cache->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (cache->file == INVALID_HANDLE_VALUE)
+	{
+		cache->file = NULL;
+		return 0;
+	}
+	if (!GetFileSizeEx(cache->file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(struct s_texCacheHeader))
+	{
+		closeTextureCache(cache);
+		return 0;
+	}
+	cache->size = (size_t)fileSize.QuadPart;
+	cache->mapping = CreateFileMappingA(cache->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	cache->data = cache->mapping != NULL ? MapViewOfFile(cache->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (cache->data == NULL)
+	{
+		closeTextureCache(cache);
+		return 0;
+	}
+#else
+	struct stat info;
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return 0;
+	}
+	if (fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(struct s_texCacheHeader))
+	{
+		close(file);
+		return 0;
+	}
+	cache->size = (size_t)info.st_size;
+	void *data = mmap(NULL, cache->size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps the file open on its own.
+	close(file);
+	if (data == MAP_FAILED)
+	{
+		cache->size = 0;
+		return 0;
+	}
+	cache->data = data;
+#endif
+
+	// Anything that doesn't match exactly is treated as missing and gets rebuilt. The header is checked before the
+	// sizes it gives are added up, so a corrupt level count or page size can't send the loop off for billions of levels.
+	header = (const struct s_texCacheHeader *)cache->data;
+	if (memcmp(header->magic, "MSQC", 4) != 0 || header->version != TEXCACHE_VERSION || header->key != key
+		|| header->format > TEXCACHE_BC3 || header->pageCount < 1 || header->pageCount > ATLAS_MAX_PAGES
+		|| header->pageSize < 1 || header->pageSize > ATLAS_PAGE_SIZE
+		|| header->levelCount != (unsigned int)levelCount(header->pageSize)
+		|| header->dataOffset < sizeof(struct s_texCacheHeader) + sizeof(struct s_texCacheSprite) * header->spriteCount)
+	{
+		fprintf(stderr, "Ignoring stale texture cache %s\n", path);
+		closeTextureCache(cache);
+		return 0;
+	}
+	expected = header->dataOffset;
+	for (level = 0; level < (int)header->levelCount; level++)
+	{
+		expected += levelSize(header->format, header->pageSize, header->pageCount, level);
+	}
+	if (expected != cache->size)
+	{
+		fprintf(stderr, "Ignoring stale texture cache %s\n", path);
+		closeTextureCache(cache);
+		return 0;
+	}
+	cache->header = header;
+	return 1;
+}
+
+GLuint loadTextureCache(const struct s_textureCache *cache, struct s_atlas *atlas)
+{
+	static const GLenum compressedFormats[] = { 0, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT };
+	const struct s_texCacheHeader *header = cache->header;
+	const struct s_texCacheSprite *sprites = (const struct s_texCacheSprite *)(header + 1);
+	const unsigned char *level = cache->data + header->dataOffset;
+	GLuint texture;
+	int i;
+
+	if (!textureCacheFormatSupported(header->format))
+	{
+		return 0;
+	}
+
+	initAtlas(atlas, header->pageSize);
+	for (i = 0; i < (int)header->spriteCount; i++)
+	{
+		char name[ATLAS_NAME_LENGTH];
+
+		snprintf(name, sizeof(name), "%.*s", ATLAS_NAME_LENGTH - 1, sprites[i].name);
+		if (sprites[i].page < 0 || sprites[i].page >= (int)header->pageCount
+			|| placeAtlasSprite(atlas, name, sprites[i].page, sprites[i].x, sprites[i].y, sprites[i].width, sprites[i].height) < 0)
+		{
+			freeAtlas(atlas);
+			return 0;
+		}
+	}
+	atlas->pageCount = header->pageCount;
+	atlas->built = 1;
+
+	// Straight from the mapped file to the driver, every level is already there so nothing is generated.
+	glGenTextures(1, &texture);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	for (i = 0; i < (int)header->levelCount; i++)
+	{
+		int size = header->pageSize >> i > 0 ? header->pageSize >> i : 1;
+		size_t bytes = levelSize(header->format, header->pageSize, header->pageCount, i);
+
+		if (header->format == TEXCACHE_RGBA)
+		{
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, size, size, header->pageCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+		}
+		else
+		{
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, compressedFormats[header->format], size, size, header->pageCount, 0, (GLsizei)bytes, level);
+		}
+		level += bytes;
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, header->levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	atlas->texture = texture;
+	return texture;
+}
+
+void closeTextureCache(struct s_textureCache *cache)
+{
+#ifdef _WIN32
+	if (cache->data != NULL)
+	{
+		UnmapViewOfFile(cache->data);
+	}
+	if (cache->mapping != NULL)
+	{
+		CloseHandle(cache->mapping);
+	}
+	if (cache->file != NULL)
+	{
+		CloseHandle(cache->file);
+	}
+#else
+	if (cache->data != NULL)
+	{
+		munmap((void *)cache->data, cache->size);
+	}
+#endif
+	memset(cache, 0, sizeof(*cache));
+}
+
+int writeTextureCache(const char *directory, unsigned long long key, const struct s_atlas *atlas, enum texCacheFormats format)
+{
+	char path[TEXCACHE_PATH_LENGTH];
+	char temporary[TEXCACHE_PATH_LENGTH + 4];
+	struct s_texCacheHeader header;
+	struct s_texCacheSprite *sprites;
+	unsigned char *rgba;
+	unsigned char *compressed = NULL;
+	FILE *file;
+	int ok = 1;
+	int i;
+
+	if (atlas->texture == 0 || atlas->pageCount < 1)
+	{
+		return 0;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MSQC", 4);
+	header.version = TEXCACHE_VERSION;
+	header.key = key;
+	header.format = format;
+	header.pageSize = atlas->pageSize;
+	header.pageCount = atlas->pageCount;
+	header.levelCount = levelCount(atlas->pageSize);
+	header.spriteCount = atlas->spriteCount;
+	// Level data starts 16 byte aligned in the file, and so in the mapping.
+	header.dataOffset = (unsigned int)((sizeof(header) + sizeof(struct s_texCacheSprite) * atlas->spriteCount + 15) & ~(size_t)15);
+
+	sprites = calloc(atlas->spriteCount > 0 ? atlas->spriteCount : 1, sizeof(struct s_texCacheSprite));
+	rgba = malloc(levelSize(TEXCACHE_RGBA, atlas->pageSize, atlas->pageCount, 0));
+	if (format != TEXCACHE_RGBA)
+	{
+		compressed = malloc(levelSize(format, atlas->pageSize, atlas->pageCount, 0));
+	}
+	if (sprites == NULL || rgba == NULL || (format != TEXCACHE_RGBA && compressed == NULL))
+	{
+		free(sprites);
+		free(rgba);
+		free(compressed);
+		return 0;
+	}
+	for (i = 0; i < atlas->spriteCount; i++)
+	{
+		memcpy(sprites[i].name, atlas->sprites[i].name, ATLAS_NAME_LENGTH);
+		sprites[i].page = atlas->sprites[i].page;
+		sprites[i].x = atlas->sprites[i].x;
+		sprites[i].y = atlas->sprites[i].y;
+		sprites[i].width = atlas->sprites[i].width;
+		sprites[i].height = atlas->sprites[i].height;
+	}
+
+#ifdef _WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0755);
+#endif
+	// Written under another name and renamed at the end, so a run that dies halfway never leaves a file that looks valid.
+	cachePath(path, sizeof(path), directory, key);
+	snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+	file = fopen(temporary, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", temporary);
+		free(sprites);
+		free(rgba);
+		free(compressed);
+		return 0;
+	}
+	ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (atlas->spriteCount == 0 || fwrite(sprites, sizeof(struct s_texCacheSprite), atlas->spriteCount, file) == (size_t)atlas->spriteCount)
+		&& fseek(file, header.dataOffset, SEEK_SET) == 0;
+
+	// The mipmaps the gpu generated are read back, so the cache holds exactly what a cold run draws with.
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, atlas->texture);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (i = 0; i < (int)header.levelCount && ok; i++)
+	{
+		int size = atlas->pageSize >> i > 0 ? atlas->pageSize >> i : 1;
+		size_t pageBytes = (size_t)size * size * 4;
+		int page;
+
+		glGetTexImage(GL_TEXTURE_2D_ARRAY, i, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		if (format == TEXCACHE_RGBA)
+		{
+			ok = fwrite(rgba, 1, pageBytes * atlas->pageCount, file) == pageBytes * atlas->pageCount;
+			continue;
+		}
+
+		size_t compressedPage = levelSize(format, atlas->pageSize, 1, i);
+		for (page = 0; page < atlas->pageCount; page++)
+		{
+			compressLevel(format, rgba + pageBytes * page, size, compressed + compressedPage * page);
+		}
+		ok = fwrite(compressed, 1, compressedPage * atlas->pageCount, file) == compressedPage * atlas->pageCount;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	stateBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	ok = fclose(file) == 0 && ok;
+	free(sprites);
+	free(rgba);
+	free(compressed);
+	if (!ok)
+	{
+		remove(temporary);
+		return 0;
+	}
+	remove(path);
+	return rename(temporary, path) == 0;
+}
+
+int parseTextureCacheFormat(const char *name)
+{
+	static const char *names[] = { "rgba", "bc1", "bc3" };
+	int i;
+
+	for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+int textureCacheFormatSupported(enum texCacheFormats format)
+{
+	GLint count = 0;
+	int i;
+
+	if (format == TEXCACHE_RGBA)
+	{
+		return 1;
+	}
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (i = 0; i < count; i++)
+	{
+		const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != NULL && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static unsigned long long hashBytes(unsigned long long hash, const void *data, size_t length)
+{
+	const unsigned char *bytes = data;
+	size_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		hash = (hash ^ bytes[i]) * FNV64_PRIME;
+	}
+	return hash;
+}
+
+static void cachePath(char *path, size_t size, const char *directory, unsigned long long key)
+{
+	snprintf(path, size, "%s/atlas_%016llx.texcache", directory, key);
+}
+
+// Down to 1x1.
+static int levelCount(int pageSize)
+{
+	int count = 1;
+
+	while (pageSize > 1)
+	{
+		pageSize >>= 1;
+		count++;
+	}
+	return count;
+}
+
+static size_t levelSize(enum texCacheFormats format, int pageSize, int pageCount, int level)
+{
+	size_t size = pageSize >> level > 0 ? pageSize >> level : 1;
+	size_t blocks = (size + 3) / 4;
+
+	switch (format)
+	{
+	case TEXCACHE_BC1:
+		return blocks * blocks * 8 * pageCount;
+	case TEXCACHE_BC3:
+		return blocks * blocks * 16 * pageCount;
+	default:
+		return size * size * 4 * pageCount;
+	}
+}
+
+// One page of one level, a 4x4 block at a time, row by row.
+static void compressLevel(enum texCacheFormats format, const unsigned char *rgba, int size, unsigned char *out)
+{
+	unsigned char block[64];
+	int blocks = (size + 3) / 4;
+	int x;
+	int y;
+
+	for (y = 0; y < blocks; y++)
+	{
+		for (x = 0; x < blocks; x++)
+		{
+			fetchBlock(rgba, size, x, y, block);
+			if (format == TEXCACHE_BC3)
+			{
+				encodeAlphaBlock(block, out);
+				encodeColorBlock(block, 0, out + 8);
+				out += 16;
+			}
+			else
+			{
+				encodeColorBlock(block, 1, out);
+				out += 8;
+			}
+		}
+	}
+}
+
+// Levels smaller than a block repeat their edge pixels to fill it.
+static void fetchBlock(const unsigned char *rgba, int size, int blockX, int blockY, unsigned char block[64])
+{
+	int x;
+	int y;
+
+	for (y = 0; y < 4; y++)
+	{
+		int sy = blockY * 4 + y < size ? blockY * 4 + y : size - 1;
+		for (x = 0; x < 4; x++)
+		{
+			int sx = blockX * 4 + x < size ? blockX * 4 + x : size - 1;
+			memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * size + sx) * 4, 4);
+		}
+	}
+}
+
+// Endpoints are the corners of the colors' bounding box, pulled in a little so the in between colors land on more of them.
+// With punchAlpha, mostly transparent pixels use the transparent index of the three color mode, as BC1 does on its own.
+static void encodeColorBlock(const unsigned char block[64], int punchAlpha, unsigned char out[8])
+{
+	int low[3] = { 255, 255, 255 };
+	int high[3] = { 0, 0, 0 };
+	int palette[4][3];
+	int transparent = 0;
+	unsigned short color0;
+	unsigned short color1;
+	unsigned int indices = 0;
+	int i;
+	int c;
+
+	for (i = 0; i < 16; i++)
+	{
+		if (punchAlpha && block[i * 4 + 3] < 128)
+		{
+			transparent = 1;
+			continue;
+		}
+		for (c = 0; c < 3; c++)
+		{
+			low[c] = block[i * 4 + c] < low[c] ? block[i * 4 + c] : low[c];
+			high[c] = block[i * 4 + c] > high[c] ? block[i * 4 + c] : high[c];
+		}
+	}
+	if (low[0] > high[0])
+	{
+		// Nothing opaque, every index is transparent.
+		out[0] = out[1] = out[2] = out[3] = 0;
+		out[4] = out[5] = out[6] = out[7] = 0xff;
+		return;
+	}
+	for (c = 0; c < 3; c++)
+	{
+		int inset = (high[c] - low[c]) / 16;
+		low[c] += inset;
+		high[c] -= inset;
+	}
+
+	color0 = packColor(high[0], high[1], high[2]);
+	color1 = packColor(low[0], low[1], low[2]);
+	// color0 > color1 picks the four color mode, otherwise it is three colors and transparent.
+	if (transparent ? color0 > color1 : color0 < color1)
+	{
+		unsigned short swap = color0;
+		color0 = color1;
+		color1 = swap;
+	}
+	unpackColor(color0, palette[0]);
+	unpackColor(color1, palette[1]);
+	for (c = 0; c < 3; c++)
+	{
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	for (i = 0; i < 16; i++)
+	{
+		int best = 0;
+		int bestDistance = 1 << 30;
+		int entries = color0 > color1 ? 4 : 3;
+		int entry;
+
+		if (transparent && block[i * 4 + 3] < 128)
+		{
+			indices |= 3u << (i * 2);
+			continue;
+		}
+		for (entry = 0; entry < entries; entry++)
+		{
+			int distance = 0;
+			for (c = 0; c < 3; c++)
+			{
+				int d = block[i * 4 + c] - palette[entry][c];
+				distance += d * d;
+			}
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = entry;
+			}
+		}
+		indices |= (unsigned int)best << (i * 2);
+	}
+
+	out[0] = color0 & 0xff;
+	out[1] = color0 >> 8;
+	out[2] = color1 & 0xff;
+	out[3] = color1 >> 8;
+	out[4] = indices & 0xff;
+	out[5] = (indices >> 8) & 0xff;
+	out[6] = (indices >> 16) & 0xff;
+	out[7] = (indices >> 24) & 0xff;
+}
+
+// The alpha half of BC3, eight levels between the lowest and highest alpha of the block, three bits a pixel.
+static void encodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+{
+	int high = 0;
+	int low = 255;
+	int palette[8];
+	unsigned long long indices = 0;
+	int i;
+
+	for (i = 0; i < 16; i++)
+	{
+		high = block[i * 4 + 3] > high ? block[i * 4 + 3] : high;
+		low = block[i * 4 + 3] < low ? block[i * 4 + 3] : low;
+	}
+	palette[0] = high;
+	palette[1] = low;
+	for (i = 1; i < 7; i++)
+	{
+		palette[i + 1] = ((7 - i) * high + i * low) / 7;
+	}
+
+	for (i = 0; i < 16 && high != low; i++)
+	{
+		int best = 0;
+		int bestDistance = 256;
+		int entry;
+
+		for (entry = 0; entry < 8; entry++)
+		{
+			int distance = abs(block[i * 4 + 3] - palette[entry]);
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = entry;
+			}
+		}
+		indices |= (unsigned long long)best << (i * 3);
+	}
+
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+	for (i = 0; i < 6; i++)
+	{
+		out[2 + i] = (indices >> (i * 8)) & 0xff;
+	}
+}
+
+static unsigned short packColor(int r, int g, int b)
+{
+	return (unsigned short)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | (b * 31 + 127) / 255);
+}
+
+static void unpackColor(unsigned short color, int rgb[3])
+{
+	int r = color >> 11;
+	int g = (color >> 5) & 63;
+	int b = color & 31;
+
+	rgb[0] = r << 3 | r >> 2;
+	rgb[1] = g << 2 | g >> 4;
+	rgb[2] = b << 3 | b >> 2;
+}
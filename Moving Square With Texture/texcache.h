@@ -0,0 +1,64 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <stddef.h>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "atlas.h"
+
+#define TEXCACHE_VERSION	1	// bump when the layout changes, older files are then rebuilt
+#define TEXCACHE_PATH_LENGTH	512
+
+enum texCacheFormats { TEXCACHE_RGBA, TEXCACHE_BC1, TEXCACHE_BC3 };
+
+// Start of a cache file. The sprite table follows it, then every mip level of the texture array from 0 down to 1x1,
+// each level holding all the pages back to back, exactly as glTexImage3D or glCompressedTexImage3D takes it.
+struct s_texCacheHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned long long key;	// hash of the source images and the settings they were packed with
+	unsigned int format;
+	unsigned int pageSize;
+	unsigned int pageCount;
+	unsigned int levelCount;
+	unsigned int spriteCount;
+	unsigned int dataOffset;	// where level 0 starts, from the start of the file
+};
+
+struct s_texCacheSprite {
+	char name[ATLAS_NAME_LENGTH];
+	int page;
+	int x, y, width, height;
+};
+
+// A packed and mipmapped atlas saved the way the gpu takes it, so a later run maps the file and uploads it
+// without decoding, packing or generating mipmaps. The file name is the key, so different sets of images and
+// formats each get their own file.
+struct s_textureCache {
+	const unsigned char *data;
+	size_t size;
+	const struct s_texCacheHeader *header;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+};
+
+//hashes the contents and names of the files along with everything else that changes the cached texture
+unsigned long long hashTextureSources(char **files, int fileCount, int pageSize, enum texCacheFormats format);
+//maps the cache file for key in directory. Returns 0 if there is none or it is stale.
+int openTextureCache(struct s_textureCache *cache, const char *directory, unsigned long long key);
+//fills an empty atlas with the cached sprites and uploads every level. Returns the texture array, or 0 and leaves the atlas empty.
+GLuint loadTextureCache(const struct s_textureCache *cache, struct s_atlas *atlas);
+//unmaps the file
+void closeTextureCache(struct s_textureCache *cache);
+//reads every level of the atlas texture back and writes it to directory as key, compressed to format. Returns 0 on failure.
+int writeTextureCache(const char *directory, unsigned long long key, const struct s_atlas *atlas, enum texCacheFormats format);
+//returns the format called rgba, bc1 or bc3, or -1
+int parseTextureCacheFormat(const char *name);
+//whether the gl driver can upload format
+int textureCacheFormatSupported(enum texCacheFormats format);
+
+#endif
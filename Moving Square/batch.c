@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "glstate.h"
+#include "arena.h"
+
+#define QUAD_BYTES	(sizeof(struct s_quadVertex) * 4)
+
+#if QUAD_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+const struct s_vertexLayout g_quadVertexLayout = { "quad compact", sizeof(struct s_quadVertex), 0, 2, {
+	{ "position", 2, GL_SHORT, GL_TRUE, GL_FALSE, offsetof(struct s_quadVertex, x) },
+	{ "vertexColor", 4, GL_UNSIGNED_BYTE, GL_TRUE, GL_FALSE, offsetof(struct s_quadVertex, r) } } };
+#else
+const struct s_vertexLayout g_quadVertexLayout = { "quad float", sizeof(struct s_quadVertex), 0, 2, {
+	{ "position", 2, GL_FLOAT, GL_FALSE, GL_FALSE, offsetof(struct s_quadVertex, x) },
+	{ "vertexColor", 4, GL_UNSIGNED_BYTE, GL_TRUE, GL_FALSE, offsetof(struct s_quadVertex, r) } } };
+#endif
+
+static void mapBatch(struct s_batch *batch, int wantQuads);
+static void packPosition(struct s_quadVertex *vertex, GLfloat x, GLfloat y);
+static void storeQuad(struct s_quadVertex *vertex, const struct s_quadVertex *quad, unsigned char *dirty);
+
+int initBatch(struct s_batch *batch, GLuint shaderProgram, int maxQuads, enum streamModes mode, enum quadIndexModes indexMode)
+{
+	GLuint *indices;
+	int indexCount = quadIndexCount(indexMode, maxQuads);
+
+	batch->maxQuads = maxQuads;
+	batch->indexMode = indexMode;
+	batch->quadCount = 0;
+	batch->capacity = 0;
+	batch->vertices = NULL;
+	batch->dirty = NULL;
+	batch->residentQuads = 0;
+	batch->drawCalls = 0;
+	batch->quadsDrawn = 0;
+	indices = allocHeap(sizeof(GLuint) * indexCount);
+	if (indices == NULL)
+	{
+		fprintf(stderr, "Failed to allocate batch for %d quads\n", maxQuads);
+		return 0;
+	}
+	buildQuadIndices(indexMode, maxQuads, indices);
+
+	glGenVertexArrays(1, &batch->vao);
+	stateBindVertexArray(batch->vao);
+
+	// Each region of the ring holds one full batch, a resident buffer tracks changes a quad at a time.
+	if (!initStreamBuffer(&batch->stream, QUAD_BYTES * maxQuads, mode, QUAD_BYTES))
+	{
+		freeHeap(indices);
+		stateDeleteVertexArrays(1, &batch->vao);
+		return 0;
+	}
+
+	// The element buffer never changes, so it is uploaded once here.
+	glGenBuffers(1, &batch->ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indexCount, indices, GL_STATIC_DRAW);
+	freeHeap(indices);
+
+	// The restart index is checked before base vertex is added, so the one buffer ends strips wherever the batch lands.
+	if (indexMode == QUAD_INDEX_STRIP)
+	{
+		stateEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(QUAD_RESTART_INDEX);
+	}
+
+	// The stream buffer is still bound to GL_ARRAY_BUFFER, the attributes read from it.
+	applyVertexLayout(&g_quadVertexLayout, shaderProgram);
+
+	stateBindVertexArray(0);
+
+	return 1;
+}
+
+void addBatchQuads(struct s_batch *batch, const struct s_polyF4 *prims, int count)
+{
+	int done = 0;
+	int reserved;
+
+	while (done < count)
+	{
+		struct s_quadVertex *vertices = reserveBatchQuads(batch, count - done, &reserved);
+		packBatchQuads(&prims[done], reserved, vertices, batch->dirty != NULL ? batch->dirty + batch->quadCount : NULL);
+		commitBatchQuads(batch, reserved);
+		done += reserved;
+	}
+}
+
+void addBatchSoA(struct s_batch *batch, const struct s_primSoA *soa)
+{
+	struct s_primSoA slice;
+	int done = 0;
+	int reserved;
+
+	while (done < soa->count)
+	{
+		struct s_quadVertex *vertices = reserveBatchQuads(batch, soa->count - done, &reserved);
+		slicePrimSoA(soa, done, done + reserved, &slice);
+		packBatchSoA(&slice, vertices, batch->dirty != NULL ? batch->dirty + batch->quadCount : NULL);
+		commitBatchQuads(batch, reserved);
+		done += reserved;
+	}
+}
+
+void addBatchVertices(struct s_batch *batch, const struct s_quadVertex *vertices, int count)
+{
+	int done = 0;
+	int reserved;
+	int i;
+
+	while (done < count)
+	{
+		struct s_quadVertex *mapped = reserveBatchQuads(batch, count - done, &reserved);
+		if (batch->dirty != NULL)
+		{
+			for (i = 0; i < reserved; i++)
+			{
+				storeQuad(&mapped[i * 4], &vertices[(done + i) * 4], &batch->dirty[batch->quadCount + i]);
+			}
+		}
+		else
+		{
+			memcpy(mapped, &vertices[done * 4], QUAD_BYTES * reserved);
+		}
+		commitBatchQuads(batch, reserved);
+		done += reserved;
+	}
+}
+
+struct s_quadVertex *reserveBatchQuads(struct s_batch *batch, int count, int *reserved)
+{
+	if (batch->vertices == NULL || batch->quadCount == batch->capacity)
+	{
+		flushBatch(batch);
+		mapBatch(batch, count);
+	}
+	*reserved = batch->capacity - batch->quadCount < count ? batch->capacity - batch->quadCount : count;
+	return &batch->vertices[batch->quadCount * 4];
+}
+
+void commitBatchQuads(struct s_batch *batch, int count)
+{
+	batch->quadCount += count;
+}
+
+void packBatchQuads(const struct s_polyF4 *prims, int count, struct s_quadVertex *vertices, unsigned char *dirty)
+{
+	struct s_quadVertex quad[4];
+	int i;
+	int k;
+
+	for (i = 0; i < count; i++)
+	{
+		const struct s_polyF4 *f4 = &prims[i];
+		struct s_quadVertex *vertex = dirty != NULL ? quad : &vertices[i * 4];
+
+		// Flat shaded, every corner gets the primitive's color.
+		packPosition(&vertex[0], f4->x0, f4->y0);
+		packPosition(&vertex[1], f4->x1, f4->y1);
+		packPosition(&vertex[2], f4->x2, f4->y2);
+		packPosition(&vertex[3], f4->x3, f4->y3);
+		for (k = 0; k < 4; k++)
+		{
+			vertex[k].r = f4->r0;
+			vertex[k].g = f4->g0;
+			vertex[k].b = f4->b0;
+			vertex[k].a = 255;
+		}
+		if (dirty != NULL)
+		{
+			storeQuad(&vertices[i * 4], quad, &dirty[i]);
+		}
+	}
+}
+
+void packBatchSoA(const struct s_primSoA *soa, struct s_quadVertex *vertices, unsigned char *dirty)
+{
+	struct s_quadVertex quad[4];
+	int i;
+	int k;
+
+	for (i = 0; i < soa->count; i++)
+	{
+		struct s_quadVertex *vertex = dirty != NULL ? quad : &vertices[i * 4];
+		for (k = 0; k < 4; k++)
+		{
+			packPosition(&vertex[k], soa->x[k][i], soa->y[k][i]);
+			vertex[k].r = soa->r[i];
+			vertex[k].g = soa->g[i];
+			vertex[k].b = soa->b[i];
+			vertex[k].a = 255;
+		}
+		if (dirty != NULL)
+		{
+			storeQuad(&vertices[i * 4], quad, &dirty[i]);
+		}
+	}
+}
+
+void flushBatch(struct s_batch *batch)
+{
+	if (batch->quadCount == 0)
+	{
+		return;
+	}
+
+	unmapStream(&batch->stream, QUAD_BYTES * batch->quadCount);
+
+	// The indices always start at quad 0, base vertex moves them to where this batch landed in the ring.
+	stateBindVertexArray(batch->vao);
+	glDrawElementsBaseVertex(quadIndexPrimitive(batch->indexMode), quadIndexCount(batch->indexMode, batch->quadCount), GL_UNSIGNED_INT, 0,
+		(GLint)(batch->baseOffset / sizeof(struct s_quadVertex)));
+
+	batch->drawCalls++;
+	batch->quadsDrawn += batch->quadCount;
+	batch->quadCount = 0;
+	batch->capacity = 0;
+	batch->vertices = NULL;
+	batch->dirty = NULL;
+}
+
+void endBatchFrame(struct s_batch *batch)
+{
+	flushBatch(batch);
+	endStreamFrame(&batch->stream);
+}
+
+void resetBatchStats(struct s_batch *batch)
+{
+	batch->drawCalls = 0;
+	batch->quadsDrawn = 0;
+}
+
+void freeBatch(struct s_batch *batch)
+{
+	if (batch->indexMode == QUAD_INDEX_STRIP)
+	{
+		stateDisable(GL_PRIMITIVE_RESTART);
+	}
+	stateDeleteBuffers(1, &batch->ebo);
+	freeStreamBuffer(&batch->stream);
+	stateDeleteVertexArrays(1, &batch->vao);
+	batch->vertices = NULL;
+}
+
+// Maps room for up to wantQuads quads, fewer if the batch or the stream region can't hold them all.
+static void mapBatch(struct s_batch *batch, int wantQuads)
+{
+	GLsizeiptr available;
+
+	if (wantQuads > batch->maxQuads)
+	{
+		wantQuads = batch->maxQuads;
+	}
+	batch->vertices = mapStream(&batch->stream, QUAD_BYTES * wantQuads, &available, &batch->baseOffset);
+	batch->capacity = (int)(available / QUAD_BYTES);
+	if (batch->capacity > batch->maxQuads)
+	{
+		batch->capacity = batch->maxQuads;
+	}
+	batch->dirty = streamDirtyFlags(&batch->stream, batch->baseOffset);
+}
+
+// Same as packSnorm16, but static so it inlines into the pack loops, which run over every vertex every frame.
+static void packPosition(struct s_quadVertex *vertex, GLfloat x, GLfloat y)
+{
+#if QUAD_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+	x = x < -1.0f ? -1.0f : x > 1.0f ? 1.0f : x;
+	y = y < -1.0f ? -1.0f : y > 1.0f ? 1.0f : y;
+	vertex->x = (GLshort)(x * 32767.0f + (x < 0.0f ? -0.5f : 0.5f));
+	vertex->y = (GLshort)(y * 32767.0f + (y < 0.0f ? -0.5f : 0.5f));
+#else
+	vertex->x = x;
+	vertex->y = y;
+#endif
+}
+
+// Writes a packed quad over the resident one only if it differs, so a quad that didn't move isn't uploaded again.
+static void storeQuad(struct s_quadVertex *vertex, const struct s_quadVertex *quad, unsigned char *dirty)
+{
+	if (memcmp(vertex, quad, QUAD_BYTES) != 0)
+	{
+		memcpy(vertex, quad, QUAD_BYTES);
+		*dirty = 1;
+	}
+}
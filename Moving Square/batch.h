@@ -0,0 +1,79 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "primitive.h"
+#include "primsoa.h"
+#include "quadindex.h"
+#include "stream.h"
+#include "vertexformat.h"
+
+// Build with -DQUAD_VERTEX_FORMAT=VERTEX_FORMAT_FLOAT for the float positions, to compare the two.
+#ifndef QUAD_VERTEX_FORMAT
+#define QUAD_VERTEX_FORMAT	VERTEX_FORMAT_COMPACT
+#endif
+
+// One vertex of a batched quad, position followed by a packed RGBA color.
+// The compact position is a normalized short, 8 bytes a vertex instead of 12. It clamps to the screen, which
+// doesn't change what is drawn, the quads are flat colored so only their part on the screen can show.
+struct s_quadVertex {
+#if QUAD_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+	GLshort x, y;
+#else
+	GLfloat x, y;
+#endif
+	GLubyte r, g, b, a;
+};
+
+// How gl reads s_quadVertex, for the format it was built with.
+extern const struct s_vertexLayout g_quadVertexLayout;
+
+// Collects many s_polyF4 quads into one vertex stream and draws them with a single glDrawElements call.
+// The index buffer is built once for maxQuads quads, as a list or as strips, so only the vertices are sent every frame,
+// four a quad, through the stream ring buffer.
+// With a resident stream the vertices stay in the buffer between frames, packing compares each quad with what is already
+// there and only the quads that changed are marked in dirty and uploaded.
+struct s_batch {
+	GLuint vao;
+	GLuint ebo;
+	struct s_streamBuffer stream;
+	struct s_quadVertex *vertices;	// where the next quad is packed, NULL until mapped
+	GLintptr baseOffset;	// offset of vertices in the stream buffer
+	int capacity;	// quads that fit in the current mapping
+	int maxQuads;
+	enum quadIndexModes indexMode;
+	int quadCount;
+	unsigned char *dirty;	// resident stream, a flag for each quad of vertices, NULL otherwise
+	int residentQuads;	// quads from 0 on the resident buffer holds packed from the last frame, they can be drawn as they are
+	// stats, cleared with resetBatchStats
+	unsigned long drawCalls;
+	unsigned long quadsDrawn;
+};
+
+//creates the buffers for the batch, the attributes of g_quadVertexLayout are looked up in shaderProgram.
+//With QUAD_INDEX_STRIP it turns on primitive restart. Returns 0 on failure.
+int initBatch(struct s_batch *batch, GLuint shaderProgram, int maxQuads, enum streamModes mode, enum quadIndexModes indexMode);
+//packs count quads into the batch, flushing whenever the batch fills up
+void addBatchQuads(struct s_batch *batch, const struct s_polyF4 *prims, int count);
+//packs every primitive of the struct of arrays store into the batch
+void addBatchSoA(struct s_batch *batch, const struct s_primSoA *soa);
+//copies count quads already packed, four vertices each, into the batch
+void addBatchVertices(struct s_batch *batch, const struct s_quadVertex *vertices, int count);
+//maps room for count quads in one go and returns where the next quad goes, so they can be packed from several threads.
+//reserved is set to how many fit, it is less than count only when the stream region is smaller than the batch.
+struct s_quadVertex *reserveBatchQuads(struct s_batch *batch, int count, int *reserved);
+//counts count quads written to the reserved room as part of the batch
+void commitBatchQuads(struct s_batch *batch, int count);
+//packs count quads into vertices, four per quad. With dirty only the quads that differ are written, and their flags set.
+void packBatchQuads(const struct s_polyF4 *prims, int count, struct s_quadVertex *vertices, unsigned char *dirty);
+//packs every primitive of the store into vertices, four per primitive, dirty as for packBatchQuads
+void packBatchSoA(const struct s_primSoA *soa, struct s_quadVertex *vertices, unsigned char *dirty);
+//uploads the packed quads and draws them with one indexed draw call
+void flushBatch(struct s_batch *batch);
+//call once all of the frame's quads are flushed, so the next frame streams into a free region
+void endBatchFrame(struct s_batch *batch);
+//clears the draw call and quad counters
+void resetBatchStats(struct s_batch *batch);
+//deletes the buffers
+void freeBatch(struct s_batch *batch);
+
+#endif
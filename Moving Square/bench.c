@@ -0,0 +1,981 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "primitive.h"
+#include "primsoa.h"
+#include "input.h"
+#include "grid.h"
+#include "update.h"
+#include "raster.h"
+#include "ordertable.h"
+#include "primtypes.h"
+#include "quadindex.h"
+#include "batch.h"
+#include "thread.h"
+#include "timer.h"
+
+// Micro-benchmarks for the cpu side of the render loop, run with the names of the benchmarks to run or none for all of them.
+
+// Roughly how many primitive updates each measurement does, so small counts loop more.
+#define BENCH_WORK	200000000.0
+#define BENCH_EVENTS	20000000	// events each input queue stress run pushes
+#define BENCH_RASTER_WIDTH	640	// the example's screen, so the fill rates are the ones it gets
+#define BENCH_RASTER_HEIGHT	480
+#define BENCH_PRIM_RUN	64	// primitives of a type added one after another, in the primtypes streams that aren't shuffled
+
+// One stress run of the input queue, the producer thread pushes and the main thread pops.
+struct s_queueStress {
+	struct s_inputQueue queue;
+	unsigned int events;
+	int burst;	// events pushed each millisecond without retrying, 0 pushes flat out and retries when full
+	unsigned long retries;	// pushes flat out that found the queue full and were tried again, the queue counts them as dropped too
+	volatile unsigned int done;	// set by the producer once it has pushed everything
+};
+
+struct s_benchmark {
+	const char *name;
+	void (*run)(void);
+};
+
+static int benchIterations(int count);
+static void benchMove(void);
+static void benchInputQueue(void);
+static void produceInputEvents(void *arg);
+static void benchGrid(void);
+static GLfloat benchRandom(unsigned int *state);
+static void benchJobs(void);
+static void benchRaster(void);
+static void benchOrderTable(void);
+static int compareDepths(const void *a, const void *b);
+static void benchPrimTypes(void);
+static int convertBenchPrim(const void *prim, struct s_primVertex *vertices);
+static void convertBenchF4(const struct s_polyF4 *f4, struct s_primVertex *vertices);
+static void setBenchVertex(struct s_primVertex *vertex, GLfloat x, GLfloat y, const unsigned char *rgb, unsigned char u, unsigned char v);
+static void benchQuadIndices(void);
+
+static const struct s_benchmark g_benchmarks[] = {
+	{ "move", benchMove },
+	{ "inputqueue", benchInputQueue },
+	{ "grid", benchGrid },
+	{ "jobs", benchJobs },
+	{ "raster", benchRaster },
+	{ "ordertable", benchOrderTable },
+	{ "primtypes", benchPrimTypes },
+	{ "quadindex", benchQuadIndices },
+};
+
+int main(int argc, char **argv)
+{
+	int count = sizeof(g_benchmarks) / sizeof(g_benchmarks[0]);
+	int i;
+	int j;
+
+	for (i = 0; i < count; i++)
+	{
+		int selected = argc < 2;
+		for (j = 1; j < argc; j++)
+		{
+			selected = selected || strcmp(argv[j], g_benchmarks[i].name) == 0;
+		}
+		if (selected)
+		{
+			g_benchmarks[i].run();
+		}
+	}
+
+	return 0;
+}
+
+static int benchIterations(int count)
+{
+	int iterations = (int)(BENCH_WORK / count);
+	return iterations < 3 ? 3 : iterations;
+}
+
+// movePrimitive on an array of structs against movePrimSoA with each kernel.
+static void benchMove(void)
+{
+	static const int sizes[] = { 1000, 100000, 10000000 };
+	static const enum soaKernels kernels[] = { SOA_KERNEL_SCALAR, SOA_KERNEL_SSE, SOA_KERNEL_AVX2 };
+	int s;
+	int k;
+	int i;
+	int j;
+
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		int count = sizes[s];
+		int iterations = benchIterations(count);
+		struct s_polyF4 *prims = malloc(sizeof(struct s_polyF4) * count);
+		struct s_primSoA soa;
+
+		if (prims == NULL)
+		{
+			fprintf(stderr, "Failed to allocate %d primitives\n", count);
+			return;
+		}
+		genPrimitiveGrid(prims, count);
+
+		// Moving diagonally exercises both axes and wraps every so often.
+		double start = timerNow();
+		for (i = 0; i < iterations; i++)
+		{
+			for (j = 0; j < count; j++)
+			{
+				movePrimitive(&prims[j], UPRIGHT);
+			}
+		}
+		double aosSeconds = timerNow() - start;
+		printf("move prims: %d kernel: %-6s ns/prim: %.3f Mprims/s: %.1f\n",
+			count, "aos", aosSeconds * 1e9 / ((double)count * iterations), (double)count * iterations / aosSeconds / 1e6);
+
+		for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++)
+		{
+			enum soaKernels kernel = selectSoAKernel(kernels[k]);
+			struct s_polyF4 check;
+			GLfloat error = 0.0f;
+
+			if (kernel != kernels[k])
+			{
+				printf("move prims: %d kernel: %-6s not supported\n", count, soaKernelName(kernels[k]));
+				continue;
+			}
+
+			if (!initPrimSoA(&soa, count))
+			{
+				fprintf(stderr, "Failed to allocate %d primitives\n", count);
+				break;
+			}
+			genPrimitiveGrid(prims, count);
+			for (j = 0; j < count; j++)
+			{
+				addPrimSoA(&soa, &prims[j]);
+			}
+
+			start = timerNow();
+			for (i = 0; i < iterations; i++)
+			{
+				movePrimSoA(&soa, UPRIGHT);
+			}
+			double seconds = timerNow() - start;
+
+			// Run the same moves through movePrimitive and make sure both ended up in the same place.
+			for (i = 0; i < iterations; i++)
+			{
+				for (j = 0; j < count; j++)
+				{
+					movePrimitive(&prims[j], UPRIGHT);
+				}
+			}
+			for (j = 0; j < count; j++)
+			{
+				getPrimSoA(&soa, j, &check);
+				error = fmaxf(error, fabsf(check.x0 - prims[j].x0));
+				error = fmaxf(error, fabsf(check.y3 - prims[j].y3));
+			}
+
+			printf("move prims: %d kernel: %-6s ns/prim: %.3f Mprims/s: %.1f speedup: %.2fx max error: %g\n",
+				count, soaKernelName(kernel), seconds * 1e9 / ((double)count * iterations), (double)count * iterations / seconds / 1e6,
+				aosSeconds / seconds, error);
+			freePrimSoA(&soa);
+		}
+
+		free(prims);
+	}
+	selectSoAKernel(SOA_KERNEL_AVX2);
+}
+
+// Pushes synthetic key events through the input queue from another thread and checks every one arrives, in order and intact.
+// Flat out shows the most the queue moves, the bursts are far faster than any keyboard but drained once a millisecond like a sim tick.
+// The biggest burst is a quarter of the ring, so a drain can run a few milliseconds late without the ring filling up.
+// Any event dropped fails the run, in bursts as much as flat out.
+static void benchInputQueue(void)
+{
+	static const int bursts[] = { 0, INPUT_QUEUE_SIZE / 8, INPUT_QUEUE_SIZE / 4 };
+	static struct s_queueStress stress;
+	struct s_thread producer;
+	struct s_inputEvent event;
+	int b;
+
+	for (b = 0; b < (int)(sizeof(bursts) / sizeof(bursts[0])); b++)
+	{
+		unsigned int received = 0;
+		unsigned int wrong = 0;
+		double expected = -1.0;
+
+		initInputQueue(&stress.queue);
+		stress.events = bursts[b] > 0 ? BENCH_EVENTS / 200 : BENCH_EVENTS;
+		stress.burst = bursts[b];
+		stress.retries = 0;
+		stress.done = 0;
+
+		double start = timerNow();
+		if (!startThread(&producer, produceInputEvents, &stress))
+		{
+			fprintf(stderr, "Failed to start the producer thread\n");
+			return;
+		}
+		for (;;)
+		{
+			int finished = loadAcquire(&stress.done);
+
+			// The time is the index the producer pushed it at, so a gap means an event went missing.
+			while (popInputEvent(&stress.queue, 1e300, &event))
+			{
+				unsigned int index = (unsigned int)event.time;
+				if (event.time <= expected || event.sequence != received ||
+					event.key != index % KEY_COUNT || event.action != ((index / KEY_COUNT) & 1))
+				{
+					wrong++;
+				}
+				expected = event.time;
+				received++;
+			}
+			if (finished)
+			{
+				break;
+			}
+			// Yielding when empty keeps the run fair on a single cpu, where spinning would starve the producer.
+			sleepThread(stress.burst > 0 ? 1 : 0);
+		}
+		double seconds = timerNow() - start;
+		joinThread(&producer);
+
+		// Every event arrived in order with nothing wrong and nothing dropped but the pushes that were retried.
+		unsigned long dropped = stress.queue.dropped - stress.retries;
+		printf("inputqueue burst: %-4d events: %u received: %u dropped: %lu retries: %lu wrong: %u Mevents/s: %.2f %s\n",
+			stress.burst, stress.events, received, dropped, stress.retries, wrong, received / seconds / 1e6,
+			wrong == 0 && received == stress.events && dropped == 0 ? "ok" : "FAILED");
+	}
+}
+
+static void produceInputEvents(void *arg)
+{
+	struct s_queueStress *stress = arg;
+	unsigned int i;
+
+	for (i = 0; i < stress->events; i++)
+	{
+		enum inputKeys key = (enum inputKeys)(i % KEY_COUNT);
+		enum inputActions action = (enum inputActions)((i / KEY_COUNT) & 1);
+
+		if (stress->burst > 0)
+		{
+			if (i > 0 && i % stress->burst == 0)
+			{
+				sleepThread(1);
+			}
+			pushInputEvent(&stress->queue, key, action, (double)i);
+		}
+		else
+		{
+			// Flat out the producer waits for room, counting each push it has to try again.
+			while (!pushInputEvent(&stress->queue, key, action, (double)i))
+			{
+				stress->retries++;
+				sleepThread(0);
+			}
+		}
+	}
+	storeRelease(&stress->done, 1);
+}
+
+// The spatial grid against testing every pair, on quads scattered at random and sized so each overlaps about two others.
+// Both have to find the same pairs, visible set and picks.
+static void benchGrid(void)
+{
+	static const int sizes[] = { 10000, 100000 };
+	const struct s_gridBox view = { -0.5f, -0.5f, 0.5f, 0.5f };
+	const int steps = 10;
+	const int picks = 10000;
+	int s;
+	int i;
+	int j;
+
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		int count = sizes[s];
+		GLfloat size = sqrtf(2.0f / count);
+		unsigned int random = 1;
+		struct s_polyF4 *prims = malloc(sizeof(struct s_polyF4) * count);
+		int *visible = malloc(sizeof(int) * count);
+		struct s_primSoA soa;
+		struct s_spatialGrid grid;
+
+		if (prims == NULL || visible == NULL || !initPrimSoA(&soa, count))
+		{
+			fprintf(stderr, "Failed to allocate %d primitives\n", count);
+			free(prims);
+			free(visible);
+			return;
+		}
+		if (!initSpatialGrid(&grid, size * 2.0f, count))
+		{
+			fprintf(stderr, "Failed to allocate the grid for %d primitives\n", count);
+			freePrimSoA(&soa);
+			free(prims);
+			free(visible);
+			return;
+		}
+		for (i = 0; i < count; i++)
+		{
+			GLfloat left = -1.0f + benchRandom(&random) * (2.0f - size);
+			GLfloat bottom = -1.0f + benchRandom(&random) * (2.0f - size);
+			prims[i] = genPrimitive();
+			prims[i].x0 = prims[i].x1 = left;
+			prims[i].x2 = prims[i].x3 = left + size;
+			prims[i].y0 = prims[i].y2 = bottom;
+			prims[i].y1 = prims[i].y3 = bottom + size;
+			addPrimSoA(&soa, &prims[i]);
+		}
+
+		double start = timerNow();
+		updateSpatialGridSoA(&grid, &soa);
+		double buildSeconds = timerNow() - start;
+
+		// Keeping the grid current as everything moves a step.
+		double updateSeconds = 0.0;
+		long relinked = 0;
+		for (i = 0; i < steps; i++)
+		{
+			movePrimSoA(&soa, UPRIGHT);
+			start = timerNow();
+			updateSpatialGridSoA(&grid, &soa);
+			updateSeconds += timerNow() - start;
+			relinked += grid.relinked;
+		}
+
+		start = timerNow();
+		int pairCount = findGridPairs(&grid);
+		double pairSeconds = timerNow() - start;
+		unsigned long long pairSum = 0;
+		for (i = 0; i < pairCount; i++)
+		{
+			pairSum += (unsigned long long)grid.pairs[i].a * count + grid.pairs[i].b;
+		}
+
+		start = timerNow();
+		int visibleCount = cullSpatialGrid(&grid, &view, visible, count);
+		double cullSeconds = timerNow() - start;
+
+		unsigned int pickRandom = 7;
+		int picked[64];
+		long pickCount = 0;
+		start = timerNow();
+		for (i = 0; i < picks; i++)
+		{
+			GLfloat x = benchRandom(&pickRandom) * 2.0f - 1.0f;
+			GLfloat y = benchRandom(&pickRandom) * 2.0f - 1.0f;
+			pickCount += pickSpatialGrid(&grid, x, y, picked, 64);
+		}
+		double pickSeconds = timerNow() - start;
+
+		// The same queries by brute force, every pair of boxes and every box against the view and the points.
+		int brutePairs = 0;
+		unsigned long long bruteSum = 0;
+		start = timerNow();
+		for (i = 0; i < count; i++)
+		{
+			for (j = i + 1; j < count; j++)
+			{
+				if (gridBoxesOverlap(&grid.boxes[i], &grid.boxes[j]))
+				{
+					brutePairs++;
+					bruteSum += (unsigned long long)i * count + j;
+				}
+			}
+		}
+		double brutePairSeconds = timerNow() - start;
+
+		int bruteVisible = 0;
+		start = timerNow();
+		for (i = 0; i < count; i++)
+		{
+			bruteVisible += gridBoxesOverlap(&grid.boxes[i], &view);
+		}
+		double bruteCullSeconds = timerNow() - start;
+
+		long brutePicks = 0;
+		pickRandom = 7;
+		start = timerNow();
+		for (i = 0; i < picks; i++)
+		{
+			struct s_gridBox point;
+			point.minX = point.maxX = benchRandom(&pickRandom) * 2.0f - 1.0f;
+			point.minY = point.maxY = benchRandom(&pickRandom) * 2.0f - 1.0f;
+			for (j = 0; j < count; j++)
+			{
+				brutePicks += gridBoxesOverlap(&grid.boxes[j], &point);
+			}
+		}
+		double brutePickSeconds = timerNow() - start;
+
+		printf("grid prims: %d cells: %dx%d build ms: %.3f update ms: %.3f relinked: %.1f%%\n",
+			count, grid.columns, grid.rows, buildSeconds * 1000.0, updateSeconds * 1000.0 / steps, 100.0 * relinked / ((double)count * steps));
+		printf("grid prims: %d pairs: %d ms: %.3f brute ms: %.3f speedup: %.0fx %s\n",
+			count, pairCount, pairSeconds * 1000.0, brutePairSeconds * 1000.0, brutePairSeconds / pairSeconds,
+			pairCount == brutePairs && pairSum == bruteSum ? "ok" : "MISMATCH");
+		// The view covers a quarter of the field, so the cull is bound by the quarter it has to write out and the grid only
+		// saves testing the rest. Walking a quarter of the cell lists jumps around memory where brute force streams the boxes
+		// in order, so it isn't expected to win there and loses once the lists outgrow the cache. Picks touch one cell.
+		printf("grid prims: %d visible: %d ms: %.3f brute ms: %.3f speedup: %.2fx %s\n",
+			count, visibleCount, cullSeconds * 1000.0, bruteCullSeconds * 1000.0, bruteCullSeconds / cullSeconds,
+			visibleCount == bruteVisible ? "ok" : "MISMATCH");
+		printf("grid prims: %d picks: %d hits: %ld us/pick: %.3f brute us/pick: %.3f speedup: %.0fx %s\n",
+			count, picks, pickCount, pickSeconds * 1e6 / picks, brutePickSeconds * 1e6 / picks, brutePickSeconds / pickSeconds,
+			pickCount == brutePicks ? "ok" : "MISMATCH");
+
+		freeSpatialGrid(&grid);
+		freePrimSoA(&soa);
+		free(prims);
+		free(visible);
+	}
+}
+
+// Xorshift, so the scattered quads are the same every run. Returns 0 to 1.
+static GLfloat benchRandom(unsigned int *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return (*state & 0xffffff) / (GLfloat)0xffffff;
+}
+
+// Move and pack a million quads on 1 to every cpu's worth of job threads, the per frame cost should drop close to 1 / threads.
+// Every thread count has to pack exactly the same vertices as one thread does.
+static void benchJobs(void)
+{
+	const int count = 1000000;
+	const int frames = 50;
+	int maxThreads = cpuCount() < JOB_MAX_THREADS ? cpuCount() : JOB_MAX_THREADS;
+	struct s_polyF4 *prims = malloc(sizeof(struct s_polyF4) * count);
+	struct s_quadVertex *vertices = malloc(sizeof(struct s_quadVertex) * 4 * count);
+	struct s_quadVertex *expected = malloc(sizeof(struct s_quadVertex) * 4 * count);
+	struct s_primSoA soa;
+	struct s_jobSystem jobs;
+	struct s_updateJob job;
+	int useSoA;
+	int threads;
+	int i;
+	int f;
+
+	if (prims == NULL || vertices == NULL || expected == NULL || !initPrimSoA(&soa, count))
+	{
+		fprintf(stderr, "Failed to allocate %d primitives\n", count);
+		free(prims);
+		free(vertices);
+		free(expected);
+		return;
+	}
+
+	for (useSoA = 0; useSoA < 2; useSoA++)
+	{
+		double serialSeconds = 0.0;
+
+		// Powers of two, then every cpu if that isn't one.
+		for (threads = 1; threads <= maxThreads; threads = threads * 2 > maxThreads && threads < maxThreads ? maxThreads : threads * 2)
+		{
+			if (!initJobSystem(&jobs, threads))
+			{
+				fprintf(stderr, "Failed to start %d job threads\n", threads);
+				break;
+			}
+			genPrimitiveGrid(prims, count);
+			soa.count = 0;
+			for (i = 0; i < count; i++)
+			{
+				addPrimSoA(&soa, &prims[i]);
+			}
+
+			memset(&job, 0, sizeof(job));
+			job.prims = useSoA ? NULL : prims;
+			job.soa = useSoA ? &soa : NULL;
+			job.vertices = vertices;
+			job.input = UPRIGHT;
+			double start = timerNow();
+			for (f = 0; f < frames; f++)
+			{
+				runUpdateJob(&jobs, &job, count);
+			}
+			double seconds = timerNow() - start;
+
+			if (threads == 1)
+			{
+				serialSeconds = seconds;
+				memcpy(expected, vertices, sizeof(struct s_quadVertex) * 4 * count);
+			}
+			printf("jobs prims: %d layout: %s threads: %-2d ms/frame: %.3f speedup: %.2fx efficiency: %.0f%% steals/frame: %.1f %s\n",
+				count, useSoA ? "soa" : "aos", threads, seconds * 1000.0 / frames, serialSeconds / seconds,
+				100.0 * serialSeconds / seconds / threads, (double)jobs.steals / frames,
+				memcmp(expected, vertices, sizeof(struct s_quadVertex) * 4 * count) == 0 ? "ok" : "MISMATCH");
+			freeJobSystem(&jobs);
+
+			if (threads == maxThreads)
+			{
+				break;
+			}
+		}
+	}
+
+	freePrimSoA(&soa);
+	free(prims);
+	free(vertices);
+	free(expected);
+}
+
+// Draw the grid of quads with the software rasterizer on every job thread, with each edge test kernel the cpu supports.
+// Every kernel has to fill exactly the same pixels as the scalar one does.
+static void benchRaster(void)
+{
+	static const int counts[] = { 1000, 10000, 100000 };
+	const int frames = 50;
+	const int maxQuads = 100000;
+	struct s_polyF4 *prims = malloc(sizeof(struct s_polyF4) * maxQuads);
+	struct s_quadVertex *vertices = malloc(sizeof(struct s_quadVertex) * 4 * maxQuads);
+	unsigned int *expected = malloc(sizeof(unsigned int) * BENCH_RASTER_WIDTH * BENCH_RASTER_HEIGHT);
+	struct s_jobSystem jobs;
+	struct s_updateJob job;
+	struct s_raster raster;
+	struct s_arena arena;
+	int kernel;
+	int c;
+	int f;
+
+	if (prims == NULL || vertices == NULL || expected == NULL || !initArena(&arena, 0) || !initJobSystem(&jobs, 0))
+	{
+		fprintf(stderr, "Failed to set up %d quads to rasterize\n", maxQuads);
+		free(prims);
+		free(vertices);
+		free(expected);
+		return;
+	}
+
+	for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++)
+	{
+		int count = counts[c];
+
+		genPrimitiveGrid(prims, count);
+		memset(&job, 0, sizeof(job));
+		job.prims = prims;
+		job.vertices = vertices;
+		job.input = NONE;
+		runUpdateJob(&jobs, &job, count);
+
+		for (kernel = RASTER_KERNEL_SCALAR; kernel <= RASTER_KERNEL_AVX2; kernel++)
+		{
+			// Kernels the cpu doesn't support fall back to one it has already run.
+			if (selectRasterKernel((enum rasterKernels)kernel) != (enum rasterKernels)kernel)
+			{
+				continue;
+			}
+			if (!initRaster(&raster, BENCH_RASTER_WIDTH, BENCH_RASTER_HEIGHT))
+			{
+				fprintf(stderr, "Failed to set up a %dx%d raster\n", BENCH_RASTER_WIDTH, BENCH_RASTER_HEIGHT);
+				continue;
+			}
+			for (f = 0; f < frames; f++)
+			{
+				resetArena(&arena);
+				drawRasterQuads(&raster, &jobs, &arena, vertices, count);
+			}
+
+			if (kernel == RASTER_KERNEL_SCALAR)
+			{
+				memcpy(expected, raster.pixels, sizeof(unsigned int) * BENCH_RASTER_WIDTH * BENCH_RASTER_HEIGHT);
+			}
+			printf("raster quads: %-6d kernel: %-6s threads: %d ms/frame: %.3f Mpixels/sec: %.1f triangles/sec: %.0f pixels/frame: %lu %s\n",
+				count, rasterKernelName(raster.kernel), jobs.threadCount, raster.total.seconds * 1000.0 / frames,
+				raster.total.pixels / raster.total.seconds / 1000000.0, raster.total.triangles / raster.total.seconds,
+				raster.total.pixels / frames,
+				memcmp(expected, raster.pixels, sizeof(unsigned int) * BENCH_RASTER_WIDTH * BENCH_RASTER_HEIGHT) == 0 ? "ok" : "MISMATCH");
+			freeRaster(&raster);
+		}
+	}
+
+	freeJobSystem(&jobs);
+	freeArena(&arena);
+	free(prims);
+	free(vertices);
+	free(expected);
+}
+
+// The depths and base of the quads qsort is sorting, it has no argument to pass them through.
+static const int *g_benchDepths = NULL;
+static const struct s_polyF4 *g_benchPrims = NULL;
+
+// Sort quads at random depths into the ordering table and walk it, against qsort doing the same by comparing them.
+// Both have to give the same order: deepest first, and array order within a depth.
+static void benchOrderTable(void)
+{
+	static const int counts[] = { 10000, 100000, 1000000 };
+	const int maxCount = 1000000;
+	struct s_polyF4 *prims = malloc(sizeof(struct s_polyF4) * maxCount);
+	const struct s_polyF4 **order = malloc(sizeof(*order) * maxCount);
+	const struct s_polyF4 **expected = malloc(sizeof(*expected) * maxCount);
+	int *depths = malloc(sizeof(int) * maxCount);
+	struct s_orderTable table;
+	unsigned int random = 1;
+	int c;
+	int i;
+	int r;
+
+	if (prims == NULL || order == NULL || expected == NULL || depths == NULL || !initOrderTable(&table, ORDER_TABLE_LENGTH))
+	{
+		fprintf(stderr, "Failed to allocate %d primitives to sort\n", maxCount);
+		free(prims);
+		free(order);
+		free(expected);
+		free(depths);
+		return;
+	}
+
+	for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++)
+	{
+		int count = counts[c];
+		int iterations = benchIterations(count) / 100 + 3;
+
+		genPrimitiveGrid(prims, count);
+		for (i = 0; i < count; i++)
+		{
+			depths[i] = (int)(benchRandom(&random) * (ORDER_TABLE_LENGTH - 1));
+		}
+
+		double start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			clearOrderTable(&table);
+			for (i = count - 1; i >= 0; i--)
+			{
+				addOrderTablePrim(&table, depths[i], &prims[i]);
+			}
+			walkOrderTable(&table, order);
+		}
+		double tableSeconds = (timerNow() - start) / iterations;
+
+		g_benchDepths = depths;
+		g_benchPrims = prims;
+		start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			for (i = 0; i < count; i++)
+			{
+				expected[i] = &prims[i];
+			}
+			qsort(expected, count, sizeof(*expected), compareDepths);
+		}
+		double sortSeconds = (timerNow() - start) / iterations;
+
+		printf("ordertable prims: %-7d buckets: %d table ms: %.3f qsort ms: %.3f speedup: %.1fx %s\n", count, table.length,
+			tableSeconds * 1000.0, sortSeconds * 1000.0, sortSeconds / tableSeconds,
+			memcmp(order, expected, sizeof(*order) * count) == 0 ? "ok" : "MISMATCH");
+	}
+
+	freeOrderTable(&table);
+	free(prims);
+	free(order);
+	free(expected);
+	free(depths);
+}
+
+// Deepest first, then by where they are in the array.
+static int compareDepths(const void *a, const void *b)
+{
+	int i = (int)(*(const struct s_polyF4 *const *)a - g_benchPrims);
+	int j = (int)(*(const struct s_polyF4 *const *)b - g_benchPrims);
+
+	if (g_benchDepths[i] != g_benchDepths[j])
+	{
+		return g_benchDepths[i] > g_benchDepths[j] ? -1 : 1;
+	}
+	return i < j ? -1 : i > j;
+}
+
+// Any one primitive, so a mixed stream can sit in one array in the order it was made.
+union u_benchPrim {
+	struct s_polyF3 f3;
+	struct s_polyF4 f4;
+	struct s_polyG4 g4;
+	struct s_polyFT4 ft4;
+};
+
+// Converting a mixed stream of primitives to vertices, by switching on each one's code in the order they were made against
+// adding them to a s_primStream and running each type's generated emitter over its own array. On the F4s alone the
+// emitter is timed against convertPrimQuadVertices and against the same conversion written by hand. The emitters have to
+// give the vertices in the order the primitives were made, the same as the switch does.
+static void benchPrimTypes(void)
+{
+	static const int counts[] = { 10000, 100000, 1000000 };
+	const int maxCount = 1000000;
+	union u_benchPrim *prims = malloc(sizeof(union u_benchPrim) * maxCount);
+	struct s_polyF4 *quads = malloc(sizeof(struct s_polyF4) * maxCount);
+	GLfloat *positions = malloc(sizeof(GLfloat) * 12 * maxCount);
+	struct s_primVertex *vertices = malloc(sizeof(struct s_primVertex) * PRIM_VERTICES_QUAD * maxCount);
+	struct s_primVertex *expected = malloc(sizeof(struct s_primVertex) * PRIM_VERTICES_QUAD * maxCount);
+	struct s_primStream stream;
+	unsigned int random = 1;
+	int c;
+	int i;
+	int r;
+
+	if (prims == NULL || quads == NULL || positions == NULL || vertices == NULL || expected == NULL || !initPrimStream(&stream, maxCount))
+	{
+		fprintf(stderr, "Failed to allocate %d primitives to convert\n", maxCount);
+		free(prims);
+		free(quads);
+		free(positions);
+		free(vertices);
+		free(expected);
+		return;
+	}
+
+	// Each count shuffled, then in runs of BENCH_PRIM_RUN.
+	for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])) * 2; c++)
+	{
+		int count = counts[c / 2];
+		int runLength = c % 2 == 0 ? 1 : BENCH_PRIM_RUN;
+		int iterations = benchIterations(count) / 100 + 3;
+		int quadCount = 0;
+		int vertexCount = 0;
+		int type = PRIM_F3;
+
+		// A random type for each run, so the switch can't guess the next one when they are one long.
+		genPrimitiveGrid(quads, count);
+		clearPrimStream(&stream);
+		for (i = 0; i < count; i++)
+		{
+			const struct s_polyF4 *q = &quads[i];
+			union u_benchPrim *prim = &prims[i];
+			unsigned char shade = (unsigned char)i;
+
+			if (i % runLength == 0)
+			{
+				type = (int)(benchRandom(&random) * PRIM_TYPE_COUNT) % PRIM_TYPE_COUNT;
+			}
+			switch (type)
+			{
+			case PRIM_F3:
+				setPolyF3(&prim->f3);
+				prim->f3.r0 = shade;
+				prim->f3.x0 = q->x0; prim->f3.y0 = q->y0;
+				prim->f3.x1 = q->x1; prim->f3.y1 = q->y1;
+				prim->f3.x2 = q->x2; prim->f3.y2 = q->y2;
+				break;
+			case PRIM_F4:
+				setPolyF4(&prim->f4);
+				prim->f4.g0 = shade;
+				prim->f4.x0 = q->x0; prim->f4.y0 = q->y0;
+				prim->f4.x1 = q->x1; prim->f4.y1 = q->y1;
+				prim->f4.x2 = q->x2; prim->f4.y2 = q->y2;
+				prim->f4.x3 = q->x3; prim->f4.y3 = q->y3;
+				break;
+			case PRIM_G4:
+				setPolyG4(&prim->g4);
+				prim->g4.r0 = shade; prim->g4.g1 = shade; prim->g4.b2 = shade; prim->g4.r3 = 255;
+				prim->g4.x0 = q->x0; prim->g4.y0 = q->y0;
+				prim->g4.x1 = q->x1; prim->g4.y1 = q->y1;
+				prim->g4.x2 = q->x2; prim->g4.y2 = q->y2;
+				prim->g4.x3 = q->x3; prim->g4.y3 = q->y3;
+				break;
+			default:
+				setPolyFT4(&prim->ft4);
+				prim->ft4.b0 = shade;
+				prim->ft4.x0 = q->x0; prim->ft4.y0 = q->y0; prim->ft4.u0 = 0; prim->ft4.v0 = 0;
+				prim->ft4.x1 = q->x1; prim->ft4.y1 = q->y1; prim->ft4.u1 = 255; prim->ft4.v1 = 0;
+				prim->ft4.x2 = q->x2; prim->ft4.y2 = q->y2; prim->ft4.u2 = 0; prim->ft4.v2 = 255;
+				prim->ft4.x3 = q->x3; prim->ft4.y3 = q->y3; prim->ft4.u3 = 255; prim->ft4.v3 = 255;
+				break;
+			}
+			addPrimStream(&stream, prim);
+			if ((prim->f4.code & PRIM_CODE_MASK) == PRIM_CODE_F4)
+			{
+				quads[quadCount++] = prim->f4;
+			}
+		}
+
+		double start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			for (i = 0; i < quadCount; i++)
+			{
+				convertPrimQuadVertices(&quads[i], positions + i * 12);
+			}
+		}
+		double quadSeconds = (timerNow() - start) / iterations;
+
+		start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			for (i = 0; i < quadCount; i++)
+			{
+				convertBenchF4(&quads[i], vertices + i * PRIM_VERTICES_QUAD);
+			}
+		}
+		double handQuadSeconds = (timerNow() - start) / iterations;
+
+		start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			emitPolyF4(stream.primsF4, stream.countF4, vertices);
+		}
+		double emitQuadSeconds = (timerNow() - start) / iterations;
+
+		start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			vertexCount = 0;
+			for (i = 0; i < count; i++)
+			{
+				vertexCount += convertBenchPrim(&prims[i], expected + vertexCount);
+			}
+		}
+		double switchSeconds = (timerNow() - start) / iterations;
+
+		// Garbage first, so a vertex the emitters skipped can't match by being left over from the switch.
+		memset(vertices, 0xcd, sizeof(*vertices) * vertexCount);
+		start = timerNow();
+		for (r = 0; r < iterations; r++)
+		{
+			convertPrimStream(&stream, vertices);
+		}
+		double streamSeconds = (timerNow() - start) / iterations;
+
+		// The switch went through the primitives in the order they were made, the emitters have to end up the same.
+		int ok = vertexCount == primStreamVertices(&stream) && memcmp(vertices, expected, sizeof(*vertices) * vertexCount) == 0;
+
+		// convertPrimQuadVertices only writes positions, 48 bytes a quad against the 96 of s_primVertex, so it is the
+		// hand written conversion to s_primVertex that the F4 emitter has to match.
+		printf("primtypes prims: %-7d run: %-3d F4s: %-7d convertPrimQuadVertices ns/F4: %.2f (%d bytes) by hand ns/F4: %.2f (%d bytes) "
+			"emitPolyF4 ns/F4: %.2f (%d bytes)\n", count, runLength, quadCount, quadSeconds * 1e9 / quadCount, (int)sizeof(GLfloat) * 12,
+			handQuadSeconds * 1e9 / quadCount, (int)sizeof(struct s_primVertex) * PRIM_VERTICES_QUAD,
+			emitQuadSeconds * 1e9 / quadCount, (int)sizeof(struct s_primVertex) * PRIM_VERTICES_QUAD);
+		printf("primtypes prims: %-7d run: %-3d runs: %-7d mixed switch ns/prim: %.2f emitters ns/prim: %.2f speedup: %.2fx %s\n",
+			count, runLength, stream.runCount, switchSeconds * 1e9 / count, streamSeconds * 1e9 / count, switchSeconds / streamSeconds, ok ? "ok" : "MISMATCH");
+	}
+
+	freePrimStream(&stream);
+	free(prims);
+	free(quads);
+	free(positions);
+	free(vertices);
+	free(expected);
+}
+
+// Converts one primitive of any type the hand written way, deciding what it is from its code. Returns the vertices written.
+static int convertBenchPrim(const void *prim, struct s_primVertex *vertices)
+{
+	const union u_benchPrim *p = prim;
+
+	switch (p->f4.code & PRIM_CODE_MASK)
+	{
+	case PRIM_CODE_F3:
+		setBenchVertex(&vertices[0], p->f3.x0, p->f3.y0, &p->f3.r0, 0, 0);
+		setBenchVertex(&vertices[1], p->f3.x1, p->f3.y1, &p->f3.r0, 0, 0);
+		setBenchVertex(&vertices[2], p->f3.x2, p->f3.y2, &p->f3.r0, 0, 0);
+		return PRIM_VERTICES_TRI;
+	case PRIM_CODE_F4:
+		convertBenchF4(&p->f4, vertices);
+		return PRIM_VERTICES_QUAD;
+	case PRIM_CODE_G4:
+		setBenchVertex(&vertices[0], p->g4.x0, p->g4.y0, &p->g4.r0, 0, 0);
+		setBenchVertex(&vertices[1], p->g4.x1, p->g4.y1, &p->g4.r1, 0, 0);
+		setBenchVertex(&vertices[2], p->g4.x2, p->g4.y2, &p->g4.r2, 0, 0);
+		setBenchVertex(&vertices[3], p->g4.x2, p->g4.y2, &p->g4.r2, 0, 0);
+		setBenchVertex(&vertices[4], p->g4.x3, p->g4.y3, &p->g4.r3, 0, 0);
+		setBenchVertex(&vertices[5], p->g4.x1, p->g4.y1, &p->g4.r1, 0, 0);
+		return PRIM_VERTICES_QUAD;
+	case PRIM_CODE_FT4:
+		setBenchVertex(&vertices[0], p->ft4.x0, p->ft4.y0, &p->ft4.r0, p->ft4.u0, p->ft4.v0);
+		setBenchVertex(&vertices[1], p->ft4.x1, p->ft4.y1, &p->ft4.r0, p->ft4.u1, p->ft4.v1);
+		setBenchVertex(&vertices[2], p->ft4.x2, p->ft4.y2, &p->ft4.r0, p->ft4.u2, p->ft4.v2);
+		setBenchVertex(&vertices[3], p->ft4.x2, p->ft4.y2, &p->ft4.r0, p->ft4.u2, p->ft4.v2);
+		setBenchVertex(&vertices[4], p->ft4.x3, p->ft4.y3, &p->ft4.r0, p->ft4.u3, p->ft4.v3);
+		setBenchVertex(&vertices[5], p->ft4.x1, p->ft4.y1, &p->ft4.r0, p->ft4.u1, p->ft4.v1);
+		return PRIM_VERTICES_QUAD;
+	}
+	return 0;
+}
+
+// The F4 case of convertBenchPrim on its own, the hand written way to the same vertices as emitPolyF4.
+static void convertBenchF4(const struct s_polyF4 *f4, struct s_primVertex *vertices)
+{
+	setBenchVertex(&vertices[0], f4->x0, f4->y0, &f4->r0, 0, 0);
+	setBenchVertex(&vertices[1], f4->x1, f4->y1, &f4->r0, 0, 0);
+	setBenchVertex(&vertices[2], f4->x2, f4->y2, &f4->r0, 0, 0);
+	setBenchVertex(&vertices[3], f4->x2, f4->y2, &f4->r0, 0, 0);
+	setBenchVertex(&vertices[4], f4->x3, f4->y3, &f4->r0, 0, 0);
+	setBenchVertex(&vertices[5], f4->x1, f4->y1, &f4->r0, 0, 0);
+}
+
+// rgb points at a primitive's r, g and b, which are always next to each other.
+static void setBenchVertex(struct s_primVertex *vertex, GLfloat x, GLfloat y, const unsigned char *rgb, unsigned char u, unsigned char v)
+{
+	vertex->x = x;
+	vertex->y = y;
+	vertex->r = rgb[0];
+	vertex->g = rgb[1];
+	vertex->b = rgb[2];
+	vertex->a = 255;
+	vertex->u = u;
+	vertex->v = v;
+	vertex->pad[0] = 0;
+	vertex->pad[1] = 0;
+}
+
+// What a post-transform vertex cache makes of a large field of quads drawn three ways: six vertices a quad with no indices
+// as convertPrimQuadVertices gives them, the batch's four vertices indexed as a list, and as strips with restarts.
+// Without indices no vertex is ever reused, so it's run through the cache as a list of indices that never repeat.
+// The cache's hit rate means nothing for a strip, which reuses its last two vertices without looking them up, so what is
+// compared is the vertices shaded for each triangle drawn.
+// The quads share no corners, so any cache that holds one quad's vertices gets the same result and one size is enough.
+static void benchQuadIndices(void)
+{
+	static const int counts[] = { 10000, 1000000 };
+	const int cacheSize = 16;
+	const int maxCount = 1000000;
+	GLuint *indices = malloc(sizeof(GLuint) * 6 * maxCount);
+	int c;
+	int m;
+	int i;
+
+	if (indices == NULL)
+	{
+		fprintf(stderr, "Failed to allocate indices for %d quads\n", maxCount);
+		return;
+	}
+
+	for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++)
+	{
+		int count = counts[c];
+
+		for (m = -1; m < QUAD_INDEX_MODES; m++)
+		{
+			enum quadIndexModes mode = m < 0 ? QUAD_INDEX_LIST : (enum quadIndexModes)m;
+			int indexCount = quadIndexCount(mode, count);
+			int vertexBytes = (int)sizeof(struct s_quadVertex) * (m < 0 ? 6 : 4);
+			int indexBytes = m < 0 ? 0 : (int)sizeof(GLuint) * quadIndexCount(mode, 1);
+			struct s_vertexCacheStats stats;
+
+			if (m < 0)
+			{
+				for (i = 0; i < indexCount; i++)
+				{
+					indices[i] = (GLuint)i;
+				}
+			}
+			else
+			{
+				buildQuadIndices(mode, count, indices);
+			}
+
+			memset(&stats, 0, sizeof(stats));
+			simulateVertexCache(mode, indices, indexCount, cacheSize, &stats);
+			printf("quadindex quads: %-7d %-6s cache: %-2d bytes/quad: %d vertices %d indices shaded/triangle: %.2f shaded/quad: %.2f\n",
+				count, m < 0 ? "arrays" : quadIndexModeName(mode), cacheSize, vertexBytes, indexBytes,
+				(double)stats.misses / stats.triangles, (double)stats.misses / count);
+		}
+	}
+
+	free(indices);
+}
@@ -0,0 +1,364 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "grid.h"
+#include "arena.h"
+
+static GLfloat minOf(GLfloat a, GLfloat b);
+static GLfloat maxOf(GLfloat a, GLfloat b);
+static int gridCell(const struct s_spatialGrid *grid, GLfloat v, int cells);
+static struct s_gridSpan gridSpan(const struct s_spatialGrid *grid, const struct s_gridBox *box);
+static int spanIsLarge(const struct s_gridSpan *span);
+static int *spanHead(struct s_spatialGrid *grid, const struct s_gridSpan *span, int slot);
+static void linkNode(struct s_spatialGrid *grid, int *head, int node);
+static void unlinkNode(struct s_spatialGrid *grid, int *head, int node);
+static int addGridPair(struct s_spatialGrid *grid, int a, int b);
+
+int initSpatialGrid(struct s_spatialGrid *grid, GLfloat cellSize, int capacity)
+{
+	int i;
+
+	memset(grid, 0, sizeof(*grid));
+	grid->cellSize = cellSize;
+	grid->columns = (int)ceilf((GRID_MAX - GRID_MIN) / cellSize);
+	grid->rows = grid->columns;
+	grid->large = -1;
+
+	grid->cells = allocHeap(sizeof(int) * grid->columns * grid->rows);
+	grid->nodes = allocHeap(sizeof(struct s_gridNode) * GRID_SLOTS * capacity);
+	grid->boxes = allocHeap(sizeof(struct s_gridBox) * capacity);
+	grid->spans = allocHeap(sizeof(struct s_gridSpan) * capacity);
+	if (grid->cells == NULL || grid->nodes == NULL || grid->boxes == NULL || grid->spans == NULL)
+	{
+		freeSpatialGrid(grid);
+		return 0;
+	}
+
+	for (i = 0; i < grid->columns * grid->rows; i++)
+	{
+		grid->cells[i] = -1;
+	}
+	for (i = 0; i < capacity; i++)
+	{
+		grid->spans[i].x0 = -1;
+	}
+	grid->capacity = capacity;
+	return 1;
+}
+
+void updateGridBox(struct s_spatialGrid *grid, int index, const struct s_gridBox *box)
+{
+	struct s_gridSpan span = gridSpan(grid, box);
+	struct s_gridSpan *old = &grid->spans[index];
+	int slot;
+
+	grid->boxes[index] = *box;
+	if (index >= grid->count)
+	{
+		grid->count = index + 1;
+	}
+
+	// Most moves stay inside the same cells and only need the new bounds.
+	if (span.x0 == old->x0 && span.y0 == old->y0 && span.x1 == old->x1 && span.y1 == old->y1)
+	{
+		return;
+	}
+
+	for (slot = 0; slot < GRID_SLOTS && old->x0 >= 0; slot++)
+	{
+		int *head = spanHead(grid, old, slot);
+		if (head != NULL)
+		{
+			unlinkNode(grid, head, index * GRID_SLOTS + slot);
+		}
+	}
+	for (slot = 0; slot < GRID_SLOTS; slot++)
+	{
+		int *head = spanHead(grid, &span, slot);
+		if (head != NULL)
+		{
+			linkNode(grid, head, index * GRID_SLOTS + slot);
+		}
+	}
+	*old = span;
+	grid->relinked++;
+}
+
+void updateSpatialGrid(struct s_spatialGrid *grid, const struct s_polyF4 *prims, int count)
+{
+	struct s_gridBox box;
+	int i;
+
+	grid->relinked = 0;
+	for (i = 0; i < count; i++)
+	{
+		const struct s_polyF4 *f4 = &prims[i];
+		box.minX = minOf(minOf(f4->x0, f4->x1), minOf(f4->x2, f4->x3));
+		box.minY = minOf(minOf(f4->y0, f4->y1), minOf(f4->y2, f4->y3));
+		box.maxX = maxOf(maxOf(f4->x0, f4->x1), maxOf(f4->x2, f4->x3));
+		box.maxY = maxOf(maxOf(f4->y0, f4->y1), maxOf(f4->y2, f4->y3));
+		updateGridBox(grid, i, &box);
+	}
+}
+
+void updateSpatialGridSoA(struct s_spatialGrid *grid, const struct s_primSoA *soa)
+{
+	struct s_gridBox box;
+	int i;
+
+	grid->relinked = 0;
+	for (i = 0; i < soa->count; i++)
+	{
+		box.minX = minOf(minOf(soa->x[0][i], soa->x[1][i]), minOf(soa->x[2][i], soa->x[3][i]));
+		box.minY = minOf(minOf(soa->y[0][i], soa->y[1][i]), minOf(soa->y[2][i], soa->y[3][i]));
+		box.maxX = maxOf(maxOf(soa->x[0][i], soa->x[1][i]), maxOf(soa->x[2][i], soa->x[3][i]));
+		box.maxY = maxOf(maxOf(soa->y[0][i], soa->y[1][i]), maxOf(soa->y[2][i], soa->y[3][i]));
+		updateGridBox(grid, i, &box);
+	}
+}
+
+int findGridPairs(struct s_spatialGrid *grid)
+{
+	int cx, cy;
+	int a, b;
+
+	grid->pairCount = 0;
+	for (cy = 0; cy < grid->rows; cy++)
+	{
+		for (cx = 0; cx < grid->columns; cx++)
+		{
+			for (a = grid->cells[cy * grid->columns + cx]; a >= 0; a = grid->nodes[a].next)
+			{
+				const struct s_gridBox *boxA = &grid->boxes[a / GRID_SLOTS];
+				for (b = grid->nodes[a].next; b >= 0; b = grid->nodes[b].next)
+				{
+					const struct s_gridBox *boxB = &grid->boxes[b / GRID_SLOTS];
+					if (!gridBoxesOverlap(boxA, boxB))
+					{
+						continue;
+					}
+					// Two primitives can share up to four cells, the pair belongs to the one where their overlap starts.
+					if (gridCell(grid, maxOf(boxA->minX, boxB->minX), grid->columns) != cx ||
+						gridCell(grid, maxOf(boxA->minY, boxB->minY), grid->rows) != cy)
+					{
+						continue;
+					}
+					if (!addGridPair(grid, a / GRID_SLOTS, b / GRID_SLOTS))
+					{
+						return -1;
+					}
+				}
+			}
+		}
+	}
+
+	// Large primitives are checked against everything, a pair of them only from the lower index.
+	for (a = grid->large; a >= 0; a = grid->nodes[a].next)
+	{
+		int prim = a / GRID_SLOTS;
+		for (b = 0; b < grid->count; b++)
+		{
+			if (b == prim || grid->spans[b].x0 < 0 || (b < prim && spanIsLarge(&grid->spans[b])))
+			{
+				continue;
+			}
+			if (gridBoxesOverlap(&grid->boxes[prim], &grid->boxes[b]) && !addGridPair(grid, prim, b))
+			{
+				return -1;
+			}
+		}
+	}
+	return grid->pairCount;
+}
+
+int cullSpatialGrid(const struct s_spatialGrid *grid, const struct s_gridBox *view, int *visible, int max)
+{
+	struct s_gridSpan span = gridSpan(grid, view);
+	int total = 0;
+	int cx, cy;
+	int node;
+
+	for (cy = span.y0; cy <= span.y1; cy++)
+	{
+		for (cx = span.x0; cx <= span.x1; cx++)
+		{
+			// Everything in a cell off the span's border overlaps the view, only the border cells need the boxes.
+			int inside = cx > span.x0 && cx < span.x1 && cy > span.y0 && cy < span.y1;
+
+			for (node = grid->cells[cy * grid->columns + cx]; node >= 0; node = grid->nodes[node].next)
+			{
+				// Same as the pairs, only the cell where the primitive's overlap with the view starts lists it.
+				// That is the primitive's first cell unless the view starts further on, and the slot says whether this
+				// is its first column and row without looking at the box, see spanHead.
+				if (((node & 1) && cx != span.x0) || ((node & 2) && cy != span.y0))
+				{
+					continue;
+				}
+				if (!inside && !gridBoxesOverlap(&grid->boxes[node / GRID_SLOTS], view))
+				{
+					continue;
+				}
+				if (total < max)
+				{
+					visible[total] = node / GRID_SLOTS;
+				}
+				total++;
+			}
+		}
+	}
+
+	for (node = grid->large; node >= 0; node = grid->nodes[node].next)
+	{
+		if (gridBoxesOverlap(&grid->boxes[node / GRID_SLOTS], view))
+		{
+			if (total < max)
+			{
+				visible[total] = node / GRID_SLOTS;
+			}
+			total++;
+		}
+	}
+	return total;
+}
+
+int pickSpatialGrid(const struct s_spatialGrid *grid, GLfloat x, GLfloat y, int *picked, int max)
+{
+	struct s_gridBox point = { x, y, x, y };
+	int cell = gridCell(grid, y, grid->rows) * grid->columns + gridCell(grid, x, grid->columns);
+	int total = 0;
+	int pass;
+	int node;
+
+	// A primitive is only in a cell once, so the point's cell and the large list can't list anything twice.
+	for (pass = 0; pass < 2; pass++)
+	{
+		for (node = pass == 0 ? grid->cells[cell] : grid->large; node >= 0; node = grid->nodes[node].next)
+		{
+			if (gridBoxesOverlap(&grid->boxes[node / GRID_SLOTS], &point))
+			{
+				if (total < max)
+				{
+					picked[total] = node / GRID_SLOTS;
+				}
+				total++;
+			}
+		}
+	}
+	return total;
+}
+
+int gridBoxesOverlap(const struct s_gridBox *a, const struct s_gridBox *b)
+{
+	return a->minX <= b->maxX && b->minX <= a->maxX && a->minY <= b->maxY && b->minY <= a->maxY;
+}
+
+void freeSpatialGrid(struct s_spatialGrid *grid)
+{
+	freeHeap(grid->cells);
+	freeHeap(grid->nodes);
+	freeHeap(grid->boxes);
+	freeHeap(grid->spans);
+	freeHeap(grid->pairs);
+	memset(grid, 0, sizeof(*grid));
+}
+
+// Plain compares rather than fminf and fmaxf, which don't inline without -ffast-math and made the update 30 times slower.
+static GLfloat minOf(GLfloat a, GLfloat b)
+{
+	return a < b ? a : b;
+}
+
+static GLfloat maxOf(GLfloat a, GLfloat b)
+{
+	return a > b ? a : b;
+}
+
+static int gridCell(const struct s_spatialGrid *grid, GLfloat v, int cells)
+{
+	// Truncating rounds the small negatives just past GRID_MIN up to 0, which the clamp would do anyway.
+	int cell = (int)((v - GRID_MIN) / grid->cellSize);
+	return cell < 0 ? 0 : cell >= cells ? cells - 1 : cell;
+}
+
+static struct s_gridSpan gridSpan(const struct s_spatialGrid *grid, const struct s_gridBox *box)
+{
+	struct s_gridSpan span;
+
+	span.x0 = (short)gridCell(grid, box->minX, grid->columns);
+	span.y0 = (short)gridCell(grid, box->minY, grid->rows);
+	span.x1 = (short)gridCell(grid, box->maxX, grid->columns);
+	span.y1 = (short)gridCell(grid, box->maxY, grid->rows);
+	return span;
+}
+
+static int spanIsLarge(const struct s_gridSpan *span)
+{
+	return span->x1 - span->x0 > 1 || span->y1 - span->y0 > 1;
+}
+
+// The list slot of a primitive goes in, slot k covers the cell k & 1 across and k >> 1 up from the span's corner.
+// Returns NULL when the span doesn't reach that cell.
+static int *spanHead(struct s_spatialGrid *grid, const struct s_gridSpan *span, int slot)
+{
+	int cx = span->x0 + (slot & 1);
+	int cy = span->y0 + (slot >> 1);
+
+	if (spanIsLarge(span))
+	{
+		return slot == 0 ? &grid->large : NULL;
+	}
+	if (cx > span->x1 || cy > span->y1)
+	{
+		return NULL;
+	}
+	return &grid->cells[cy * grid->columns + cx];
+}
+
+static void linkNode(struct s_spatialGrid *grid, int *head, int node)
+{
+	grid->nodes[node].previous = -1;
+	grid->nodes[node].next = *head;
+	if (*head >= 0)
+	{
+		grid->nodes[*head].previous = node;
+	}
+	*head = node;
+}
+
+static void unlinkNode(struct s_spatialGrid *grid, int *head, int node)
+{
+	struct s_gridNode *n = &grid->nodes[node];
+
+	if (n->previous >= 0)
+	{
+		grid->nodes[n->previous].next = n->next;
+	}
+	else
+	{
+		*head = n->next;
+	}
+	if (n->next >= 0)
+	{
+		grid->nodes[n->next].previous = n->previous;
+	}
+}
+
+static int addGridPair(struct s_spatialGrid *grid, int a, int b)
+{
+	if (grid->pairCount == grid->pairCapacity)
+	{
+		int capacity = grid->pairCapacity > 0 ? grid->pairCapacity * 2 : 1024;
+		struct s_gridPair *pairs = reallocHeap(grid->pairs, sizeof(struct s_gridPair) * capacity);
+		if (pairs == NULL)
+		{
+			return 0;
+		}
+		grid->pairs = pairs;
+		grid->pairCapacity = capacity;
+	}
+	grid->pairs[grid->pairCount].a = a < b ? a : b;
+	grid->pairs[grid->pairCount].b = a < b ? b : a;
+	grid->pairCount++;
+	return 1;
+}
@@ -0,0 +1,75 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "primitive.h"
+#include "primsoa.h"
+
+// The area the primitives wrap around in, anything outside it goes in the edge cells.
+#define GRID_MIN	-1.0f
+#define GRID_MAX	1.0f
+#define GRID_SLOTS	4	// cells a primitive can be in, it is never bigger than a cell so it covers 2x2 at most
+
+// Bounds of a primitive.
+struct s_gridBox {
+	GLfloat minX, minY, maxX, maxY;
+};
+
+// Two primitives whose bounds overlap, a < b.
+struct s_gridPair {
+	int a, b;
+};
+
+// A primitive's place in one cell's list.
+struct s_gridNode {
+	int next;
+	int previous;
+};
+
+// Cells the primitive covers, inclusive. x0 is -1 before it is added.
+struct s_gridSpan {
+	short x0, y0, x1, y1;
+};
+
+// Uniform grid over the screen for broad phase queries on many moving primitives.
+// Each cell keeps a linked list of the primitives touching it. Updates only relink the primitives that crossed
+// into other cells, the rest just get their new bounds, so keeping it current is one pass with no sorting or rebuilding.
+// Primitives bigger than a cell go on a separate list that every query checks in full.
+struct s_spatialGrid {
+	int columns, rows;
+	GLfloat cellSize;
+	int *cells;	// first node of each cell's list, -1 when empty
+	int large;	// first node of the list of primitives bigger than a cell
+	struct s_gridNode *nodes;	// GRID_SLOTS per primitive, node index * GRID_SLOTS + slot
+	struct s_gridBox *boxes;
+	struct s_gridSpan *spans;
+	int count;
+	int capacity;
+
+	struct s_gridPair *pairs;	// filled by findGridPairs
+	int pairCount;
+	int pairCapacity;
+
+	// stats for the last update
+	int relinked;	// primitives that changed cells
+};
+
+//sets up a grid of cellSize cells for up to capacity primitives. Returns 0 on failure.
+int initSpatialGrid(struct s_spatialGrid *grid, GLfloat cellSize, int capacity);
+//sets the bounds of primitive index, moving it to other cells if it left its old ones
+void updateGridBox(struct s_spatialGrid *grid, int index, const struct s_gridBox *box);
+//updates every primitive from an array of quads
+void updateSpatialGrid(struct s_spatialGrid *grid, const struct s_polyF4 *prims, int count);
+//updates every primitive from a struct of arrays store
+void updateSpatialGridSoA(struct s_spatialGrid *grid, const struct s_primSoA *soa);
+//finds every pair of primitives whose bounds overlap into grid->pairs, each once. Returns the pair count, or -1 if it ran out of memory.
+int findGridPairs(struct s_spatialGrid *grid);
+//writes up to max primitives whose bounds overlap the box to visible, each once. Returns how many there are in total.
+int cullSpatialGrid(const struct s_spatialGrid *grid, const struct s_gridBox *view, int *visible, int max);
+//writes up to max primitives whose bounds hold the point to picked. Returns how many there are in total.
+int pickSpatialGrid(const struct s_spatialGrid *grid, GLfloat x, GLfloat y, int *picked, int max);
+//whether two boxes overlap, touching edges count
+int gridBoxesOverlap(const struct s_gridBox *a, const struct s_gridBox *b);
+//frees the cells and lists
+void freeSpatialGrid(struct s_spatialGrid *grid);
+
+#endif
@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "input.h"
+#include "thread.h"
+
+void initInputQueue(struct s_inputQueue *queue)
+{
+	memset(queue, 0, sizeof(*queue));
+}
+
+int pushInputEvent(struct s_inputQueue *queue, enum inputKeys key, enum inputActions action, double time)
+{
+	unsigned int tail = queue->tail;
+	struct s_inputEvent *event;
+
+	if (tail - loadAcquire(&queue->head) == INPUT_QUEUE_SIZE)
+	{
+		queue->dropped++;
+		return 0;
+	}
+
+	event = &queue->events[tail & (INPUT_QUEUE_SIZE - 1)];
+	event->time = time;
+	event->sequence = queue->sequence++;
+	event->key = (unsigned char)key;
+	event->action = (unsigned char)action;
+
+	// Publishing the tail after the event is written is what lets the consumer read it.
+	storeRelease(&queue->tail, tail + 1);
+	return 1;
+}
+
+int popInputEvent(struct s_inputQueue *queue, double until, struct s_inputEvent *event)
+{
+	unsigned int head = queue->head;
+	const struct s_inputEvent *next;
+
+	if (head == loadAcquire(&queue->tail))
+	{
+		return 0;
+	}
+
+	// Events later than until stay queued for the next tick.
+	next = &queue->events[head & (INPUT_QUEUE_SIZE - 1)];
+	if (next->time > until)
+	{
+		return 0;
+	}
+	*event = *next;
+
+	// The slot is only handed back once it has been copied out.
+	storeRelease(&queue->head, head + 1);
+	return 1;
+}
+
+void applyInputEvent(struct s_keyState *state, const struct s_inputEvent *event)
+{
+	unsigned int bit = 1u << event->key;
+
+	if (event->action == KEY_PRESS)
+	{
+		state->down |= bit;
+		state->pressed |= bit;
+	}
+	else
+	{
+		state->down &= ~bit;
+	}
+	state->lastEvent = event->time;
+}
+
+int drainInputQueue(struct s_inputQueue *queue, struct s_keyState *state, double until)
+{
+	struct s_inputEvent event;
+	int count = 0;
+
+	while (popInputEvent(queue, until, &event))
+	{
+		applyInputEvent(state, &event);
+		count++;
+	}
+	return count;
+}
+
+enum inputTypes decodeKeyState(struct s_keyState *state)
+{
+	unsigned int keys = state->down | state->pressed;
+	int up = (keys >> KEY_UP) & 1;
+	int down = (keys >> KEY_DOWN) & 1;
+	int left = (keys >> KEY_LEFT) & 1;
+	int right = (keys >> KEY_RIGHT) & 1;
+	int color = (state->pressed >> KEY_COLOR) & 1;
+
+	state->pressed = 0;
+
+	// Holding the color key doesn't keep changing it, only pressing it does.
+	if (color)
+	{
+		return CHANGE_COLOR;
+	}
+
+	// Opposite keys cancel out.
+	int vertical = up - down;
+	int horizontal = right - left;
+	if (vertical > 0)
+	{
+		return horizontal < 0 ? UPLEFT : horizontal > 0 ? UPRIGHT : UP;
+	}
+	if (vertical < 0)
+	{
+		return horizontal < 0 ? DOWNLEFT : horizontal > 0 ? DOWNRIGHT : DOWN;
+	}
+	return horizontal < 0 ? LEFT : horizontal > 0 ? RIGHT : NONE;
+}
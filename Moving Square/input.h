@@ -0,0 +1,54 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "primitive.h"
+
+#define INPUT_QUEUE_SIZE	256	// events, a power of two
+#define INPUT_CACHE_LINE	64
+
+// The keys the example reacts to, independent of glfw's key codes.
+enum inputKeys { KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_COLOR, KEY_COUNT };
+
+enum inputActions { KEY_RELEASE, KEY_PRESS };
+
+// One key going down or up, and when, on the timerNow clock.
+struct s_inputEvent {
+	double time;
+	unsigned int sequence;	// counts up from 0 for every event pushed, so the consumer can tell if any went missing
+	unsigned char key;
+	unsigned char action;
+};
+
+// Bounded ring of input events from one producer thread to one consumer thread, without locks.
+// Each side only writes its own index and reads the other's with acquire, so neither ever waits on the other.
+// The indices count up forever and are masked into the ring, so full and empty don't need a spare slot to tell apart.
+struct s_inputQueue {
+	struct s_inputEvent events[INPUT_QUEUE_SIZE];
+	volatile unsigned int head;	// next event to pop, written by the consumer
+	char headPadding[INPUT_CACHE_LINE - sizeof(unsigned int)];	// keeps the two indices off the same cache line
+	volatile unsigned int tail;	// next slot to push into, written by the producer
+	unsigned int sequence;	// producer only
+	unsigned long dropped;	// events pushed while the ring was full, producer only
+};
+
+// Which keys are held, built from the events. A key pressed and released before anyone looked still counts as pressed once.
+struct s_keyState {
+	unsigned int down;	// bit per inputKeys
+	unsigned int pressed;	// went down since the last decodeKeyState
+	double lastEvent;
+};
+
+//empties the queue
+void initInputQueue(struct s_inputQueue *queue);
+//producer side, adds a key event. Returns 0 and counts it as dropped when the queue is full.
+int pushInputEvent(struct s_inputQueue *queue, enum inputKeys key, enum inputActions action, double time);
+//consumer side, takes the oldest event if it happened at or before until. Returns 0 when there is none.
+int popInputEvent(struct s_inputQueue *queue, double until, struct s_inputEvent *event);
+//applies an event to the key state
+void applyInputEvent(struct s_keyState *state, const struct s_inputEvent *event);
+//applies every queued event up to until, returns how many there were
+int drainInputQueue(struct s_inputQueue *queue, struct s_keyState *state, double until);
+//the input the held keys make, a color press wins over moving. Clears the presses.
+enum inputTypes decodeKeyState(struct s_keyState *state);
+
+#endif
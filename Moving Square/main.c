@@ -1,6 +1,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -8,7 +10,23 @@
 // Include GLFW
 #include <GLFW/glfw3.h>
 
-#define GLSL(src) "#version 330 core\n" #src // Writing glsl shaders directly into character arrays in-file for examples.
+#include "primitive.h"
+#include "batch.h"
+#include "script.h"
+#include "sim.h"
+#include "input.h"
+#include "update.h"
+#include "headless.h"
+#include "timer.h"
+#include "profiler.h"
+#include "overlay.h"
+#include "shader.h"
+#include "glstate.h"
+#include "trace.h"
+#include "raster.h"
+#include "ordertable.h"
+#include "arena.h"
+#include "pool.h"
 
 #define SCREEN_HEIGHT	480
 #define SCREEN_WIDTH	640
@@ -16,131 +34,827 @@
 
 #define SQUARE_SIZE		50
 
-struct s_polyF4 {
-	unsigned long *tag;
-	unsigned char r0, g0, b0;
-	unsigned char code;
-	GLfloat x0, y0;
-	GLfloat x1, y1;
-	GLfloat x2, y2;
-	GLfloat x3, y3;
-};
+#define FNV_OFFSET	2166136261u
+#define FNV_PRIME	16777619u
 
-//to help translate input into a common type
-enum inputTypes { UP, DOWN, LEFT, RIGHT, UPLEFT, UPRIGHT, DOWNLEFT, DOWNRIGHT, CHANGE_COLOR, NONE };
-enum inputTypes g_decodedInput = NONE;
+#define RASTER_REPORTS	8	// frames the check renderer prints a difference for, the rest are only counted
+
+// What draws the frames. Soft draws on the cpu with no gl context at all, check draws with both and compares them.
+enum renderers { RENDERER_GL, RENDERER_SOFT, RENDERER_CHECK, RENDERERS };
+static const char *const g_rendererNames[RENDERERS] = { "gl", "soft", "check" };
+
+// Filled by the key callback on the main thread, emptied by getInput or the sim thread.
+struct s_inputQueue g_inputQueue;
+struct s_keyState g_keyState;	// only used when the quads move on the main thread
 
 //prototypes
 //initializes graphics
 void *initGraphics();
 //initialize input
 void initInput(void *window);
-//get translated input
+//get translated input from the keys pressed and held up to now
 enum inputTypes getInput();
-//generate primitive quad
-struct s_polyF4 genPrimitive();
-//move the primitive passed based on input from keyboard or controller
-void movePrimitive(struct s_polyF4 *f4, enum inputTypes decodedInput);
-//converts psx coords to opengl array
-void convertPrimQuadVertices(struct s_polyF4 *f4, GLfloat *vertexArray);
+//show the finished frame, swapping the window or reading back the offscreen frame when there is no window
+void presentFrame(void *window, struct s_headless *headless);
 //check if the display is still live.
 int displayLive(void *window);
+//hash of every primitive's position and color, to check that scripted runs end up in the same place
+static unsigned int hashScene(const struct s_polyF4 *prims, const struct s_primSoA *soa, int count);
+//moves every primitive by input, one step of a replayed trace
+static void moveScene(struct s_polyF4 *prims, struct s_primSoA *soa, int count, enum inputTypes input);
+//runs the steps read from a trace but the last, which is returned for the frame's update to run, or NONE if there are none. With all it runs every one.
+static enum inputTypes replaySteps(const struct s_trace *trace, struct s_polyF4 *prims, struct s_primSoA *soa, int count, int all);
+//sorts the quads into the ordering table by depth and lists them deepest first in the arena. Returns NULL if there was no room.
+static const struct s_polyF4 **orderScene(struct s_orderTable *table, struct s_polyF4 *prims, int count, struct s_arena *arena);
+//depth bucket of a quad in a table of length buckets, 0 the nearest
+static int primDepth(const struct s_polyF4 *f4, int length);
+//writes the software frame to the dump pattern, if there is one
+static void presentRasterFrame(const struct s_raster *raster, const char *dumpPattern, int frame);
+//appends the benchmark results to path as one json object per line, raster is NULL when only gl draws and batch is empty when only it does
+static void writeResults(const char *path, int quadCount, int frames, double seconds, int useSoA, enum renderers renderer,
+	const struct s_batch *batch, const struct s_raster *raster, const struct s_shaderManager *shaders, const struct s_simulation *sim,
+	int jobThreads, const struct s_trace *replay, const struct s_arena *frameArena, unsigned int steadyAllocations,
+	const struct s_orderTable *orderTable, int orderTimer, unsigned int checksum);
+//the renderer with that name, -1 if there's none
+static int parseRenderer(const char *name);
 //callback to decode input
 static void inputCallback(GLFWwindow *window, int key, int scanCode, int action, int mods);
 
-int main(void)
+int main(int argc, char **argv)
 {
-	void *window = initGraphics();
+	int quadCount = 1;
+	int benchFrames = 0; // when set, run this many frames unthrottled and report throughput
+	enum streamModes streamMode = STREAM_PERSISTENT;
+	int useSoA = 0;
+	int headless = 0;
+	const char *dumpPattern = NULL;
+	const char *profilePath = NULL;
+	int profileEvery = 0;
+	int showOverlay = 0;
+	const char *scriptText = NULL;
+	unsigned int seed = 1;
+	const char *resultsPath = NULL;
+	const char *shaderCache = NULL;
+	double tickRate = 60.0;
+	int jobThreads = 0;
+	int glStateMode = GLSTATE_CACHED;
+	const char *recordPath = NULL;
+	int recordGL = 0;
+	const char *replayPath = NULL;
+	enum renderers renderer = RENDERER_GL;
+	int rasterKernel = RASTER_KERNEL_AVX2;
+	int useOrderTable = 0;
+	enum quadIndexModes indexMode = QUAD_INDEX_LIST;
+	int frame;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-quads") == 0 && i + 1 < argc)
+		{
+			quadCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+		{
+			benchFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-stream") == 0 && i + 1 < argc && parseStreamMode(argv[i + 1]) >= 0)
+		{
+			// persistent (default when ARB_buffer_storage is there), subdata, or resident to upload only what changed
+			streamMode = (enum streamModes)parseStreamMode(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-soa") == 0)
+		{
+			useSoA = 1; // move the quads as a struct of arrays with the simd kernel
+		}
+		else if (strcmp(argv[i], "-headless") == 0)
+		{
+			headless = 1; // render offscreen, no window or display needed
+		}
+		else if (strcmp(argv[i], "-dump") == 0 && i + 1 < argc)
+		{
+			dumpPattern = argv[++i]; // headless frames are written to this printf pattern, .ppm or .png
+		}
+		else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+		{
+			profilePath = argv[++i]; // stage timings are logged here, .csv or .json
+		}
+		else if (strcmp(argv[i], "-profile-every") == 0 && i + 1 < argc)
+		{
+			profileEvery = atoi(argv[++i]); // frames between profiler reports
+		}
+		else if (strcmp(argv[i], "-overlay") == 0)
+		{
+			showOverlay = 1; // draw the profiler stats over the scene
+		}
+		else if (strcmp(argv[i], "-script") == 0 && i + 1 < argc)
+		{
+			scriptText = argv[++i]; // scripted input like "upright:90,color,none:10" in place of the keyboard
+		}
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+		{
+			seed = (unsigned int)strtoul(argv[++i], NULL, 10); // seed for the random colors
+		}
+		else if (strcmp(argv[i], "-shader-cache") == 0 && i + 1 < argc)
+		{
+			shaderCache = argv[++i]; // keep linked shader binaries here, later runs load them instead of compiling
+		}
+		else if (strcmp(argv[i], "-tick-rate") == 0 && i + 1 < argc)
+		{
+			tickRate = atof(argv[++i]); // simulation ticks a second on its own thread, 0 moves the quads once a frame on the render thread
+		}
+		else if (strcmp(argv[i], "-jobs") == 0 && i + 1 < argc)
+		{
+			jobThreads = atoi(argv[++i]); // threads that move and pack the quads, 0 is one per cpu
+		}
+		else if (strcmp(argv[i], "-results") == 0 && i + 1 < argc)
+		{
+			resultsPath = argv[++i]; // with -frames, append the results to this file as a json line
+		}
+		else if (strcmp(argv[i], "-gl-state") == 0 && i + 1 < argc && parseGLStateMode(argv[i + 1]) >= 0)
+		{
+			glStateMode = parseGLStateMode(argv[++i]); // skip redundant binds, make them all, or check the cache against glGet
+		}
+		else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+		{
+			recordPath = argv[++i]; // write the input, color clock and settings of the run to this trace file
+		}
+		else if (strcmp(argv[i], "-record-gl") == 0)
+		{
+			recordGL = 1; // with -record, put every gl state call that reaches gl in the trace too
+		}
+		else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+		{
+			replayPath = argv[++i]; // run a recorded trace again headless and flat out, with its settings
+		}
+		else if (strcmp(argv[i], "-renderer") == 0 && i + 1 < argc && parseRenderer(argv[i + 1]) >= 0)
+		{
+			// gl, soft to draw on the cpu without a gpu, or check to draw with both and count the pixels that differ
+			renderer = (enum renderers)parseRenderer(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-raster-kernel") == 0 && i + 1 < argc && parseRasterKernel(argv[i + 1]) >= 0)
+		{
+			// scalar, sse or avx2 edge tests for the soft renderer, the best the cpu has by default
+			rasterKernel = parseRasterKernel(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-order") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "array") == 0 || strcmp(argv[i + 1], "table") == 0))
+		{
+			useOrderTable = strcmp(argv[++i], "table") == 0; // draw in array order, or sorted by depth through an ordering table
+		}
+		else if (strcmp(argv[i], "-indices") == 0 && i + 1 < argc && parseQuadIndexMode(argv[i + 1]) >= 0)
+		{
+			indexMode = (enum quadIndexModes)parseQuadIndexMode(argv[++i]); // each quad's four vertices indexed as a triangle list, or as a strip with restarts
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-quads count] [-frames count] [-stream persistent|subdata|resident] [-soa] [-headless] [-dump frame%%04d.png] [-profile log.csv|log.json] [-profile-every frames] [-overlay] [-script input:frames,...] [-seed n] [-results file.json] [-shader-cache dir] [-tick-rate hz] [-jobs threads] [-gl-state cached|direct|check] [-record trace.bin] [-record-gl] [-replay trace.bin] [-renderer gl|soft|check] [-raster-kernel scalar|sse|avx2] [-order array|table] [-indices list|strip]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (quadCount < 1)
+	{
+		quadCount = 1;
+	}
+
+	// A replay runs with the recorded settings, headless and on one thread, taking its input and color clock from the trace.
+	// The recorded frames are the frame count, unless -frames asks for fewer.
+	struct s_trace trace;
+	int replaying = replayPath != NULL;
+	if (replaying)
+	{
+		if (!openTraceReplay(&trace, replayPath))
+		{
+			exit(EXIT_FAILURE);
+		}
+		quadCount = trace.header.quadCount;
+		seed = trace.header.seed;
+		useSoA = trace.header.soa;
+		streamMode = (enum streamModes)trace.header.streamMode;
+		showOverlay = trace.header.overlay;
+		glStateMode = trace.header.glStateMode;
+		useOrderTable = trace.header.orderTable;
+		tickRate = 0.0;
+		headless = 1;
+		scriptText = NULL;
+		recordPath = NULL;
+		if (benchFrames == 0 || (trace.header.frames > 0 && (unsigned int)benchFrames > trace.header.frames))
+		{
+			benchFrames = trace.header.frames > 0 ? (int)trace.header.frames : INT_MAX;
+		}
+		if (trace.header.vertexFormat != QUAD_VERTEX_FORMAT)
+		{
+			printf("replay: recorded with the other vertex format, the draws are the same but the bytes streamed aren't\n");
+		}
+	}
+
+	// The ordering table links the quads through their own tags, so it needs them as an array of structs moved on this thread.
+	if (useOrderTable && (useSoA || tickRate > 0.0))
+	{
+		printf("order: the ordering table sorts the quads as an array of structs on the render thread, -soa and the sim thread are off\n");
+		useSoA = 0;
+		tickRate = 0.0;
+	}
+
+	// A script also drives the color change clock, so the same frames always get the same colors.
+	struct s_inputScript script;
+	if (scriptText != NULL)
+	{
+		if (!parseInputScript(&script, scriptText))
+		{
+			exit(EXIT_FAILURE);
+		}
+		setPrimitiveClock(scriptClock);
+	}
+	seedPrimitiveColors(seed);
+	initGLState((enum glStateModes)glStateMode);
+
+	// The soft renderer has no window and no overlay, and check mode compares the overlay-free frames.
+	// Neither can record or compare gl calls the soft renderer doesn't make.
+	int useGL = renderer != RENDERER_SOFT;
+	if (renderer != RENDERER_GL)
+	{
+		headless = 1;
+		showOverlay = 0;
+	}
+	if (renderer == RENDERER_SOFT)
+	{
+		recordGL = 0;
+		if (replaying)
+		{
+			trace.header.glCalls = 0;
+		}
+	}
 
+	void *window = NULL;
+	struct s_headless offscreen;
+
+	if (!useGL)
+	{
+		if (benchFrames == 0)
+		{
+			benchFrames = 1;
+		}
+	}
+	else if (headless)
+	{
+		if (!initHeadless(&offscreen, SCREEN_WIDTH, SCREEN_HEIGHT, dumpPattern))
+		{
+			exit(EXIT_FAILURE);
+		}
+		// There is no window to close, so headless always runs a set number of frames.
+		if (benchFrames == 0)
+		{
+			benchFrames = 1;
+		}
+	}
+	else
+	{
+		window = initGraphics();
+	}
 	initInput(window);
 
-	struct s_polyF4 polyF4;
-	GLfloat vertices[12];
+	// The quads live for the whole run, so they come from a pool. Its blocks are packed together, so everything below
+	// walks them as a plain array.
+	struct s_pool primPool;
+	if (!initPool(&primPool, sizeof(struct s_polyF4), quadCount))
+	{
+		fprintf(stderr, "Failed to allocate %d primitives\n", quadCount);
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < quadCount; i++)
+	{
+		allocPoolBlock(&primPool);
+	}
+	struct s_polyF4 *prims = poolBlocks(&primPool);
 
-	polyF4 = genPrimitive();
+	if (quadCount == 1)
+	{
+		prims[0] = genPrimitive();
+	}
+	else
+	{
+		genPrimitiveGrid(prims, quadCount);
+	}
 
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	struct s_primSoA soa;
+	if (useSoA)
+	{
+		if (!initPrimSoA(&soa, quadCount))
+		{
+			fprintf(stderr, "Failed to allocate %d primitives\n", quadCount);
+			glfwTerminate();
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < quadCount; i++)
+		{
+			addPrimSoA(&soa, &prims[i]);
+		}
+	}
 
-	// Create a Vertex Buffer Object and copy the vertex data to it
-	GLuint vbo;
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	// The shaders are in shaders/, compiled once and kept as binaries with -shader-cache, and reloaded when they change.
+	struct s_shaderManager shaders;
+	int quadShader = -1;
+	memset(&shaders, 0, sizeof(shaders));
+	if (useGL)
+	{
+		initShaderManager(&shaders, shaderCache);
+		quadShader = loadShaderProgram(&shaders, "shaders/quad.vert", "shaders/quad.frag");
+		if (quadShader < 0)
+		{
+			glfwTerminate();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (window != NULL)
+	{
+		watchShaderFiles(&shaders);
+	}
 
+	// With a tick rate the quads move on the sim thread, and each frame draws between its last two ticks.
+	struct s_simulation sim;
+	struct s_primSoA drawn;
+	int threaded = tickRate > 0.0;
+	if (threaded)
+	{
+		if (!initSimulation(&sim, prims, useSoA ? &soa : NULL, quadCount, scriptText != NULL ? &script : NULL, &g_inputQueue, tickRate) ||
+			!initPrimSoA(&drawn, quadCount))
+		{
+			fprintf(stderr, "Failed to allocate %d primitives\n", quadCount);
+			glfwTerminate();
+			exit(EXIT_FAILURE);
+		}
+	}
 
+	// All of the quads go through one batch, so the whole scene is a single draw call.
+	struct s_batch batch;
+	memset(&batch, 0, sizeof(batch));
+	if (useGL && !initBatch(&batch, shaderProgram(&shaders, quadShader), quadCount, streamMode, indexMode))
+	{
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
 
-	// Writing shaders in file for example, should be loaded from a separate file.
-	// Create and compile the vertex shader
-	const char* vertexSource = GLSL(
-		in vec2 position;
+	// The soft renderer draws the same packed vertices the batch would get.
+	struct s_raster raster;
+	if (renderer != RENDERER_GL)
+	{
+		selectRasterKernel((enum rasterKernels)rasterKernel);
+		if (!initRaster(&raster, SCREEN_WIDTH, SCREEN_HEIGHT))
+		{
+			glfwTerminate();
+			exit(EXIT_FAILURE);
+		}
+	}
 
-	void main() {
-		gl_Position = vec4(position, 0.0, 1.0);
+	// What only lasts a frame, the raster's vertices and triangles, the check's readback and the depth order, comes from
+	// an arena that is reset every frame. It starts at a guess and grows to fit, after that the loop leaves the heap alone.
+	struct s_arena frameArena;
+	size_t frameBytes = 0;
+	if (renderer != RENDERER_GL)
+	{
+		frameBytes += (size_t)quadCount * (sizeof(struct s_quadVertex) * 4 + sizeof(struct s_rasterTriangle) * 2 + sizeof(int) * 2);
+	}
+	if (renderer == RENDERER_CHECK)
+	{
+		frameBytes += (size_t)SCREEN_WIDTH * SCREEN_HEIGHT * 4;
+	}
+	if (useOrderTable)
+	{
+		frameBytes += sizeof(struct s_polyF4 *) * quadCount;
+	}
+	if (!initArena(&frameArena, frameBytes))
+	{
+		fprintf(stderr, "Failed to allocate %lu bytes for each frame\n", (unsigned long)frameBytes);
+		glfwTerminate();
+		exit(EXIT_FAILURE);
 	}
-	);
 
-	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexSource, NULL);
-	glCompileShader(vertexShader);
-	// Create and compile the fragment shader
-	const char* fragmentSource = GLSL(
-		out vec4 color;
+	struct s_orderTable orderTable;
+	if (useOrderTable && !initOrderTable(&orderTable, ORDER_TABLE_LENGTH))
+	{
+		fprintf(stderr, "Failed to allocate an ordering table of %d buckets\n", ORDER_TABLE_LENGTH);
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
 
-	void main() {
-		color = vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	// The quads are moved, or lerped, and packed straight into the batch in chunks on every job thread.
+	struct s_jobSystem jobs;
+	if (!initJobSystem(&jobs, jobThreads))
+	{
+		fprintf(stderr, "Failed to start the job threads\n");
+		glfwTerminate();
+		exit(EXIT_FAILURE);
 	}
-	);
 
-	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-	glCompileShader(fragmentShader);
+	// Timers for each stage of the loop, the gpu one covers the clear and the batch draws.
+	int inputTimer = profRegister("input", PROF_CPU);
+	int updateTimer = profRegister("update", PROF_CPU);
+	int submitTimer = profRegister("submit", PROF_CPU);
+	int drawTimer = useGL ? profRegister("draw", PROF_GPU) : -1;
+	int rasterTimer = renderer != RENDERER_GL ? profRegister("raster", PROF_CPU) : -1;
+	int orderTimer = useOrderTable ? profRegister("order", PROF_CPU) : -1;
+	int presentTimer = profRegister("present", PROF_CPU);
+	if (profilePath != NULL && !profOpenLog(profilePath, profileEvery))
+	{
+		exit(EXIT_FAILURE);
+	}
 
-	// Link the vertex and fragment shader into a shader program
-	GLuint shaderProgram = glCreateProgram();
-	glAttachShader(shaderProgram, vertexShader);
-	glAttachShader(shaderProgram, fragmentShader);
-	glBindFragDataLocation(shaderProgram, 0, "color");
-	glLinkProgram(shaderProgram);
-	glUseProgram(shaderProgram);
+	struct s_overlay overlay;
+	char report[1024];
+	if (showOverlay && !initOverlay(&overlay))
+	{
+		showOverlay = 0;
+	}
 
-	// Specify the layout of the vertex data
-	GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-	glEnableVertexAttribArray(posAttrib);
-	glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	if (benchFrames > 0 && window != NULL)
+	{
+		glfwSwapInterval(0); // Don't let vsync cap the measurement.
+	}
+	// With a sim thread the trace records its ticks, without one the frames below do.
+	if (recordPath != NULL)
+	{
+		struct s_traceHeader settings;
+		memset(&settings, 0, sizeof(settings));
+		settings.quadCount = quadCount;
+		settings.seed = seed;
+		settings.soa = useSoA;
+		settings.streamMode = streamMode;
+		settings.overlay = showOverlay;
+		settings.vertexFormat = QUAD_VERTEX_FORMAT;
+		settings.glStateMode = glStateMode;
+		settings.glCalls = recordGL;
+		settings.orderTable = useOrderTable;
+		settings.tickRate = tickRate;
+		if (!openTraceRecorder(&trace, recordPath, &settings))
+		{
+			exit(EXIT_FAILURE);
+		}
+		if (threaded)
+		{
+			sim.trace = &trace;
+		}
+	}
+	int tracing = recordPath != NULL || replaying;
+	unsigned long lastDrawCalls = 0;
+	unsigned long lastQuadsDrawn = 0;
+	// The first frame sets up whatever grows to fit, the heap calls after it are what the loop makes every frame.
+	struct s_heapStats heapAfterFirst;
+	struct s_heapStats heapAtEnd;
+	memset(&heapAfterFirst, 0, sizeof(heapAfterFirst));
 
+	double startTime = timerNow();
+	resetGLStateStats();
+	if (threaded && !startSimulation(&sim))
+	{
+		fprintf(stderr, "Failed to start the simulation thread\n");
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
 
-	while (displayLive(window)) // Check if the window was closed
+	for (frame = 0; displayLive(window); frame++) // Check if the window was closed
 	{
-		// Check to see if we need to move the primitive
-		movePrimitive(&polyF4, getInput());
+		if (benchFrames > 0 && frame == benchFrames)
+		{
+			break;
+		}
+		if (replaying && !readTraceFrame(&trace))
+		{
+			break;
+		}
+		resetArena(&frameArena);
+		if (frame == 1)
+		{
+			readHeapStats(&heapAfterFirst);
+		}
+
+		// Pick up edited shaders, the batch's attributes have fixed locations so nothing else changes.
+		if (useGL)
+		{
+			updateShaderManager(&shaders);
+		}
+
+		// Check to see if we need to move the primitives, the sim thread reads the input itself.
+		profBegin(inputTimer);
+		enum inputTypes input = NONE;
+		if (replaying)
+		{
+			input = replaySteps(&trace, prims, useSoA ? &soa : NULL, quadCount, 0);
+		}
+		else if (!threaded)
+		{
+			input = scriptText != NULL ? nextScriptInput(&script) : getInput();
+			if (recordPath != NULL)
+			{
+				traceStep(&trace, input);
+			}
+		}
+		profEnd(inputTimer);
+		profBegin(updateTimer);
+		struct s_quadVertex *packed = NULL;
+		struct s_updateJob job;
+		memset(&job, 0, sizeof(job));
+		job.input = input;
+		// A replayed frame with more than one step may have moved before its last one.
+		job.unchanged = input == NONE && !threaded && !(replaying && trace.stepCount > 1);
+		if (threaded)
+		{
+			lockSnapshots(&sim, &job.from, &job.to, &job.alpha);
+			job.drawn = &drawn;
+		}
+		else if (useSoA)
+		{
+			job.soa = &soa;
+		}
+		else
+		{
+			job.prims = prims;
+		}
+		// With the ordering table the quads are moved first, then sorted, then packed in the order it walks them in.
+		if (useOrderTable)
+		{
+			if (input != NONE)
+			{
+				runUpdateJob(&jobs, &job, quadCount);
+			}
+			profBegin(orderTimer);
+			const struct s_polyF4 **order = orderScene(&orderTable, prims, quadCount, &frameArena);
+			profEnd(orderTimer);
+			if (order != NULL)
+			{
+				job.order = order;
+				job.prims = NULL;
+			}
+			job.input = NONE;
+		}
+		if (renderer == RENDERER_GL)
+		{
+			updateBatch(&jobs, &batch, &job, quadCount);
+		}
+		else
+		{
+			// Packed once for the raster, and copied into the batch as they are so a check draws the same vertices with both.
+			packed = arenaAlloc(&frameArena, sizeof(struct s_quadVertex) * 4 * quadCount);
+			if (job.drawn != NULL)
+			{
+				job.drawn->count = quadCount;
+			}
+			job.vertices = packed;
+			if (packed != NULL)
+			{
+				runUpdateJob(&jobs, &job, quadCount);
+			}
+			if (packed != NULL && useGL)
+			{
+				addBatchVertices(&batch, packed, quadCount);
+			}
+		}
+		if (threaded)
+		{
+			unlockSnapshots(&sim);
+		}
+		profEnd(updateTimer);
 
 		// Clear the screen to black
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		if (tracing)
+		{
+			beginTraceGL(&trace);
+		}
+		if (useGL)
+		{
+			profBegin(drawTimer);
+			stateClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
 
-		// Do the vertex conversion, and send it to the gpu.
-		convertPrimQuadVertices(&polyF4, vertices);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+			// Send every quad to the gpu in one go.
+			profBegin(submitTimer);
+			stateUseProgram(shaderProgram(&shaders, quadShader));
+			endBatchFrame(&batch);
+			profEnd(submitTimer);
+			profEnd(drawTimer);
+		}
+		if (renderer != RENDERER_GL)
+		{
+			profBegin(rasterTimer);
+			drawRasterQuads(&raster, &jobs, &frameArena, packed, packed != NULL ? quadCount : 0);
+			profEnd(rasterTimer);
+		}
 
-		// Draw two triangles from the 6 vertices
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		if (showOverlay)
+		{
+			drawOverlay(&overlay, SCREEN_WIDTH, SCREEN_HEIGHT);
+		}
+
+		// The frame is what was drawn, presenting it goes differently with and without a window.
+		if (tracing)
+		{
+			endTraceGL(&trace);
+			unsigned long drawCalls = useGL ? batch.drawCalls : raster.frames;
+			unsigned long quadsDrawn = useGL ? batch.quadsDrawn : raster.total.triangles / 2;
+			unsigned int draws = (unsigned int)(drawCalls - lastDrawCalls);
+			unsigned int quads = (unsigned int)(quadsDrawn - lastQuadsDrawn);
+			if (replaying)
+			{
+				checkTraceFrame(&trace, draws, quads);
+			}
+			else
+			{
+				traceFrame(&trace, timerNow() - startTime, draws, quads);
+			}
+			lastDrawCalls = drawCalls;
+			lastQuadsDrawn = quadsDrawn;
+		}
+
+		// Read back what gl drew before presenting, which may start a readback of its own for the dump.
+		if (renderer == RENDERER_CHECK)
+		{
+			unsigned char *rgba = arenaAlloc(&frameArena, (size_t)SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+			if (rgba != NULL)
+			{
+				readHeadlessFrame(&offscreen, rgba);
+				unsigned long differ = compareRasterFrame(&raster, rgba);
+				if (differ > 0 && raster.differingFrames <= RASTER_REPORTS)
+				{
+					fprintf(stderr, "raster: frame %d differs from gl in %lu pixels\n", frame, differ);
+				}
+			}
+		}
 
 		// Swap buffers and poll window events
-		glfwSwapBuffers((GLFWwindow *)window);
-		glfwPollEvents();
+		profBegin(presentTimer);
+		if (useGL)
+		{
+			presentFrame(window, &offscreen);
+		}
+		else
+		{
+			presentRasterFrame(&raster, dumpPattern, frame);
+		}
+		profEnd(presentTimer);
+
+		profEndFrame();
+		if (useGL && glStateMode == GLSTATE_CHECK)
+		{
+			validateGLState();
+		}
+		if (showOverlay && (profReportReady() || frame == 0))
+		{
+			profFormatReport(report, sizeof(report));
+			setOverlayText(&overlay, report);
+		}
+	}
+
+	readHeapStats(&heapAtEnd);
+	unsigned int steadyAllocations = frame > 1 ? heapAtEnd.allocations - heapAfterFirst.allocations : 0;
+
+	// The quads stay where the last tick left them, which is what the checksum hashes.
+	if (threaded)
+	{
+		stopSimulation(&sim);
+	}
+
+	// The sim ticks after the last frame are in the trace too, so a replay of the whole run ends where it did.
+	if (recordPath != NULL)
+	{
+		endTrace(&trace, hashScene(prims, useSoA ? &soa : NULL, quadCount));
+		printf("trace: %s frames: %lu bytes: %lu bytes/frame: %.1f\n", recordPath, trace.frames, trace.bytes,
+			trace.frames > 0 ? (double)trace.bytes / trace.frames : 0.0);
+		closeTrace(&trace);
+	}
+	if (replaying)
+	{
+		if (!trace.ended && (unsigned int)frame == trace.header.frames)
+		{
+			readTraceFrame(&trace);
+		}
+		if (trace.ended)
+		{
+			replaySteps(&trace, prims, useSoA ? &soa : NULL, quadCount, 1);
+			unsigned int checksum = hashScene(prims, useSoA ? &soa : NULL, quadCount);
+			printf("replay: %s frames: %d of %u recorded in %.3f seconds divergent frames: %lu checksum: %08x %s\n", replayPath, frame,
+				trace.endFrames, trace.frameTime, trace.divergentFrames, checksum, checksum == trace.endChecksum ? "matches" : "differs");
+		}
+		else
+		{
+			printf("replay: %s frames: %d divergent frames: %lu, stopped before the end so there is no checksum to compare\n", replayPath,
+				frame, trace.divergentFrames);
+		}
+	}
+
+	if (benchFrames > 0)
+	{
+		if (useGL)
+		{
+			glFinish();
+		}
+		double seconds = timerNow() - startTime;
+		struct s_streamStats *upload = &batch.stream.total;
+		unsigned long quadsDrawn = useGL ? batch.quadsDrawn : raster.total.triangles / 2;
+		unsigned long drawCalls = useGL ? batch.drawCalls : raster.frames;
+		printf("quads: %d frames: %d seconds: %.3f quads/sec: %.0f draw calls/frame: %.2f renderer: %s\n",
+			quadCount, frame, seconds, (double)quadsDrawn / seconds, (double)drawCalls / frame, g_rendererNames[renderer]);
+		if (useGL)
+		{
+			printf("stream: %s KB/frame: %.1f bytes/frame: %.0f ranges/frame: %.2f stalls/frame: %.3f orphans/frame: %.3f upload ms/frame: %.3f\n",
+				g_streamModeNames[batch.stream.mode], upload->bytes / 1024.0 / frame, (double)upload->bytes / frame,
+				(double)upload->ranges / frame, (double)upload->stalls / frame, (double)upload->orphans / frame,
+				upload->uploadSeconds * 1000.0 / frame);
+		}
+		printf("vertices: %s bytes/vertex: %d bytes/quad: %d indices: %s indices/quad: %d\n", g_quadVertexLayout.name,
+			(int)g_quadVertexLayout.stride, (int)g_quadVertexLayout.stride * 4, quadIndexModeName(indexMode), quadIndexCount(indexMode, 1));
+		// The rates are over the time spent in the raster, so they are what it manages with every job thread on it.
+		if (renderer != RENDERER_GL)
+		{
+			printf("raster: %s tiles: %d ms/frame: %.3f Mpixels/sec: %.1f triangles/sec: %.0f pixels/frame: %.0f\n",
+				rasterKernelName(raster.kernel), raster.tilesX * raster.tilesY, raster.total.seconds * 1000.0 / frame,
+				raster.total.pixels / raster.total.seconds / 1000000.0, raster.total.triangles / raster.total.seconds,
+				(double)raster.total.pixels / frame);
+		}
+		if (renderer == RENDERER_CHECK)
+		{
+			printf("raster check: frames differing from gl: %lu of %d pixels differing: %lu\n", raster.differingFrames, frame,
+				raster.differingPixels);
+		}
+		if (threaded)
+		{
+			printf("sim: ticks/sec: %.1f ticks: %lu dropped: %lu\n", tickRate, sim.ticks, sim.droppedTicks);
+		}
+		printf("jobs: threads: %d steals/frame: %.2f\n", jobs.threadCount, (double)jobs.steals / frame);
+		printf("memory: heap allocations after the first frame: %u frame arena KB: %.1f peak KB: %.1f allocations/frame: %.2f grows: %lu overflows: %lu pool: %d of %d\n",
+			steadyAllocations, frameArena.size / 1024.0, frameArena.peak / 1024.0, (double)frameArena.allocations / frame, frameArena.grows,
+			frameArena.overflows, primPool.count, primPool.capacity);
+		if (useOrderTable)
+		{
+			printf("order: table buckets: %d used/frame: %.1f quads/bucket: %.2f\n", orderTable.length,
+				(double)orderTable.bucketsUsed / frame, orderTable.bucketsUsed > 0 ? (double)orderTable.walked / orderTable.bucketsUsed : 0.0);
+		}
+		if (useGL)
+		{
+			printf("shaders: compiled: %d from binary: %d ms: %.3f\n", shaders.compiledCount, shaders.binaryCount, shaders.loadTime * 1000.0);
+			printf("gl state: %s calls/frame: %.2f skipped/frame: %.2f mismatches: %lu\n", g_glStateModeNames[g_glState.mode],
+				(double)g_glState.stats.calls / frame, (double)g_glState.stats.skipped / frame, g_glState.stats.mismatches);
+		}
+		if (resultsPath != NULL)
+		{
+			writeResults(resultsPath, quadCount, frame, seconds, useSoA, renderer, &batch, renderer != RENDERER_GL ? &raster : NULL,
+				&shaders, threaded ? &sim : NULL, jobs.threadCount, replaying ? &trace : NULL, &frameArena, steadyAllocations,
+				useOrderTable ? &orderTable : NULL, orderTimer, hashScene(prims, useSoA ? &soa : NULL, quadCount));
+		}
 	}
 
 	// Delete allocated resources
-	glDeleteProgram(shaderProgram);
-	glDeleteShader(fragmentShader);
-	glDeleteShader(vertexShader);
-	glDeleteBuffers(1, &vbo);
-	glDeleteVertexArrays(1, &vao);
+	if (showOverlay)
+	{
+		freeOverlay(&overlay);
+	}
+	profShutdown();
+	freeJobSystem(&jobs);
+	if (useGL)
+	{
+		freeBatch(&batch);
+	}
+	if (renderer != RENDERER_GL)
+	{
+		freeRaster(&raster);
+	}
+	if (threaded)
+	{
+		freeSimulation(&sim);
+		freePrimSoA(&drawn);
+	}
+	if (useSoA)
+	{
+		freePrimSoA(&soa);
+	}
+	freePool(&primPool);
+	freeArena(&frameArena);
+	if (useOrderTable)
+	{
+		freeOrderTable(&orderTable);
+	}
+	if (scriptText != NULL)
+	{
+		freeInputScript(&script);
+	}
+	if (useGL)
+	{
+		freeShaderManager(&shaders);
+	}
+	if (replaying)
+	{
+		closeTrace(&trace);
+	}
 
 
-	// Close OpenGL window and terminate GLFW
-	glfwTerminate();
+	if (headless && useGL)
+	{
+		freeHeadless(&offscreen);
+	}
+	else if (!headless)
+	{
+		// Close OpenGL window and terminate GLFW
+		glfwTerminate();
+	}
 
 	return 0;
 }
@@ -185,228 +899,265 @@ void *initGraphics()
 
 void initInput(void *window)
 {
+	initInputQueue(&g_inputQueue);
+	memset(&g_keyState, 0, sizeof(g_keyState));
 	if (window != NULL)
 	{
 		glfwSetKeyCallback((GLFWwindow *)window, inputCallback);
 	}
 }
 
-struct s_polyF4 genPrimitive()
+enum inputTypes getInput()
 {
-	struct s_polyF4 temp;
-
-#ifdef psx
-	SetPolyF4((POLY_F4 *)&temp);
-#endif
-
-	temp.r0 = 0;
-	temp.g0 = 0;
-	temp.b0 = 255;
-
-	/*temp.x0 = 0;
-	temp.y0 = 0;
-	temp.x1 = SQUARE_SIZE;
-	temp.y1 = 0;
-	temp.x2 = 0;
-	temp.y2 = SQUARE_SIZE;
-	temp.x3 = SQUARE_SIZE;
-	temp.y3 = SQUARE_SIZE;*/
-	temp.x0 = -0.5f;
-	temp.y0 = -0.5f;
-	temp.x1 = -0.5f;
-	temp.y1 = 0.5f;
-	temp.x2 = 0.5f;
-	temp.y2 = -0.5f;
-	temp.x3 = 0.5f;
-	temp.y3 = 0.5f;
-
-	return temp;
+	drainInputQueue(&g_inputQueue, &g_keyState, timerNow());
+	return decodeKeyState(&g_keyState);
 }
 
-enum inputTypes getInput()
+void display(void *window, struct s_polyF4 *f4)
 {
-	enum inputTypes temp = g_decodedInput;
-	g_decodedInput = NONE;
-	return temp;
+	//WIP
 }
 
-void movePrimitive(struct s_polyF4 *f4, enum inputTypes decodedInput)
+void presentFrame(void *window, struct s_headless *headless)
 {
-	if ((decodedInput == UP) || (decodedInput == UPLEFT) || (decodedInput == UPRIGHT))
+	if (window == NULL)
 	{
-		f4->y0 = f4->y0 + .01f;
-		f4->y1 = f4->y1 + .01f;
-		f4->y2 = f4->y2 + .01f;
-		f4->y3 = f4->y3 + .01f;
-		if (f4->y0 > 1)
-		{
-			f4->y0 = -2.0f;
-			f4->y1 = -1.0f;
-			f4->y2 = -2.0f;
-			f4->y3 = -1.0f;
-		}
+		endHeadlessFrame(headless);
+		return;
 	}
 
-	if ((decodedInput == DOWN) || (decodedInput == DOWNLEFT) || (decodedInput == DOWNRIGHT))
+	glfwSwapBuffers((GLFWwindow *)window);
+	glfwPollEvents();
+}
+
+// Added last to first, so quads at the same depth come out in the order they are in the array.
+static const struct s_polyF4 **orderScene(struct s_orderTable *table, struct s_polyF4 *prims, int count, struct s_arena *arena)
+{
+	const struct s_polyF4 **order = arenaAlloc(arena, sizeof(*order) * count);
+	int i;
+
+	if (order == NULL)
 	{
-		f4->y0 = f4->y0 - .01f;
-		f4->y1 = f4->y1 - .01f;
-		f4->y2 = f4->y2 - .01f;
-		f4->y3 = f4->y3 - .01f;
-		if (f4->y1 < -1)
-		{
-			f4->y0 = 1.0f;
-			f4->y1 = 2.0f;
-			f4->y2 = 1.0f;
-			f4->y3 = 2.0f;
-		}
+		return NULL;
+	}
+	clearOrderTable(table);
+	for (i = count - 1; i >= 0; i--)
+	{
+		addOrderTablePrim(table, primDepth(&prims[i], table->length), &prims[i]);
 	}
+	walkOrderTable(table, order);
+	return order;
+}
+
+// The scene is seen from above, so the higher up the screen a quad is the further away it is, and the ones lower down
+// are painted over it.
+static int primDepth(const struct s_polyF4 *f4, int length)
+{
+	GLfloat y = (f4->y0 + f4->y1 + f4->y2 + f4->y3) * 0.25f;
+	return (int)((y + 1.0f) * 0.5f * (length - 1));
+}
 
-	if ((decodedInput == LEFT) || (decodedInput == UPLEFT) || (decodedInput == DOWNLEFT))
+static void presentRasterFrame(const struct s_raster *raster, const char *dumpPattern, int frame)
+{
+	char path[512];
+
+	if (dumpPattern == NULL)
 	{
-		f4->x0 = f4->x0 - .01f;
-		f4->x1 = f4->x1 - .01f;
-		f4->x2 = f4->x2 - .01f;
-		f4->x3 = f4->x3 - .01f;
-		if (f4->x2 < -1)
-		{
-			f4->x0 = 1.0f;
-			f4->x1 = 1.0f;
-			f4->x2 = 2.0f;
-			f4->x3 = 2.0f;
-		}
+		return;
 	}
+	snprintf(path, sizeof(path), dumpPattern, frame);
+	writeRasterFrame(raster, path);
+}
 
-	if ((decodedInput == RIGHT) || (decodedInput == UPRIGHT) || (decodedInput == DOWNRIGHT))
+int displayLive(void *window)
+{
+	// Headless has no window to close, it runs until its frame count.
+	if (window == NULL)
 	{
-		f4->x0 = f4->x0 + .01f;
-		f4->x1 = f4->x1 + .01f;
-		f4->x2 = f4->x2 + .01f;
-		f4->x3 = f4->x3 + .01f;
-		if (f4->x0 > 1)
-		{
-			f4->x0 = -2.0f;
-			f4->x1 = -2.0f;
-			f4->x2 = -1.0f;
-			f4->x3 = -1.0f;
-		}
+		return 1;
 	}
-	if (decodedInput == CHANGE_COLOR)
+	return (glfwWindowShouldClose((GLFWwindow *)window) == 0 ? 1 : 0);
+}
+
+static unsigned int hashScene(const struct s_polyF4 *prims, const struct s_primSoA *soa, int count)
+{
+	unsigned int hash = FNV_OFFSET;
+	struct s_polyF4 f4;
+	int i;
+
+	for (i = 0; i < count; i++)
 	{
-		//check if it has been greater than 1 second since glfw time has been reset
-		if (glfwGetTime() > 1.0f)
+		if (soa != NULL)
+		{
+			getPrimSoA(soa, i, &f4);
+		}
+		else
+		{
+			f4 = prims[i];
+		}
+
+		// Only the fields that end up on screen, the tag and padding aren't part of the result.
+		GLfloat corners[8] = { f4.x0, f4.y0, f4.x1, f4.y1, f4.x2, f4.y2, f4.x3, f4.y3 };
+		unsigned char colors[3] = { f4.r0, f4.g0, f4.b0 };
+		const unsigned char *bytes = (const unsigned char *)corners;
+		size_t b;
+		for (b = 0; b < sizeof(corners); b++)
+		{
+			hash = (hash ^ bytes[b]) * FNV_PRIME;
+		}
+		for (b = 0; b < sizeof(colors); b++)
 		{
-			glfwSetTime(0.0f);
-			f4->r0 = rand() % 256;
-			f4->g0 = rand() % 256;
-			f4->b0 = rand() % 256;
+			hash = (hash ^ colors[b]) * FNV_PRIME;
 		}
 	}
+	return hash;
 }
 
-void display(void *window, struct s_polyF4 *f4)
+static void moveScene(struct s_polyF4 *prims, struct s_primSoA *soa, int count, enum inputTypes input)
 {
-	//WIP
+	int i;
+
+	if (soa != NULL)
+	{
+		movePrimSoA(soa, input);
+		return;
+	}
+	for (i = 0; i < count; i++)
+	{
+		movePrimitive(&prims[i], input);
+	}
 }
 
+static enum inputTypes replaySteps(const struct s_trace *trace, struct s_polyF4 *prims, struct s_primSoA *soa, int count, int all)
+{
+	int last = all ? trace->stepCount : trace->stepCount - 1;
+	int i;
 
+	// A frame recorded with a sim thread can hold any number of ticks, without one it is always one.
+	for (i = 0; i < last; i++)
+	{
+		setTraceClock(&trace->steps[i]);
+		moveScene(prims, soa, count, trace->steps[i].input);
+	}
+	if (last == trace->stepCount || last < 0)
+	{
+		return NONE;
+	}
+	setTraceClock(&trace->steps[last]);
+	return trace->steps[last].input;
+}
 
-void convertPrimQuadVertices(struct s_polyF4 *f4, GLfloat *vertexArray)
+static void writeResults(const char *path, int quadCount, int frames, double seconds, int useSoA, enum renderers renderer,
+	const struct s_batch *batch, const struct s_raster *raster, const struct s_shaderManager *shaders, const struct s_simulation *sim,
+	int jobThreads, const struct s_trace *replay, const struct s_arena *frameArena, unsigned int steadyAllocations,
+	const struct s_orderTable *orderTable, int orderTimer, unsigned int checksum)
 {
-	// We need to convert from the psx struct to an array opengl can use.
-	vertexArray[0] = f4->x0;
-	vertexArray[1] = f4->y0;
-	vertexArray[2] = f4->x1;
-	vertexArray[3] = f4->y1;
-	vertexArray[4] = f4->x2;
-	vertexArray[5] = f4->y2;
-	vertexArray[6] = f4->x2;
-	vertexArray[7] = f4->y2;
-	vertexArray[8] = f4->x3;
-	vertexArray[9] = f4->y3;
-	vertexArray[10] = f4->x1;
-	vertexArray[11] = f4->y1;
+	struct s_profStats frameStats;
+	struct s_profStats orderStats;
+	struct s_rasterStats rasterTotal;
+	unsigned long quadsDrawn = renderer == RENDERER_SOFT ? raster->total.triangles / 2 : batch->quadsDrawn;
+	unsigned long drawCalls = renderer == RENDERER_SOFT ? raster->frames : batch->drawCalls;
+	FILE *file = fopen(path, "a");
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open results file %s\n", path);
+		return;
+	}
+
+	// Frame time stats cover the last PROF_SAMPLES frames, the throughput covers the whole run.
+	// Without a raster its rates are 0, and without gl the stream is none.
+	profGetStats(PROF_FRAME, &frameStats);
+	memset(&orderStats, 0, sizeof(orderStats));
+	if (orderTable != NULL)
+	{
+		profGetStats(orderTimer, &orderStats);
+	}
+	memset(&rasterTotal, 0, sizeof(rasterTotal));
+	if (raster != NULL && raster->total.seconds > 0.0)
+	{
+		rasterTotal = raster->total;
+	}
+	else
+	{
+		rasterTotal.seconds = 1.0;
+	}
+	fprintf(file, "{\"example\":\"moving_square\",\"quads\":%d,\"frames\":%d,\"renderer\":\"%s\",\"stream\":\"%s\",\"soa\":%d,\"seconds\":%.4f,"
+		"\"quads_per_sec\":%.0f,\"draw_calls_per_frame\":%.2f,\"upload_ms_per_frame\":%.4f,\"stalls_per_frame\":%.4f,"
+		"\"frame_ms_min\":%.4f,\"frame_ms_avg\":%.4f,\"frame_ms_p99\":%.4f,\"frame_ms_max\":%.4f,"
+		"\"shader_ms\":%.3f,\"shaders_compiled\":%d,\"shaders_from_binary\":%d,\"tick_rate\":%.1f,\"ticks\":%lu,\"jobs\":%d,"
+		"\"vertex_format\":\"%s\",\"vertex_bytes\":%d,\"indices\":\"%s\",\"stream_kb_per_frame\":%.1f,\"upload_bytes_per_frame\":%.0f,"
+		"\"upload_ranges_per_frame\":%.2f,\"gl_state\":\"%s\",\"gl_calls_per_frame\":%.2f,"
+		"\"gl_calls_skipped_per_frame\":%.2f,\"gl_state_mismatches\":%lu,\"raster_kernel\":\"%s\",\"raster_ms_per_frame\":%.4f,"
+		"\"raster_mpixels_per_sec\":%.1f,\"raster_triangles_per_sec\":%.0f,\"raster_differing_frames\":%lu,\"raster_differing_pixels\":%lu,"
+		"\"heap_allocations_after_first_frame\":%u,\"frame_arena_peak_kb\":%.1f,\"frame_arena_allocations_per_frame\":%.2f,"
+		"\"order\":\"%s\",\"order_ms_avg\":%.4f,"
+		"\"replay\":%d,\"divergent_frames\":%lu,\"checksum\":\"%08x\"}\n",
+		quadCount, frames, g_rendererNames[renderer], renderer == RENDERER_SOFT ? "none" : g_streamModeNames[batch->stream.mode], useSoA, seconds,
+		(double)quadsDrawn / seconds, (double)drawCalls / frames, batch->stream.total.uploadSeconds * 1000.0 / frames,
+		(double)batch->stream.total.stalls / frames, frameStats.min, frameStats.avg, frameStats.p99, frameStats.max,
+		shaders->loadTime * 1000.0, shaders->compiledCount, shaders->binaryCount, sim != NULL ? 1.0 / sim->tickLength : 0.0,
+		sim != NULL ? sim->ticks : (unsigned long)frames, jobThreads, g_quadVertexLayout.name, (int)g_quadVertexLayout.stride,
+		renderer == RENDERER_SOFT ? "none" : quadIndexModeName(batch->indexMode),
+		batch->stream.total.bytes / 1024.0 / frames, (double)batch->stream.total.bytes / frames,
+		(double)batch->stream.total.ranges / frames, g_glStateModeNames[g_glState.mode], (double)g_glState.stats.calls / frames,
+		(double)g_glState.stats.skipped / frames, g_glState.stats.mismatches, raster != NULL ? rasterKernelName(raster->kernel) : "none",
+		raster != NULL ? raster->total.seconds * 1000.0 / frames : 0.0, rasterTotal.pixels / rasterTotal.seconds / 1000000.0,
+		rasterTotal.triangles / rasterTotal.seconds, raster != NULL ? raster->differingFrames : 0ul, raster != NULL ? raster->differingPixels : 0ul,
+		steadyAllocations, frameArena->peak / 1024.0, (double)frameArena->allocations / frames,
+		orderTable != NULL ? "table" : "array", orderStats.avg,
+		replay != NULL, replay != NULL ? replay->divergentFrames : 0ul, checksum);
+	fclose(file);
 }
 
-int displayLive(void *window)
+static int parseRenderer(const char *name)
 {
-	return (glfwWindowShouldClose((GLFWwindow *)window) == 0 ? 1 : 0);
+	int renderer;
+
+	for (renderer = RENDERER_GL; renderer < RENDERERS; renderer++)
+	{
+		if (strcmp(name, g_rendererNames[renderer]) == 0)
+		{
+			return renderer;
+		}
+	}
+	return -1;
 }
 
-//keyboard input callback to decode key pressed into are decoded type.
+//keyboard input callback, queues every press and release of the keys we use with the time it happened.
 static void inputCallback(GLFWwindow *window, int key, int scanCode, int action, int mods)
 {
-	if (action == GLFW_PRESS || action == GLFW_REPEAT)
-	{
-		switch (key)
-		{
-		case GLFW_KEY_UP:
-			printf("UP");
-			if (glfwGetKey(window, GLFW_KEY_LEFT))
-			{
-				g_decodedInput = UPLEFT;
-				printf("UpLeft");
-			}
-			else if (glfwGetKey(window, GLFW_KEY_RIGHT))
-			{
-				g_decodedInput = UPRIGHT;
-			}
-			else
-			{
-				g_decodedInput = UP;
-			}
-			break;
-		case GLFW_KEY_DOWN:
+	enum inputKeys inputKey;
 
-			if (glfwGetKey(window, GLFW_KEY_LEFT))
-			{
-				g_decodedInput = DOWNLEFT;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_RIGHT))
-			{
-				g_decodedInput = DOWNRIGHT;
-			}
-			else
-			{
-				g_decodedInput = DOWN;
-			}
-			break;
-		case GLFW_KEY_LEFT:
+	(void)window;
+	(void)scanCode;
+	(void)mods;
 
-			if (glfwGetKey(window, GLFW_KEY_UP))
-			{
-				g_decodedInput = UPLEFT;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_DOWN))
-			{
-				g_decodedInput = DOWNLEFT;
-			}
-			else
-			{
-				g_decodedInput = LEFT;
-			}
-			break;
-		case GLFW_KEY_RIGHT:
+	// Repeats don't change which keys are held.
+	if (action == GLFW_REPEAT)
+	{
+		return;
+	}
 
-			if (glfwGetKey(window, GLFW_KEY_UP))
-			{
-				g_decodedInput = UPRIGHT;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_DOWN))
-			{
-				g_decodedInput = DOWNRIGHT;
-			}
-			else
-			{
-				g_decodedInput = RIGHT;
-			}
-			break;
-		case GLFW_KEY_X:
-			g_decodedInput = CHANGE_COLOR;
-			break;
-		default:
-			g_decodedInput = NONE;
-			break;
-		}
+	switch (key)
+	{
+	case GLFW_KEY_UP:
+		inputKey = KEY_UP;
+		break;
+	case GLFW_KEY_DOWN:
+		inputKey = KEY_DOWN;
+		break;
+	case GLFW_KEY_LEFT:
+		inputKey = KEY_LEFT;
+		break;
+	case GLFW_KEY_RIGHT:
+		inputKey = KEY_RIGHT;
+		break;
+	case GLFW_KEY_X:
+		inputKey = KEY_COLOR;
+		break;
+	default:
+		return;
 	}
-}
\ No newline at end of file
+	pushInputEvent(&g_inputQueue, inputKey, action == GLFW_PRESS ? KEY_PRESS : KEY_RELEASE, timerNow());
+}
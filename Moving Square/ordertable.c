@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "ordertable.h"
+#include "arena.h"
+
+int initOrderTable(struct s_orderTable *table, int length)
+{
+	memset(table, 0, sizeof(*table));
+	table->buckets = allocHeap(sizeof(unsigned long *) * length);
+	if (table->buckets == NULL)
+	{
+		return 0;
+	}
+	table->length = length;
+	clearOrderTable(table);
+	return 1;
+}
+
+void clearOrderTable(struct s_orderTable *table)
+{
+	memset(table->buckets, 0, sizeof(unsigned long *) * table->length);
+}
+
+void addOrderTablePrim(struct s_orderTable *table, int z, struct s_polyF4 *prim)
+{
+	if (z < 0)
+	{
+		z = 0;
+	}
+	else if (z >= table->length)
+	{
+		z = table->length - 1;
+	}
+
+	// The tag is the first thing in a primitive, so a pointer to it is a pointer to the primitive.
+	prim->tag = table->buckets[z];
+	table->buckets[z] = (unsigned long *)prim;
+	table->added++;
+}
+
+int walkOrderTable(struct s_orderTable *table, const struct s_polyF4 **order)
+{
+	int count = 0;
+	int z;
+
+	for (z = table->length - 1; z >= 0; z--)
+	{
+		unsigned long *tag = table->buckets[z];
+		if (tag == NULL)
+		{
+			continue;
+		}
+		table->bucketsUsed++;
+		while (tag != NULL)
+		{
+			const struct s_polyF4 *prim = (const struct s_polyF4 *)tag;
+			order[count++] = prim;
+			tag = prim->tag;
+		}
+	}
+	table->walked += count;
+	return count;
+}
+
+void freeOrderTable(struct s_orderTable *table)
+{
+	freeHeap(table->buckets);
+	table->buckets = NULL;
+	table->length = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef ORDERTABLE_H
+#define ORDERTABLE_H
+
+#include "primitive.h"
+
+#define ORDER_TABLE_LENGTH	4096	// depth buckets, more than the screen has rows so quads a row apart sort apart
+
+// The psx ordering table: a list of primitives for each depth, linked through their tags.
+// Adding a primitive points its tag at the bucket's first one and makes it the first, so sorting a frame is
+// one O(1) insert per primitive and never compares two of them. Drawing walks the buckets from the deepest to
+// the nearest, painting the far primitives first. A primitive's tag is only good until the table is cleared.
+struct s_orderTable {
+	unsigned long **buckets;	// the first primitive's tag in each, which is the primitive, NULL when empty
+	int length;
+
+	// stats
+	unsigned long added;
+	unsigned long walked;
+	unsigned long bucketsUsed;	// buckets that weren't empty when walked
+};
+
+//allocates length buckets, all empty. Returns 0 on failure.
+int initOrderTable(struct s_orderTable *table, int length);
+//empties every bucket
+void clearOrderTable(struct s_orderTable *table);
+//adds prim at depth z, 0 the nearest and clamped to the table. Within a bucket the last one added is drawn first.
+void addOrderTablePrim(struct s_orderTable *table, int z, struct s_polyF4 *prim);
+//lists the primitives deepest first into order, which has room for all of them. Returns how many there were.
+int walkOrderTable(struct s_orderTable *table, const struct s_polyF4 **order);
+//frees the buckets
+void freeOrderTable(struct s_orderTable *table);
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <math.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+#include "primitive.h"
+
+// Clock and random colors behind CHANGE_COLOR, benchmarks swap in a scripted clock so runs repeat exactly.
+static double (*g_colorClock)(void) = NULL;
+static double g_lastColorChange = 0.0;
+static unsigned int g_colorSeed = 1;
+
+struct s_polyF4 genPrimitive()
+{
+	struct s_polyF4 temp;
+
+#ifdef psx
+	SetPolyF4((POLY_F4 *)&temp);
+#endif
+
+	temp.r0 = 0;
+	temp.g0 = 0;
+	temp.b0 = 255;
+
+	/*temp.x0 = 0;
+	temp.y0 = 0;
+	temp.x1 = SQUARE_SIZE;
+	temp.y1 = 0;
+	temp.x2 = 0;
+	temp.y2 = SQUARE_SIZE;
+	temp.x3 = SQUARE_SIZE;
+	temp.y3 = SQUARE_SIZE;*/
+	temp.x0 = -0.5f;
+	temp.y0 = -0.5f;
+	temp.x1 = -0.5f;
+	temp.y1 = 0.5f;
+	temp.x2 = 0.5f;
+	temp.y2 = -0.5f;
+	temp.x3 = 0.5f;
+	temp.y3 = 0.5f;
+
+	return temp;
+}
+
+void genPrimitiveGrid(struct s_polyF4 *prims, int count)
+{
+	int side = (int)ceil(sqrt((double)count));
+	GLfloat cell = 2.0f / side;
+	GLfloat size = cell * 0.8f;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		GLfloat left = -1.0f + (i % side) * cell + (cell - size) * 0.5f;
+		GLfloat bottom = -1.0f + (i / side) * cell + (cell - size) * 0.5f;
+
+		prims[i] = genPrimitive();
+		prims[i].r0 = (unsigned char)(255 * (i % side) / side);
+		prims[i].g0 = (unsigned char)(255 * (i / side) / side);
+		prims[i].x0 = left;
+		prims[i].y0 = bottom;
+		prims[i].x1 = left;
+		prims[i].y1 = bottom + size;
+		prims[i].x2 = left + size;
+		prims[i].y2 = bottom;
+		prims[i].x3 = left + size;
+		prims[i].y3 = bottom + size;
+	}
+}
+
+void movePrimitive(struct s_polyF4 *f4, enum inputTypes decodedInput)
+{
+	if ((decodedInput == UP) || (decodedInput == UPLEFT) || (decodedInput == UPRIGHT))
+	{
+		f4->y0 = f4->y0 + MOVE_STEP;
+		f4->y1 = f4->y1 + MOVE_STEP;
+		f4->y2 = f4->y2 + MOVE_STEP;
+		f4->y3 = f4->y3 + MOVE_STEP;
+		// Wrap to just below the bottom edge, keeping the quad's height.
+		if (f4->y0 > 1)
+		{
+			f4->y0 = -1.0f - (f4->y1 - f4->y0);
+			f4->y1 = -1.0f;
+			f4->y2 = f4->y0;
+			f4->y3 = -1.0f;
+		}
+	}
+
+	if ((decodedInput == DOWN) || (decodedInput == DOWNLEFT) || (decodedInput == DOWNRIGHT))
+	{
+		f4->y0 = f4->y0 - MOVE_STEP;
+		f4->y1 = f4->y1 - MOVE_STEP;
+		f4->y2 = f4->y2 - MOVE_STEP;
+		f4->y3 = f4->y3 - MOVE_STEP;
+		if (f4->y1 < -1)
+		{
+			f4->y1 = 1.0f + (f4->y1 - f4->y0);
+			f4->y0 = 1.0f;
+			f4->y2 = 1.0f;
+			f4->y3 = f4->y1;
+		}
+	}
+
+	if ((decodedInput == LEFT) || (decodedInput == UPLEFT) || (decodedInput == DOWNLEFT))
+	{
+		f4->x0 = f4->x0 - MOVE_STEP;
+		f4->x1 = f4->x1 - MOVE_STEP;
+		f4->x2 = f4->x2 - MOVE_STEP;
+		f4->x3 = f4->x3 - MOVE_STEP;
+		if (f4->x2 < -1)
+		{
+			f4->x2 = 1.0f + (f4->x2 - f4->x0);
+			f4->x0 = 1.0f;
+			f4->x1 = 1.0f;
+			f4->x3 = f4->x2;
+		}
+	}
+
+	if ((decodedInput == RIGHT) || (decodedInput == UPRIGHT) || (decodedInput == DOWNRIGHT))
+	{
+		f4->x0 = f4->x0 + MOVE_STEP;
+		f4->x1 = f4->x1 + MOVE_STEP;
+		f4->x2 = f4->x2 + MOVE_STEP;
+		f4->x3 = f4->x3 + MOVE_STEP;
+		if (f4->x0 > 1)
+		{
+			f4->x0 = -1.0f - (f4->x2 - f4->x0);
+			f4->x1 = f4->x0;
+			f4->x2 = -1.0f;
+			f4->x3 = -1.0f;
+		}
+	}
+	if (decodedInput == CHANGE_COLOR)
+	{
+		//check if it has been greater than 1 second since the last color change
+		if (primitiveColorDue())
+		{
+			f4->r0 = randomPrimitiveColor();
+			f4->g0 = randomPrimitiveColor();
+			f4->b0 = randomPrimitiveColor();
+		}
+	}
+}
+
+void setPrimitiveClock(double (*clock)(void))
+{
+	g_colorClock = clock;
+	g_lastColorChange = 0.0;
+}
+
+void seedPrimitiveColors(unsigned int seed)
+{
+	// Xorshift gets stuck on 0.
+	g_colorSeed = seed != 0 ? seed : 1;
+}
+
+double primitiveClockNow(void)
+{
+	return g_colorClock != NULL ? g_colorClock() : glfwGetTime();
+}
+
+int primitiveColorDue(void)
+{
+	double now = primitiveClockNow();
+
+	if (now - g_lastColorChange > 1.0)
+	{
+		g_lastColorChange = now;
+		return 1;
+	}
+	return 0;
+}
+
+unsigned char randomPrimitiveColor(void)
+{
+	// Xorshift32, unlike rand it gives the same colors on every platform.
+	g_colorSeed ^= g_colorSeed << 13;
+	g_colorSeed ^= g_colorSeed >> 17;
+	g_colorSeed ^= g_colorSeed << 5;
+	return (unsigned char)(g_colorSeed >> 24);
+}
+
+void convertPrimQuadVertices(struct s_polyF4 *f4, GLfloat *vertexArray)
+{
+	// We need to convert from the psx struct to an array opengl can use.
+	vertexArray[0] = f4->x0;
+	vertexArray[1] = f4->y0;
+	vertexArray[2] = f4->x1;
+	vertexArray[3] = f4->y1;
+	vertexArray[4] = f4->x2;
+	vertexArray[5] = f4->y2;
+	vertexArray[6] = f4->x2;
+	vertexArray[7] = f4->y2;
+	vertexArray[8] = f4->x3;
+	vertexArray[9] = f4->y3;
+	vertexArray[10] = f4->x1;
+	vertexArray[11] = f4->y1;
+}
@@ -0,0 +1,43 @@
+#ifndef PRIMITIVE_H
+#define PRIMITIVE_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Mirrors the psx POLY_F4 layout so the same code can be shared with the psx build.
+struct s_polyF4 {
+	unsigned long *tag;
+	unsigned char r0, g0, b0;
+	unsigned char code;
+	GLfloat x0, y0;
+	GLfloat x1, y1;
+	GLfloat x2, y2;
+	GLfloat x3, y3;
+};
+
+//to help translate input into a common type
+enum inputTypes { UP, DOWN, LEFT, RIGHT, UPLEFT, UPRIGHT, DOWNLEFT, DOWNRIGHT, CHANGE_COLOR, NONE };
+
+// How far one input moves a primitive.
+#define MOVE_STEP	.01f
+
+//generate primitive quad
+struct s_polyF4 genPrimitive();
+//fill the array with count small quads laid out in a grid
+void genPrimitiveGrid(struct s_polyF4 *prims, int count);
+//move the primitive passed based on input from keyboard or controller
+void movePrimitive(struct s_polyF4 *f4, enum inputTypes decodedInput);
+//sets the clock CHANGE_COLOR waits on, NULL goes back to glfwGetTime
+void setPrimitiveClock(double (*clock)(void));
+//restarts the random colors from seed, so a run can be repeated exactly
+void seedPrimitiveColors(unsigned int seed);
+//the time on the clock CHANGE_COLOR waits on
+double primitiveClockNow(void);
+//returns 1, and starts the wait over, when it has been more than a second since the last color change
+int primitiveColorDue(void);
+//next random color channel
+unsigned char randomPrimitiveColor(void);
+//converts psx coords to opengl array
+void convertPrimQuadVertices(struct s_polyF4 *f4, GLfloat *vertexArray);
+
+#endif
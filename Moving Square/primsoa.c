@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "primsoa.h"
+#include "arena.h"
+
+// Farther than a primitive moves between two snapshots, only a wrap to the other side of the screen jumps this far.
+#define LERP_JUMP	0.5f
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOA_HAVE_SSE
+#include <emmintrin.h>
+#endif
+
+// The avx2 kernel is built with a target attribute and only used when the cpu reports avx2 at runtime.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SOA_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+static enum soaKernels g_soaKernel = SOA_KERNEL_AVX2;
+static int g_soaKernelSelected = 0;
+
+static void translateAxisScalar(GLfloat **c, int begin, int end, GLfloat d);
+#ifdef SOA_HAVE_SSE
+static void translateAxisSSE(GLfloat **c, int count, GLfloat d);
+#endif
+#ifdef SOA_HAVE_AVX2
+static void translateAxisAVX2(GLfloat **c, int count, GLfloat d);
+#endif
+
+int initPrimSoA(struct s_primSoA *soa, int capacity)
+{
+	int k;
+	int ok = 1;
+
+	memset(soa, 0, sizeof(*soa));
+	for (k = 0; k < 4; k++)
+	{
+		soa->x[k] = allocHeap(sizeof(GLfloat) * capacity);
+		soa->y[k] = allocHeap(sizeof(GLfloat) * capacity);
+		ok = ok && soa->x[k] != NULL && soa->y[k] != NULL;
+	}
+	soa->r = allocHeap(capacity);
+	soa->g = allocHeap(capacity);
+	soa->b = allocHeap(capacity);
+	ok = ok && soa->r != NULL && soa->g != NULL && soa->b != NULL;
+	if (!ok)
+	{
+		freePrimSoA(soa);
+		return 0;
+	}
+
+	soa->capacity = capacity;
+	return 1;
+}
+
+int addPrimSoA(struct s_primSoA *soa, const struct s_polyF4 *f4)
+{
+	int i = soa->count;
+
+	if (i == soa->capacity)
+	{
+		return -1;
+	}
+
+	soa->x[0][i] = f4->x0;
+	soa->y[0][i] = f4->y0;
+	soa->x[1][i] = f4->x1;
+	soa->y[1][i] = f4->y1;
+	soa->x[2][i] = f4->x2;
+	soa->y[2][i] = f4->y2;
+	soa->x[3][i] = f4->x3;
+	soa->y[3][i] = f4->y3;
+	soa->r[i] = f4->r0;
+	soa->g[i] = f4->g0;
+	soa->b[i] = f4->b0;
+	soa->count++;
+
+	return i;
+}
+
+void getPrimSoA(const struct s_primSoA *soa, int index, struct s_polyF4 *f4)
+{
+	f4->tag = NULL;
+	f4->code = 0;
+	f4->x0 = soa->x[0][index];
+	f4->y0 = soa->y[0][index];
+	f4->x1 = soa->x[1][index];
+	f4->y1 = soa->y[1][index];
+	f4->x2 = soa->x[2][index];
+	f4->y2 = soa->y[2][index];
+	f4->x3 = soa->x[3][index];
+	f4->y3 = soa->y[3][index];
+	f4->r0 = soa->r[index];
+	f4->g0 = soa->g[index];
+	f4->b0 = soa->b[index];
+}
+
+void movePrimSoA(struct s_primSoA *soa, enum inputTypes decodedInput)
+{
+	GLfloat dx = 0.0f;
+	GLfloat dy = 0.0f;
+	int i;
+
+	if ((decodedInput == UP) || (decodedInput == UPLEFT) || (decodedInput == UPRIGHT))
+	{
+		dy = MOVE_STEP;
+	}
+	if ((decodedInput == DOWN) || (decodedInput == DOWNLEFT) || (decodedInput == DOWNRIGHT))
+	{
+		dy = -MOVE_STEP;
+	}
+	if ((decodedInput == LEFT) || (decodedInput == UPLEFT) || (decodedInput == DOWNLEFT))
+	{
+		dx = -MOVE_STEP;
+	}
+	if ((decodedInput == RIGHT) || (decodedInput == UPRIGHT) || (decodedInput == DOWNRIGHT))
+	{
+		dx = MOVE_STEP;
+	}
+
+	translatePrimSoA(soa, dx, dy);
+
+	if (decodedInput == CHANGE_COLOR)
+	{
+		//check if it has been greater than 1 second since the last color change
+		if (primitiveColorDue())
+		{
+			for (i = 0; i < soa->count; i++)
+			{
+				soa->r[i] = randomPrimitiveColor();
+				soa->g[i] = randomPrimitiveColor();
+				soa->b[i] = randomPrimitiveColor();
+			}
+		}
+	}
+}
+
+void translatePrimSoA(struct s_primSoA *soa, GLfloat dx, GLfloat dy)
+{
+	int axis;
+
+	if (!g_soaKernelSelected)
+	{
+		selectSoAKernel(SOA_KERNEL_AVX2);
+	}
+
+	// Each axis is independent, and like movePrimitive an axis that isn't moving isn't wrapped either.
+	for (axis = 0; axis < 2; axis++)
+	{
+		GLfloat **c = axis == 0 ? soa->x : soa->y;
+		GLfloat d = axis == 0 ? dx : dy;
+
+		if (d == 0.0f)
+		{
+			continue;
+		}
+		switch (g_soaKernel)
+		{
+#ifdef SOA_HAVE_AVX2
+		case SOA_KERNEL_AVX2:
+			translateAxisAVX2(c, soa->count, d);
+			break;
+#endif
+#ifdef SOA_HAVE_SSE
+		case SOA_KERNEL_SSE:
+			translateAxisSSE(c, soa->count, d);
+			break;
+#endif
+		default:
+			translateAxisScalar(c, 0, soa->count, d);
+			break;
+		}
+	}
+}
+
+void slicePrimSoA(const struct s_primSoA *soa, int begin, int end, struct s_primSoA *slice)
+{
+	int k;
+
+	for (k = 0; k < 4; k++)
+	{
+		slice->x[k] = soa->x[k] + begin;
+		slice->y[k] = soa->y[k] + begin;
+	}
+	slice->r = soa->r + begin;
+	slice->g = soa->g + begin;
+	slice->b = soa->b + begin;
+	slice->count = end - begin;
+	slice->capacity = end - begin;
+}
+
+void copyPrimSoA(struct s_primSoA *dst, const struct s_primSoA *src)
+{
+	int k;
+
+	for (k = 0; k < 4; k++)
+	{
+		memcpy(dst->x[k], src->x[k], sizeof(GLfloat) * src->count);
+		memcpy(dst->y[k], src->y[k], sizeof(GLfloat) * src->count);
+	}
+	memcpy(dst->r, src->r, src->count);
+	memcpy(dst->g, src->g, src->count);
+	memcpy(dst->b, src->b, src->count);
+	dst->count = src->count;
+}
+
+void lerpPrimSoA(struct s_primSoA *out, const struct s_primSoA *from, const struct s_primSoA *to, GLfloat alpha)
+{
+	int count = from->count < to->count ? from->count : to->count;
+	int i;
+	int k;
+
+	// Written as a select rather than a branch so the compiler can vectorize it.
+	for (k = 0; k < 4; k++)
+	{
+		const GLfloat *fromX = from->x[k];
+		const GLfloat *fromY = from->y[k];
+		const GLfloat *toX = to->x[k];
+		const GLfloat *toY = to->y[k];
+		GLfloat *outX = out->x[k];
+		GLfloat *outY = out->y[k];
+
+		for (i = 0; i < count; i++)
+		{
+			GLfloat dx = toX[i] - fromX[i];
+			GLfloat dy = toY[i] - fromY[i];
+			outX[i] = dx > LERP_JUMP || dx < -LERP_JUMP ? toX[i] : fromX[i] + dx * alpha;
+			outY[i] = dy > LERP_JUMP || dy < -LERP_JUMP ? toY[i] : fromY[i] + dy * alpha;
+		}
+	}
+	memcpy(out->r, to->r, count);
+	memcpy(out->g, to->g, count);
+	memcpy(out->b, to->b, count);
+	out->count = count;
+}
+
+enum soaKernels selectSoAKernel(enum soaKernels kernel)
+{
+#ifdef SOA_HAVE_AVX2
+	if (kernel == SOA_KERNEL_AVX2 && !__builtin_cpu_supports("avx2"))
+	{
+		kernel = SOA_KERNEL_SSE;
+	}
+#else
+	if (kernel == SOA_KERNEL_AVX2)
+	{
+		kernel = SOA_KERNEL_SSE;
+	}
+#endif
+#ifndef SOA_HAVE_SSE
+	if (kernel == SOA_KERNEL_SSE)
+	{
+		kernel = SOA_KERNEL_SCALAR;
+	}
+#endif
+
+	g_soaKernel = kernel;
+	g_soaKernelSelected = 1;
+	return kernel;
+}
+
+const char *soaKernelName(enum soaKernels kernel)
+{
+	switch (kernel)
+	{
+	case SOA_KERNEL_AVX2:
+		return "avx2";
+	case SOA_KERNEL_SSE:
+		return "sse";
+	default:
+		return "scalar";
+	}
+}
+
+void freePrimSoA(struct s_primSoA *soa)
+{
+	int k;
+
+	for (k = 0; k < 4; k++)
+	{
+		freeHeap(soa->x[k]);
+		freeHeap(soa->y[k]);
+	}
+	freeHeap(soa->r);
+	freeHeap(soa->g);
+	freeHeap(soa->b);
+	memset(soa, 0, sizeof(*soa));
+}
+
+// Moves the four corners of each primitive along one axis.
+// A primitive whose low edge went past 1 is moved so its high edge sits at -1 and the other way around,
+// which is the same wrap movePrimitive does, without the branches on which way we are moving.
+static void translateAxisScalar(GLfloat **c, int begin, int end, GLfloat d)
+{
+	// Local copies of the corner arrays, otherwise every store could alias c and force a reload.
+	GLfloat *corner0 = c[0];
+	GLfloat *corner1 = c[1];
+	GLfloat *corner2 = c[2];
+	GLfloat *corner3 = c[3];
+	int i;
+
+	for (i = begin; i < end; i++)
+	{
+		GLfloat c0 = corner0[i] + d;
+		GLfloat c1 = corner1[i] + d;
+		GLfloat c2 = corner2[i] + d;
+		GLfloat c3 = corner3[i] + d;
+		GLfloat lo = c0 < c1 ? c0 : c1;
+		GLfloat hi = c0 > c1 ? c0 : c1;
+		GLfloat shift = 0.0f;
+
+		lo = c2 < lo ? c2 : lo;
+		lo = c3 < lo ? c3 : lo;
+		hi = c2 > hi ? c2 : hi;
+		hi = c3 > hi ? c3 : hi;
+		if (lo > 1.0f)
+		{
+			shift = -1.0f - hi;
+		}
+		else if (hi < -1.0f)
+		{
+			shift = 1.0f - lo;
+		}
+
+		corner0[i] = c0 + shift;
+		corner1[i] = c1 + shift;
+		corner2[i] = c2 + shift;
+		corner3[i] = c3 + shift;
+	}
+}
+
+#ifdef SOA_HAVE_SSE
+// Four primitives per iteration, the wrap is a pair of compare masks instead of branches.
+static void translateAxisSSE(GLfloat **c, int count, GLfloat d)
+{
+	__m128 delta = _mm_set1_ps(d);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 minusOne = _mm_set1_ps(-1.0f);
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		__m128 c0 = _mm_add_ps(_mm_loadu_ps(c[0] + i), delta);
+		__m128 c1 = _mm_add_ps(_mm_loadu_ps(c[1] + i), delta);
+		__m128 c2 = _mm_add_ps(_mm_loadu_ps(c[2] + i), delta);
+		__m128 c3 = _mm_add_ps(_mm_loadu_ps(c[3] + i), delta);
+		__m128 lo = _mm_min_ps(_mm_min_ps(c0, c1), _mm_min_ps(c2, c3));
+		__m128 hi = _mm_max_ps(_mm_max_ps(c0, c1), _mm_max_ps(c2, c3));
+		// lo > 1 and hi < -1 can't both be true, so the two shifts can just be or'd together.
+		__m128 wrapHigh = _mm_and_ps(_mm_cmpgt_ps(lo, one), _mm_sub_ps(minusOne, hi));
+		__m128 wrapLow = _mm_and_ps(_mm_cmplt_ps(hi, minusOne), _mm_sub_ps(one, lo));
+		__m128 shift = _mm_or_ps(wrapHigh, wrapLow);
+
+		_mm_storeu_ps(c[0] + i, _mm_add_ps(c0, shift));
+		_mm_storeu_ps(c[1] + i, _mm_add_ps(c1, shift));
+		_mm_storeu_ps(c[2] + i, _mm_add_ps(c2, shift));
+		_mm_storeu_ps(c[3] + i, _mm_add_ps(c3, shift));
+	}
+	translateAxisScalar(c, i, count, d);
+}
+#endif
+
+#ifdef SOA_HAVE_AVX2
+// Same as the sse kernel, eight primitives at a time.
+__attribute__((target("avx2")))
+static void translateAxisAVX2(GLfloat **c, int count, GLfloat d)
+{
+	__m256 delta = _mm256_set1_ps(d);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 minusOne = _mm256_set1_ps(-1.0f);
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		__m256 c0 = _mm256_add_ps(_mm256_loadu_ps(c[0] + i), delta);
+		__m256 c1 = _mm256_add_ps(_mm256_loadu_ps(c[1] + i), delta);
+		__m256 c2 = _mm256_add_ps(_mm256_loadu_ps(c[2] + i), delta);
+		__m256 c3 = _mm256_add_ps(_mm256_loadu_ps(c[3] + i), delta);
+		__m256 lo = _mm256_min_ps(_mm256_min_ps(c0, c1), _mm256_min_ps(c2, c3));
+		__m256 hi = _mm256_max_ps(_mm256_max_ps(c0, c1), _mm256_max_ps(c2, c3));
+		__m256 wrapHigh = _mm256_and_ps(_mm256_cmp_ps(lo, one, _CMP_GT_OQ), _mm256_sub_ps(minusOne, hi));
+		__m256 wrapLow = _mm256_and_ps(_mm256_cmp_ps(hi, minusOne, _CMP_LT_OQ), _mm256_sub_ps(one, lo));
+		__m256 shift = _mm256_or_ps(wrapHigh, wrapLow);
+
+		_mm256_storeu_ps(c[0] + i, _mm256_add_ps(c0, shift));
+		_mm256_storeu_ps(c[1] + i, _mm256_add_ps(c1, shift));
+		_mm256_storeu_ps(c[2] + i, _mm256_add_ps(c2, shift));
+		_mm256_storeu_ps(c[3] + i, _mm256_add_ps(c3, shift));
+	}
+	translateAxisScalar(c, i, count, d);
+}
+#endif
@@ -0,0 +1,42 @@
+#ifndef PRIMSOA_H
+#define PRIMSOA_H
+
+#include "primitive.h"
+
+// Which translate and wrap kernel movePrimSoA runs, the best one the cpu supports is picked by default.
+enum soaKernels { SOA_KERNEL_SCALAR, SOA_KERNEL_SSE, SOA_KERNEL_AVX2 };
+
+// Struct of arrays store for large numbers of quads.
+// Corner k of primitive i lives at x[k][i], y[k][i], so one pass can move and wrap many primitives with simd.
+struct s_primSoA {
+	GLfloat *x[4];
+	GLfloat *y[4];
+	unsigned char *r, *g, *b;
+	int count;
+	int capacity;
+};
+
+//allocates room for capacity primitives. Returns 0 on failure.
+int initPrimSoA(struct s_primSoA *soa, int capacity);
+//appends a copy of the primitive, returns its index or -1 when full
+int addPrimSoA(struct s_primSoA *soa, const struct s_polyF4 *f4);
+//reads primitive index back into a s_polyF4
+void getPrimSoA(const struct s_primSoA *soa, int index, struct s_polyF4 *f4);
+//moves and wraps every primitive, the same as calling movePrimitive on each of them
+void movePrimSoA(struct s_primSoA *soa, enum inputTypes decodedInput);
+//translates every primitive by dx, dy and wraps the ones that left the screen to the other side
+void translatePrimSoA(struct s_primSoA *soa, GLfloat dx, GLfloat dy);
+//sets slice to a view of primitives begin to end of soa, sharing its arrays, so a range can be moved or packed on its own
+void slicePrimSoA(const struct s_primSoA *soa, int begin, int end, struct s_primSoA *slice);
+//copies the primitives of src over dst, which needs the capacity for them
+void copyPrimSoA(struct s_primSoA *dst, const struct s_primSoA *src);
+//sets out to the positions alpha of the way from from to to, with the colors of to. A primitive that wrapped in between is put at to.
+void lerpPrimSoA(struct s_primSoA *out, const struct s_primSoA *from, const struct s_primSoA *to, GLfloat alpha);
+//selects the kernel used by translatePrimSoA, falling back to the best supported one below it. Returns the kernel selected.
+enum soaKernels selectSoAKernel(enum soaKernels kernel);
+//name of a kernel for printing
+const char *soaKernelName(enum soaKernels kernel);
+//frees the arrays
+void freePrimSoA(struct s_primSoA *soa);
+
+#endif
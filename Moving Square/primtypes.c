@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "primtypes.h"
+#include "arena.h"
+
+static void addPrimRun(struct s_primStream *stream, enum primTypes type);
+
+// What one corner k of a primitive p writes into its vertex dst, for each way of coloring and texturing.
+// k is pasted onto the field names, so each is unrolled with the fields fixed and nothing is decided per primitive.
+// Every corner starts as a copy of base, which holds what all of the primitive's corners share, so a flat untextured
+// corner is its position and one 8 byte store rather than a store for each color, texel and pad byte.
+#define PRIM_COLOR_FLAT(dst, p, k)
+#define PRIM_COLOR_GOURAUD(dst, p, k) (dst)->r = (p)->r##k; (dst)->g = (p)->g##k; (dst)->b = (p)->b##k;
+#define PRIM_TEXTURE_NONE(dst, p, k)
+#define PRIM_TEXTURE_UV(dst, p, k) (dst)->u = (p)->u##k; (dst)->v = (p)->v##k;
+#define PRIM_VERTEX(dst, p, k, color, texture) \
+	*(dst) = base; \
+	(dst)->x = (p)->x##k; \
+	(dst)->y = (p)->y##k; \
+	PRIM_COLOR_##color(dst, p, k) \
+	PRIM_TEXTURE_##texture(dst, p, k)
+
+// The vertex every corner of p starts from, its first color, opaque, with no texel.
+#define PRIM_BASE(p) \
+	struct s_primVertex base = { 0.0f, 0.0f, (p)->r0, (p)->g0, (p)->b0, 255, 0, 0, { 0, 0 } };
+
+// The corners each shape's vertices come from, a quad's two triangles share the 1 to 2 edge.
+#define PRIM_EMIT_TRI(dst, p, color, texture) \
+	PRIM_VERTEX(&(dst)[0], p, 0, color, texture) \
+	PRIM_VERTEX(&(dst)[1], p, 1, color, texture) \
+	PRIM_VERTEX(&(dst)[2], p, 2, color, texture)
+#define PRIM_EMIT_QUAD(dst, p, color, texture) \
+	PRIM_VERTEX(&(dst)[0], p, 0, color, texture) \
+	PRIM_VERTEX(&(dst)[1], p, 1, color, texture) \
+	PRIM_VERTEX(&(dst)[2], p, 2, color, texture) \
+	PRIM_VERTEX(&(dst)[3], p, 2, color, texture) \
+	PRIM_VERTEX(&(dst)[4], p, 3, color, texture) \
+	PRIM_VERTEX(&(dst)[5], p, 1, color, texture)
+
+#define PRIM_NAME(name, type, psxCode, shape, color, texture) "POLY_" #name,
+static const char *g_primTypeNames[PRIM_TYPE_COUNT] = { PRIM_TYPES(PRIM_NAME) };
+#undef PRIM_NAME
+
+#define PRIM_VERTEX_COUNT(name, type, psxCode, shape, color, texture) PRIM_VERTICES_##shape,
+static const int g_primTypeVertices[PRIM_TYPE_COUNT] = { PRIM_TYPES(PRIM_VERTEX_COUNT) };
+#undef PRIM_VERTEX_COUNT
+
+// Each type's setter and emitter. The emitter's loop body is the type's corners written out, with no branches.
+#define PRIM_DEFINE(name, type, psxCode, shape, color, texture) \
+void setPoly##name(struct type *prim) \
+{ \
+	memset(prim, 0, sizeof(*prim)); \
+	prim->code = psxCode; \
+} \
+void emitPoly##name(const struct type *prims, int count, struct s_primVertex *vertices) \
+{ \
+	int i; \
+	for (i = 0; i < count; i++) \
+	{ \
+		const struct type *p = &prims[i]; \
+		struct s_primVertex *dst = vertices + i * PRIM_VERTICES_##shape; \
+		PRIM_BASE(p) \
+		PRIM_EMIT_##shape(dst, p, color, texture) \
+	} \
+}
+PRIM_TYPES(PRIM_DEFINE)
+#undef PRIM_DEFINE
+
+int primTypeVertices(enum primTypes type)
+{
+	return g_primTypeVertices[type];
+}
+
+const char *primTypeName(enum primTypes type)
+{
+	return g_primTypeNames[type];
+}
+
+// Every primitive could start a run of its own, so there is room for as many runs as primitives.
+int initPrimStream(struct s_primStream *stream, int capacity)
+{
+	memset(stream, 0, sizeof(*stream));
+#define PRIM_ALLOC(name, type, psxCode, shape, color, texture) \
+	stream->prims##name = allocHeap(sizeof(struct type) * capacity); \
+	stream->capacity##name = capacity; \
+	if (stream->prims##name == NULL) \
+	{ \
+		freePrimStream(stream); \
+		return 0; \
+	}
+	PRIM_TYPES(PRIM_ALLOC)
+#undef PRIM_ALLOC
+	stream->runs = allocHeap(sizeof(struct s_primRun) * capacity * PRIM_TYPE_COUNT);
+	if (stream->runs == NULL)
+	{
+		freePrimStream(stream);
+		return 0;
+	}
+	stream->runCapacity = capacity * PRIM_TYPE_COUNT;
+	return 1;
+}
+
+void clearPrimStream(struct s_primStream *stream)
+{
+#define PRIM_CLEAR(name, type, psxCode, shape, color, texture) stream->count##name = 0;
+	PRIM_TYPES(PRIM_CLEAR)
+#undef PRIM_CLEAR
+	stream->runCount = 0;
+	stream->vertexCount = 0;
+}
+
+// Adding is the one place a primitive's type is looked at, each goes to the end of its type's array and of the last
+// run if that is of the same type.
+int addPrimStream(struct s_primStream *stream, const void *prim)
+{
+	// Every type starts with the tag then the code, like s_polyF4.
+	unsigned char code = ((const struct s_polyF4 *)prim)->code & PRIM_CODE_MASK;
+
+#define PRIM_ADD(name, type, psxCode, shape, color, texture) \
+	if (code == psxCode) \
+	{ \
+		if (stream->count##name == stream->capacity##name) \
+		{ \
+			return 0; \
+		} \
+		stream->prims##name[stream->count##name++] = *(const struct type *)prim; \
+		addPrimRun(stream, PRIM_##name); \
+		stream->vertexCount += PRIM_VERTICES_##shape; \
+		return 1; \
+	}
+	PRIM_TYPES(PRIM_ADD)
+#undef PRIM_ADD
+	return 0;
+}
+
+int primStreamVertices(const struct s_primStream *stream)
+{
+	return stream->vertexCount;
+}
+
+int convertPrimStream(const struct s_primStream *stream, struct s_primVertex *vertices)
+{
+	int first[PRIM_TYPE_COUNT] = { 0 };	// each type's first primitive not converted yet
+	int count = 0;
+	int r;
+
+	for (r = 0; r < stream->runCount; r++)
+	{
+		const struct s_primRun *run = &stream->runs[r];
+
+		switch (run->type)
+		{
+#define PRIM_CONVERT(name, type, psxCode, shape, color, texture) \
+		case PRIM_##name: \
+			emitPoly##name(stream->prims##name + first[PRIM_##name], run->count, vertices + count); \
+			count += run->count * PRIM_VERTICES_##shape; \
+			break;
+		PRIM_TYPES(PRIM_CONVERT)
+#undef PRIM_CONVERT
+		default:
+			break;
+		}
+		first[run->type] += run->count;
+	}
+	return count;
+}
+
+void freePrimStream(struct s_primStream *stream)
+{
+#define PRIM_FREE(name, type, psxCode, shape, color, texture) freeHeap(stream->prims##name);
+	PRIM_TYPES(PRIM_FREE)
+#undef PRIM_FREE
+	freeHeap(stream->runs);
+	memset(stream, 0, sizeof(*stream));
+}
+
+// Extends the last run with one more primitive of type, or starts a new one. There is always room, see initPrimStream.
+static void addPrimRun(struct s_primStream *stream, enum primTypes type)
+{
+	if (stream->runCount > 0 && stream->runs[stream->runCount - 1].type == type)
+	{
+		stream->runs[stream->runCount - 1].count++;
+		return;
+	}
+	stream->runs[stream->runCount].type = type;
+	stream->runs[stream->runCount].count = 1;
+	stream->runCount++;
+}
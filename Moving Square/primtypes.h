@@ -0,0 +1,130 @@
+#ifndef PRIMTYPES_H
+#define PRIMTYPES_H
+
+#include "primitive.h"
+
+// The psx polygon primitives, listed once so every per type struct and emitter is generated from the same table.
+// Only bench.c uses these so far, the renderer still draws s_polyF4 through the batch's own packing.
+// X(name, struct, psx code, shape, color, texture):
+// shape TRI or QUAD, color FLAT (r0 for every corner) or GOURAUD (a color per corner), texture NONE or UV (u, v per corner).
+#define PRIM_TYPES(X) \
+	X(F3, s_polyF3, 0x20, TRI, FLAT, NONE) \
+	X(F4, s_polyF4, 0x28, QUAD, FLAT, NONE) \
+	X(G4, s_polyG4, 0x38, QUAD, GOURAUD, NONE) \
+	X(FT4, s_polyFT4, 0x2c, QUAD, FLAT, UV)
+
+#define PRIM_ENUM(name, type, psxCode, shape, color, texture) PRIM_##name,
+enum primTypes { PRIM_TYPES(PRIM_ENUM) PRIM_TYPE_COUNT };
+#undef PRIM_ENUM
+
+// The code byte of each type. The low two bits are the semi transparent and raw texture flags, the rest is the type.
+#define PRIM_CODE_MASK	0xfc
+#define PRIM_CODE(name, type, psxCode, shape, color, texture) PRIM_CODE_##name = psxCode,
+enum primCodes { PRIM_TYPES(PRIM_CODE) };
+#undef PRIM_CODE
+
+// Corners and emitted vertices of each shape, a quad is two triangles (0,1,2) and (2,3,1) like convertPrimQuadVertices.
+#define PRIM_CORNERS_TRI	3
+#define PRIM_CORNERS_QUAD	4
+#define PRIM_VERTICES_TRI	3
+#define PRIM_VERTICES_QUAD	6
+
+// Mirror the psx POLY_F3, POLY_G4 and POLY_FT4 layouts like s_polyF4 does POLY_F4, with float positions.
+struct s_polyF3 {
+	unsigned long *tag;
+	unsigned char r0, g0, b0;
+	unsigned char code;
+	GLfloat x0, y0;
+	GLfloat x1, y1;
+	GLfloat x2, y2;
+};
+
+struct s_polyG4 {
+	unsigned long *tag;
+	unsigned char r0, g0, b0;
+	unsigned char code;
+	GLfloat x0, y0;
+	unsigned char r1, g1, b1, pad1;
+	GLfloat x1, y1;
+	unsigned char r2, g2, b2, pad2;
+	GLfloat x2, y2;
+	unsigned char r3, g3, b3, pad3;
+	GLfloat x3, y3;
+};
+
+// u and v are texels in the 256 x 256 texture page, clut and tpage pick the palette and page as on the psx.
+struct s_polyFT4 {
+	unsigned long *tag;
+	unsigned char r0, g0, b0;
+	unsigned char code;
+	GLfloat x0, y0;
+	unsigned char u0, v0;
+	unsigned short clut;
+	GLfloat x1, y1;
+	unsigned char u1, v1;
+	unsigned short tpage;
+	GLfloat x2, y2;
+	unsigned char u2, v2;
+	unsigned short pad1;
+	GLfloat x3, y3;
+	unsigned char u3, v3;
+	unsigned short pad2;
+};
+
+// One vertex every primitive type converts to, so a mixed stream goes in one buffer. The untextured types leave u and v 0.
+struct s_primVertex {
+	GLfloat x, y;
+	GLubyte r, g, b, a;
+	GLubyte u, v;	// texels of the page, read as 0 to 1
+	GLubyte pad[2];
+};
+
+// A run of primitives of one type added one after another.
+struct s_primRun {
+	enum primTypes type;
+	int count;
+};
+
+// A frame's primitives kept in one array per type, so converting them runs each type's emitter over its own array
+// instead of switching on the type of every primitive. The runs of one type after another are kept in the order they
+// were added, and the emitters go through them in that order, so overlapping primitives still paint in it.
+// Converting costs one switch a run, a stream drawn a type at a time pays it a few times a frame.
+#define PRIM_STREAM_FIELDS(name, type, psxCode, shape, color, texture) \
+	struct type *prims##name; \
+	int count##name; \
+	int capacity##name;
+struct s_primStream {
+	PRIM_TYPES(PRIM_STREAM_FIELDS)
+	struct s_primRun *runs;
+	int runCount;
+	int runCapacity;
+	int vertexCount;	// of everything added so far
+};
+#undef PRIM_STREAM_FIELDS
+
+#define PRIM_DECLARE(name, type, psxCode, shape, color, texture) \
+	void setPoly##name(struct type *prim); \
+	void emitPoly##name(const struct type *prims, int count, struct s_primVertex *vertices);
+//setPolyX zeroes a primitive and sets its psx code, like the psx SetPolyX macros
+//emitPolyX converts count primitives of one type to PRIM_VERTICES_X vertices each, one after another
+PRIM_TYPES(PRIM_DECLARE)
+#undef PRIM_DECLARE
+
+//vertices each primitive of a type converts to
+int primTypeVertices(enum primTypes type);
+//name of a type for printing, as the psx calls it
+const char *primTypeName(enum primTypes type);
+//allocates room in the stream for capacity primitives of every type. Returns 0 on failure.
+int initPrimStream(struct s_primStream *stream, int capacity);
+//empties the stream, keeping its room
+void clearPrimStream(struct s_primStream *stream);
+//adds a primitive, its type taken from its psx code. Returns 0 if that type is full or the code isn't one of PRIM_TYPES.
+int addPrimStream(struct s_primStream *stream, const void *prim);
+//vertices the whole stream converts to
+int primStreamVertices(const struct s_primStream *stream);
+//converts every primitive into vertices in the order they were added. Returns the vertices written.
+int convertPrimStream(const struct s_primStream *stream, struct s_primVertex *vertices);
+//frees the stream
+void freePrimStream(struct s_primStream *stream);
+
+#endif
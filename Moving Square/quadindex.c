@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "quadindex.h"
+
+static const char *g_quadIndexModeNames[QUAD_INDEX_MODES] = { "list", "strip" };
+
+const char *quadIndexModeName(enum quadIndexModes mode)
+{
+	return g_quadIndexModeNames[mode];
+}
+
+int parseQuadIndexMode(const char *name)
+{
+	int mode;
+
+	for (mode = 0; mode < QUAD_INDEX_MODES; mode++)
+	{
+		if (strcmp(name, g_quadIndexModeNames[mode]) == 0)
+		{
+			return mode;
+		}
+	}
+	return -1;
+}
+
+GLenum quadIndexPrimitive(enum quadIndexModes mode)
+{
+	return mode == QUAD_INDEX_STRIP ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+}
+
+int quadIndexCount(enum quadIndexModes mode, int count)
+{
+	return count * (mode == QUAD_INDEX_STRIP ? 5 : 6);
+}
+
+void buildQuadIndices(enum quadIndexModes mode, int count, GLuint *indices)
+{
+	GLuint i;
+
+	if (mode == QUAD_INDEX_STRIP)
+	{
+		// The strip 0,1,2,3 is the triangles (0,1,2) and (2,1,3). The second covers the same corners as the list's (2,3,1)
+		// wound the other way, which draws the same with culling off, as it always is for the quads.
+		for (i = 0; i < (GLuint)count; i++)
+		{
+			indices[i * 5 + 0] = i * 4 + 0;
+			indices[i * 5 + 1] = i * 4 + 1;
+			indices[i * 5 + 2] = i * 4 + 2;
+			indices[i * 5 + 3] = i * 4 + 3;
+			indices[i * 5 + 4] = QUAD_RESTART_INDEX;
+		}
+		return;
+	}
+
+	for (i = 0; i < (GLuint)count; i++)
+	{
+		indices[i * 6 + 0] = i * 4 + 0;
+		indices[i * 6 + 1] = i * 4 + 1;
+		indices[i * 6 + 2] = i * 4 + 2;
+		indices[i * 6 + 3] = i * 4 + 2;
+		indices[i * 6 + 4] = i * 4 + 3;
+		indices[i * 6 + 5] = i * 4 + 1;
+	}
+}
+
+// A restart doesn't empty the cache, the vertices before it can still be hit after.
+void simulateVertexCache(enum quadIndexModes mode, const GLuint *indices, int count, int cacheSize, struct s_vertexCacheStats *stats)
+{
+	GLuint cache[VERTEX_CACHE_MAX];
+	int next = 0;	// the oldest entry, replaced by the next miss
+	int filled = 0;
+	int strip = 0;	// indices since the last restart
+	int i;
+	int k;
+
+	if (cacheSize > VERTEX_CACHE_MAX)
+	{
+		cacheSize = VERTEX_CACHE_MAX;
+	}
+	for (i = 0; i < count; i++)
+	{
+		GLuint index = indices[i];
+
+		if (mode == QUAD_INDEX_STRIP && index == QUAD_RESTART_INDEX)
+		{
+			strip = 0;
+			continue;
+		}
+		stats->indices++;
+		if (mode == QUAD_INDEX_STRIP)
+		{
+			stats->triangles += ++strip >= 3;
+		}
+		else
+		{
+			stats->triangles += i % 3 == 2;
+		}
+
+		for (k = 0; k < filled && cache[k] != index; k++)
+		{
+		}
+		if (k < filled)
+		{
+			continue;
+		}
+		stats->misses++;
+		cache[next] = index;
+		next = (next + 1) % cacheSize;
+		filled += filled < cacheSize;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef QUADINDEX_H
+#define QUADINDEX_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+// How a quad's four vertices are indexed. Every quad is the same two triangles (0,1,2) and (2,3,1) convertPrimQuadVertices
+// makes from six vertices, the indices only differ in where the quad starts, so one buffer built up front serves every frame.
+enum quadIndexModes {
+	QUAD_INDEX_LIST,	// six indices a quad, drawn as GL_TRIANGLES
+	QUAD_INDEX_STRIP,	// the four corners as a strip then QUAD_RESTART_INDEX, five a quad, drawn as GL_TRIANGLE_STRIP
+	QUAD_INDEX_MODES
+};
+
+#define QUAD_RESTART_INDEX	0xffffffffu	// ends a strip, set with glPrimitiveRestartIndex
+#define VERTEX_CACHE_MAX	64	// most entries simulateVertexCache can model
+
+// What a post-transform vertex cache did over an index buffer. A miss is a vertex the gpu has to shade.
+struct s_vertexCacheStats {
+	unsigned long indices;	// restarts aren't counted
+	unsigned long triangles;
+	unsigned long misses;
+};
+
+//name of a mode for printing and the -indices option
+const char *quadIndexModeName(enum quadIndexModes mode);
+//the mode with that name, -1 if there's none
+int parseQuadIndexMode(const char *name);
+//the primitive a mode draws with
+GLenum quadIndexPrimitive(enum quadIndexModes mode);
+//indices count quads take
+int quadIndexCount(enum quadIndexModes mode, int count);
+//writes the indices of quads 0 to count, four vertices each from vertex 0
+void buildQuadIndices(enum quadIndexModes mode, int count, GLuint *indices);
+//runs count indices of a mode through a first in first out cache of cacheSize vertices, adding what it did to stats
+void simulateVertexCache(enum quadIndexModes mode, const GLuint *indices, int count, int cacheSize, struct s_vertexCacheStats *stats);
+
+#endif
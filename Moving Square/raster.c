@@ -0,0 +1,616 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "raster.h"
+#include "image.h"
+#include "timer.h"
+#include "arena.h"
+
+#define SUBPIXEL_ONE	(1 << RASTER_SUBPIXEL_BITS)
+#define BLOCK_LAST	(RASTER_BLOCK_SIZE - 1)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_HAVE_SSE
+#include <emmintrin.h>
+#endif
+
+// The avx2 kernel is built with a target attribute and only used when the cpu reports avx2 at runtime.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RASTER_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+static enum rasterKernels g_rasterKernel = RASTER_KERNEL_AVX2;
+static int g_rasterKernelSelected = 0;
+
+// Set bits in each 4 bit lane mask, for counting the pixels a kernel wrote.
+static const unsigned char g_maskBits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+static void setupQuads(void *arg, int begin, int end);
+static void setupTriangle(const struct s_raster *raster, struct s_rasterTriangle *tri, const long long *x, const long long *y,
+	unsigned int color);
+static void snapVertex(const struct s_raster *raster, const struct s_quadVertex *vertex, long long *x, long long *y);
+static int binTriangles(struct s_raster *raster, struct s_arena *arena, int count);
+static void fillTiles(void *arg, int begin, int end);
+static unsigned long fillTriangle(struct s_raster *raster, const struct s_rasterTriangle *tri, int tileX, int tileY);
+static long long floorDiv(long long value, int divisor);
+static unsigned int fillBlockScalar(unsigned int *pixels, int stride, const int *e, const int *a, const int *b, unsigned int color);
+#ifdef RASTER_HAVE_SSE
+static unsigned int fillBlockSSE(unsigned int *pixels, int stride, const int *e, const int *a, const int *b, unsigned int color);
+#endif
+#ifdef RASTER_HAVE_AVX2
+static unsigned int fillBlockAVX2(unsigned int *pixels, int stride, const int *e, const int *a, const int *b, unsigned int color);
+#endif
+
+int initRaster(struct s_raster *raster, int width, int height)
+{
+	memset(raster, 0, sizeof(*raster));
+	if (width % RASTER_BLOCK_SIZE != 0 || height % RASTER_BLOCK_SIZE != 0)
+	{
+		fprintf(stderr, "Software raster needs a size that is a multiple of %d, not %d x %d\n", RASTER_BLOCK_SIZE, width, height);
+		return 0;
+	}
+
+	raster->width = width;
+	raster->height = height;
+	raster->tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	raster->tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	raster->pixels = allocHeap(sizeof(unsigned int) * width * height);
+	raster->tiles = callocHeap(raster->tilesX * raster->tilesY, sizeof(struct s_rasterTile));
+	if (raster->pixels == NULL || raster->tiles == NULL)
+	{
+		fprintf(stderr, "Failed to allocate a %d x %d software raster\n", width, height);
+		freeRaster(raster);
+		return 0;
+	}
+	setRasterClearColor(raster, 0, 0, 0, 255);
+
+	if (!g_rasterKernelSelected)
+	{
+		selectRasterKernel(RASTER_KERNEL_AVX2);
+	}
+	raster->kernel = g_rasterKernel;
+	return 1;
+}
+
+void setRasterClearColor(struct s_raster *raster, GLubyte r, GLubyte g, GLubyte b, GLubyte a)
+{
+	GLubyte rgba[4] = { r, g, b, a };
+	memcpy(&raster->clearColor, rgba, sizeof(raster->clearColor));
+}
+
+void drawRasterQuads(struct s_raster *raster, struct s_jobSystem *jobs, struct s_arena *arena, const struct s_quadVertex *vertices, int count)
+{
+	double start = timerNow();
+	int i;
+
+	raster->triangles = arenaAlloc(arena, sizeof(struct s_rasterTriangle) * 2 * count);
+	if (raster->triangles == NULL)
+	{
+		fprintf(stderr, "Failed to allocate %d raster triangles\n", count * 2);
+		count = 0;
+	}
+
+	raster->vertices = vertices;
+	runJobs(jobs, setupQuads, raster, count, RASTER_SETUP_CHUNK);
+	raster->vertices = NULL;
+
+	// Binning is one pass in order, so each tile's triangles stay in the order they were drawn in.
+	// If there is no room for the bins the tiles are still cleared, only empty.
+	if (!binTriangles(raster, arena, count * 2))
+	{
+		for (i = 0; i < raster->tilesX * raster->tilesY; i++)
+		{
+			raster->tiles[i].count = 0;
+		}
+	}
+	runJobs(jobs, fillTiles, raster, raster->tilesX * raster->tilesY, 1);
+	raster->triangles = NULL;
+	raster->binned = NULL;
+
+	raster->frame.triangles = (unsigned long)count * 2;
+	raster->frame.pixels = 0;
+	for (i = 0; i < raster->tilesX * raster->tilesY; i++)
+	{
+		raster->frame.pixels += raster->tiles[i].pixels;
+	}
+	raster->frame.seconds = timerNow() - start;
+
+	raster->total.triangles += raster->frame.triangles;
+	raster->total.pixels += raster->frame.pixels;
+	raster->total.seconds += raster->frame.seconds;
+	raster->frames++;
+}
+
+unsigned long compareRasterFrame(struct s_raster *raster, const unsigned char *rgba)
+{
+	const unsigned char *pixels = (const unsigned char *)raster->pixels;
+	unsigned long differ = 0;
+	int i;
+
+	for (i = 0; i < raster->width * raster->height; i++)
+	{
+		if (memcmp(&pixels[i * 4], &rgba[i * 4], 4) != 0)
+		{
+			differ++;
+		}
+	}
+	if (differ > 0)
+	{
+		raster->differingFrames++;
+		raster->differingPixels += differ;
+	}
+	return differ;
+}
+
+int writeRasterFrame(const struct s_raster *raster, const char *path)
+{
+	return writeImage(path, raster->width, raster->height, (const unsigned char *)raster->pixels, 1);
+}
+
+enum rasterKernels selectRasterKernel(enum rasterKernels kernel)
+{
+#ifdef RASTER_HAVE_AVX2
+	if (kernel == RASTER_KERNEL_AVX2 && !__builtin_cpu_supports("avx2"))
+	{
+		kernel = RASTER_KERNEL_SSE;
+	}
+#else
+	if (kernel == RASTER_KERNEL_AVX2)
+	{
+		kernel = RASTER_KERNEL_SSE;
+	}
+#endif
+#ifndef RASTER_HAVE_SSE
+	if (kernel == RASTER_KERNEL_SSE)
+	{
+		kernel = RASTER_KERNEL_SCALAR;
+	}
+#endif
+
+	g_rasterKernel = kernel;
+	g_rasterKernelSelected = 1;
+	return kernel;
+}
+
+const char *rasterKernelName(enum rasterKernels kernel)
+{
+	switch (kernel)
+	{
+	case RASTER_KERNEL_AVX2:
+		return "avx2";
+	case RASTER_KERNEL_SSE:
+		return "sse";
+	default:
+		return "scalar";
+	}
+}
+
+int parseRasterKernel(const char *name)
+{
+	int kernel;
+
+	for (kernel = RASTER_KERNEL_SCALAR; kernel <= RASTER_KERNEL_AVX2; kernel++)
+	{
+		if (strcmp(name, rasterKernelName((enum rasterKernels)kernel)) == 0)
+		{
+			return kernel;
+		}
+	}
+	return -1;
+}
+
+void resetRasterStats(struct s_raster *raster)
+{
+	memset(&raster->total, 0, sizeof(raster->total));
+	raster->frames = 0;
+	raster->differingFrames = 0;
+	raster->differingPixels = 0;
+}
+
+void freeRaster(struct s_raster *raster)
+{
+	freeHeap(raster->pixels);
+	freeHeap(raster->tiles);
+	raster->pixels = NULL;
+	raster->tiles = NULL;
+}
+
+// Each quad is the two triangles the batch's indices make, (0,1,2) and (2,3,1).
+static void setupQuads(void *arg, int begin, int end)
+{
+	struct s_raster *raster = arg;
+	long long x[4];
+	long long y[4];
+	int i;
+	int k;
+
+	for (i = begin; i < end; i++)
+	{
+		const struct s_quadVertex *quad = &raster->vertices[i * 4];
+		GLubyte rgba[4] = { quad[0].r, quad[0].g, quad[0].b, quad[0].a };
+		unsigned int color;
+		memcpy(&color, rgba, sizeof(color));
+
+		for (k = 0; k < 4; k++)
+		{
+			snapVertex(raster, &quad[k], &x[k], &y[k]);
+		}
+		long long x0[3] = { x[0], x[1], x[2] };
+		long long y0[3] = { y[0], y[1], y[2] };
+		long long x1[3] = { x[2], x[3], x[1] };
+		long long y1[3] = { y[2], y[3], y[1] };
+		setupTriangle(raster, &raster->triangles[i * 2], x0, y0, color);
+		setupTriangle(raster, &raster->triangles[i * 2 + 1], x1, y1, color);
+	}
+}
+
+// Either winding is drawn, like gl with culling off, by swapping two corners of the clockwise ones.
+// A triangle reaching more than a screen past any side is dropped, which keeps every edge step and every edge value
+// inside a block that the edge crosses within 32 bits. The quads here never get near that.
+static void setupTriangle(const struct s_raster *raster, struct s_rasterTriangle *tri, const long long *x, const long long *y,
+	unsigned int color)
+{
+	long long px[3] = { x[0], x[1], x[2] };
+	long long py[3] = { y[0], y[1], y[2] };
+	long long limitX = (long long)raster->width * SUBPIXEL_ONE;
+	long long limitY = (long long)raster->height * SUBPIXEL_ONE;
+	long long area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+	long long minX = px[0];
+	long long maxX = px[0];
+	long long minY = py[0];
+	long long maxY = py[0];
+	int k;
+
+	tri->minX = 0;
+	tri->maxX = -1;
+	for (k = 1; k < 3; k++)
+	{
+		minX = px[k] < minX ? px[k] : minX;
+		maxX = px[k] > maxX ? px[k] : maxX;
+		minY = py[k] < minY ? py[k] : minY;
+		maxY = py[k] > maxY ? py[k] : maxY;
+	}
+	if (area == 0 || minX < -limitX || maxX > 2 * limitX || minY < -limitY || maxY > 2 * limitY)
+	{
+		return;
+	}
+	if (area < 0)
+	{
+		long long swap = px[1];
+		px[1] = px[2];
+		px[2] = swap;
+		swap = py[1];
+		py[1] = py[2];
+		py[2] = swap;
+	}
+
+	// Pixel centers are at whole subpixel positions after snapping, so the pixels inside the bounds are the ones whose
+	// centers are.
+	tri->minX = (int)floorDiv(minX + SUBPIXEL_ONE - 1, SUBPIXEL_ONE);
+	tri->maxX = (int)floorDiv(maxX, SUBPIXEL_ONE);
+	tri->minY = (int)floorDiv(minY + SUBPIXEL_ONE - 1, SUBPIXEL_ONE);
+	tri->maxY = (int)floorDiv(maxY, SUBPIXEL_ONE);
+	tri->minX = tri->minX < 0 ? 0 : tri->minX;
+	tri->minY = tri->minY < 0 ? 0 : tri->minY;
+	tri->maxX = tri->maxX >= raster->width ? raster->width - 1 : tri->maxX;
+	tri->maxY = tri->maxY >= raster->height ? raster->height - 1 : tri->maxY;
+	tri->color = color;
+
+	// Counter clockwise the inside is left of every edge. A pixel center right on an edge belongs to the triangle when
+	// the edge is a left or a bottom one, the way llvmpipe fills with the origin at the bottom left, so two triangles
+	// sharing an edge never both cover it.
+	for (k = 0; k < 3; k++)
+	{
+		int j = (k + 1) % 3;
+		long long dx = px[j] - px[k];
+		long long dy = py[j] - py[k];
+		int owned = dy < 0 || (dy == 0 && dx > 0);
+
+		tri->a[k] = (int)(-dy * SUBPIXEL_ONE);
+		tri->b[k] = (int)(dx * SUBPIXEL_ONE);
+		tri->c[k] = dy * px[k] - dx * py[k] - (owned ? 0 : 1);
+	}
+}
+
+// The vertex goes through the same steps as the quad shader and gl's viewport transform, in floats, then is snapped
+// with pixel centers at whole subpixel positions. Positions often land exactly half a subpixel apart, so the rounding
+// has to match too: llvmpipe fuses the viewport multiply and add, and snaps to the nearest even.
+static void snapVertex(const struct s_raster *raster, const struct s_quadVertex *vertex, long long *x, long long *y)
+{
+#if QUAD_VERTEX_FORMAT == VERTEX_FORMAT_COMPACT
+	GLfloat nx = vertex->x / 32767.0f;
+	GLfloat ny = vertex->y / 32767.0f;
+	nx = nx < -1.0f ? -1.0f : nx;
+	ny = ny < -1.0f ? -1.0f : ny;
+#else
+	GLfloat nx = vertex->x;
+	GLfloat ny = vertex->y;
+#endif
+	GLfloat halfWidth = raster->width * 0.5f;
+	GLfloat halfHeight = raster->height * 0.5f;
+
+	*x = llrintf((fmaf(nx, halfWidth, halfWidth) - 0.5f) * SUBPIXEL_ONE);
+	*y = llrintf((fmaf(ny, halfHeight, halfHeight) - 0.5f) * SUBPIXEL_ONE);
+}
+
+// Counts each tile's triangles, then lays the tiles out one after the other and fills them in a second pass.
+static int binTriangles(struct s_raster *raster, struct s_arena *arena, int count)
+{
+	int tileCount = raster->tilesX * raster->tilesY;
+	int total = 0;
+	int i;
+	int tx;
+	int ty;
+
+	for (i = 0; i < tileCount; i++)
+	{
+		raster->tiles[i].count = 0;
+	}
+	for (i = 0; i < count; i++)
+	{
+		const struct s_rasterTriangle *tri = &raster->triangles[i];
+		if (tri->minX > tri->maxX || tri->minY > tri->maxY)
+		{
+			continue;
+		}
+		for (ty = tri->minY / RASTER_TILE_SIZE; ty <= tri->maxY / RASTER_TILE_SIZE; ty++)
+		{
+			for (tx = tri->minX / RASTER_TILE_SIZE; tx <= tri->maxX / RASTER_TILE_SIZE; tx++)
+			{
+				raster->tiles[ty * raster->tilesX + tx].count++;
+			}
+		}
+	}
+
+	for (i = 0; i < tileCount; i++)
+	{
+		raster->tiles[i].first = total;
+		total += raster->tiles[i].count;
+		raster->tiles[i].count = 0;
+	}
+	raster->binned = arenaAlloc(arena, sizeof(int) * total);
+	if (raster->binned == NULL)
+	{
+		fprintf(stderr, "Failed to allocate %d binned triangles\n", total);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		const struct s_rasterTriangle *tri = &raster->triangles[i];
+		if (tri->minX > tri->maxX || tri->minY > tri->maxY)
+		{
+			continue;
+		}
+		for (ty = tri->minY / RASTER_TILE_SIZE; ty <= tri->maxY / RASTER_TILE_SIZE; ty++)
+		{
+			for (tx = tri->minX / RASTER_TILE_SIZE; tx <= tri->maxX / RASTER_TILE_SIZE; tx++)
+			{
+				struct s_rasterTile *tile = &raster->tiles[ty * raster->tilesX + tx];
+				raster->binned[tile->first + tile->count++] = i;
+			}
+		}
+	}
+	return 1;
+}
+
+static void fillTiles(void *arg, int begin, int end)
+{
+	struct s_raster *raster = arg;
+	int t;
+	int x;
+	int y;
+	int i;
+
+	for (t = begin; t < end; t++)
+	{
+		struct s_rasterTile *tile = &raster->tiles[t];
+		int tileX = (t % raster->tilesX) * RASTER_TILE_SIZE;
+		int tileY = (t / raster->tilesX) * RASTER_TILE_SIZE;
+		int endX = tileX + RASTER_TILE_SIZE < raster->width ? tileX + RASTER_TILE_SIZE : raster->width;
+		int endY = tileY + RASTER_TILE_SIZE < raster->height ? tileY + RASTER_TILE_SIZE : raster->height;
+
+		for (y = tileY; y < endY; y++)
+		{
+			unsigned int *row = &raster->pixels[y * raster->width];
+			for (x = tileX; x < endX; x++)
+			{
+				row[x] = raster->clearColor;
+			}
+		}
+
+		tile->pixels = 0;
+		for (i = 0; i < tile->count; i++)
+		{
+			tile->pixels += fillTriangle(raster, &raster->triangles[raster->binned[tile->first + i]], tileX, tileY);
+		}
+	}
+}
+
+// Walks the blocks of the triangle's bounds inside the tile. Each edge is worked out at the block's corner in 64 bits,
+// which says whether the block is all outside it, all inside it, or crossed by it. Only the crossing edges are tested
+// per pixel, and those fit in 32 bits since they change sign inside the block.
+static unsigned long fillTriangle(struct s_raster *raster, const struct s_rasterTriangle *tri, int tileX, int tileY)
+{
+	int minX = tri->minX > tileX ? tri->minX : tileX;
+	int minY = tri->minY > tileY ? tri->minY : tileY;
+	int maxX = tri->maxX < tileX + RASTER_TILE_SIZE - 1 ? tri->maxX : tileX + RASTER_TILE_SIZE - 1;
+	int maxY = tri->maxY < tileY + RASTER_TILE_SIZE - 1 ? tri->maxY : tileY + RASTER_TILE_SIZE - 1;
+	unsigned long written = 0;
+	int x;
+	int y;
+	int k;
+
+	for (y = minY & ~BLOCK_LAST; y <= maxY; y += RASTER_BLOCK_SIZE)
+	{
+		for (x = minX & ~BLOCK_LAST; x <= maxX; x += RASTER_BLOCK_SIZE)
+		{
+			int e[3] = { 0, 0, 0 };
+			int a[3] = { 0, 0, 0 };
+			int b[3] = { 0, 0, 0 };
+			int crossed = 0;
+
+			for (k = 0; k < 3; k++)
+			{
+				long long value = (long long)tri->a[k] * x + (long long)tri->b[k] * y + tri->c[k];
+				long long stepX = (long long)tri->a[k] * BLOCK_LAST;
+				long long stepY = (long long)tri->b[k] * BLOCK_LAST;
+				long long low = value + (stepX < 0 ? stepX : 0) + (stepY < 0 ? stepY : 0);
+				long long high = value + (stepX > 0 ? stepX : 0) + (stepY > 0 ? stepY : 0);
+
+				if (high < 0)
+				{
+					break;
+				}
+				if (low < 0)
+				{
+					e[k] = (int)value;
+					a[k] = tri->a[k];
+					b[k] = tri->b[k];
+					crossed = 1;
+				}
+			}
+			if (k < 3)
+			{
+				continue;
+			}
+
+			unsigned int *pixels = &raster->pixels[y * raster->width + x];
+			if (!crossed)
+			{
+				int row;
+				int column;
+				for (row = 0; row < RASTER_BLOCK_SIZE; row++)
+				{
+					for (column = 0; column < RASTER_BLOCK_SIZE; column++)
+					{
+						pixels[row * raster->width + column] = tri->color;
+					}
+				}
+				written += RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE;
+				continue;
+			}
+			switch (raster->kernel)
+			{
+#ifdef RASTER_HAVE_AVX2
+			case RASTER_KERNEL_AVX2:
+				written += fillBlockAVX2(pixels, raster->width, e, a, b, tri->color);
+				break;
+#endif
+#ifdef RASTER_HAVE_SSE
+			case RASTER_KERNEL_SSE:
+				written += fillBlockSSE(pixels, raster->width, e, a, b, tri->color);
+				break;
+#endif
+			default:
+				written += fillBlockScalar(pixels, raster->width, e, a, b, tri->color);
+				break;
+			}
+		}
+	}
+	return written;
+}
+
+static long long floorDiv(long long value, int divisor)
+{
+	return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+// The edges a block doesn't cross come in as 0, so they pass everywhere. A pixel is inside when no edge is negative,
+// which is when the or of all three has no sign bit.
+static unsigned int fillBlockScalar(unsigned int *pixels, int stride, const int *e, const int *a, const int *b, unsigned int color)
+{
+	unsigned int written = 0;
+	int row;
+	int column;
+
+	for (row = 0; row < RASTER_BLOCK_SIZE; row++)
+	{
+		for (column = 0; column < RASTER_BLOCK_SIZE; column++)
+		{
+			int inside = (e[0] + a[0] * column + b[0] * row) | (e[1] + a[1] * column + b[1] * row) | (e[2] + a[2] * column + b[2] * row);
+			if (inside >= 0)
+			{
+				pixels[row * stride + column] = color;
+				written++;
+			}
+		}
+	}
+	return written;
+}
+
+#ifdef RASTER_HAVE_SSE
+// Half a row at a time, the sign of the or'd edges is spread into a mask that picks the color or the old pixel.
+static unsigned int fillBlockSSE(unsigned int *pixels, int stride, const int *e, const int *a, const int *b, unsigned int color)
+{
+	__m128i fill = _mm_set1_epi32((int)color);
+	__m128i left[3];
+	__m128i right[3];
+	__m128i down[3];
+	unsigned int written = 0;
+	int row;
+	int k;
+
+	for (k = 0; k < 3; k++)
+	{
+		left[k] = _mm_setr_epi32(e[k], e[k] + a[k], e[k] + a[k] * 2, e[k] + a[k] * 3);
+		right[k] = _mm_add_epi32(left[k], _mm_set1_epi32(a[k] * 4));
+		down[k] = _mm_set1_epi32(b[k]);
+	}
+	for (row = 0; row < RASTER_BLOCK_SIZE; row++)
+	{
+		__m128i *line = (__m128i *)&pixels[row * stride];
+		__m128i outLeft = _mm_srai_epi32(_mm_or_si128(_mm_or_si128(left[0], left[1]), left[2]), 31);
+		__m128i outRight = _mm_srai_epi32(_mm_or_si128(_mm_or_si128(right[0], right[1]), right[2]), 31);
+
+		_mm_storeu_si128(line, _mm_or_si128(_mm_and_si128(outLeft, _mm_loadu_si128(line)), _mm_andnot_si128(outLeft, fill)));
+		_mm_storeu_si128(line + 1, _mm_or_si128(_mm_and_si128(outRight, _mm_loadu_si128(line + 1)), _mm_andnot_si128(outRight, fill)));
+		written += 8 - g_maskBits[_mm_movemask_ps(_mm_castsi128_ps(outLeft))] - g_maskBits[_mm_movemask_ps(_mm_castsi128_ps(outRight))];
+
+		for (k = 0; k < 3; k++)
+		{
+			left[k] = _mm_add_epi32(left[k], down[k]);
+			right[k] = _mm_add_epi32(right[k], down[k]);
+		}
+	}
+	return written;
+}
+#endif
+
+#ifdef RASTER_HAVE_AVX2
+// Same as the sse kernel, a whole row at a time.
+__attribute__((target("avx2")))
+static unsigned int fillBlockAVX2(unsigned int *pixels, int stride, const int *e, const int *a, const int *b, unsigned int color)
+{
+	__m256i fill = _mm256_set1_epi32((int)color);
+	__m256i edge[3];
+	__m256i down[3];
+	unsigned int written = 0;
+	int row;
+	int k;
+
+	for (k = 0; k < 3; k++)
+	{
+		edge[k] = _mm256_add_epi32(_mm256_set1_epi32(e[k]), _mm256_mullo_epi32(_mm256_set1_epi32(a[k]), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+		down[k] = _mm256_set1_epi32(b[k]);
+	}
+	for (row = 0; row < RASTER_BLOCK_SIZE; row++)
+	{
+		__m256i *line = (__m256i *)&pixels[row * stride];
+		__m256i out = _mm256_srai_epi32(_mm256_or_si256(_mm256_or_si256(edge[0], edge[1]), edge[2]), 31);
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(out));
+
+		_mm256_storeu_si256(line, _mm256_blendv_epi8(fill, _mm256_loadu_si256(line), out));
+		written += 8 - g_maskBits[mask & 15] - g_maskBits[mask >> 4];
+
+		for (k = 0; k < 3; k++)
+		{
+			edge[k] = _mm256_add_epi32(edge[k], down[k]);
+		}
+	}
+	return written;
+}
+#endif
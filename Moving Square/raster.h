@@ -0,0 +1,88 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "batch.h"
+#include "jobs.h"
+#include "arena.h"
+
+#define RASTER_TILE_SIZE	64	// pixels on a side of a tile, each tile is cleared and filled by one job
+#define RASTER_BLOCK_SIZE	8	// pixels on a side of the blocks edges are tested in, one avx2 row of 32 bit pixels
+#define RASTER_SUBPIXEL_BITS	8	// fraction bits vertex positions are snapped to, the same as llvmpipe so the edges land alike
+#define RASTER_SETUP_CHUNK	4096	// quads set up by each job
+
+// Which edge test kernel fills the blocks an edge crosses, the best one the cpu supports is picked by default.
+enum rasterKernels { RASTER_KERNEL_SCALAR, RASTER_KERNEL_SSE, RASTER_KERNEL_AVX2 };
+
+// One triangle in fixed point, set up so every edge is a*x + b*y + c at the center of pixel x, y.
+// A pixel is covered when all three are >= 0, the edges that don't own their pixels are 1 lower so ties go one way.
+struct s_rasterTriangle {
+	int minX, minY, maxX, maxY;	// pixels it can cover, clipped to the screen, minX > maxX when none
+	int a[3];
+	int b[3];
+	long long c[3];
+	unsigned int color;	// rgba8 as it goes in the framebuffer
+};
+
+// The triangles that touch a tile, in the order they were drawn, are binned[first] to binned[first + count - 1].
+struct s_rasterTile {
+	int first;
+	int count;
+	unsigned long pixels;	// written by the tile's job the last frame
+};
+
+// Counts for one frame, or all frames in total.
+struct s_rasterStats {
+	unsigned long triangles;	// submitted, two a quad
+	unsigned long pixels;	// written, a pixel covered twice counts twice
+	double seconds;	// setting up, binning and filling
+};
+
+// Draws s_quadVertex quads the way the quad shader does into a framebuffer in memory, with no gpu or gl context.
+// Each frame the quads are set up as triangles on every job thread, binned into tiles in order, then the tiles are
+// cleared and filled on every job thread, a tile at a time so no two threads write the same pixels.
+// The triangles and bins only last the frame, so they come from the frame arena and only the framebuffer is kept.
+// Positions are snapped like gl snaps them and pixel centers are tested with the same fill rule, so a frame matches
+// what llvmpipe draws pixel for pixel.
+struct s_raster {
+	int width;
+	int height;
+	unsigned int *pixels;	// rgba8, bottom row first like glReadPixels gives
+	unsigned int clearColor;
+	enum rasterKernels kernel;	// the one selected when it was set up
+	int tilesX;
+	int tilesY;
+	struct s_rasterTile *tiles;
+	struct s_rasterTriangle *triangles;	// the frame being drawn, in the frame arena
+	int *binned;	// the same
+	const struct s_quadVertex *vertices;	// the quads being set up
+
+	struct s_rasterStats frame;	// the last frame
+	struct s_rasterStats total;
+	unsigned long frames;
+	unsigned long differingFrames;	// frames compareRasterFrame found a difference in
+	unsigned long differingPixels;
+};
+
+//allocates a width x height framebuffer, both multiples of RASTER_BLOCK_SIZE. Returns 0 on failure.
+int initRaster(struct s_raster *raster, int width, int height);
+//sets the color frames are cleared to
+void setRasterClearColor(struct s_raster *raster, GLubyte r, GLubyte g, GLubyte b, GLubyte a);
+//clears the framebuffer and draws count quads, four vertices each as packed for the batch, on every job thread.
+//The triangles are allocated from arena, which has to outlive the call but not the frame.
+void drawRasterQuads(struct s_raster *raster, struct s_jobSystem *jobs, struct s_arena *arena, const struct s_quadVertex *vertices, int count);
+//counts the pixels that differ from rgba, a frame of the same size bottom row first, and adds them to the totals
+unsigned long compareRasterFrame(struct s_raster *raster, const unsigned char *rgba);
+//writes the framebuffer as a .ppm or .png. Returns 0 on failure.
+int writeRasterFrame(const struct s_raster *raster, const char *path);
+//selects the edge test kernel of rasters set up from now on, falling back to the best supported one below it. Returns the kernel selected.
+enum rasterKernels selectRasterKernel(enum rasterKernels kernel);
+//name of a kernel for printing
+const char *rasterKernelName(enum rasterKernels kernel);
+//the kernel with that name, -1 if there's none
+int parseRasterKernel(const char *name);
+//clears the totals
+void resetRasterStats(struct s_raster *raster);
+//frees the framebuffer
+void freeRaster(struct s_raster *raster);
+
+#endif
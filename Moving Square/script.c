@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script.h"
+#include "arena.h"
+
+static const char *g_inputNames[] = { "up", "down", "left", "right", "upleft", "upright", "downleft", "downright", "color", "none" };
+
+// Script time is shared with scriptClock, which setPrimitiveClock takes as a plain function.
+static unsigned long g_scriptFrames = 0;
+
+int parseInputScript(struct s_inputScript *script, const char *text)
+{
+	const char *token = text;
+	int capacity = 1;
+	const char *c;
+
+	memset(script, 0, sizeof(*script));
+	for (c = text; *c != '\0'; c++)
+	{
+		capacity += *c == ',';
+	}
+	script->steps = allocHeap(sizeof(struct s_scriptStep) * capacity);
+	if (script->steps == NULL)
+	{
+		return 0;
+	}
+
+	while (*token != '\0')
+	{
+		size_t length = strcspn(token, ",");
+		size_t nameLength = strcspn(token, ":,");
+		struct s_scriptStep *step = &script->steps[script->stepCount];
+		int input;
+
+		step->frames = 1;
+		if (nameLength < length)
+		{
+			step->frames = atoi(token + nameLength + 1);
+		}
+		for (input = UP; input <= NONE; input++)
+		{
+			if (strlen(g_inputNames[input]) == nameLength && strncmp(token, g_inputNames[input], nameLength) == 0)
+			{
+				break;
+			}
+		}
+		if (input > NONE || step->frames < 1)
+		{
+			fprintf(stderr, "Bad input script step: %.*s\n", (int)length, token);
+			freeInputScript(script);
+			return 0;
+		}
+		step->input = (enum inputTypes)input;
+		script->stepCount++;
+
+		token += length;
+		if (*token == ',')
+		{
+			token++;
+		}
+	}
+
+	if (script->stepCount == 0)
+	{
+		fprintf(stderr, "Input script is empty\n");
+		freeInputScript(script);
+		return 0;
+	}
+	g_scriptFrames = 0;
+	return 1;
+}
+
+enum inputTypes nextScriptInput(struct s_inputScript *script)
+{
+	struct s_scriptStep *step = &script->steps[script->step];
+	enum inputTypes input = step->input;
+
+	script->frame++;
+	if (script->frame == step->frames)
+	{
+		script->frame = 0;
+		script->step = (script->step + 1) % script->stepCount;
+	}
+	g_scriptFrames++;
+	return input;
+}
+
+double scriptClock(void)
+{
+	return g_scriptFrames / SCRIPT_RATE;
+}
+
+void freeInputScript(struct s_inputScript *script)
+{
+	freeHeap(script->steps);
+	memset(script, 0, sizeof(*script));
+}
@@ -0,0 +1,34 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "primitive.h"
+
+// Frames per second of the script clock, one input is read per frame.
+#define SCRIPT_RATE	60.0
+
+// One run of the same input for a number of frames.
+struct s_scriptStep {
+	enum inputTypes input;
+	int frames;
+};
+
+// Scripted input in place of the keyboard, so benchmark runs press the same keys on the same frames every time.
+// Written as comma separated input:frames pairs, e.g. "upright:90,color,none:10". The frames default to 1.
+// Inputs are up, down, left, right, upleft, upright, downleft, downright, color and none. The script loops when it reaches the end.
+struct s_inputScript {
+	struct s_scriptStep *steps;
+	int stepCount;
+	int step;
+	int frame;	// frames into the current step
+};
+
+//parses the script text. Returns 0 and prints the bad step on failure.
+int parseInputScript(struct s_inputScript *script, const char *text);
+//input for the next frame
+enum inputTypes nextScriptInput(struct s_inputScript *script);
+//seconds of script time read so far, for setPrimitiveClock so color changes happen on the same frames
+double scriptClock(void);
+//frees the steps
+void freeInputScript(struct s_inputScript *script);
+
+#endif
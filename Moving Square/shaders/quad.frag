@@ -0,0 +1,10 @@
+#version 330 core
+
+in vec4 quadColor;
+
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	color = quadColor;
+}
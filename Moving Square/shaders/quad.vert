@@ -0,0 +1,12 @@
+#version 330 core
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec4 vertexColor;
+
+out vec4 quadColor;
+
+void main()
+{
+	gl_Position = vec4(position, 0.0, 1.0);
+	quadColor = vertexColor;
+}
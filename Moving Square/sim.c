@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "timer.h"
+
+// The sim clock is read through setPrimitiveClock, which takes a plain function.
+static const struct s_simulation *g_clockSimulation = NULL;
+
+static void runSimulation(void *arg);
+static void tickSimulation(struct s_simulation *sim, double time);
+static void publishSnapshot(struct s_simulation *sim, double time);
+static void fillSnapshot(struct s_simulation *sim, struct s_simSnapshot *snapshot, double time);
+static double simClock(void);
+
+int initSimulation(struct s_simulation *sim, struct s_polyF4 *prims, struct s_primSoA *soa, int count, struct s_inputScript *script,
+	struct s_inputQueue *queue, double tickRate)
+{
+	int i;
+
+	memset(sim, 0, sizeof(*sim));
+	sim->prims = prims;
+	sim->soa = soa;
+	sim->count = count;
+	sim->script = script;
+	sim->queue = queue;
+	sim->tickLength = 1.0 / tickRate;
+	sim->pinned[0] = -1;
+	sim->pinned[1] = -1;
+
+	for (i = 0; i < SIM_SNAPSHOTS; i++)
+	{
+		if (!initPrimSoA(&sim->snapshots[i].prims, count))
+		{
+			freeSimulation(sim);
+			return 0;
+		}
+	}
+	initMutex(&sim->mutex);
+	return 1;
+}
+
+int startSimulation(struct s_simulation *sim)
+{
+	// The starting state is published as both snapshots, so there is something to draw before the first tick.
+	sim->startTime = timerNow();
+	fillSnapshot(sim, &sim->snapshots[0], sim->startTime);
+	sim->previous = 0;
+	sim->latest = 0;
+
+	// Without a script the colors change once a second of sim time, not wall time.
+	if (sim->script == NULL)
+	{
+		g_clockSimulation = sim;
+		setPrimitiveClock(simClock);
+	}
+
+	sim->running = startThread(&sim->thread, runSimulation, sim);
+	return sim->running;
+}
+
+void lockSnapshots(struct s_simulation *sim, const struct s_primSoA **from, const struct s_primSoA **to, GLfloat *alpha)
+{
+	const struct s_simSnapshot *previous;
+	const struct s_simSnapshot *latest;
+
+	lockMutex(&sim->mutex);
+	sim->pinned[0] = sim->previous;
+	sim->pinned[1] = sim->latest;
+	previous = &sim->snapshots[sim->previous];
+	latest = &sim->snapshots[sim->latest];
+	unlockMutex(&sim->mutex);
+
+	// Drawing a tick behind keeps the frame between two ticks that have already happened.
+	double renderTime = timerNow() - sim->tickLength;
+	double span = latest->time - previous->time;
+	double t = span > 0.0 ? (renderTime - previous->time) / span : 1.0;
+
+	*from = &previous->prims;
+	*to = &latest->prims;
+	*alpha = (GLfloat)(t < 0.0 ? 0.0 : t > 1.0 ? 1.0 : t);
+}
+
+void unlockSnapshots(struct s_simulation *sim)
+{
+	lockMutex(&sim->mutex);
+	sim->pinned[0] = -1;
+	sim->pinned[1] = -1;
+	unlockMutex(&sim->mutex);
+}
+
+void stopSimulation(struct s_simulation *sim)
+{
+	if (!sim->running)
+	{
+		return;
+	}
+	lockMutex(&sim->mutex);
+	sim->stop = 1;
+	unlockMutex(&sim->mutex);
+	joinThread(&sim->thread);
+	sim->running = 0;
+
+	if (g_clockSimulation == sim)
+	{
+		setPrimitiveClock(NULL);
+		g_clockSimulation = NULL;
+	}
+}
+
+void freeSimulation(struct s_simulation *sim)
+{
+	int i;
+
+	stopSimulation(sim);
+	for (i = 0; i < SIM_SNAPSHOTS; i++)
+	{
+		freePrimSoA(&sim->snapshots[i].prims);
+	}
+	freeMutex(&sim->mutex);
+}
+
+static void runSimulation(void *arg)
+{
+	struct s_simulation *sim = arg;
+	double nextTick = sim->startTime + sim->tickLength;
+
+	for (;;)
+	{
+		lockMutex(&sim->mutex);
+		int stop = sim->stop;
+		unlockMutex(&sim->mutex);
+		if (stop)
+		{
+			break;
+		}
+
+		// Sleep until the tick is close, the sleeps aren't precise enough to wait out the last millisecond.
+		double now = timerNow();
+		if (now < nextTick)
+		{
+			int wait = (int)((nextTick - now) * 1000.0);
+			sleepThread(wait > 1 ? wait - 1 : 0);
+			continue;
+		}
+
+		// Run the ticks that are due, a few at most, then drop the rest so a long stall doesn't leave the sim running flat out.
+		int catchUp = 0;
+		while (now >= nextTick && catchUp < SIM_MAX_CATCHUP)
+		{
+			tickSimulation(sim, nextTick);
+			nextTick += sim->tickLength;
+			catchUp++;
+		}
+		double tickTime = nextTick - sim->tickLength;
+		if (now >= nextTick)
+		{
+			unsigned long dropped = (unsigned long)((now - nextTick) / sim->tickLength) + 1;
+			sim->droppedTicks += dropped;
+			nextTick += dropped * sim->tickLength;
+		}
+
+		publishSnapshot(sim, tickTime);
+	}
+}
+
+static void tickSimulation(struct s_simulation *sim, double time)
+{
+	enum inputTypes input;
+	int i;
+
+	if (sim->script != NULL)
+	{
+		input = nextScriptInput(sim->script);
+	}
+	else
+	{
+		// Only the events up to when the tick was due, later ones belong to the next tick even when catching up.
+		drainInputQueue(sim->queue, &sim->keys, time);
+		input = decodeKeyState(&sim->keys);
+	}
+
+	sim->ticks++;
+	if (sim->trace != NULL)
+	{
+		traceStep(sim->trace, input);
+	}
+	if (sim->soa != NULL)
+	{
+		movePrimSoA(sim->soa, input);
+	}
+	else
+	{
+		for (i = 0; i < sim->count; i++)
+		{
+			movePrimitive(&sim->prims[i], input);
+		}
+	}
+}
+
+static void publishSnapshot(struct s_simulation *sim, double time)
+{
+	int slot;
+
+	// Any slot that isn't published or pinned is free, with SIM_SNAPSHOTS of them there is always one.
+	lockMutex(&sim->mutex);
+	for (slot = 0; slot < SIM_SNAPSHOTS; slot++)
+	{
+		if (slot != sim->previous && slot != sim->latest && slot != sim->pinned[0] && slot != sim->pinned[1])
+		{
+			break;
+		}
+	}
+	unlockMutex(&sim->mutex);
+
+	fillSnapshot(sim, &sim->snapshots[slot], time);
+
+	lockMutex(&sim->mutex);
+	sim->previous = sim->latest;
+	sim->latest = slot;
+	unlockMutex(&sim->mutex);
+}
+
+static void fillSnapshot(struct s_simulation *sim, struct s_simSnapshot *snapshot, double time)
+{
+	int i;
+
+	if (sim->soa != NULL)
+	{
+		copyPrimSoA(&snapshot->prims, sim->soa);
+	}
+	else
+	{
+		snapshot->prims.count = 0;
+		for (i = 0; i < sim->count; i++)
+		{
+			addPrimSoA(&snapshot->prims, &sim->prims[i]);
+		}
+	}
+	snapshot->tick = sim->ticks;
+	snapshot->time = time;
+}
+
+static double simClock(void)
+{
+	return g_clockSimulation->ticks * g_clockSimulation->tickLength;
+}
@@ -0,0 +1,64 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "primitive.h"
+#include "primsoa.h"
+#include "script.h"
+#include "input.h"
+#include "thread.h"
+#include "trace.h"
+
+#define SIM_SNAPSHOTS	5	// the two published, the two the renderer has pinned and one being written
+#define SIM_MAX_CATCHUP	5	// ticks run back to back before the sim gives up on catching up
+
+// The primitives as they were after one tick.
+struct s_simSnapshot {
+	struct s_primSoA prims;
+	unsigned long tick;
+	double time;	// when the tick was due, on the timerNow clock
+};
+
+// Moves the primitives on its own thread at a fixed tick rate, so they move at the same speed however fast the frames are drawn.
+// Every tick is published as a snapshot and the renderer draws between the last two, one tick behind.
+struct s_simulation {
+	// the state the sim owns while it runs, either an array of primitives or a struct of arrays
+	struct s_polyF4 *prims;
+	struct s_primSoA *soa;
+	int count;
+	struct s_inputScript *script;	// NULL takes the input from queue
+	struct s_inputQueue *queue;	// the sim thread is its only consumer
+	struct s_keyState keys;
+	double tickLength;	// seconds
+	struct s_trace *trace;	// records every tick's input when set, before startSimulation
+
+	struct s_simSnapshot snapshots[SIM_SNAPSHOTS];
+	int previous;	// the last two published snapshots, guarded by mutex
+	int latest;
+	int pinned[2];	// the pair the renderer is drawing, -1 when none
+
+	struct s_mutex mutex;
+	struct s_thread thread;
+	int running;
+	int stop;	// guarded by mutex
+	double startTime;
+
+	// stats
+	unsigned long ticks;
+	unsigned long droppedTicks;	// ticks skipped when the sim fell too far behind
+};
+
+//sets up the snapshots for count primitives moving at tickRate ticks a second. prims or soa is the state, the input comes from script or else queue. Returns 0 on failure.
+int initSimulation(struct s_simulation *sim, struct s_polyF4 *prims, struct s_primSoA *soa, int count, struct s_inputScript *script,
+	struct s_inputQueue *queue, double tickRate);
+//starts the sim thread, the state belongs to it until stopSimulation. Returns 0 on failure.
+int startSimulation(struct s_simulation *sim);
+//pins the two snapshots to draw between until unlockSnapshots, alpha is how far to go from from to to
+void lockSnapshots(struct s_simulation *sim, const struct s_primSoA **from, const struct s_primSoA **to, GLfloat *alpha);
+//lets the sim reuse the pinned snapshots
+void unlockSnapshots(struct s_simulation *sim);
+//stops the thread, the state is then the one after the last tick
+void stopSimulation(struct s_simulation *sim);
+//frees the snapshots
+void freeSimulation(struct s_simulation *sim);
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+#include "timer.h"
+#include "glstate.h"
+#include "arena.h"
+
+const char *const g_streamModeNames[] = { "subdata", "persistent", "resident" };
+
+static void waitRegion(struct s_streamBuffer *stream);
+static void advanceRegion(struct s_streamBuffer *stream);
+static void uploadDirtyBlocks(struct s_streamBuffer *stream, GLintptr offset, GLsizeiptr size);
+
+int initStreamBuffer(struct s_streamBuffer *stream, GLsizeiptr regionSize, enum streamModes mode, GLsizeiptr blockSize)
+{
+	GLsizeiptr size = regionSize * STREAM_REGIONS;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->regionSize = regionSize;
+	stream->mode = STREAM_SUBDATA;
+
+	glGenBuffers(1, &stream->vbo);
+	stateBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+
+	// Every block starts dirty, so the first frame uploads all of it whatever was written.
+	if (mode == STREAM_RESIDENT)
+	{
+		stream->mode = STREAM_RESIDENT;
+		stream->blockSize = blockSize;
+		glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_DYNAMIC_DRAW);
+		stream->staging = callocHeap(1, regionSize);
+		stream->dirty = allocHeap(regionSize / blockSize);
+		if (stream->staging == NULL || stream->dirty == NULL)
+		{
+			fprintf(stderr, "Failed to allocate %ld byte resident copy\n", (long)regionSize);
+			freeStreamBuffer(stream);
+			return 0;
+		}
+		memset(stream->dirty, 1, regionSize / blockSize);
+		return 1;
+	}
+
+	if (mode == STREAM_PERSISTENT && GLEW_ARB_buffer_storage)
+	{
+		// Immutable storage that stays mapped for the life of the buffer, coherent so no flushes are needed.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		stream->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		if (stream->mapped != NULL)
+		{
+			stream->mode = STREAM_PERSISTENT;
+			return 1;
+		}
+
+		// Storage is immutable, so start again with a fresh buffer for the fallback.
+		fprintf(stderr, "Failed to map stream buffer, falling back to glBufferSubData\n");
+		stateDeleteBuffers(1, &stream->vbo);
+		glGenBuffers(1, &stream->vbo);
+		stateBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+	}
+
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	stream->staging = allocHeap(regionSize);
+	if (stream->staging == NULL)
+	{
+		fprintf(stderr, "Failed to allocate %ld byte staging buffer\n", (long)regionSize);
+		stateDeleteBuffers(1, &stream->vbo);
+		return 0;
+	}
+
+	return 1;
+}
+
+void *mapStream(struct s_streamBuffer *stream, GLsizeiptr minSize, GLsizeiptr *available, GLintptr *offset)
+{
+	if (minSize > stream->regionSize)
+	{
+		return NULL;
+	}
+	// The resident copy is written in place, the gpu only sees it once the dirty blocks are uploaded.
+	if (stream->mode == STREAM_RESIDENT)
+	{
+		stream->mapOffset = stream->used;
+		*offset = stream->mapOffset;
+		*available = stream->regionSize - stream->used;
+		return stream->staging + stream->mapOffset;
+	}
+	if (stream->regionSize - stream->used < minSize)
+	{
+		advanceRegion(stream);
+	}
+	if (stream->used == 0)
+	{
+		waitRegion(stream);
+	}
+
+	stream->mapOffset = stream->region * stream->regionSize + stream->used;
+	*offset = stream->mapOffset;
+	*available = stream->regionSize - stream->used;
+
+	if (stream->mode == STREAM_PERSISTENT)
+	{
+		return stream->mapped + stream->mapOffset;
+	}
+	return stream->staging;
+}
+
+unsigned char *streamDirtyFlags(struct s_streamBuffer *stream, GLintptr offset)
+{
+	if (stream->mode != STREAM_RESIDENT)
+	{
+		return NULL;
+	}
+	return stream->dirty + offset / stream->blockSize;
+}
+
+void unmapStream(struct s_streamBuffer *stream, GLsizeiptr used)
+{
+	if (stream->mode == STREAM_RESIDENT)
+	{
+		uploadDirtyBlocks(stream, stream->mapOffset, used);
+		stream->used += used;
+		return;
+	}
+	if (stream->mode == STREAM_SUBDATA && used > 0)
+	{
+		double start = timerNow();
+		stateBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, stream->mapOffset, used, stream->staging);
+		stream->frame.uploadSeconds += timerNow() - start;
+		stream->frame.ranges++;
+	}
+
+	stream->used += used;
+	stream->frame.bytes += used;
+}
+
+void endStreamFrame(struct s_streamBuffer *stream)
+{
+	if (stream->mode == STREAM_RESIDENT)
+	{
+		stream->used = 0;
+	}
+	else if (stream->used > 0)
+	{
+		advanceRegion(stream);
+	}
+
+	stream->lastFrame = stream->frame;
+	stream->total.bytes += stream->frame.bytes;
+	stream->total.stalls += stream->frame.stalls;
+	stream->total.orphans += stream->frame.orphans;
+	stream->total.ranges += stream->frame.ranges;
+	stream->total.uploadSeconds += stream->frame.uploadSeconds;
+	memset(&stream->frame, 0, sizeof(stream->frame));
+}
+
+void freeStreamBuffer(struct s_streamBuffer *stream)
+{
+	int i;
+
+	for (i = 0; i < STREAM_REGIONS; i++)
+	{
+		if (stream->fences[i] != NULL)
+		{
+			glDeleteSync(stream->fences[i]);
+			stream->fences[i] = NULL;
+		}
+	}
+	if (stream->mode == STREAM_PERSISTENT)
+	{
+		stateBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		stream->mapped = NULL;
+	}
+	stateDeleteBuffers(1, &stream->vbo);
+	freeHeap(stream->staging);
+	stream->staging = NULL;
+	freeHeap(stream->dirty);
+	stream->dirty = NULL;
+}
+
+int parseStreamMode(const char *name)
+{
+	int mode;
+
+	for (mode = STREAM_SUBDATA; mode <= STREAM_RESIDENT; mode++)
+	{
+		if (strcmp(name, g_streamModeNames[mode]) == 0)
+		{
+			return mode;
+		}
+	}
+	return -1;
+}
+
+// Makes sure the gpu is done reading the current region before it is written again.
+static void waitRegion(struct s_streamBuffer *stream)
+{
+	GLsync fence = stream->fences[stream->region];
+	int i;
+
+	if (fence == NULL)
+	{
+		return;
+	}
+
+	double start = timerNow();
+	if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		if (stream->mode == STREAM_SUBDATA)
+		{
+			// Instead of waiting hand the driver fresh storage, the old one is released once the gpu is done with it.
+			stateBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+			glBufferData(GL_ARRAY_BUFFER, stream->regionSize * STREAM_REGIONS, NULL, GL_STREAM_DRAW);
+			for (i = 0; i < STREAM_REGIONS; i++)
+			{
+				if (stream->fences[i] != NULL)
+				{
+					glDeleteSync(stream->fences[i]);
+					stream->fences[i] = NULL;
+				}
+			}
+			stream->frame.orphans++;
+			stream->frame.uploadSeconds += timerNow() - start;
+			return;
+		}
+
+		stream->frame.stalls++;
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		{
+			// Keep waiting, the region can't be reused until the gpu lets go of it.
+		}
+	}
+	stream->frame.uploadSeconds += timerNow() - start;
+
+	glDeleteSync(fence);
+	stream->fences[stream->region] = NULL;
+}
+
+// Fences the region we are leaving and moves on to the next one.
+static void advanceRegion(struct s_streamBuffer *stream)
+{
+	if (stream->fences[stream->region] != NULL)
+	{
+		glDeleteSync(stream->fences[stream->region]);
+	}
+	stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stream->region = (stream->region + 1) % STREAM_REGIONS;
+	stream->used = 0;
+}
+
+// Uploads the runs of dirty blocks in the size bytes from offset, joining runs with up to STREAM_MERGE_GAP clean blocks
+// between them, since one bigger call costs less than two. A frame where nothing changed makes no calls at all.
+static void uploadDirtyBlocks(struct s_streamBuffer *stream, GLintptr offset, GLsizeiptr size)
+{
+	GLsizeiptr block = offset / stream->blockSize;
+	GLsizeiptr end = (offset + size) / stream->blockSize;
+	double start = timerNow();
+
+	while (block < end)
+	{
+		if (!stream->dirty[block])
+		{
+			block++;
+			continue;
+		}
+
+		GLsizeiptr first = block;
+		GLsizeiptr last = block;
+		for (block++; block < end && block - last <= STREAM_MERGE_GAP; block++)
+		{
+			if (stream->dirty[block])
+			{
+				last = block;
+			}
+		}
+		memset(stream->dirty + first, 0, last - first + 1);
+
+		GLsizeiptr bytes = (last - first + 1) * stream->blockSize;
+		stateBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, first * stream->blockSize, bytes, stream->staging + first * stream->blockSize);
+		stream->frame.bytes += bytes;
+		stream->frame.ranges++;
+		block = last + 1;
+	}
+	stream->frame.uploadSeconds += timerNow() - start;
+}
@@ -0,0 +1,64 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Number of regions in the ring, the gpu can still be reading two of them while we write the third.
+#define STREAM_REGIONS	3
+// Clean blocks between two dirty ones that are uploaded anyway, so the two go in one call.
+#define STREAM_MERGE_GAP	8
+
+enum streamModes { STREAM_SUBDATA, STREAM_PERSISTENT, STREAM_RESIDENT };
+
+// subdata, persistent and resident, by mode
+extern const char *const g_streamModeNames[];
+
+struct s_streamStats {
+	unsigned long bytes;	// bytes written into the buffer
+	unsigned long stalls;	// times we had to wait on the gpu to release a region
+	unsigned long orphans;	// times the subdata path orphaned the buffer instead of waiting
+	unsigned long ranges;	// glBufferSubData calls, the persistent path makes none
+	double uploadSeconds;	// cpu time spent uploading and waiting
+};
+
+// Ring buffer for vertex data that changes every frame.
+// The buffer is split in STREAM_REGIONS regions, each one is fenced when we move past it and only written again once the gpu is done with it.
+// With ARB_buffer_storage the whole buffer stays mapped and callers write straight into it,
+// otherwise writes go to a staging copy and are sent with glBufferSubData, orphaning the buffer rather than stalling.
+// STREAM_RESIDENT is not a ring, for data that mostly stays the same. The buffer is one region with a full copy in
+// staging that callers write into every frame, marking the blocks they change, and only the dirty ranges are uploaded.
+struct s_streamBuffer {
+	GLuint vbo;
+	enum streamModes mode;
+	GLsizeiptr regionSize;
+	int region;		// region currently being written
+	GLsizeiptr used;	// bytes used in the current region
+	GLintptr mapOffset;	// where the bytes handed out by mapStream land in the buffer
+	GLsync fences[STREAM_REGIONS];
+	unsigned char *mapped;	// persistent mapping of the whole buffer
+	unsigned char *staging;	// cpu copy of one region for the subdata path, of the whole buffer for the resident one
+	unsigned char *dirty;	// resident, a flag for each block of staging that changed since it was uploaded
+	GLsizeiptr blockSize;
+	struct s_streamStats frame;	// stats for the frame in progress
+	struct s_streamStats lastFrame;	// stats for the last finished frame
+	struct s_streamStats total;
+};
+
+//creates the buffer in mode, persistent falls back to subdata without ARB_buffer_storage. Resident tracks changes in blocks
+//of blockSize bytes, which regionSize is a multiple of. Returns 0 on failure.
+int initStreamBuffer(struct s_streamBuffer *stream, GLsizeiptr regionSize, enum streamModes mode, GLsizeiptr blockSize);
+//returns a pointer to write at least minSize bytes, available is set to how many bytes can be written and offset to where they land in the buffer
+void *mapStream(struct s_streamBuffer *stream, GLsizeiptr minSize, GLsizeiptr *available, GLintptr *offset);
+//the dirty flags of the blocks from offset on, to set for every block written that changed. NULL unless resident.
+unsigned char *streamDirtyFlags(struct s_streamBuffer *stream, GLintptr offset);
+//commits the used bytes written since mapStream, resident uploads only the dirty blocks among them
+void unmapStream(struct s_streamBuffer *stream, GLsizeiptr used);
+//fences the current region so the next frame writes to the next one and rolls the frame stats over
+void endStreamFrame(struct s_streamBuffer *stream);
+//unmaps and deletes the buffer and the fences
+void freeStreamBuffer(struct s_streamBuffer *stream);
+//the mode with that name, -1 if there's none
+int parseStreamMode(const char *name);
+
+#endif
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "arena.h"
+
+// Payload bytes of each record type, see traceRecords.
+static const int g_recordSizes[TRACE_RECORD_TYPES] = { 9, 16, 9, 8 };
+
+// The gl logger and the color clock take plain functions, so they find the trace through these. There is only ever one.
+static struct s_trace *g_glTrace = NULL;
+static double g_traceClock = 0.0;
+
+static void writeRecord(struct s_trace *trace, enum traceRecords type, const unsigned char *payload);
+static int readRecord(struct s_trace *trace, enum traceRecords *type, unsigned char *payload);
+static int appendStep(struct s_trace *trace, const unsigned char *payload);
+static int appendCall(struct s_trace *trace, const unsigned char *payload);
+static void recordGLCall(enum glStateCalls call, GLuint a, GLuint b);
+static void compareGLCall(enum glStateCalls call, GLuint a, GLuint b);
+static double traceClock(void);
+
+int openTraceRecorder(struct s_trace *trace, const char *path, const struct s_traceHeader *header)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->file = fopen(path, "wb");
+	if (trace->file == NULL)
+	{
+		fprintf(stderr, "Failed to open trace file %s\n", path);
+		return 0;
+	}
+	trace->recording = 1;
+	trace->header = *header;
+	memcpy(trace->header.magic, "MSQT", 4);
+	trace->header.version = TRACE_VERSION;
+	trace->header.frames = 0;
+	if (fwrite(&trace->header, sizeof(trace->header), 1, trace->file) != 1)
+	{
+		fprintf(stderr, "Failed to write trace file %s\n", path);
+		fclose(trace->file);
+		trace->file = NULL;
+		return 0;
+	}
+	trace->bytes = sizeof(trace->header);
+	initMutex(&trace->mutex);
+	return 1;
+}
+
+void traceStep(struct s_trace *trace, enum inputTypes input)
+{
+	unsigned char payload[9];
+	double clock = primitiveClockNow();
+
+	memcpy(payload, &clock, sizeof(clock));
+	payload[8] = (unsigned char)input;
+	writeRecord(trace, TRACE_STEP, payload);
+}
+
+void beginTraceGL(struct s_trace *trace)
+{
+	if (trace->header.glCalls)
+	{
+		g_glTrace = trace;
+		setGLStateLogger(trace->recording ? recordGLCall : compareGLCall);
+	}
+}
+
+void endTraceGL(struct s_trace *trace)
+{
+	if (trace->header.glCalls)
+	{
+		setGLStateLogger(NULL);
+		g_glTrace = NULL;
+	}
+}
+
+void traceFrame(struct s_trace *trace, double time, unsigned int draws, unsigned int quads)
+{
+	unsigned char payload[16];
+
+	memcpy(payload, &time, sizeof(time));
+	memcpy(payload + 8, &draws, sizeof(draws));
+	memcpy(payload + 12, &quads, sizeof(quads));
+	writeRecord(trace, TRACE_FRAME, payload);
+	trace->frames++;
+}
+
+void endTrace(struct s_trace *trace, unsigned int checksum)
+{
+	unsigned char payload[8];
+	unsigned int frames = (unsigned int)trace->frames;
+
+	memcpy(payload, &frames, sizeof(frames));
+	memcpy(payload + 4, &checksum, sizeof(checksum));
+	writeRecord(trace, TRACE_END, payload);
+
+	// The frame count goes back into the header, so a replay knows how long the run is before it starts.
+	trace->header.frames = frames;
+	fseek(trace->file, 0, SEEK_SET);
+	fwrite(&trace->header, sizeof(trace->header), 1, trace->file);
+	fseek(trace->file, 0, SEEK_END);
+}
+
+int openTraceReplay(struct s_trace *trace, const char *path)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->file = fopen(path, "rb");
+	if (trace->file == NULL)
+	{
+		fprintf(stderr, "Failed to open trace file %s\n", path);
+		return 0;
+	}
+	if (fread(&trace->header, sizeof(trace->header), 1, trace->file) != 1 || memcmp(trace->header.magic, "MSQT", 4) != 0)
+	{
+		fprintf(stderr, "%s is not a trace file\n", path);
+		fclose(trace->file);
+		trace->file = NULL;
+		return 0;
+	}
+	if (trace->header.version != TRACE_VERSION)
+	{
+		fprintf(stderr, "%s is a version %u trace, this build replays version %d\n", path, trace->header.version, TRACE_VERSION);
+		fclose(trace->file);
+		trace->file = NULL;
+		return 0;
+	}
+	trace->bytes = sizeof(trace->header);
+	initMutex(&trace->mutex);
+
+	// The color changes read the recorded clock from here on.
+	g_traceClock = 0.0;
+	setPrimitiveClock(traceClock);
+	return 1;
+}
+
+int readTraceFrame(struct s_trace *trace)
+{
+	unsigned char payload[16];
+	enum traceRecords type;
+
+	trace->stepCount = 0;
+	trace->callCount = 0;
+	trace->callsMatched = 0;
+	trace->callsDiverged = 0;
+	while (readRecord(trace, &type, payload))
+	{
+		switch (type)
+		{
+		case TRACE_STEP:
+			if (!appendStep(trace, payload))
+			{
+				return 0;
+			}
+			break;
+		case TRACE_GL_CALL:
+			if (!appendCall(trace, payload))
+			{
+				return 0;
+			}
+			break;
+		case TRACE_FRAME:
+			memcpy(&trace->frameTime, payload, sizeof(trace->frameTime));
+			memcpy(&trace->frameDraws, payload + 8, sizeof(trace->frameDraws));
+			memcpy(&trace->frameQuads, payload + 12, sizeof(trace->frameQuads));
+			return 1;
+		case TRACE_END:
+			memcpy(&trace->endFrames, payload, sizeof(trace->endFrames));
+			memcpy(&trace->endChecksum, payload + 4, sizeof(trace->endChecksum));
+			trace->ended = 1;
+			return 0;
+		default:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+void setTraceClock(const struct s_traceStep *step)
+{
+	g_traceClock = step->clock;
+}
+
+void checkTraceFrame(struct s_trace *trace, unsigned int draws, unsigned int quads)
+{
+	int callsDiffer = trace->callsDiverged || (trace->header.glCalls && trace->callsMatched != trace->callCount);
+
+	if (callsDiffer || draws != trace->frameDraws || quads != trace->frameQuads)
+	{
+		trace->divergentFrames++;
+		if (trace->divergentFrames <= TRACE_REPORTS)
+		{
+			fprintf(stderr, "replay: frame %lu went differently, draws %u quads %u were %u and %u, gl calls matched %d of %d%s\n",
+				trace->frames, draws, quads, trace->frameDraws, trace->frameQuads, trace->callsMatched, trace->callCount,
+				trace->callsDiverged ? " before one differed" : "");
+		}
+	}
+	trace->frames++;
+}
+
+void closeTrace(struct s_trace *trace)
+{
+	if (trace->file == NULL)
+	{
+		return;
+	}
+	if (!trace->recording)
+	{
+		setPrimitiveClock(NULL);
+	}
+	if (g_glTrace == trace)
+	{
+		endTraceGL(trace);
+	}
+	fclose(trace->file);
+	trace->file = NULL;
+	freeMutex(&trace->mutex);
+	freeHeap(trace->steps);
+	freeHeap(trace->calls);
+	trace->steps = NULL;
+	trace->calls = NULL;
+}
+
+static void writeRecord(struct s_trace *trace, enum traceRecords type, const unsigned char *payload)
+{
+	unsigned char byte = (unsigned char)type;
+
+	lockMutex(&trace->mutex);
+	fwrite(&byte, 1, 1, trace->file);
+	fwrite(payload, 1, g_recordSizes[type], trace->file);
+	trace->bytes += 1 + g_recordSizes[type];
+	unlockMutex(&trace->mutex);
+}
+
+// Returns 0 at the end of the file, or if the trace is cut short or corrupt.
+static int readRecord(struct s_trace *trace, enum traceRecords *type, unsigned char *payload)
+{
+	unsigned char byte;
+
+	if (fread(&byte, 1, 1, trace->file) != 1)
+	{
+		return 0;
+	}
+	if (byte >= TRACE_RECORD_TYPES || fread(payload, 1, g_recordSizes[byte], trace->file) != (size_t)g_recordSizes[byte])
+	{
+		fprintf(stderr, "Trace is corrupt or cut short %lu bytes in\n", trace->bytes);
+		return 0;
+	}
+	*type = (enum traceRecords)byte;
+	trace->bytes += 1 + g_recordSizes[byte];
+	return 1;
+}
+
+static int appendStep(struct s_trace *trace, const unsigned char *payload)
+{
+	if (trace->stepCount == trace->stepCapacity)
+	{
+		int capacity = trace->stepCapacity > 0 ? trace->stepCapacity * 2 : 16;
+		struct s_traceStep *steps = reallocHeap(trace->steps, sizeof(struct s_traceStep) * capacity);
+		if (steps == NULL)
+		{
+			fprintf(stderr, "Failed to allocate %d trace steps\n", capacity);
+			return 0;
+		}
+		trace->steps = steps;
+		trace->stepCapacity = capacity;
+	}
+	struct s_traceStep *step = &trace->steps[trace->stepCount++];
+	memcpy(&step->clock, payload, sizeof(step->clock));
+	step->input = (enum inputTypes)payload[8];
+	return 1;
+}
+
+static int appendCall(struct s_trace *trace, const unsigned char *payload)
+{
+	if (trace->callCount == trace->callCapacity)
+	{
+		int capacity = trace->callCapacity > 0 ? trace->callCapacity * 2 : 64;
+		struct s_traceGLCall *calls = reallocHeap(trace->calls, sizeof(struct s_traceGLCall) * capacity);
+		if (calls == NULL)
+		{
+			fprintf(stderr, "Failed to allocate %d trace gl calls\n", capacity);
+			return 0;
+		}
+		trace->calls = calls;
+		trace->callCapacity = capacity;
+	}
+	struct s_traceGLCall *call = &trace->calls[trace->callCount++];
+	call->call = (enum glStateCalls)payload[0];
+	memcpy(&call->a, payload + 1, sizeof(call->a));
+	memcpy(&call->b, payload + 5, sizeof(call->b));
+	return 1;
+}
+
+static void recordGLCall(enum glStateCalls call, GLuint a, GLuint b)
+{
+	unsigned char payload[9];
+
+	payload[0] = (unsigned char)call;
+	memcpy(payload + 1, &a, sizeof(a));
+	memcpy(payload + 5, &b, sizeof(b));
+	writeRecord(g_glTrace, TRACE_GL_CALL, payload);
+}
+
+// Calls are matched in order, once one differs the rest of the frame can't be lined up so they aren't looked at.
+static void compareGLCall(enum glStateCalls call, GLuint a, GLuint b)
+{
+	struct s_trace *trace = g_glTrace;
+
+	if (trace->callsDiverged)
+	{
+		return;
+	}
+	if (trace->callsMatched < trace->callCount)
+	{
+		const struct s_traceGLCall *expected = &trace->calls[trace->callsMatched];
+		if (expected->call == call && expected->a == a && expected->b == b)
+		{
+			trace->callsMatched++;
+			return;
+		}
+	}
+	trace->callsDiverged = 1;
+}
+
+static double traceClock(void)
+{
+	return g_traceClock;
+}
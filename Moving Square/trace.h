@@ -0,0 +1,105 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+#include "primitive.h"
+#include "thread.h"
+#include "glstate.h"
+
+#define TRACE_VERSION	2	// bump when the layout changes, older traces are then refused
+#define TRACE_REPORTS	8	// divergent frames printed on replay, the rest are only counted
+
+// What a run needs to start the same way again, at the start of a trace file. frames is filled in when the trace is closed,
+// a trace from a run that never got that far has 0 and is replayed until it ends.
+struct s_traceHeader {
+	char magic[4];
+	unsigned int version;
+	int quadCount;
+	unsigned int seed;
+	int soa;
+	int streamMode;	// the streamModes asked for
+	int overlay;
+	int vertexFormat;	// QUAD_VERTEX_FORMAT of the build that recorded it
+	int glStateMode;
+	int glCalls;	// the gl calls of each frame are in the trace too
+	int orderTable;	// drawn sorted by depth
+	double tickRate;
+	unsigned int frames;
+};
+
+// After the header the trace is a stream of records, a type byte then a payload of a fixed size for that type:
+// TRACE_STEP	9 bytes, one move of every quad: the clock CHANGE_COLOR read as a double, then the input as a byte
+// TRACE_FRAME	16 bytes, the end of a frame: seconds since the first frame as a double, then its draw calls and quads as 32 bit
+// TRACE_GL_CALL	9 bytes, a gl state call that wasn't skipped: the glStateCalls as a byte, then its two values as 32 bit
+// TRACE_END	8 bytes, the frames and the scene checksum as 32 bit
+// The steps of a frame come before its TRACE_FRAME, steps run after the last frame before TRACE_END.
+// Everything is written in the byte order of the machine that recorded it.
+enum traceRecords { TRACE_STEP, TRACE_FRAME, TRACE_GL_CALL, TRACE_END, TRACE_RECORD_TYPES };
+
+struct s_traceStep {
+	double clock;
+	enum inputTypes input;
+};
+
+struct s_traceGLCall {
+	enum glStateCalls call;
+	GLuint a;
+	GLuint b;
+};
+
+// Records a run's input, the clock its color changes read, and optionally its gl calls, so it can be run again exactly.
+// While recording the sim thread writes steps and the render thread frames, so writes take the mutex.
+// When replaying each frame is read ahead, its steps are run in place of the input and its gl calls compared as they happen.
+struct s_trace {
+	FILE *file;
+	int recording;
+	struct s_traceHeader header;
+	struct s_mutex mutex;
+	unsigned long bytes;
+
+	// replay, the frame read by readTraceFrame
+	struct s_traceStep *steps;
+	int stepCount;
+	int stepCapacity;
+	struct s_traceGLCall *calls;
+	int callCount;
+	int callCapacity;
+	int callsMatched;	// calls made so far this frame that matched
+	int callsDiverged;	// a call this frame didn't match
+	double frameTime;
+	unsigned int frameDraws;
+	unsigned int frameQuads;
+	int ended;	// TRACE_END was read
+	unsigned int endFrames;
+	unsigned int endChecksum;
+
+	// stats
+	unsigned long frames;
+	unsigned long divergentFrames;
+};
+
+//starts a trace at path for a run with the settings in header, magic, version and frames are filled in. Returns 0 on failure.
+int openTraceRecorder(struct s_trace *trace, const char *path, const struct s_traceHeader *header);
+//records one move of every quad with input, and the clock it read, from whichever thread moves them
+void traceStep(struct s_trace *trace, enum inputTypes input);
+//while recording with gl calls, logs every gl state call until endTraceGL
+void beginTraceGL(struct s_trace *trace);
+//stops logging gl state calls
+void endTraceGL(struct s_trace *trace);
+//records the end of a frame, time in seconds since the first one
+void traceFrame(struct s_trace *trace, double time, unsigned int draws, unsigned int quads);
+//records the end of the run with the scene checksum and writes the frame count into the header
+void endTrace(struct s_trace *trace, unsigned int checksum);
+//opens a trace to replay and reads its header. Returns 0 and prints why on failure.
+int openTraceReplay(struct s_trace *trace, const char *path);
+//reads the next frame's steps and gl calls. Returns 0 at the end, the steps after the last frame are then in steps.
+int readTraceFrame(struct s_trace *trace);
+//sets the clock the color changes read to a step's, before running it
+void setTraceClock(const struct s_traceStep *step);
+//compares the frame that was just replayed with the recorded one, counting and reporting it if it went differently
+void checkTraceFrame(struct s_trace *trace, unsigned int draws, unsigned int quads);
+//closes the file and frees the frame
+void closeTrace(struct s_trace *trace);
+
+#endif
@@ -0,0 +1,111 @@
+#include "update.h"
+
+static void updateChunk(void *arg, int begin, int end);
+
+void runUpdateJob(struct s_jobSystem *jobs, struct s_updateJob *job, int count)
+{
+	struct s_primSoA slice;
+	int i;
+
+	// A color change draws from one random sequence in order, so it stays on this thread to give the same colors as a serial run.
+	// It never moves anything, the jobs then only pack.
+	if (job->input == CHANGE_COLOR)
+	{
+		if (job->prims != NULL)
+		{
+			for (i = job->first; i < job->first + count; i++)
+			{
+				movePrimitive(&job->prims[i], CHANGE_COLOR);
+			}
+		}
+		else if (job->soa != NULL)
+		{
+			slicePrimSoA(job->soa, job->first, job->first + count, &slice);
+			movePrimSoA(&slice, CHANGE_COLOR);
+		}
+	}
+	runJobs(jobs, updateChunk, job, count, UPDATE_CHUNK);
+}
+
+void updateBatch(struct s_jobSystem *jobs, struct s_batch *batch, struct s_updateJob *job, int count)
+{
+	int done = 0;
+	int reserved;
+
+	if (job->drawn != NULL)
+	{
+		job->drawn->count = count;
+	}
+	// The resident buffer already holds these quads as the last frame packed them, so they are drawn without packing
+	// or uploading anything.
+	if (job->unchanged && batch->residentQuads == count)
+	{
+		while (done < count)
+		{
+			reserveBatchQuads(batch, count - done, &reserved);
+			commitBatchQuads(batch, reserved);
+			done += reserved;
+		}
+		return;
+	}
+	while (done < count)
+	{
+		job->vertices = reserveBatchQuads(batch, count - done, &reserved);
+		job->dirty = batch->dirty != NULL ? batch->dirty + batch->quadCount : NULL;
+		job->first = done;
+		runUpdateJob(jobs, job, reserved);
+		commitBatchQuads(batch, reserved);
+		done += reserved;
+	}
+	batch->residentQuads = batch->stream.mode == STREAM_RESIDENT ? count : 0;
+}
+
+static void updateChunk(void *arg, int begin, int end)
+{
+	const struct s_updateJob *job = arg;
+	enum inputTypes input = job->input == CHANGE_COLOR ? NONE : job->input;
+	struct s_quadVertex *vertices = job->vertices != NULL ? job->vertices + begin * 4 : NULL;
+	unsigned char *dirty = job->dirty != NULL ? job->dirty + begin : NULL;
+	int first = job->first + begin;
+	int last = job->first + end;
+	struct s_primSoA slice;
+	int i;
+
+	if (job->order != NULL)
+	{
+		for (i = first; i < last; i++)
+		{
+			packBatchQuads(job->order[i], 1, vertices + (i - first) * 4, dirty != NULL ? dirty + (i - first) : NULL);
+		}
+	}
+	else if (job->prims != NULL)
+	{
+		for (i = first; i < last && input != NONE; i++)
+		{
+			movePrimitive(&job->prims[i], input);
+		}
+		if (vertices != NULL)
+		{
+			packBatchQuads(&job->prims[first], last - first, vertices, dirty);
+		}
+	}
+	else if (job->soa != NULL)
+	{
+		slicePrimSoA(job->soa, first, last, &slice);
+		if (input != NONE)
+		{
+			movePrimSoA(&slice, input);
+		}
+		packBatchSoA(&slice, vertices, dirty);
+	}
+	else
+	{
+		struct s_primSoA from;
+		struct s_primSoA to;
+		slicePrimSoA(job->from, first, last, &from);
+		slicePrimSoA(job->to, first, last, &to);
+		slicePrimSoA(job->drawn, first, last, &slice);
+		lerpPrimSoA(&slice, &from, &to, job->alpha);
+		packBatchSoA(&slice, vertices, dirty);
+	}
+}
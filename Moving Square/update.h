@@ -0,0 +1,36 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include "primitive.h"
+#include "primsoa.h"
+#include "batch.h"
+#include "jobs.h"
+
+#define UPDATE_CHUNK	4096	// primitives per job, small enough to balance and big enough that taking one is noise
+
+// One frame's move and pack of a range of primitives, run in chunks on the job system.
+// Exactly one of prims, soa, from or order is set. prims and soa are moved by input, from and to are lerped into drawn.
+// Then the primitives are packed into vertices, which can be the mapped batch so nothing is copied again.
+// Without vertices prims are only moved, and order packs primitives already moved in the order it lists them.
+// dirty is the batch's, set when its stream is resident, and unchanged says nothing moved since the last frame.
+struct s_updateJob {
+	enum inputTypes input;
+	struct s_polyF4 *prims;
+	struct s_primSoA *soa;
+	const struct s_primSoA *from;
+	const struct s_primSoA *to;
+	struct s_primSoA *drawn;
+	GLfloat alpha;
+	const struct s_polyF4 **order;
+	int first;	// primitive that goes in vertices[0]
+	struct s_quadVertex *vertices;
+	unsigned char *dirty;	// flags for vertices, NULL to write every quad
+	int unchanged;
+};
+
+//updates and packs count primitives from job->first on, in parallel on jobs
+void runUpdateJob(struct s_jobSystem *jobs, struct s_updateJob *job, int count);
+//updates every primitive and packs them into the batch, reserving the room for them in one go
+void updateBatch(struct s_jobSystem *jobs, struct s_batch *batch, struct s_updateJob *job, int count);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "thread.h"
+
+// Bumped from any thread, the shader watcher and the sim thread allocate too.
+static volatile unsigned int g_heapAllocations = 0;
+static volatile unsigned int g_heapFrees = 0;
+
+static void *alignUp(void *memory);
+
+void *allocHeap(size_t bytes)
+{
+	atomicAdd(&g_heapAllocations, 1);
+	return malloc(bytes);
+}
+
+void *callocHeap(size_t count, size_t bytes)
+{
+	atomicAdd(&g_heapAllocations, 1);
+	return calloc(count, bytes);
+}
+
+void *reallocHeap(void *memory, size_t bytes)
+{
+	atomicAdd(&g_heapAllocations, 1);
+	return realloc(memory, bytes);
+}
+
+void freeHeap(void *memory)
+{
+	if (memory != NULL)
+	{
+		atomicAdd(&g_heapFrees, 1);
+		free(memory);
+	}
+}
+
+void readHeapStats(struct s_heapStats *stats)
+{
+	stats->allocations = loadAcquire(&g_heapAllocations);
+	stats->frees = loadAcquire(&g_heapFrees);
+}
+
+int initArena(struct s_arena *arena, size_t size)
+{
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+	arena->demand = 0;
+	arena->overflow = NULL;
+	arena->peak = 0;
+	arena->allocations = 0;
+	arena->overflows = 0;
+	arena->grows = 0;
+	arena->resets = 0;
+	if (size > 0)
+	{
+		// Room to align the start, so all size bytes can be handed out.
+		arena->base = allocHeap(size + ARENA_ALIGN);
+		if (arena->base == NULL)
+		{
+			return 0;
+		}
+		arena->size = size;
+	}
+	return 1;
+}
+
+void *arenaAlloc(struct s_arena *arena, size_t bytes)
+{
+	arena->allocations++;
+	arena->demand += (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (arena->base != NULL)
+	{
+		unsigned char *start = alignUp(arena->base + arena->used);
+		size_t offset = (size_t)(start - arena->base);
+		if (offset + bytes <= arena->size + ARENA_ALIGN)
+		{
+			arena->used = offset + bytes;
+			return start;
+		}
+	}
+
+	// It doesn't fit this frame, the heap covers it until the reset grows the arena.
+	struct s_arenaChunk *chunk = allocHeap(sizeof(struct s_arenaChunk) + ARENA_ALIGN + bytes);
+	if (chunk == NULL)
+	{
+		return NULL;
+	}
+	chunk->next = arena->overflow;
+	arena->overflow = chunk;
+	arena->overflows++;
+	return alignUp(chunk + 1);
+}
+
+void resetArena(struct s_arena *arena)
+{
+	while (arena->overflow != NULL)
+	{
+		struct s_arenaChunk *next = arena->overflow->next;
+		freeHeap(arena->overflow);
+		arena->overflow = next;
+	}
+	if (arena->demand > arena->peak)
+	{
+		arena->peak = arena->demand;
+	}
+
+	// A half again the frame that overflowed, so a scene that creeps up doesn't grow it every frame.
+	if (arena->demand > arena->size)
+	{
+		size_t size = arena->demand + arena->demand / 2;
+		unsigned char *base = allocHeap(size + ARENA_ALIGN);
+		if (base != NULL)
+		{
+			freeHeap(arena->base);
+			arena->base = base;
+			arena->size = size;
+			arena->grows++;
+		}
+	}
+	arena->used = 0;
+	arena->demand = 0;
+	arena->resets++;
+}
+
+void freeArena(struct s_arena *arena)
+{
+	resetArena(arena);
+	freeHeap(arena->base);
+	arena->base = NULL;
+	arena->size = 0;
+}
+
+static void *alignUp(void *memory)
+{
+	return (void *)(((uintptr_t)memory + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+}
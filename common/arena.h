@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN	32	// every allocation starts on this, so avx2 loads of it are aligned
+
+// Counts of the heap calls made through allocHeap and friends, from every thread since the start.
+// Comparing two reads shows whether the code between them touched the heap at all.
+struct s_heapStats {
+	unsigned int allocations;	// allocHeap, callocHeap and reallocHeap calls
+	unsigned int frees;
+};
+
+// Memory asked for after the arena filled up, freed at the next reset.
+struct s_arenaChunk {
+	struct s_arenaChunk *next;
+};
+
+// A linear allocator for what only lives one frame. Allocating bumps an offset and resetArena drops everything at once.
+// If a frame asks for more than it has, the rest comes from the heap and the next reset grows the arena to fit,
+// so after the first frames settle the loop makes no heap calls. Only one thread allocates from an arena.
+struct s_arena {
+	unsigned char *base;
+	size_t size;
+	size_t used;
+	size_t demand;	// bytes asked for since the reset, with alignment, including what overflowed
+	struct s_arenaChunk *overflow;
+
+	// stats
+	size_t peak;	// most demand in one frame
+	unsigned long allocations;
+	unsigned long overflows;	// allocations that didn't fit
+	unsigned long grows;
+	unsigned long resets;
+};
+
+//malloc, counted in the heap stats
+void *allocHeap(size_t bytes);
+//calloc, counted in the heap stats
+void *callocHeap(size_t count, size_t bytes);
+//realloc, counted in the heap stats as an allocation
+void *reallocHeap(void *memory, size_t bytes);
+//free, counted in the heap stats when memory isn't NULL
+void freeHeap(void *memory);
+//copies out the heap stats
+void readHeapStats(struct s_heapStats *stats);
+//allocates size bytes for the arena, 0 starts it empty to grow on first use. Returns 0 on failure.
+int initArena(struct s_arena *arena, size_t size);
+//returns bytes aligned to ARENA_ALIGN that last until the next reset, or NULL when the heap is out too
+void *arenaAlloc(struct s_arena *arena, size_t bytes);
+//drops everything allocated since the last reset, growing the arena first if that didn't fit
+void resetArena(struct s_arena *arena);
+//frees the arena and anything that overflowed it
+void freeArena(struct s_arena *arena);
+
+#endif
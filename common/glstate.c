@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "glstate.h"
+
+struct s_glState g_glState;
+const char *const g_glStateModeNames[] = { "cached", "direct", "check" };
+
+// glGet names for the cached bindings, in the order of their enums.
+static const GLenum g_textureTargets[STATE_TEXTURES] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER };
+static const GLenum g_textureBindings[STATE_TEXTURES] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_BUFFER };
+static const GLenum g_bufferTargets[STATE_BUFFERS] = { GL_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_TEXTURE_BUFFER };
+// The buffer bound to GL_TEXTURE_BUFFER is read back with the target itself as the name.
+static const GLenum g_bufferBindings[STATE_BUFFERS] = { GL_ARRAY_BUFFER_BINDING, GL_PIXEL_PACK_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING, GL_TEXTURE_BUFFER };
+
+static int textureIndex(GLenum target);
+static int bufferIndex(GLenum target);
+static int skipCall(GLuint cached, GLuint wanted, const char *what, GLenum binding);
+static int checkBinding(const char *what, GLuint cached, GLenum binding);
+static void reportMismatch(const char *what, GLint actual, GLuint cached);
+static GLuint packColor(const GLfloat *color);
+static void logCall(enum glStateCalls call, GLuint a, GLuint b);
+
+void initGLState(enum glStateModes mode)
+{
+	memset(&g_glState, 0, sizeof(g_glState));
+	g_glState.mode = mode;
+	forgetGLState();
+}
+
+void forgetGLState(void)
+{
+	int u;
+	int t;
+
+	g_glState.program = GLSTATE_UNKNOWN;
+	g_glState.vao = GLSTATE_UNKNOWN;
+	for (t = 0; t < STATE_BUFFERS; t++)
+	{
+		g_glState.buffers[t] = GLSTATE_UNKNOWN;
+	}
+	g_glState.activeUnit = GLSTATE_UNKNOWN;
+	for (u = 0; u < GLSTATE_TEXTURE_UNITS; u++)
+	{
+		for (t = 0; t < STATE_TEXTURES; t++)
+		{
+			g_glState.textures[u][t] = GLSTATE_UNKNOWN;
+		}
+	}
+	g_glState.blend = GLSTATE_UNKNOWN;
+	g_glState.blendSource = GLSTATE_UNKNOWN;
+	g_glState.blendDestination = GLSTATE_UNKNOWN;
+	g_glState.clearColorKnown = 0;
+}
+
+void stateUseProgram(GLuint program)
+{
+	if (skipCall(g_glState.program, program, "program", GL_CURRENT_PROGRAM))
+	{
+		return;
+	}
+	glUseProgram(program);
+	g_glState.program = program;
+	logCall(CALL_USE_PROGRAM, program, 0);
+}
+
+void stateBindVertexArray(GLuint vao)
+{
+	if (skipCall(g_glState.vao, vao, "vertex array", GL_VERTEX_ARRAY_BINDING))
+	{
+		return;
+	}
+	glBindVertexArray(vao);
+	g_glState.vao = vao;
+	logCall(CALL_BIND_VERTEX_ARRAY, vao, 0);
+}
+
+void stateBindBuffer(GLenum target, GLuint buffer)
+{
+	int index = bufferIndex(target);
+
+	if (index < 0)
+	{
+		g_glState.stats.calls++;
+		glBindBuffer(target, buffer);
+		logCall(CALL_BIND_BUFFER, target, buffer);
+		return;
+	}
+	if (skipCall(g_glState.buffers[index], buffer, "buffer", g_bufferBindings[index]))
+	{
+		return;
+	}
+	glBindBuffer(target, buffer);
+	g_glState.buffers[index] = buffer;
+	logCall(CALL_BIND_BUFFER, target, buffer);
+}
+
+void stateActiveTexture(GLenum unit)
+{
+	// The binding reads back as GL_TEXTUREn, so the check compares it in the same terms.
+	GLuint cached = g_glState.activeUnit == GLSTATE_UNKNOWN ? GLSTATE_UNKNOWN : GL_TEXTURE0 + g_glState.activeUnit;
+	if (skipCall(cached, unit, "active texture", GL_ACTIVE_TEXTURE))
+	{
+		return;
+	}
+	glActiveTexture(unit);
+	g_glState.activeUnit = unit - GL_TEXTURE0;
+	logCall(CALL_ACTIVE_TEXTURE, unit, 0);
+}
+
+void stateBindTexture(GLenum target, GLuint texture)
+{
+	int index = textureIndex(target);
+	GLuint unit = g_glState.activeUnit;
+
+	if (index < 0 || unit >= GLSTATE_TEXTURE_UNITS)
+	{
+		// An unknown unit may be any of them, so what the cache has for all of them might be wrong now.
+		if (index >= 0)
+		{
+			for (unit = 0; unit < GLSTATE_TEXTURE_UNITS; unit++)
+			{
+				g_glState.textures[unit][index] = GLSTATE_UNKNOWN;
+			}
+		}
+		g_glState.stats.calls++;
+		glBindTexture(target, texture);
+		logCall(CALL_BIND_TEXTURE, target, texture);
+		return;
+	}
+	if (skipCall(g_glState.textures[unit][index], texture, "texture", g_textureBindings[index]))
+	{
+		return;
+	}
+	glBindTexture(target, texture);
+	g_glState.textures[unit][index] = texture;
+	logCall(CALL_BIND_TEXTURE, target, texture);
+}
+
+void stateEnable(GLenum capability)
+{
+	if (capability != GL_BLEND)
+	{
+		g_glState.stats.calls++;
+		glEnable(capability);
+		logCall(CALL_ENABLE, capability, 0);
+		return;
+	}
+	if (skipCall(g_glState.blend, 1, "blend", GL_BLEND))
+	{
+		return;
+	}
+	glEnable(capability);
+	g_glState.blend = 1;
+	logCall(CALL_ENABLE, capability, 0);
+}
+
+void stateDisable(GLenum capability)
+{
+	if (capability != GL_BLEND)
+	{
+		g_glState.stats.calls++;
+		glDisable(capability);
+		logCall(CALL_DISABLE, capability, 0);
+		return;
+	}
+	if (skipCall(g_glState.blend, 0, "blend", GL_BLEND))
+	{
+		return;
+	}
+	glDisable(capability);
+	g_glState.blend = 0;
+	logCall(CALL_DISABLE, capability, 0);
+}
+
+void stateBlendFunc(GLenum source, GLenum destination)
+{
+	// Counted as one call, so the source is checked and skipped only if the destination matches too.
+	int sourceSame = g_glState.mode != GLSTATE_DIRECT && g_glState.blendSource == source && checkBinding("blend source", source, GL_BLEND_SRC_RGB);
+	if (skipCall(sourceSame ? g_glState.blendDestination : GLSTATE_UNKNOWN, destination, "blend destination", GL_BLEND_DST_RGB))
+	{
+		return;
+	}
+	glBlendFunc(source, destination);
+	g_glState.blendSource = source;
+	g_glState.blendDestination = destination;
+	logCall(CALL_BLEND_FUNC, source, destination);
+}
+
+void stateClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	GLfloat *cached = g_glState.clearColor;
+
+	g_glState.stats.calls++;
+	if (g_glState.mode != GLSTATE_DIRECT && g_glState.clearColorKnown && cached[0] == r && cached[1] == g && cached[2] == b && cached[3] == a)
+	{
+		if (g_glState.mode == GLSTATE_CHECK)
+		{
+			GLfloat actual[4];
+			glGetFloatv(GL_COLOR_CLEAR_VALUE, actual);
+			if (actual[0] != r || actual[1] != g || actual[2] != b || actual[3] != a)
+			{
+				// Reported as rgba8, which is enough to tell which color it was.
+				reportMismatch("clear color", (GLint)packColor(actual), packColor(cached));
+				glClearColor(r, g, b, a);
+				logCall(CALL_CLEAR_COLOR, packColor(cached), 0);
+				return;
+			}
+		}
+		g_glState.stats.skipped++;
+		return;
+	}
+	glClearColor(r, g, b, a);
+	cached[0] = r;
+	cached[1] = g;
+	cached[2] = b;
+	cached[3] = a;
+	g_glState.clearColorKnown = 1;
+	logCall(CALL_CLEAR_COLOR, packColor(cached), 0);
+}
+
+void stateDeleteTextures(GLsizei count, const GLuint *textures)
+{
+	GLsizei i;
+	int u;
+	int t;
+
+	// Deleting a texture unbinds it from every unit, not just the active one.
+	for (i = 0; i < count; i++)
+	{
+		for (u = 0; u < GLSTATE_TEXTURE_UNITS; u++)
+		{
+			for (t = 0; t < STATE_TEXTURES; t++)
+			{
+				if (g_glState.textures[u][t] == textures[i] && textures[i] != 0)
+				{
+					g_glState.textures[u][t] = 0;
+				}
+			}
+		}
+	}
+	glDeleteTextures(count, textures);
+}
+
+void stateDeleteBuffers(GLsizei count, const GLuint *buffers)
+{
+	GLsizei i;
+	int t;
+
+	for (i = 0; i < count; i++)
+	{
+		for (t = 0; t < STATE_BUFFERS; t++)
+		{
+			if (g_glState.buffers[t] == buffers[i] && buffers[i] != 0)
+			{
+				g_glState.buffers[t] = 0;
+			}
+		}
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void stateDeleteVertexArrays(GLsizei count, const GLuint *vaos)
+{
+	GLsizei i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (g_glState.vao == vaos[i] && vaos[i] != 0)
+		{
+			g_glState.vao = 0;
+		}
+	}
+	glDeleteVertexArrays(count, vaos);
+}
+
+int validateGLState(void)
+{
+	unsigned long before = g_glState.stats.mismatches;
+	GLint active;
+	int u;
+	int t;
+
+	checkBinding("program", g_glState.program, GL_CURRENT_PROGRAM);
+	checkBinding("vertex array", g_glState.vao, GL_VERTEX_ARRAY_BINDING);
+	for (t = 0; t < STATE_BUFFERS; t++)
+	{
+		checkBinding("buffer", g_glState.buffers[t], g_bufferBindings[t]);
+	}
+	checkBinding("blend", g_glState.blend, GL_BLEND);
+
+	// Texture bindings only read back for the active unit, so each unit is made active in turn, then the real one restored.
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+	checkBinding("active texture", g_glState.activeUnit == GLSTATE_UNKNOWN ? GLSTATE_UNKNOWN : GL_TEXTURE0 + g_glState.activeUnit,
+		GL_ACTIVE_TEXTURE);
+	for (u = 0; u < GLSTATE_TEXTURE_UNITS; u++)
+	{
+		glActiveTexture(GL_TEXTURE0 + u);
+		for (t = 0; t < STATE_TEXTURES; t++)
+		{
+			checkBinding("texture", g_glState.textures[u][t], g_textureBindings[t]);
+		}
+	}
+	glActiveTexture(active);
+
+	return (int)(g_glState.stats.mismatches - before);
+}
+
+void resetGLStateStats(void)
+{
+	memset(&g_glState.stats, 0, sizeof(g_glState.stats));
+}
+
+void setGLStateLogger(void (*logger)(enum glStateCalls call, GLuint a, GLuint b))
+{
+	g_glState.logger = logger;
+}
+
+int parseGLStateMode(const char *name)
+{
+	int mode;
+
+	for (mode = GLSTATE_CACHED; mode <= GLSTATE_CHECK; mode++)
+	{
+		if (strcmp(name, g_glStateModeNames[mode]) == 0)
+		{
+			return mode;
+		}
+	}
+	return -1;
+}
+
+static int textureIndex(GLenum target)
+{
+	int t;
+
+	for (t = 0; t < STATE_TEXTURES; t++)
+	{
+		if (g_textureTargets[t] == target)
+		{
+			return t;
+		}
+	}
+	return -1;
+}
+
+static int bufferIndex(GLenum target)
+{
+	int t;
+
+	for (t = 0; t < STATE_BUFFERS; t++)
+	{
+		if (g_bufferTargets[t] == target)
+		{
+			return t;
+		}
+	}
+	return -1;
+}
+
+// Counts the call and returns 1 if it would set what is already set. In check mode the cache is compared with gl first.
+static int skipCall(GLuint cached, GLuint wanted, const char *what, GLenum binding)
+{
+	g_glState.stats.calls++;
+	if (g_glState.mode == GLSTATE_DIRECT || cached == GLSTATE_UNKNOWN)
+	{
+		return 0;
+	}
+	if (g_glState.mode == GLSTATE_CHECK && !checkBinding(what, cached, binding))
+	{
+		// The cache was wrong, so the call goes through to put things right.
+		return 0;
+	}
+	if (cached != wanted)
+	{
+		return 0;
+	}
+	g_glState.stats.skipped++;
+	return 1;
+}
+
+// Returns 0 and reports it if gl has something other than cached bound. Unknown always matches.
+static int checkBinding(const char *what, GLuint cached, GLenum binding)
+{
+	GLint actual;
+
+	if (cached == GLSTATE_UNKNOWN || g_glState.mode != GLSTATE_CHECK)
+	{
+		return 1;
+	}
+	glGetIntegerv(binding, &actual);
+	if ((GLuint)actual == cached)
+	{
+		return 1;
+	}
+	reportMismatch(what, actual, cached);
+	return 0;
+}
+
+static void reportMismatch(const char *what, GLint actual, GLuint cached)
+{
+	g_glState.stats.mismatches++;
+	if (g_glState.stats.mismatches <= GLSTATE_REPORTS)
+	{
+		fprintf(stderr, "gl state: %s is %d but the cache has %u, something bound it without going through the cache\n", what, actual, cached);
+	}
+}
+
+static GLuint packColor(const GLfloat *color)
+{
+	GLuint packed = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		packed = packed << 8 | (GLuint)(color[i] * 255.0f + 0.5f);
+	}
+	return packed;
+}
+
+static void logCall(enum glStateCalls call, GLuint a, GLuint b)
+{
+	if (g_glState.logger != NULL)
+	{
+		g_glState.logger(call, a, b);
+	}
+}
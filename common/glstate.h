@@ -0,0 +1,95 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#define GLSTATE_TEXTURE_UNITS	8	// units past these are passed straight through
+#define GLSTATE_UNKNOWN			0xffffffffu	// the cache doesn't know what is bound, the next call goes through
+#define GLSTATE_REPORTS			8	// mismatches printed in check mode, the rest are only counted
+
+enum glStateModes {
+	GLSTATE_CACHED,	// skip calls that would set what is already set
+	GLSTATE_DIRECT,	// make every call, to compare against
+	GLSTATE_CHECK	// cached, and every call first compares the cache with glGet
+};
+
+// Texture targets the cache follows, the others go straight through.
+enum glStateTextures { STATE_TEXTURE_2D, STATE_TEXTURE_2D_ARRAY, STATE_TEXTURE_BUFFER, STATE_TEXTURES };
+
+// Buffer targets the cache follows. The element buffer belongs to the vertex array, so binding it always goes through.
+enum glStateBuffers { STATE_ARRAY_BUFFER, STATE_PIXEL_PACK_BUFFER, STATE_PIXEL_UNPACK_BUFFER, STATE_TEXTURE_BUFFER_BINDING, STATE_BUFFERS };
+
+// The calls a logger is told about, with what they were given. Blend func passes source and destination,
+// clear color the color packed as rgba8, and the calls that take one value pass 0 as the second.
+enum glStateCalls { CALL_USE_PROGRAM, CALL_BIND_VERTEX_ARRAY, CALL_BIND_BUFFER, CALL_ACTIVE_TEXTURE, CALL_BIND_TEXTURE,
+	CALL_ENABLE, CALL_DISABLE, CALL_BLEND_FUNC, CALL_CLEAR_COLOR };
+
+struct s_glStateStats {
+	unsigned long calls;	// state calls asked for
+	unsigned long skipped;	// of those, the ones that would have set what was already set
+	unsigned long mismatches;	// check mode, times the cache was wrong
+};
+
+// What the context has bound, as far as calls through here know. Everything that binds the state it follows has to go
+// through these calls, or call forgetGLState after, or the cache skips a call it shouldn't. Check mode finds those.
+// There is one gl context on one thread in both examples, so this is one global.
+struct s_glState {
+	enum glStateModes mode;
+	GLuint program;
+	GLuint vao;
+	GLuint buffers[STATE_BUFFERS];
+	GLuint activeUnit;	// 0 based, not GL_TEXTURE0 based
+	GLuint textures[GLSTATE_TEXTURE_UNITS][STATE_TEXTURES];
+	GLuint blend;	// 0, 1, or GLSTATE_UNKNOWN
+	GLenum blendSource;
+	GLenum blendDestination;
+	GLfloat clearColor[4];
+	int clearColorKnown;
+
+	struct s_glStateStats stats;
+	void (*logger)(enum glStateCalls call, GLuint a, GLuint b);	// told about every call that reaches gl, NULL for none
+};
+
+extern struct s_glState g_glState;
+// cached, direct and check, by mode
+extern const char *const g_glStateModeNames[];
+
+//starts following the state in mode with everything unknown, call before anything binds through here
+void initGLState(enum glStateModes mode);
+//marks everything unknown, for after code that binds things behind the cache's back
+void forgetGLState(void);
+//glUseProgram
+void stateUseProgram(GLuint program);
+//glBindVertexArray
+void stateBindVertexArray(GLuint vao);
+//glBindBuffer
+void stateBindBuffer(GLenum target, GLuint buffer);
+//glActiveTexture, unit is GL_TEXTURE0 + n
+void stateActiveTexture(GLenum unit);
+//glBindTexture on the active unit
+void stateBindTexture(GLenum target, GLuint texture);
+//glEnable, only GL_BLEND is cached
+void stateEnable(GLenum capability);
+//glDisable, only GL_BLEND is cached
+void stateDisable(GLenum capability);
+//glBlendFunc
+void stateBlendFunc(GLenum source, GLenum destination);
+//glClearColor
+void stateClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+//glDeleteTextures, deleting a bound texture binds 0 in its place
+void stateDeleteTextures(GLsizei count, const GLuint *textures);
+//glDeleteBuffers, deleting a bound buffer binds 0 in its place
+void stateDeleteBuffers(GLsizei count, const GLuint *buffers);
+//glDeleteVertexArrays, deleting the bound vertex array binds 0
+void stateDeleteVertexArrays(GLsizei count, const GLuint *vaos);
+//compares everything the cache knows with glGet, printing the first few differences. Returns how many there were.
+int validateGLState(void);
+//clears the counters
+void resetGLStateStats(void);
+//calls logger with every call that isn't skipped from now on, NULL stops it
+void setGLStateLogger(void (*logger)(enum glStateCalls call, GLuint a, GLuint b));
+//parses cached, direct or check, -1 if it is none of them
+int parseGLStateMode(const char *name);
+
+#endif
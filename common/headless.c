@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.h"
+#include "image.h"
+#include "glstate.h"
+
+#ifdef HEADLESS_EGL
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA	0x31DD
+#endif
+#ifndef EGL_NO_CONFIG_KHR
+#define EGL_NO_CONFIG_KHR	((EGLConfig)0)
+#endif
+
+static EGLDisplay openDisplay(void);
+#endif
+static void writeReadback(struct s_headless *headless, int slot);
+
+int initHeadless(struct s_headless *headless, int width, int height, const char *dumpPattern)
+{
+	memset(headless, 0, sizeof(*headless));
+	headless->width = width;
+	headless->height = height;
+	headless->dumpPattern = dumpPattern;
+
+#ifdef HEADLESS_EGL
+	EGLint major;
+	EGLint minor;
+	EGLDisplay display = openDisplay();
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		fprintf(stderr, "Failed to initialize EGL\n");
+		return 0;
+	}
+	headless->display = display;
+
+	// Same core 3.3 context the window gets, without a config or surface since we only draw into the fbo.
+	static const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = EGL_NO_CONTEXT;
+	if (eglBindAPI(EGL_OPENGL_API))
+	{
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+	}
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		fprintf(stderr, "Failed to create a surfaceless OpenGL 3.3 context (EGL error 0x%x)\n", eglGetError());
+		if (context != EGL_NO_CONTEXT)
+		{
+			eglDestroyContext(display, context);
+		}
+		eglTerminate(display);
+		return 0;
+	}
+	headless->context = context;
+
+	// Initialize GLEW
+	// A GLEW built for GLX loads the gl functions first and then fails to find an X display, which is fine here.
+	glewExperimental = GL_TRUE; // Needed for core profile
+	GLenum glewResult = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	if (glewResult == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		glewResult = GLEW_OK;
+	}
+#endif
+	if (glewResult != GLEW_OK)
+	{
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		freeHeadless(headless);
+		return 0;
+	}
+
+	// Everything gets drawn to this fbo in place of the window's back buffer.
+	glGenFramebuffers(1, &headless->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, headless->fbo);
+	glGenRenderbuffers(1, &headless->colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless->colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless->colorBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+		freeHeadless(headless);
+		return 0;
+	}
+	glViewport(0, 0, width, height);
+
+	glGenBuffers(HEADLESS_PBOS, headless->pbos);
+	for (int i = 0; i < HEADLESS_PBOS; i++)
+	{
+		stateBindBuffer(GL_PIXEL_PACK_BUFFER, headless->pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+		headless->pboFrames[i] = -1;
+	}
+	stateBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return 1;
+#else
+	fprintf(stderr, "Headless rendering needs EGL, this build was made without it\n");
+	return 0;
+#endif
+}
+
+void endHeadlessFrame(struct s_headless *headless)
+{
+	int slot = headless->frame % HEADLESS_PBOS;
+
+	if (headless->dumpPattern != NULL)
+	{
+		// The pbo we are about to reuse holds a frame from HEADLESS_PBOS frames ago, long done by now.
+		if (headless->pboFrames[slot] >= 0)
+		{
+			writeReadback(headless, slot);
+		}
+
+		stateBindBuffer(GL_PIXEL_PACK_BUFFER, headless->pbos[slot]);
+		glReadPixels(0, 0, headless->width, headless->height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+		stateBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		headless->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		headless->pboFrames[slot] = headless->frame;
+	}
+	else
+	{
+		// Nothing is read back, flush so the frame's commands don't pile up.
+		glFlush();
+	}
+
+	headless->frame++;
+}
+
+void readHeadlessFrame(struct s_headless *headless, unsigned char *pixels)
+{
+	glReadPixels(0, 0, headless->width, headless->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+void freeHeadless(struct s_headless *headless)
+{
+#ifdef HEADLESS_EGL
+	int i;
+
+	if (headless->context != NULL)
+	{
+		// Oldest first, so the files come out in frame order.
+		for (i = 0; i < HEADLESS_PBOS; i++)
+		{
+			int slot = (headless->frame + i) % HEADLESS_PBOS;
+			if (headless->pboFrames[slot] >= 0)
+			{
+				writeReadback(headless, slot);
+			}
+		}
+		if (headless->pbos[0] != 0)
+		{
+			stateDeleteBuffers(HEADLESS_PBOS, headless->pbos);
+		}
+		glDeleteRenderbuffers(1, &headless->colorBuffer);
+		glDeleteFramebuffers(1, &headless->fbo);
+
+		eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(headless->display, headless->context);
+	}
+	if (headless->display != NULL)
+	{
+		eglTerminate(headless->display);
+	}
+#endif
+	headless->context = NULL;
+	headless->display = NULL;
+}
+
+#ifdef HEADLESS_EGL
+static EGLDisplay openDisplay(void)
+{
+	// Mesa's surfaceless platform needs neither an X server nor a drm device.
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	if (getPlatformDisplay != NULL)
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	return display;
+}
+#endif
+
+// Waits for the readback in slot, which is normally already finished, and writes it out.
+static void writeReadback(struct s_headless *headless, int slot)
+{
+	char path[512];
+
+	if (headless->fences[slot] != NULL)
+	{
+		glClientWaitSync(headless->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(headless->fences[slot]);
+		headless->fences[slot] = NULL;
+	}
+
+	stateBindBuffer(GL_PIXEL_PACK_BUFFER, headless->pbos[slot]);
+	const unsigned char *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)headless->width * headless->height * 4, GL_MAP_READ_BIT);
+	if (pixels != NULL)
+	{
+		snprintf(path, sizeof(path), headless->dumpPattern, headless->pboFrames[slot]);
+		if (writeImage(path, headless->width, headless->height, pixels, 1))
+		{
+			headless->framesWritten++;
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	stateBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	headless->pboFrames[slot] = -1;
+}
@@ -0,0 +1,37 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Readbacks in flight, a frame is written out this many frames after it was drawn so glReadPixels never waits on the gpu.
+#define HEADLESS_PBOS	3
+
+// Offscreen rendering without a window, for machines with no display or gpu (Mesa llvmpipe works fine).
+// The context comes from EGL surfaceless and everything is drawn into an fbo that stays bound.
+// Frames can be read back through a ring of pixel buffer objects and dumped to ppm or png files.
+struct s_headless {
+	void *display;	// EGLDisplay
+	void *context;	// EGLContext
+	GLuint fbo;
+	GLuint colorBuffer;
+	int width;
+	int height;
+	GLuint pbos[HEADLESS_PBOS];
+	GLsync fences[HEADLESS_PBOS];
+	int pboFrames[HEADLESS_PBOS];	// frame waiting in each pbo, -1 when empty
+	int frame;
+	const char *dumpPattern;	// printf pattern for the frame number, NULL to skip readback
+	unsigned long framesWritten;
+};
+
+//creates the offscreen context, initializes GLEW and binds an fbo of width x height. Returns 0 on failure.
+int initHeadless(struct s_headless *headless, int width, int height, const char *dumpPattern);
+//starts the readback of the frame just drawn and writes out the oldest finished one
+void endHeadlessFrame(struct s_headless *headless);
+//reads back the frame just drawn into pixels, width x height rgba bottom row first, and blocks until it is done
+void readHeadlessFrame(struct s_headless *headless, unsigned char *pixels);
+//writes out every readback still in flight and destroys the context
+void freeHeadless(struct s_headless *headless);
+
+#endif
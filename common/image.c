@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "arena.h"
+
+// Largest block a stored deflate block can hold.
+#define STORED_BLOCK_MAX	65535
+
+static int writePNG(const char *path, int width, int height, const unsigned char *rgba, int flipY, int channels);
+static unsigned long crc32Update(unsigned long crc, const unsigned char *data, size_t length);
+static void writeBigEndian(unsigned char *out, unsigned long value);
+static int writeChunk(FILE *file, const char *type, const unsigned char *data, size_t length);
+
+int writeImage(const char *path, int width, int height, const unsigned char *rgba, int flipY)
+{
+	size_t length = strlen(path);
+
+	if (length > 4 && strcmp(path + length - 4, ".png") == 0)
+	{
+		return writeImagePNG(path, width, height, rgba, flipY);
+	}
+	return writeImagePPM(path, width, height, rgba, flipY);
+}
+
+int writeImagePPM(const char *path, int width, int height, const unsigned char *rgba, int flipY)
+{
+	FILE *file = fopen(path, "wb");
+	unsigned char *row;
+	int x;
+	int y;
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+		return 0;
+	}
+	row = allocHeap(width * 3);
+	if (row == NULL)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (y = 0; y < height; y++)
+	{
+		const unsigned char *src = rgba + (size_t)(flipY ? height - 1 - y : y) * width * 4;
+		for (x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = src[x * 4 + 0];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+		fwrite(row, 3, width, file);
+	}
+
+	freeHeap(row);
+	return fclose(file) == 0;
+}
+
+int writeImagePNG(const char *path, int width, int height, const unsigned char *rgba, int flipY)
+{
+	return writePNG(path, width, height, rgba, flipY, 3);
+}
+
+int writeImagePNGAlpha(const char *path, int width, int height, const unsigned char *rgba)
+{
+	return writePNG(path, width, height, rgba, 0, 4);
+}
+
+// channels is 3 for rgb or 4 for rgba.
+static int writePNG(const char *path, int width, int height, const unsigned char *rgba, int flipY, int channels)
+{
+	size_t rowSize = 1 + (size_t)width * channels; // filter byte and the pixels
+	size_t rawSize = rowSize * height;
+	size_t blocks = (rawSize + STORED_BLOCK_MAX - 1) / STORED_BLOCK_MAX;
+	size_t zlibSize = 2 + rawSize + blocks * 5 + 4;
+	unsigned char *raw = allocHeap(rawSize);
+	unsigned char *zlib = allocHeap(zlibSize);
+	unsigned char header[13];
+	unsigned long adlerA = 1;
+	unsigned long adlerB = 0;
+	size_t i;
+	size_t out;
+	int x;
+	int y;
+	int ok;
+
+	if (raw == NULL || zlib == NULL)
+	{
+		freeHeap(raw);
+		freeHeap(zlib);
+		return 0;
+	}
+
+	// Scanlines with filter type 0, which leaves the bytes as they are.
+	for (y = 0; y < height; y++)
+	{
+		const unsigned char *src = rgba + (size_t)(flipY ? height - 1 - y : y) * width * 4;
+		unsigned char *dst = raw + rowSize * y;
+		dst[0] = 0;
+		for (x = 0; x < width; x++)
+		{
+			memcpy(dst + 1 + x * channels, src + x * 4, channels);
+		}
+	}
+
+	// zlib header, the scanlines in stored deflate blocks, then the adler32 of the scanlines.
+	zlib[0] = 0x78;
+	zlib[1] = 0x01;
+	out = 2;
+	for (i = 0; i < rawSize; i += STORED_BLOCK_MAX)
+	{
+		size_t length = rawSize - i < STORED_BLOCK_MAX ? rawSize - i : STORED_BLOCK_MAX;
+		zlib[out++] = i + length == rawSize ? 1 : 0;
+		zlib[out++] = length & 0xff;
+		zlib[out++] = (length >> 8) & 0xff;
+		zlib[out++] = ~length & 0xff;
+		zlib[out++] = (~length >> 8) & 0xff;
+		memcpy(zlib + out, raw + i, length);
+		out += length;
+	}
+	for (i = 0; i < rawSize; i++)
+	{
+		adlerA = (adlerA + raw[i]) % 65521;
+		adlerB = (adlerB + adlerA) % 65521;
+	}
+	writeBigEndian(zlib + out, (adlerB << 16) | adlerA);
+	out += 4;
+
+	writeBigEndian(header, width);
+	writeBigEndian(header + 4, height);
+	header[8] = 8; // bits per channel
+	header[9] = channels == 4 ? 6 : 2; // rgba or rgb
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering
+	header[12] = 0; // not interlaced
+
+	FILE *file = fopen(path, "wb");
+	ok = file != NULL;
+	if (ok)
+	{
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		ok = fwrite(signature, 1, 8, file) == 8
+			&& writeChunk(file, "IHDR", header, sizeof(header))
+			&& writeChunk(file, "IDAT", zlib, out)
+			&& writeChunk(file, "IEND", NULL, 0);
+		ok = fclose(file) == 0 && ok;
+	}
+	else
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+	}
+
+	freeHeap(raw);
+	freeHeap(zlib);
+	return ok;
+}
+
+static unsigned long crc32Update(unsigned long crc, const unsigned char *data, size_t length)
+{
+	static unsigned long table[256];
+	static int tableReady = 0;
+	size_t i;
+	int k;
+
+	if (!tableReady)
+	{
+		for (i = 0; i < 256; i++)
+		{
+			unsigned long c = (unsigned long)i;
+			for (k = 0; k < 8; k++)
+			{
+				c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+		tableReady = 1;
+	}
+
+	for (i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void writeBigEndian(unsigned char *out, unsigned long value)
+{
+	out[0] = (value >> 24) & 0xff;
+	out[1] = (value >> 16) & 0xff;
+	out[2] = (value >> 8) & 0xff;
+	out[3] = value & 0xff;
+}
+
+// Length, type, data then the crc of the type and data.
+static int writeChunk(FILE *file, const char *type, const unsigned char *data, size_t length)
+{
+	unsigned char word[4];
+	unsigned long crc = 0xffffffffUL;
+
+	writeBigEndian(word, (unsigned long)length);
+	if (fwrite(word, 1, 4, file) != 4 || fwrite(type, 1, 4, file) != 4)
+	{
+		return 0;
+	}
+	if (length > 0 && fwrite(data, 1, length, file) != length)
+	{
+		return 0;
+	}
+
+	crc = crc32Update(crc, (const unsigned char *)type, 4);
+	crc = crc32Update(crc, data, length);
+	writeBigEndian(word, crc ^ 0xffffffffUL);
+	return fwrite(word, 1, 4, file) == 4;
+}
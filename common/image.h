@@ -0,0 +1,13 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+//writes rgba pixels as a .ppm or .png, picked by the extension of path. Set flipY for bottom up rows like glReadPixels gives. Returns 0 on failure.
+int writeImage(const char *path, int width, int height, const unsigned char *rgba, int flipY);
+//writes rgba pixels as a binary ppm, alpha is dropped
+int writeImagePPM(const char *path, int width, int height, const unsigned char *rgba, int flipY);
+//writes rgba pixels as an rgb png, stored without compression so no zlib is needed
+int writeImagePNG(const char *path, int width, int height, const unsigned char *rgba, int flipY);
+//writes rgba pixels as an rgba png, for images like texture atlases where the alpha matters
+int writeImagePNGAlpha(const char *path, int width, int height, const unsigned char *rgba);
+
+#endif
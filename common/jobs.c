@@ -0,0 +1,224 @@
+#include <string.h>
+
+#include "jobs.h"
+
+static void workerMain(void *arg);
+static void workOnJobs(struct s_jobSystem *jobs, int self);
+static int popChunk(struct s_jobQueue *queue);
+static int stealChunks(struct s_jobSystem *jobs, int self);
+
+int initJobSystem(struct s_jobSystem *jobs, int threadCount)
+{
+	int t;
+
+	memset(jobs, 0, sizeof(*jobs));
+	if (threadCount <= 0)
+	{
+		threadCount = cpuCount();
+	}
+	if (threadCount > JOB_MAX_THREADS)
+	{
+		threadCount = JOB_MAX_THREADS;
+	}
+	initMutex(&jobs->mutex);
+	initCondition(&jobs->wake);
+	initCondition(&jobs->finished);
+
+	// Thread 0 is whoever calls runJobs, so only the others are started.
+	jobs->threadCount = 1;
+	for (t = 1; t < threadCount; t++)
+	{
+		jobs->workers[t].jobs = jobs;
+		jobs->workers[t].index = t;
+		if (!startThread(&jobs->threads[t], workerMain, &jobs->workers[t]))
+		{
+			freeJobSystem(jobs);
+			return 0;
+		}
+		jobs->threadCount++;
+	}
+	return 1;
+}
+
+void runJobs(struct s_jobSystem *jobs, void (*run)(void *arg, int begin, int end), void *arg, int count, int chunkSize)
+{
+	int chunkCount;
+	int t;
+
+	if (count <= 0)
+	{
+		return;
+	}
+	if (chunkSize < 1)
+	{
+		chunkSize = 1;
+	}
+	if ((count + chunkSize - 1) / chunkSize > JOB_MAX_CHUNKS)
+	{
+		chunkSize = (count + JOB_MAX_CHUNKS - 1) / JOB_MAX_CHUNKS;
+	}
+	chunkCount = (count + chunkSize - 1) / chunkSize;
+	jobs->runs++;
+
+	if (jobs->threadCount == 1 || chunkCount == 1)
+	{
+		run(arg, 0, count);
+		return;
+	}
+
+	// The workers are all asleep, so the loop and their shares can be set up without them seeing half of it.
+	jobs->run = run;
+	jobs->arg = arg;
+	jobs->count = count;
+	jobs->chunkSize = chunkSize;
+	for (t = 0; t < jobs->threadCount; t++)
+	{
+		unsigned int begin = (unsigned int)(chunkCount * t / jobs->threadCount);
+		unsigned int end = (unsigned int)(chunkCount * (t + 1) / jobs->threadCount);
+		jobs->queues[t].range = begin | end << 16;
+		jobs->queues[t].steals = 0;
+	}
+
+	lockMutex(&jobs->mutex);
+	jobs->active = jobs->threadCount - 1;
+	jobs->generation++;
+	wakeCondition(&jobs->wake);
+	unlockMutex(&jobs->mutex);
+
+	workOnJobs(jobs, 0);
+
+	// Returning before every worker has let go would let the next loop reset queues they are still stealing from.
+	lockMutex(&jobs->mutex);
+	while (loadAcquire(&jobs->active) != 0)
+	{
+		waitCondition(&jobs->finished, &jobs->mutex);
+	}
+	unlockMutex(&jobs->mutex);
+
+	for (t = 0; t < jobs->threadCount; t++)
+	{
+		jobs->steals += jobs->queues[t].steals;
+	}
+}
+
+void freeJobSystem(struct s_jobSystem *jobs)
+{
+	int t;
+
+	lockMutex(&jobs->mutex);
+	jobs->stop = 1;
+	wakeCondition(&jobs->wake);
+	unlockMutex(&jobs->mutex);
+	for (t = 1; t < jobs->threadCount; t++)
+	{
+		joinThread(&jobs->threads[t]);
+	}
+	freeCondition(&jobs->wake);
+	freeCondition(&jobs->finished);
+	freeMutex(&jobs->mutex);
+	jobs->threadCount = 0;
+}
+
+static void workerMain(void *arg)
+{
+	struct s_jobWorker *worker = arg;
+	struct s_jobSystem *jobs = worker->jobs;
+	unsigned int seen = 0;
+
+	for (;;)
+	{
+		lockMutex(&jobs->mutex);
+		while (!jobs->stop && jobs->generation == seen)
+		{
+			waitCondition(&jobs->wake, &jobs->mutex);
+		}
+		seen = jobs->generation;
+		int stop = jobs->stop;
+		unlockMutex(&jobs->mutex);
+		if (stop)
+		{
+			return;
+		}
+
+		workOnJobs(jobs, worker->index);
+
+		// The last worker out wakes runJobs.
+		if (atomicAdd(&jobs->active, (unsigned int)-1) == 1)
+		{
+			lockMutex(&jobs->mutex);
+			wakeCondition(&jobs->finished);
+			unlockMutex(&jobs->mutex);
+		}
+	}
+}
+
+static void workOnJobs(struct s_jobSystem *jobs, int self)
+{
+	for (;;)
+	{
+		int chunk = popChunk(&jobs->queues[self]);
+		if (chunk < 0)
+		{
+			chunk = stealChunks(jobs, self);
+		}
+		if (chunk < 0)
+		{
+			return;
+		}
+
+		int begin = chunk * jobs->chunkSize;
+		int end = begin + jobs->chunkSize < jobs->count ? begin + jobs->chunkSize : jobs->count;
+		jobs->run(jobs->arg, begin, end);
+	}
+}
+
+static int popChunk(struct s_jobQueue *queue)
+{
+	for (;;)
+	{
+		unsigned int range = loadAcquire(&queue->range);
+		unsigned int begin = range & 0xffff;
+		unsigned int end = range >> 16;
+
+		if (begin >= end)
+		{
+			return -1;
+		}
+		if (compareExchange(&queue->range, range, (begin + 1) | end << 16))
+		{
+			return (int)begin;
+		}
+	}
+}
+
+// Takes the back half of the first queue that has chunks left, runs one and keeps the rest in our own queue.
+// Chunks only ever leave a queue, so a range can't come back and fool a compare and swap.
+static int stealChunks(struct s_jobSystem *jobs, int self)
+{
+	int v;
+
+	for (v = 1; v < jobs->threadCount; v++)
+	{
+		struct s_jobQueue *victim = &jobs->queues[(self + v) % jobs->threadCount];
+		for (;;)
+		{
+			unsigned int range = loadAcquire(&victim->range);
+			unsigned int begin = range & 0xffff;
+			unsigned int end = range >> 16;
+			unsigned int take = (end - begin + 1) / 2;
+
+			if (begin >= end)
+			{
+				break;
+			}
+			if (compareExchange(&victim->range, range, begin | (end - take) << 16))
+			{
+				// Our own queue is empty, so nobody else is changing it while we fill it.
+				storeRelease(&jobs->queues[self].range, (end - take + 1) | end << 16);
+				jobs->queues[self].steals += take;
+				return (int)(end - take);
+			}
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,58 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "thread.h"
+
+#define JOB_MAX_THREADS	64
+#define JOB_MAX_CHUNKS	65535	// chunks in one runJobs, the ranges pack begin and end into 16 bits each
+#define JOB_CACHE_LINE	64
+
+// The chunks one thread has left, begin in the low 16 bits and end in the high 16.
+// The owner takes chunks from the front and thieves from the back, both with one compare and swap.
+struct s_jobQueue {
+	volatile unsigned int range;
+	unsigned int steals;	// chunks this thread took from others, only written by its thread
+	char padding[JOB_CACHE_LINE - 2 * sizeof(unsigned int)];	// one queue per cache line, so threads don't fight over lines
+};
+
+struct s_jobWorker {
+	struct s_jobSystem *jobs;
+	int index;
+};
+
+// Splits a loop over count items into chunks and runs them on every thread at once.
+// Each thread starts with an even share of the chunks, the ones that finish early steal from the back of the others,
+// so an uneven share or a thread the os puts to sleep doesn't hold up the rest.
+// The thread calling runJobs works too, as thread 0.
+struct s_jobSystem {
+	int threadCount;	// including the calling thread
+	struct s_jobQueue queues[JOB_MAX_THREADS];
+	struct s_thread threads[JOB_MAX_THREADS];
+	struct s_jobWorker workers[JOB_MAX_THREADS];
+
+	// the loop being run, set before the workers are woken
+	void (*run)(void *arg, int begin, int end);
+	void *arg;
+	int count;
+	int chunkSize;
+
+	struct s_mutex mutex;
+	struct s_condition wake;	// workers wait here for the next loop
+	struct s_condition finished;	// runJobs waits here for the workers to run out of chunks
+	unsigned int generation;	// counts the loops, guarded by mutex
+	volatile unsigned int active;	// workers still on the current loop
+	int stop;	// guarded by mutex
+
+	// stats
+	unsigned long runs;
+	unsigned long steals;
+};
+
+//starts threadCount - 1 worker threads, 0 means one per cpu. Returns 0 on failure.
+int initJobSystem(struct s_jobSystem *jobs, int threadCount);
+//calls run(arg, begin, end) over chunks of about chunkSize items covering 0 to count, on every thread, and returns once all are done
+void runJobs(struct s_jobSystem *jobs, void (*run)(void *arg, int begin, int end), void *arg, int count, int chunkSize);
+//stops and joins the workers
+void freeJobSystem(struct s_jobSystem *jobs);
+
+#endif
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "overlay.h"
+#include "glstate.h"
+#include "arena.h"
+
+#define GLSL(src) "#version 330 core\n" #src // Writing glsl shaders directly into character arrays in-file for examples.
+
+#define GLYPH_WIDTH		6	// 5 pixels and a space
+#define GLYPH_HEIGHT	9	// 7 pixels and two rows between lines
+
+// 5x7 font from ' ' to 'Z', one byte per row with the leftmost pixel in bit 4. Lower case is drawn as upper case.
+static const unsigned char g_font[][7] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+	{ 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+	{ 0x0A, 0x1F, 0x0A, 0x0A, 0x0A, 0x1F, 0x0A }, // #
+	{ 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // $
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+	{ 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // &
+	{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+	{ 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // *
+	{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+	{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ;
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+	{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+	{ 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // @
+	{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+	{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // Y
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+};
+
+static GLuint compileOverlayShader(GLenum type, const char *source);
+
+int initOverlay(struct s_overlay *overlay)
+{
+	// The quad comes from gl_VertexID, so no vertex buffer is needed, only the empty vertex array core profile requires.
+	const char* vertexSource = GLSL(
+		uniform vec4 rect;
+
+	out vec2 texCoord;
+
+	void main()
+	{
+		vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+		texCoord = vec2(corner.x, 1.0 - corner.y);
+		gl_Position = vec4(rect.xy + corner * rect.zw, 0.0, 1.0);
+	}
+	);
+	const char* fragmentSource = GLSL(
+		in vec2 texCoord;
+
+	out vec4 color;
+
+	uniform sampler2D text;
+
+	void main()
+	{
+		// White text on a dark see-through background.
+		color = mix(vec4(0.0, 0.0, 0.0, 0.6), vec4(1.0), texture(text, texCoord).r);
+	}
+	);
+
+	memset(overlay, 0, sizeof(*overlay));
+	overlay->width = OVERLAY_COLUMNS * GLYPH_WIDTH;
+	overlay->height = OVERLAY_ROWS * GLYPH_HEIGHT;
+	overlay->pixels = callocHeap(overlay->width * overlay->height, 1);
+	if (overlay->pixels == NULL)
+	{
+		return 0;
+	}
+
+	GLuint vertexShader = compileOverlayShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = compileOverlayShader(GL_FRAGMENT_SHADER, fragmentSource);
+	if (vertexShader == 0 || fragmentShader == 0)
+	{
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		freeOverlay(overlay);
+		return 0;
+	}
+	overlay->program = glCreateProgram();
+	glAttachShader(overlay->program, vertexShader);
+	glAttachShader(overlay->program, fragmentShader);
+	glBindFragDataLocation(overlay->program, 0, "color");
+	glLinkProgram(overlay->program);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	overlay->rectLocation = glGetUniformLocation(overlay->program, "rect");
+
+	glGenVertexArrays(1, &overlay->vao);
+
+	glGenTextures(1, &overlay->texture);
+	stateBindTexture(GL_TEXTURE_2D, overlay->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, overlay->width, overlay->height, 0, GL_RED, GL_UNSIGNED_BYTE, overlay->pixels);
+	// Nearest keeps the font pixels sharp when scaled up.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	stateBindTexture(GL_TEXTURE_2D, 0);
+
+	return 1;
+}
+
+void setOverlayText(struct s_overlay *overlay, const char *text)
+{
+	int column = 0;
+	int row = 0;
+	int x;
+	int y;
+
+	memset(overlay->pixels, 0, overlay->width * overlay->height);
+	for (; *text != '\0' && row < OVERLAY_ROWS; text++)
+	{
+		int c = toupper((unsigned char)*text);
+
+		if (c == '\n')
+		{
+			column = 0;
+			row++;
+			continue;
+		}
+		if (column == OVERLAY_COLUMNS)
+		{
+			continue;
+		}
+		if (c >= ' ' && c <= 'Z')
+		{
+			const unsigned char *glyph = g_font[c - ' '];
+			unsigned char *cell = overlay->pixels + row * GLYPH_HEIGHT * overlay->width + column * GLYPH_WIDTH;
+			for (y = 0; y < 7; y++)
+			{
+				for (x = 0; x < 5; x++)
+				{
+					cell[(y + 1) * overlay->width + x + 1] = (glyph[y] >> (4 - x)) & 1 ? 255 : 0;
+				}
+			}
+		}
+		column++;
+	}
+
+	stateBindTexture(GL_TEXTURE_2D, overlay->texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, overlay->width, overlay->height, GL_RED, GL_UNSIGNED_BYTE, overlay->pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void drawOverlay(struct s_overlay *overlay, int viewportWidth, int viewportHeight)
+{
+	// Pixel size of the text converted to the -1 to 1 range, pinned to the top left corner.
+	GLfloat width = 2.0f * overlay->width * OVERLAY_SCALE / viewportWidth;
+	GLfloat height = 2.0f * overlay->height * OVERLAY_SCALE / viewportHeight;
+
+	stateUseProgram(overlay->program);
+	glUniform4f(overlay->rectLocation, -1.0f, 1.0f - height, width, height);
+	stateActiveTexture(GL_TEXTURE0);
+	stateBindTexture(GL_TEXTURE_2D, overlay->texture);
+	stateBindVertexArray(overlay->vao);
+
+	stateEnable(GL_BLEND);
+	stateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	stateDisable(GL_BLEND);
+}
+
+void freeOverlay(struct s_overlay *overlay)
+{
+	stateDeleteTextures(1, &overlay->texture);
+	stateDeleteVertexArrays(1, &overlay->vao);
+	glDeleteProgram(overlay->program);
+	freeHeap(overlay->pixels);
+	memset(overlay, 0, sizeof(*overlay));
+}
+
+static GLuint compileOverlayShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	GLint status;
+	char log[512];
+
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Failed to compile overlay shader: %s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
@@ -0,0 +1,32 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#define OVERLAY_COLUMNS	48
+#define OVERLAY_ROWS	18
+#define OVERLAY_SCALE	2	// screen pixels per font pixel
+
+// Text drawn over the top left of the screen, for the profiler stats.
+// The text is rasterized on the cpu with a small 5x7 font into one texture, so drawing it is a single quad.
+struct s_overlay {
+	GLuint program;
+	GLuint vao;
+	GLuint texture;
+	GLint rectLocation;
+	unsigned char *pixels;
+	int width;
+	int height;
+};
+
+//builds the shader and texture. Returns 0 on failure.
+int initOverlay(struct s_overlay *overlay);
+//replaces the text, lines are split on newlines and cut off at OVERLAY_COLUMNS and OVERLAY_ROWS
+void setOverlayText(struct s_overlay *overlay, const char *text);
+//draws the text blended over the frame, leaves blending off and the vertex array unbound
+void drawOverlay(struct s_overlay *overlay, int viewportWidth, int viewportHeight);
+//deletes the gl objects
+void freeOverlay(struct s_overlay *overlay);
+
+#endif
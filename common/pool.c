@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include "pool.h"
+#include "arena.h"
+
+#define POOL_INDEX_MASK	((1u << POOL_INDEX_BITS) - 1)
+
+static int handleSlot(const struct s_pool *pool, unsigned int handle);
+
+int initPool(struct s_pool *pool, int blockSize, int capacity)
+{
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	if (capacity < 1 || capacity > POOL_MAX_BLOCKS || blockSize < 1)
+	{
+		return 0;
+	}
+	pool->blocks = allocHeap((size_t)blockSize * capacity);
+	pool->slotBlocks = allocHeap(sizeof(int) * capacity);
+	pool->blockSlots = allocHeap(sizeof(int) * capacity);
+	pool->generations = allocHeap(sizeof(unsigned int) * capacity);
+	if (pool->blocks == NULL || pool->slotBlocks == NULL || pool->blockSlots == NULL || pool->generations == NULL)
+	{
+		freePool(pool);
+		return 0;
+	}
+	pool->blockSize = blockSize;
+	pool->capacity = capacity;
+
+	// Every slot starts free, chained in order so the first handles go out in block order.
+	for (i = 0; i < capacity; i++)
+	{
+		pool->slotBlocks[i] = i + 1 < capacity ? i + 1 : -1;
+		pool->generations[i] = 1;
+	}
+	pool->freeSlot = 0;
+	return 1;
+}
+
+unsigned int allocPoolBlock(struct s_pool *pool)
+{
+	int slot = pool->freeSlot;
+
+	if (slot < 0)
+	{
+		pool->failures++;
+		return 0;
+	}
+	pool->freeSlot = pool->slotBlocks[slot];
+	pool->slotBlocks[slot] = pool->count;
+	pool->blockSlots[pool->count] = slot;
+	memset(pool->blocks + (size_t)pool->count * pool->blockSize, 0, pool->blockSize);
+	pool->count++;
+
+	pool->allocations++;
+	if (pool->count > pool->peak)
+	{
+		pool->peak = pool->count;
+	}
+	// Slot 0 of generation 0 would be handle 0, generations start at 1 so it never is.
+	return (pool->generations[slot] << POOL_INDEX_BITS) | (unsigned int)slot;
+}
+
+void freePoolBlock(struct s_pool *pool, unsigned int handle)
+{
+	int slot = handleSlot(pool, handle);
+
+	if (slot < 0)
+	{
+		return;
+	}
+	int block = pool->slotBlocks[slot];
+	int last = pool->count - 1;
+	if (block != last)
+	{
+		memcpy(pool->blocks + (size_t)block * pool->blockSize, pool->blocks + (size_t)last * pool->blockSize, pool->blockSize);
+		pool->blockSlots[block] = pool->blockSlots[last];
+		pool->slotBlocks[pool->blockSlots[block]] = block;
+	}
+	pool->count--;
+
+	// Wraps past 0, which is saved for handle 0 of slot 0.
+	pool->generations[slot] = (pool->generations[slot] + 1) & (0xffffffffu >> POOL_INDEX_BITS);
+	if (pool->generations[slot] == 0)
+	{
+		pool->generations[slot] = 1;
+	}
+	pool->slotBlocks[slot] = pool->freeSlot;
+	pool->freeSlot = slot;
+	pool->frees++;
+}
+
+void *poolBlock(const struct s_pool *pool, unsigned int handle)
+{
+	int slot = handleSlot(pool, handle);
+
+	if (slot < 0)
+	{
+		return NULL;
+	}
+	return pool->blocks + (size_t)pool->slotBlocks[slot] * pool->blockSize;
+}
+
+void *poolBlocks(const struct s_pool *pool)
+{
+	return pool->blocks;
+}
+
+void freePool(struct s_pool *pool)
+{
+	freeHeap(pool->blocks);
+	freeHeap(pool->slotBlocks);
+	freeHeap(pool->blockSlots);
+	freeHeap(pool->generations);
+	memset(pool, 0, sizeof(*pool));
+}
+
+// Returns the handle's slot, or -1 if the handle is out of range or its block was freed.
+static int handleSlot(const struct s_pool *pool, unsigned int handle)
+{
+	int slot = (int)(handle & POOL_INDEX_MASK);
+
+	if (slot >= pool->capacity || pool->generations[slot] != handle >> POOL_INDEX_BITS)
+	{
+		return -1;
+	}
+	// A free slot's new generation hasn't been handed out, but a made up handle could still name it.
+	int block = pool->slotBlocks[slot];
+	if (block < 0 || block >= pool->count || pool->blockSlots[block] != slot)
+	{
+		return -1;
+	}
+	return slot;
+}
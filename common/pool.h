@@ -0,0 +1,42 @@
+#ifndef POOL_H
+#define POOL_H
+
+#define POOL_INDEX_BITS	24	// a handle is its slot in the low bits and the slot's generation above them
+#define POOL_MAX_BLOCKS	((1 << POOL_INDEX_BITS) - 1)
+
+// Fixed size blocks for things that live across frames, all allocated up front and handed out by handle.
+// The live blocks are kept packed at the front so they can be looped over like a plain array,
+// freeing one moves the last block into its place. That moves a pointer but never a handle,
+// each handle goes through its slot to wherever its block is now. A freed slot's generation goes up,
+// so a handle kept after its block was freed is stale and looks up NULL instead of someone else's block.
+struct s_pool {
+	unsigned char *blocks;	// count live blocks, then room for the rest
+	int blockSize;
+	int capacity;
+	int count;
+	int *slotBlocks;	// the block each slot's handle points at, or the next free slot
+	int *blockSlots;	// the slot that owns each live block
+	unsigned int *generations;
+	int freeSlot;	// first of the free slots, -1 when full
+
+	// stats
+	unsigned long allocations;
+	unsigned long frees;
+	unsigned long failures;	// allocations with the pool full
+	int peak;	// most blocks live at once
+};
+
+//allocates room for capacity blocks of blockSize bytes, up to POOL_MAX_BLOCKS. Returns 0 on failure.
+int initPool(struct s_pool *pool, int blockSize, int capacity);
+//takes a zeroed block at the end of the live ones. Returns its handle, or 0 when the pool is full, which no block ever has.
+unsigned int allocPoolBlock(struct s_pool *pool);
+//frees the handle's block, moving the last live block into its place. Stale handles are ignored.
+void freePoolBlock(struct s_pool *pool, unsigned int handle);
+//the handle's block, NULL if it is stale. Only good until the next free.
+void *poolBlock(const struct s_pool *pool, unsigned int handle);
+//the live blocks, packed one after the other
+void *poolBlocks(const struct s_pool *pool);
+//frees the blocks, every handle is stale after
+void freePool(struct s_pool *pool);
+
+#endif
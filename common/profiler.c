@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "profiler.h"
+#include "timer.h"
+
+struct s_profTimer {
+	const char *name;
+	enum profKinds kind;
+	double samples[PROF_SAMPLES];	// ring of the latest samples in milliseconds
+	int sampleCount;
+	int nextSample;
+	double start;	// cpu timers
+	GLuint queries[PROF_QUERIES];	// gpu timers, oldest query in flight is at oldestQuery
+	int oldestQuery;
+	int queriesInFlight;
+	int skipped;	// every query was still in flight when the stage began, so this one isn't timed
+	int warmedUp;
+};
+
+struct s_profiler {
+	struct s_profTimer timers[PROF_MAX_TIMERS];
+	int timerCount;
+	double frameStart;
+	unsigned long frame;
+	int reportFrames;
+	int reportReady;
+	FILE *log;
+	int logJson;
+	double logStart;
+};
+
+static struct s_profiler g_profiler = { .timerCount = 0, .reportFrames = PROF_REPORT_FRAMES };
+
+static void initFrameTimer(void);
+static void addSample(struct s_profTimer *timer, double milliseconds);
+static void collectQueries(struct s_profTimer *timer);
+static void writeLog(void);
+static int compareSamples(const void *a, const void *b);
+
+int profRegister(const char *name, enum profKinds kind)
+{
+	struct s_profTimer *timer;
+
+	initFrameTimer();
+	if (g_profiler.timerCount == PROF_MAX_TIMERS)
+	{
+		fprintf(stderr, "Too many profiler timers, %s is not timed\n", name);
+		return -1;
+	}
+
+	timer = &g_profiler.timers[g_profiler.timerCount];
+	memset(timer, 0, sizeof(*timer));
+	timer->name = name;
+	timer->kind = kind;
+	return g_profiler.timerCount++;
+}
+
+void profBegin(int id)
+{
+	struct s_profTimer *timer;
+
+	if (id <= PROF_FRAME || id >= g_profiler.timerCount)
+	{
+		return;
+	}
+	timer = &g_profiler.timers[id];
+
+	if (timer->kind == PROF_CPU)
+	{
+		timer->start = timerNow();
+		return;
+	}
+
+	if (timer->queries[0] == 0)
+	{
+		glGenQueries(PROF_QUERIES, timer->queries);
+	}
+	// Rather than wait on the gpu for a free query, skip timing this frame.
+	timer->skipped = timer->queriesInFlight == PROF_QUERIES;
+	if (!timer->skipped)
+	{
+		glBeginQuery(GL_TIME_ELAPSED, timer->queries[(timer->oldestQuery + timer->queriesInFlight) % PROF_QUERIES]);
+	}
+}
+
+void profEnd(int id)
+{
+	struct s_profTimer *timer;
+
+	if (id <= PROF_FRAME || id >= g_profiler.timerCount)
+	{
+		return;
+	}
+	timer = &g_profiler.timers[id];
+
+	if (timer->kind == PROF_CPU)
+	{
+		addSample(timer, (timerNow() - timer->start) * 1000.0);
+	}
+	else if (!timer->skipped)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		timer->queriesInFlight++;
+	}
+}
+
+void profEndFrame(void)
+{
+	double now = timerNow();
+	int i;
+
+	initFrameTimer();
+	addSample(&g_profiler.timers[PROF_FRAME], (now - g_profiler.frameStart) * 1000.0);
+	g_profiler.frameStart = now;
+	g_profiler.frame++;
+
+	for (i = 1; i < g_profiler.timerCount; i++)
+	{
+		if (g_profiler.timers[i].kind == PROF_GPU)
+		{
+			collectQueries(&g_profiler.timers[i]);
+		}
+	}
+
+	g_profiler.reportReady = g_profiler.reportFrames > 0 && g_profiler.frame % g_profiler.reportFrames == 0;
+	if (g_profiler.reportReady && g_profiler.log != NULL)
+	{
+		writeLog();
+	}
+}
+
+int profOpenLog(const char *path, int reportFrames)
+{
+	size_t length = strlen(path);
+
+	if (g_profiler.log != NULL)
+	{
+		fclose(g_profiler.log);
+	}
+	g_profiler.log = fopen(path, "w");
+	if (g_profiler.log == NULL)
+	{
+		fprintf(stderr, "Failed to open profiler log %s\n", path);
+		return 0;
+	}
+
+	g_profiler.logJson = length > 5 && strcmp(path + length - 5, ".json") == 0;
+	if (reportFrames > 0)
+	{
+		g_profiler.reportFrames = reportFrames;
+	}
+	if (!g_profiler.logJson)
+	{
+		fprintf(g_profiler.log, "frame,seconds,timer,kind,samples,min_ms,avg_ms,p99_ms,max_ms\n");
+	}
+	return 1;
+}
+
+int profGetStats(int id, struct s_profStats *stats)
+{
+	double sorted[PROF_SAMPLES];
+	struct s_profTimer *timer;
+	double sum = 0.0;
+	int i;
+
+	if (id < 0 || id >= g_profiler.timerCount)
+	{
+		return 0;
+	}
+	timer = &g_profiler.timers[id];
+
+	memset(stats, 0, sizeof(*stats));
+	stats->name = timer->name;
+	stats->kind = timer->kind;
+	stats->samples = timer->sampleCount;
+	if (timer->sampleCount == 0)
+	{
+		return 1;
+	}
+
+	memcpy(sorted, timer->samples, sizeof(double) * timer->sampleCount);
+	qsort(sorted, timer->sampleCount, sizeof(double), compareSamples);
+	for (i = 0; i < timer->sampleCount; i++)
+	{
+		sum += sorted[i];
+	}
+	stats->min = sorted[0];
+	stats->max = sorted[timer->sampleCount - 1];
+	stats->avg = sum / timer->sampleCount;
+	stats->p99 = sorted[(int)ceil(timer->sampleCount * 0.99) - 1];
+	return 1;
+}
+
+int profFormatReport(char *text, int size)
+{
+	struct s_profStats stats;
+	int used = 0;
+	int i;
+
+	text[0] = '\0';
+	used += snprintf(text, size, "%-12s %8s %8s %8s\n", "ms", "min", "avg", "p99");
+	for (i = 0; i < g_profiler.timerCount && used < size; i++)
+	{
+		profGetStats(i, &stats);
+		used += snprintf(text + used, size - used, "%-8s %-3s %8.3f %8.3f %8.3f\n",
+			stats.name, stats.kind == PROF_GPU ? "gpu" : "cpu", stats.min, stats.avg, stats.p99);
+	}
+	return g_profiler.timers[PROF_FRAME].sampleCount;
+}
+
+int profReportReady(void)
+{
+	return g_profiler.reportReady;
+}
+
+void profShutdown(void)
+{
+	int i;
+
+	for (i = 1; i < g_profiler.timerCount; i++)
+	{
+		if (g_profiler.timers[i].queries[0] != 0)
+		{
+			glDeleteQueries(PROF_QUERIES, g_profiler.timers[i].queries);
+			g_profiler.timers[i].queries[0] = 0;
+		}
+	}
+	if (g_profiler.log != NULL)
+	{
+		fclose(g_profiler.log);
+		g_profiler.log = NULL;
+	}
+}
+
+// The frame timer always takes the first slot.
+static void initFrameTimer(void)
+{
+	if (g_profiler.timerCount > 0)
+	{
+		return;
+	}
+
+	g_profiler.timers[PROF_FRAME].name = "frame";
+	g_profiler.timers[PROF_FRAME].kind = PROF_CPU;
+	g_profiler.timerCount = 1;
+	g_profiler.frameStart = timerNow();
+	g_profiler.logStart = g_profiler.frameStart;
+}
+
+static void addSample(struct s_profTimer *timer, double milliseconds)
+{
+	timer->samples[timer->nextSample] = milliseconds;
+	timer->nextSample = (timer->nextSample + 1) % PROF_SAMPLES;
+	if (timer->sampleCount < PROF_SAMPLES)
+	{
+		timer->sampleCount++;
+	}
+}
+
+// Reads back every query that has finished, oldest first, and stops at the first one that hasn't so we never wait.
+static void collectQueries(struct s_profTimer *timer)
+{
+	GLint available;
+	GLuint64 nanoseconds;
+
+	while (timer->queriesInFlight > 0)
+	{
+		GLuint query = timer->queries[timer->oldestQuery];
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			break;
+		}
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		// The first query also times driver warm up (and some drivers return nonsense for it), so it is dropped.
+		if (timer->warmedUp)
+		{
+			addSample(timer, nanoseconds / 1e6);
+		}
+		timer->warmedUp = 1;
+		timer->oldestQuery = (timer->oldestQuery + 1) % PROF_QUERIES;
+		timer->queriesInFlight--;
+	}
+}
+
+static void writeLog(void)
+{
+	struct s_profStats stats;
+	double seconds = timerNow() - g_profiler.logStart;
+	int i;
+
+	if (g_profiler.logJson)
+	{
+		fprintf(g_profiler.log, "{\"frame\":%lu,\"seconds\":%.3f,\"timers\":[", g_profiler.frame, seconds);
+	}
+	for (i = 0; i < g_profiler.timerCount; i++)
+	{
+		profGetStats(i, &stats);
+		if (g_profiler.logJson)
+		{
+			fprintf(g_profiler.log, "%s{\"name\":\"%s\",\"kind\":\"%s\",\"samples\":%d,\"min_ms\":%.4f,\"avg_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f}",
+				i > 0 ? "," : "", stats.name, stats.kind == PROF_GPU ? "gpu" : "cpu", stats.samples, stats.min, stats.avg, stats.p99, stats.max);
+		}
+		else
+		{
+			fprintf(g_profiler.log, "%lu,%.3f,%s,%s,%d,%.4f,%.4f,%.4f,%.4f\n",
+				g_profiler.frame, seconds, stats.name, stats.kind == PROF_GPU ? "gpu" : "cpu", stats.samples, stats.min, stats.avg, stats.p99, stats.max);
+		}
+	}
+	if (g_profiler.logJson)
+	{
+		fprintf(g_profiler.log, "]}\n");
+	}
+	fflush(g_profiler.log);
+}
+
+static int compareSamples(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
@@ -0,0 +1,45 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#define PROF_MAX_TIMERS	16
+#define PROF_SAMPLES	256	// rolling window the stats are taken over
+#define PROF_QUERIES	4	// gpu queries in flight per timer, results are read a few frames late instead of stalling
+#define PROF_FRAME	0	// built in timer for the whole frame, measured between profEndFrame calls
+#define PROF_REPORT_FRAMES	60	// default frames between reports
+
+enum profKinds { PROF_CPU, PROF_GPU };
+
+// Rolling statistics for one timer, in milliseconds.
+struct s_profStats {
+	const char *name;
+	enum profKinds kind;
+	int samples;
+	double min;
+	double avg;
+	double p99;
+	double max;
+};
+
+//registers a timer and returns its id for profBegin/profEnd, or -1 when there is no room left
+int profRegister(const char *name, enum profKinds kind);
+//starts timing a stage, gpu timers use GL_TIME_ELAPSED queries which can't be nested inside each other
+void profBegin(int id);
+//stops timing a stage
+void profEnd(int id);
+//call once per frame, records the frame time, collects finished gpu queries and writes the periodic report
+void profEndFrame(void);
+//logs stats every reportFrames frames, as json lines when path ends in .json and csv otherwise. Returns 0 on failure.
+int profOpenLog(const char *path, int reportFrames);
+//fills in the rolling stats of a timer. Returns 0 for an unknown id.
+int profGetStats(int id, struct s_profStats *stats);
+//writes a line of stats per timer into text for printing or the overlay. Returns the frames the stats cover.
+int profFormatReport(char *text, int size);
+//returns 1 on the frames where a report was just written, to know when to refresh an overlay
+int profReportReady(void);
+//deletes the queries and closes the log
+void profShutdown(void);
+
+#endif
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "renderqueue.h"
+#include "timer.h"
+#include "glstate.h"
+#include "arena.h"
+
+const char *const g_renderQueueModeNames[] = { "sorted", "immediate" };
+
+static int growRenderQueue(struct s_renderQueue *queue);
+static void applyCommandState(struct s_renderQueue *queue, const struct s_renderCommand *command);
+static int mergeCommand(struct s_renderCommand *draw, const struct s_renderCommand *next);
+static void drawCommand(const struct s_renderCommand *command);
+static void addStats(struct s_renderStats *total, const struct s_renderStats *frame);
+
+int initRenderQueue(struct s_renderQueue *queue, enum renderQueueModes mode, int capacity, const GLenum *targets, int unitCount)
+{
+	memset(queue, 0, sizeof(*queue));
+	queue->mode = mode;
+	queue->unitCount = unitCount < RENDER_TEXTURE_UNITS ? unitCount : RENDER_TEXTURE_UNITS;
+	memcpy(queue->targets, targets, sizeof(GLenum) * queue->unitCount);
+	queue->capacity = capacity > 0 ? capacity : 1;
+	queue->commands = allocHeap(sizeof(struct s_renderCommand) * queue->capacity);
+	queue->keys = allocHeap(sizeof(unsigned long long) * queue->capacity);
+	queue->tempKeys = allocHeap(sizeof(unsigned long long) * queue->capacity);
+	queue->order = allocHeap(sizeof(int) * queue->capacity);
+	queue->tempOrder = allocHeap(sizeof(int) * queue->capacity);
+	if (queue->commands == NULL || queue->keys == NULL || queue->tempKeys == NULL || queue->order == NULL || queue->tempOrder == NULL)
+	{
+		fprintf(stderr, "Failed to allocate a render queue for %d commands\n", queue->capacity);
+		freeRenderQueue(queue);
+		return 0;
+	}
+	return 1;
+}
+
+unsigned long long makeRenderKey(GLuint program, unsigned int textureSet, GLuint vao, unsigned int depth)
+{
+	unsigned long long key;
+
+	key = program & ((1ull << RENDER_KEY_PROGRAM_BITS) - 1);
+	key = key << RENDER_KEY_TEXTURE_BITS | (textureSet & ((1ull << RENDER_KEY_TEXTURE_BITS) - 1));
+	key = key << RENDER_KEY_VAO_BITS | (vao & ((1ull << RENDER_KEY_VAO_BITS) - 1));
+	key = key << RENDER_KEY_DEPTH_BITS | (depth & ((1ull << RENDER_KEY_DEPTH_BITS) - 1));
+	return key;
+}
+
+int submitRenderCommand(struct s_renderQueue *queue, const struct s_renderCommand *command)
+{
+	int u;
+
+	// The way the loop used to draw: bind everything, draw, unbind.
+	if (queue->mode == RENDER_IMMEDIATE)
+	{
+		stateUseProgram(command->program);
+		for (u = 0; u < queue->unitCount; u++)
+		{
+			stateActiveTexture(GL_TEXTURE0 + u);
+			stateBindTexture(queue->targets[u], command->textures[u]);
+		}
+		stateActiveTexture(GL_TEXTURE0);
+		stateBindVertexArray(command->vao);
+		drawCommand(command);
+		stateBindVertexArray(0);
+
+		queue->frame.commands++;
+		queue->frame.draws++;
+		queue->frame.programBinds++;
+		queue->frame.vaoBinds++;
+		queue->frame.textureBinds += queue->unitCount;
+		return 1;
+	}
+
+	if (queue->count == queue->capacity && !growRenderQueue(queue))
+	{
+		return 0;
+	}
+	queue->commands[queue->count] = *command;
+	queue->count++;
+	return 1;
+}
+
+void flushRenderQueue(struct s_renderQueue *queue)
+{
+	int i;
+
+	if (queue->mode == RENDER_SORTED && queue->count > 0)
+	{
+		double sortStart = timerNow();
+		for (i = 0; i < queue->count; i++)
+		{
+			queue->keys[i] = queue->commands[i].key;
+			queue->order[i] = i;
+		}
+		radixSortKeys(queue->keys, queue->order, queue->tempKeys, queue->tempOrder, queue->count);
+		queue->frame.sortSeconds = timerNow() - sortStart;
+
+		// Whatever was bound before the flush isn't known, so the first command sets all of its state.
+		queue->stateKnown = 0;
+		struct s_renderCommand draw = queue->commands[queue->order[0]];
+		applyCommandState(queue, &draw);
+		for (i = 1; i < queue->count; i++)
+		{
+			const struct s_renderCommand *next = &queue->commands[queue->order[i]];
+			if (mergeCommand(&draw, next))
+			{
+				queue->frame.merged++;
+				continue;
+			}
+			drawCommand(&draw);
+			queue->frame.draws++;
+			draw = *next;
+			applyCommandState(queue, &draw);
+		}
+		drawCommand(&draw);
+		queue->frame.draws++;
+		queue->frame.commands += queue->count;
+
+		// Drawn one by one, every command would have bound its program, its vertex array and every texture unit.
+		queue->frame.bindsAvoided = queue->frame.commands * (2 + queue->unitCount)
+			- queue->frame.programBinds - queue->frame.vaoBinds - queue->frame.textureBinds;
+
+		stateActiveTexture(GL_TEXTURE0);
+	}
+
+	addStats(&queue->total, &queue->frame);
+	queue->frames++;
+	memset(&queue->frame, 0, sizeof(queue->frame));
+	queue->count = 0;
+}
+
+// Least significant byte first, each pass a stable counting sort on one byte from one pair of arrays into the other.
+// A byte every key shares is skipped, so keys that only use a few of their bits sort in a few passes.
+void radixSortKeys(unsigned long long *keys, int *order, unsigned long long *tempKeys, int *tempOrder, int count)
+{
+	unsigned long long *fromKeys = keys;
+	unsigned long long *toKeys = tempKeys;
+	int *fromOrder = order;
+	int *toOrder = tempOrder;
+	int counts[256];
+	int shift;
+	int i;
+
+	for (shift = 0; shift < 64; shift += 8)
+	{
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < count; i++)
+		{
+			counts[(fromKeys[i] >> shift) & 0xff]++;
+		}
+		if (counts[(fromKeys[0] >> shift) & 0xff] == count)
+		{
+			continue;
+		}
+
+		int offset = 0;
+		for (i = 0; i < 256; i++)
+		{
+			int bucket = counts[i];
+			counts[i] = offset;
+			offset += bucket;
+		}
+		for (i = 0; i < count; i++)
+		{
+			int slot = counts[(fromKeys[i] >> shift) & 0xff]++;
+			toKeys[slot] = fromKeys[i];
+			toOrder[slot] = fromOrder[i];
+		}
+
+		unsigned long long *swapKeys = fromKeys;
+		int *swapOrder = fromOrder;
+		fromKeys = toKeys;
+		fromOrder = toOrder;
+		toKeys = swapKeys;
+		toOrder = swapOrder;
+	}
+
+	// An odd number of passes leaves the result in the scratch arrays.
+	if (fromKeys != keys)
+	{
+		memcpy(keys, fromKeys, sizeof(unsigned long long) * count);
+		memcpy(order, fromOrder, sizeof(int) * count);
+	}
+}
+
+void resetRenderStats(struct s_renderQueue *queue)
+{
+	memset(&queue->total, 0, sizeof(queue->total));
+	queue->frames = 0;
+}
+
+void freeRenderQueue(struct s_renderQueue *queue)
+{
+	freeHeap(queue->commands);
+	freeHeap(queue->keys);
+	freeHeap(queue->tempKeys);
+	freeHeap(queue->order);
+	freeHeap(queue->tempOrder);
+	queue->commands = NULL;
+	queue->keys = NULL;
+	queue->tempKeys = NULL;
+	queue->order = NULL;
+	queue->tempOrder = NULL;
+	queue->count = 0;
+	queue->capacity = 0;
+}
+
+int parseRenderQueueMode(const char *name)
+{
+	int mode;
+
+	for (mode = RENDER_SORTED; mode <= RENDER_IMMEDIATE; mode++)
+	{
+		if (strcmp(name, g_renderQueueModeNames[mode]) == 0)
+		{
+			return mode;
+		}
+	}
+	return -1;
+}
+
+static int growRenderQueue(struct s_renderQueue *queue)
+{
+	int capacity = queue->capacity * 2;
+	struct s_renderCommand *commands = reallocHeap(queue->commands, sizeof(struct s_renderCommand) * capacity);
+	if (commands == NULL)
+	{
+		fprintf(stderr, "Failed to grow the render queue to %d commands\n", capacity);
+		return 0;
+	}
+	queue->commands = commands;
+
+	// The sort scratch holds nothing between flushes, so it is replaced rather than copied.
+	unsigned long long *keys = allocHeap(sizeof(unsigned long long) * capacity);
+	unsigned long long *tempKeys = allocHeap(sizeof(unsigned long long) * capacity);
+	int *order = allocHeap(sizeof(int) * capacity);
+	int *tempOrder = allocHeap(sizeof(int) * capacity);
+	if (keys == NULL || tempKeys == NULL || order == NULL || tempOrder == NULL)
+	{
+		fprintf(stderr, "Failed to grow the render queue to %d commands\n", capacity);
+		freeHeap(keys);
+		freeHeap(tempKeys);
+		freeHeap(order);
+		freeHeap(tempOrder);
+		return 0;
+	}
+	freeHeap(queue->keys);
+	freeHeap(queue->tempKeys);
+	freeHeap(queue->order);
+	freeHeap(queue->tempOrder);
+	queue->keys = keys;
+	queue->tempKeys = tempKeys;
+	queue->order = order;
+	queue->tempOrder = tempOrder;
+	queue->capacity = capacity;
+	return 1;
+}
+
+// Binds whatever of the command's state isn't bound already.
+static void applyCommandState(struct s_renderQueue *queue, const struct s_renderCommand *command)
+{
+	int activeUnit = 0;
+	int u;
+
+	if (!queue->stateKnown || queue->boundProgram != command->program)
+	{
+		stateUseProgram(command->program);
+		queue->boundProgram = command->program;
+		queue->frame.programBinds++;
+	}
+	for (u = 0; u < queue->unitCount; u++)
+	{
+		if (queue->stateKnown && queue->boundTextures[u] == command->textures[u])
+		{
+			continue;
+		}
+		stateActiveTexture(GL_TEXTURE0 + u);
+		stateBindTexture(queue->targets[u], command->textures[u]);
+		queue->boundTextures[u] = command->textures[u];
+		queue->frame.textureBinds++;
+		activeUnit = u;
+	}
+	if (activeUnit != 0)
+	{
+		stateActiveTexture(GL_TEXTURE0);
+	}
+	if (!queue->stateKnown || queue->boundVao != command->vao)
+	{
+		stateBindVertexArray(command->vao);
+		queue->boundVao = command->vao;
+		queue->frame.vaoBinds++;
+	}
+	queue->stateKnown = 1;
+}
+
+// Two commands draw as one when they share all their state and next starts where draw ends, in vertices, indices or instances.
+// Strips and fans would join up across the gap, so only separate primitives are merged. Returns 1 if draw now covers next too.
+static int mergeCommand(struct s_renderCommand *draw, const struct s_renderCommand *next)
+{
+	if (draw->program != next->program || draw->vao != next->vao || draw->mode != next->mode || draw->indexType != next->indexType
+		|| memcmp(draw->textures, next->textures, sizeof(draw->textures)) != 0)
+	{
+		return 0;
+	}
+
+	// Instanced, the same vertices for the following range of instances.
+	if (draw->instances > 1 || next->instances > 1 || draw->baseInstance != 0 || next->baseInstance != 0)
+	{
+		if (draw->first != next->first || draw->count != next->count || draw->baseInstance + draw->instances != next->baseInstance)
+		{
+			return 0;
+		}
+		draw->instances += next->instances;
+		return 1;
+	}
+
+	if (draw->mode != GL_TRIANGLES && draw->mode != GL_LINES && draw->mode != GL_POINTS)
+	{
+		return 0;
+	}
+	GLintptr indexSize = draw->indexType == 0 ? 1 : draw->indexType == GL_UNSIGNED_INT ? 4 : draw->indexType == GL_UNSIGNED_SHORT ? 2 : 1;
+	if (draw->first + draw->count * indexSize != next->first)
+	{
+		return 0;
+	}
+	draw->count += next->count;
+	return 1;
+}
+
+static void drawCommand(const struct s_renderCommand *command)
+{
+	if (command->indexType == 0)
+	{
+		if (command->baseInstance != 0)
+		{
+			glDrawArraysInstancedBaseInstance(command->mode, (GLint)command->first, command->count, command->instances, command->baseInstance);
+		}
+		else if (command->instances > 1)
+		{
+			glDrawArraysInstanced(command->mode, (GLint)command->first, command->count, command->instances);
+		}
+		else
+		{
+			glDrawArrays(command->mode, (GLint)command->first, command->count);
+		}
+		return;
+	}
+
+	if (command->baseInstance != 0)
+	{
+		glDrawElementsInstancedBaseInstance(command->mode, command->count, command->indexType, (GLvoid*)command->first, command->instances,
+			command->baseInstance);
+	}
+	else if (command->instances > 1)
+	{
+		glDrawElementsInstanced(command->mode, command->count, command->indexType, (GLvoid*)command->first, command->instances);
+	}
+	else
+	{
+		glDrawElements(command->mode, command->count, command->indexType, (GLvoid*)command->first);
+	}
+}
+
+static void addStats(struct s_renderStats *total, const struct s_renderStats *frame)
+{
+	total->commands += frame->commands;
+	total->draws += frame->draws;
+	total->merged += frame->merged;
+	total->programBinds += frame->programBinds;
+	total->vaoBinds += frame->vaoBinds;
+	total->textureBinds += frame->textureBinds;
+	total->bindsAvoided += frame->bindsAvoided;
+	total->sortSeconds += frame->sortSeconds;
+}
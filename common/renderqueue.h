@@ -0,0 +1,90 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#define RENDER_TEXTURE_UNITS	4
+
+// How the 64 bit sort key is split, most significant first. Commands are sorted by program, then texture set,
+// then vertex array, then depth, so the expensive changes happen least. Depth orders draws within a state,
+// which is fine for opaque or non overlapping draws, blended ones that overlap need depth first instead.
+#define RENDER_KEY_PROGRAM_BITS	10
+#define RENDER_KEY_TEXTURE_BITS	18
+#define RENDER_KEY_VAO_BITS		12
+#define RENDER_KEY_DEPTH_BITS	24
+
+enum renderQueueModes { RENDER_SORTED, RENDER_IMMEDIATE };
+extern const char *const g_renderQueueModeNames[];
+
+// One draw and the state it needs. Every texture unit the queue was set up with is bound, 0 included.
+struct s_renderCommand {
+	unsigned long long key;	// from makeRenderKey
+	GLuint program;
+	GLuint vao;
+	GLuint textures[RENDER_TEXTURE_UNITS];
+	GLenum mode;
+	GLenum indexType;	// 0 for glDrawArrays
+	GLsizei count;	// vertices or indices
+	GLintptr first;	// first vertex, or byte offset into the element buffer
+	GLsizei instances;	// 1 for a plain draw
+	GLuint baseInstance;	// needs GL_ARB_base_instance when it isn't 0
+};
+
+// Counts for one frame, or all frames in total.
+struct s_renderStats {
+	unsigned long commands;
+	unsigned long draws;
+	unsigned long merged;	// commands drawn as part of the draw before them
+	unsigned long programBinds;
+	unsigned long vaoBinds;
+	unsigned long textureBinds;
+	unsigned long bindsAvoided;	// binds drawing each command on its own would have made on top of these
+	double sortSeconds;
+};
+
+// Collects the frame's draws and issues them at the end, sorted so commands sharing state are together.
+// Only the state that differs from the previous command is set, and a command that carries on where the previous
+// one stopped, in the same state, is drawn with it as one call.
+// In RENDER_IMMEDIATE mode every command is drawn as it is submitted with all of its state bound, as a baseline.
+struct s_renderQueue {
+	enum renderQueueModes mode;
+	struct s_renderCommand *commands;
+	int count;
+	int capacity;
+	unsigned long long *keys;	// sort scratch, the keys and command indices
+	unsigned long long *tempKeys;
+	int *order;
+	int *tempOrder;
+	int unitCount;
+	GLenum targets[RENDER_TEXTURE_UNITS];	// what each unit binds, the same for every command
+
+	// what flushRenderQueue last set, forgotten between flushes since other code binds things too
+	GLuint boundProgram;
+	GLuint boundVao;
+	GLuint boundTextures[RENDER_TEXTURE_UNITS];
+	int stateKnown;
+
+	struct s_renderStats frame;	// the last flush
+	struct s_renderStats total;
+	unsigned long frames;
+};
+
+//sets up a queue for unitCount texture units bound to targets, growing from capacity commands. Returns 0 on failure.
+int initRenderQueue(struct s_renderQueue *queue, enum renderQueueModes mode, int capacity, const GLenum *targets, int unitCount);
+//builds a sort key, each part is masked to its bits
+unsigned long long makeRenderKey(GLuint program, unsigned int textureSet, GLuint vao, unsigned int depth);
+//adds a draw to the frame, or draws it right away in immediate mode. Returns 0 if the queue couldn't grow.
+int submitRenderCommand(struct s_renderQueue *queue, const struct s_renderCommand *command);
+//sorts and draws the frame's commands, then empties the queue for the next frame
+void flushRenderQueue(struct s_renderQueue *queue);
+//sorts count keys with their indices in order, low to high, using tempKeys and tempOrder as scratch
+void radixSortKeys(unsigned long long *keys, int *order, unsigned long long *tempKeys, int *tempOrder, int count);
+//clears the totals
+void resetRenderStats(struct s_renderQueue *queue);
+//frees the commands
+void freeRenderQueue(struct s_renderQueue *queue);
+//parses sorted or immediate, -1 if it is neither
+int parseRenderQueueMode(const char *name);
+
+#endif
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "shader.h"
+#include "timer.h"
+#include "arena.h"
+
+#define FNV64_OFFSET	14695981039346656037ull
+#define FNV64_PRIME		1099511628211ull
+#define BINARY_VERSION	1
+
+// Start of a cached program binary, the driver's blob follows it.
+struct s_binaryHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned long long hash;
+	unsigned int format;
+	unsigned int length;
+};
+
+static GLuint buildProgram(struct s_shaderManager *shaders, const char *vertexSource, const char *fragmentSource, const struct s_shaderProgram *names);
+static GLuint compileShader(GLenum type, const char *source, const char *path);
+static GLuint loadBinary(struct s_shaderManager *shaders, unsigned long long hash);
+static void saveBinary(struct s_shaderManager *shaders, GLuint program, unsigned long long hash);
+static void binaryPath(const struct s_shaderManager *shaders, unsigned long long hash, char *path, size_t size);
+static unsigned long long hashSources(const struct s_shaderManager *shaders, const char *vertexSource, const char *fragmentSource);
+static unsigned long long hashBytes(unsigned long long hash, const void *data, size_t length);
+static char *readFile(const char *path);
+static long long fileStamp(const char *path);
+static void watchFiles(void *data);
+
+void initShaderManager(struct s_shaderManager *shaders, const char *binaryDirectory)
+{
+	const char *strings[3];
+	int i;
+
+	memset(shaders, 0, sizeof(*shaders));
+	initMutex(&shaders->mutex);
+	shaders->binaryDirectory = binaryDirectory;
+
+	if (binaryDirectory != NULL)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &shaders->binaryFormats);
+		if (shaders->binaryFormats == 0)
+		{
+			fprintf(stderr, "The driver can't save program binaries, shaders are always compiled\n");
+		}
+	}
+
+	// A binary from another driver or version fails to load anyway, keeping it out of the hash saves trying.
+	strings[0] = (const char *)glGetString(GL_VENDOR);
+	strings[1] = (const char *)glGetString(GL_RENDERER);
+	strings[2] = (const char *)glGetString(GL_VERSION);
+	shaders->driverHash = FNV64_OFFSET;
+	for (i = 0; i < 3; i++)
+	{
+		if (strings[i] != NULL)
+		{
+			shaders->driverHash = hashBytes(shaders->driverHash, strings[i], strlen(strings[i]) + 1);
+		}
+	}
+}
+
+int loadShaderProgram(struct s_shaderManager *shaders, const char *vertexPath, const char *fragmentPath)
+{
+	double start = timerNow();
+	struct s_shaderProgram *entry;
+	char *vertexSource;
+	char *fragmentSource;
+	unsigned long long hash;
+	int i;
+
+	for (i = 0; i < shaders->programCount; i++)
+	{
+		if (strcmp(shaders->programs[i].vertexPath, vertexPath) == 0 && strcmp(shaders->programs[i].fragmentPath, fragmentPath) == 0)
+		{
+			return i;
+		}
+	}
+	if (shaders->programCount == SHADER_MAX_PROGRAMS)
+	{
+		fprintf(stderr, "Too many shader programs\n");
+		return -1;
+	}
+
+	vertexSource = readFile(vertexPath);
+	fragmentSource = readFile(fragmentPath);
+	if (vertexSource == NULL || fragmentSource == NULL)
+	{
+		freeHeap(vertexSource);
+		freeHeap(fragmentSource);
+		return -1;
+	}
+
+	// Different files with the same sources share one program.
+	hash = hashSources(shaders, vertexSource, fragmentSource);
+	for (i = 0; i < shaders->programCount; i++)
+	{
+		if (shaders->programs[i].hash == hash)
+		{
+			freeHeap(vertexSource);
+			freeHeap(fragmentSource);
+			shaders->loadTime += timerNow() - start;
+			return i;
+		}
+	}
+
+	entry = &shaders->programs[shaders->programCount];
+	memset(entry, 0, sizeof(*entry));
+	snprintf(entry->vertexPath, sizeof(entry->vertexPath), "%s", vertexPath);
+	snprintf(entry->fragmentPath, sizeof(entry->fragmentPath), "%s", fragmentPath);
+	entry->vertexStamp = fileStamp(vertexPath);
+	entry->fragmentStamp = fileStamp(fragmentPath);
+	entry->hash = hash;
+
+	entry->program = loadBinary(shaders, hash);
+	if (entry->program != 0)
+	{
+		shaders->binaryCount++;
+	}
+	else
+	{
+		entry->program = buildProgram(shaders, vertexSource, fragmentSource, entry);
+	}
+	freeHeap(vertexSource);
+	freeHeap(fragmentSource);
+	shaders->loadTime += timerNow() - start;
+	if (entry->program == 0)
+	{
+		return -1;
+	}
+
+	// The watcher reads programCount, a new program only becomes visible to it once it's complete.
+	lockMutex(&shaders->mutex);
+	shaders->programCount++;
+	unlockMutex(&shaders->mutex);
+	return shaders->programCount - 1;
+}
+
+GLuint shaderProgram(const struct s_shaderManager *shaders, int id)
+{
+	return id >= 0 && id < shaders->programCount ? shaders->programs[id].program : 0;
+}
+
+void watchShaderFiles(struct s_shaderManager *shaders)
+{
+	if (!shaders->watching)
+	{
+		shaders->watching = startThread(&shaders->watcher, watchFiles, shaders);
+	}
+}
+
+int updateShaderManager(struct s_shaderManager *shaders)
+{
+	int swapped = 0;
+	int i;
+
+	if (!shaders->watching)
+	{
+		return 0;
+	}
+	for (i = 0; i < shaders->programCount; i++)
+	{
+		struct s_shaderProgram *entry = &shaders->programs[i];
+		char *vertexSource;
+		char *fragmentSource;
+
+		lockMutex(&shaders->mutex);
+		vertexSource = entry->pendingVertex;
+		fragmentSource = entry->pendingFragment;
+		entry->pendingVertex = NULL;
+		entry->pendingFragment = NULL;
+		unlockMutex(&shaders->mutex);
+		if (vertexSource == NULL)
+		{
+			continue;
+		}
+
+		// Compiling needs the context, so it happens here. A broken edit keeps the old program running.
+		unsigned long long hash = hashSources(shaders, vertexSource, fragmentSource);
+		GLuint program = hash == entry->hash ? 0 : buildProgram(shaders, vertexSource, fragmentSource, entry);
+		if (program != 0)
+		{
+			glDeleteProgram(entry->program);
+			entry->program = program;
+			entry->hash = hash;
+			printf("Reloaded %s and %s\n", entry->vertexPath, entry->fragmentPath);
+			swapped++;
+		}
+		freeHeap(vertexSource);
+		freeHeap(fragmentSource);
+	}
+	return swapped;
+}
+
+void freeShaderManager(struct s_shaderManager *shaders)
+{
+	int i;
+
+	if (shaders->watching)
+	{
+		lockMutex(&shaders->mutex);
+		shaders->stopWatching = 1;
+		unlockMutex(&shaders->mutex);
+		joinThread(&shaders->watcher);
+	}
+	for (i = 0; i < shaders->programCount; i++)
+	{
+		glDeleteProgram(shaders->programs[i].program);
+		freeHeap(shaders->programs[i].pendingVertex);
+		freeHeap(shaders->programs[i].pendingFragment);
+	}
+	freeMutex(&shaders->mutex);
+	memset(shaders, 0, sizeof(*shaders));
+}
+
+// Compiles and links the sources, printing the log with the file names when either fails. Returns 0 on failure.
+static GLuint buildProgram(struct s_shaderManager *shaders, const char *vertexSource, const char *fragmentSource, const struct s_shaderProgram *names)
+{
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource, names->vertexPath);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource, names->fragmentPath);
+	GLuint program;
+	GLint status;
+	char log[1024];
+
+	if (vertexShader == 0 || fragmentShader == 0)
+	{
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return 0;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	if (shaders->binaryFormats > 0)
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(program);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		fprintf(stderr, "Failed to link %s and %s: %s\n", names->vertexPath, names->fragmentPath, log);
+		glDeleteProgram(program);
+		return 0;
+	}
+	shaders->compiledCount++;
+	saveBinary(shaders, program, hashSources(shaders, vertexSource, fragmentSource));
+	return program;
+}
+
+static GLuint compileShader(GLenum type, const char *source, const char *path)
+{
+	GLuint shader = glCreateShader(type);
+	GLint status;
+	char log[1024];
+
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Failed to compile %s: %s\n", path, log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+// Returns the linked program from the binary cache, or 0 if there is none or the driver turns it down.
+static GLuint loadBinary(struct s_shaderManager *shaders, unsigned long long hash)
+{
+	struct s_binaryHeader header;
+	char path[SHADER_PATH_LENGTH + 32];
+	void *binary;
+	GLuint program;
+	GLint status;
+	FILE *file;
+
+	if (shaders->binaryDirectory == NULL || shaders->binaryFormats == 0)
+	{
+		return 0;
+	}
+	binaryPath(shaders, hash, path, sizeof(path));
+	file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		return 0;
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "MSQP", 4) != 0
+		|| header.version != BINARY_VERSION || header.hash != hash || header.length == 0)
+	{
+		fclose(file);
+		return 0;
+	}
+	binary = allocHeap(header.length);
+	if (binary == NULL || fread(binary, 1, header.length, file) != header.length)
+	{
+		freeHeap(binary);
+		fclose(file);
+		return 0;
+	}
+	fclose(file);
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.format, binary, header.length);
+	freeHeap(binary);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		// Drivers can refuse their own binaries after an update, it is compiled again and the file replaced.
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+static void saveBinary(struct s_shaderManager *shaders, GLuint program, unsigned long long hash)
+{
+	struct s_binaryHeader header;
+	char path[SHADER_PATH_LENGTH + 32];
+	GLint length = 0;
+	GLenum format;
+	void *binary;
+	FILE *file;
+
+	if (shaders->binaryDirectory == NULL || shaders->binaryFormats == 0)
+	{
+		return;
+	}
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	binary = length > 0 ? allocHeap(length) : NULL;
+	if (binary == NULL)
+	{
+		return;
+	}
+	glGetProgramBinary(program, length, &length, &format, binary);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MSQP", 4);
+	header.version = BINARY_VERSION;
+	header.hash = hash;
+	header.format = format;
+	header.length = (unsigned int)length;
+
+#ifdef _WIN32
+	_mkdir(shaders->binaryDirectory);
+#else
+	mkdir(shaders->binaryDirectory, 0755);
+#endif
+	binaryPath(shaders, hash, path, sizeof(path));
+	file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+		freeHeap(binary);
+		return;
+	}
+	if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(binary, 1, length, file) != (size_t)length)
+	{
+		fclose(file);
+		remove(path);
+	}
+	else if (fclose(file) != 0)
+	{
+		remove(path);
+	}
+	freeHeap(binary);
+}
+
+static void binaryPath(const struct s_shaderManager *shaders, unsigned long long hash, char *path, size_t size)
+{
+	snprintf(path, size, "%s/program_%016llx.bin", shaders->binaryDirectory, hash);
+}
+
+static unsigned long long hashSources(const struct s_shaderManager *shaders, const char *vertexSource, const char *fragmentSource)
+{
+	unsigned long long hash = shaders->driverHash;
+
+	hash = hashBytes(hash, vertexSource, strlen(vertexSource) + 1);
+	return hashBytes(hash, fragmentSource, strlen(fragmentSource) + 1);
+}
+
+static unsigned long long hashBytes(unsigned long long hash, const void *data, size_t length)
+{
+	const unsigned char *bytes = data;
+	size_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		hash = (hash ^ bytes[i]) * FNV64_PRIME;
+	}
+	return hash;
+}
+
+// The whole file with a terminating 0, or NULL.
+static char *readFile(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	char *text;
+	long length;
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open shader %s\n", path);
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	text = length >= 0 ? allocHeap(length + 1) : NULL;
+	if (text == NULL || fread(text, 1, length, file) != (size_t)length)
+	{
+		freeHeap(text);
+		fclose(file);
+		return NULL;
+	}
+	text[length] = '\0';
+	fclose(file);
+	return text;
+}
+
+// Modification time and size folded together, either changing means the file changed. -1 if it can't be read.
+static long long fileStamp(const char *path)
+{
+	struct stat info;
+
+	if (stat(path, &info) != 0)
+	{
+		return -1;
+	}
+	return (long long)info.st_mtime * 1000003 + (long long)info.st_size;
+}
+
+// Polls the files and reads the ones that changed, so the gl thread only has to compile them.
+static void watchFiles(void *data)
+{
+	struct s_shaderManager *shaders = data;
+	int programCount;
+	int stop;
+	int i;
+
+	for (;;)
+	{
+		sleepThread(SHADER_WATCH_MS);
+		lockMutex(&shaders->mutex);
+		stop = shaders->stopWatching;
+		programCount = shaders->programCount;
+		unlockMutex(&shaders->mutex);
+		if (stop)
+		{
+			return;
+		}
+
+		for (i = 0; i < programCount; i++)
+		{
+			struct s_shaderProgram *entry = &shaders->programs[i];
+			long long vertexStamp = fileStamp(entry->vertexPath);
+			long long fragmentStamp = fileStamp(entry->fragmentPath);
+			char *vertexSource;
+			char *fragmentSource;
+
+			// A file being saved can be missing for a moment, it is picked up on a later pass.
+			if ((vertexStamp == entry->vertexStamp && fragmentStamp == entry->fragmentStamp) || vertexStamp < 0 || fragmentStamp < 0)
+			{
+				continue;
+			}
+			vertexSource = readFile(entry->vertexPath);
+			fragmentSource = readFile(entry->fragmentPath);
+			if (vertexSource == NULL || fragmentSource == NULL)
+			{
+				freeHeap(vertexSource);
+				freeHeap(fragmentSource);
+				continue;
+			}
+			entry->vertexStamp = vertexStamp;
+			entry->fragmentStamp = fragmentStamp;
+
+			lockMutex(&shaders->mutex);
+			freeHeap(entry->pendingVertex);
+			freeHeap(entry->pendingFragment);
+			entry->pendingVertex = vertexSource;
+			entry->pendingFragment = fragmentSource;
+			unlockMutex(&shaders->mutex);
+		}
+	}
+}
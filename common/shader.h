@@ -0,0 +1,60 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "thread.h"
+
+#define SHADER_MAX_PROGRAMS	16
+#define SHADER_PATH_LENGTH	256
+#define SHADER_WATCH_MS		250	// how often the watcher looks at the files
+
+// A program built from a vertex and a fragment shader file.
+struct s_shaderProgram {
+	char vertexPath[SHADER_PATH_LENGTH];
+	char fragmentPath[SHADER_PATH_LENGTH];
+	GLuint program;
+	unsigned long long hash;	// of both sources and the driver, names the binary in the cache
+	long long vertexStamp;	// modification time and size of the files when they were last read
+	long long fragmentStamp;
+	char *pendingVertex;	// sources the watcher read after a change, guarded by mutex
+	char *pendingFragment;
+};
+
+// Loads shader programs from files, once per distinct pair of sources, and keeps the linked binaries on disk
+// with glGetProgramBinary so a later run with the same sources and driver skips compiling.
+// With watchShaderFiles a thread notices edits to the files and reads them, updateShaderManager then swaps in
+// the new program on the gl thread, keeping the old one if the edit doesn't compile.
+struct s_shaderManager {
+	struct s_shaderProgram programs[SHADER_MAX_PROGRAMS];
+	int programCount;
+	const char *binaryDirectory;	// NULL keeps no binaries
+	int binaryFormats;	// formats the driver can save programs in, 0 if it can't
+	unsigned long long driverHash;	// binaries only load on the driver that made them
+
+	struct s_mutex mutex;
+	struct s_thread watcher;
+	int watching;
+	int stopWatching;	// guarded by mutex
+
+	// stats
+	int compiledCount;
+	int binaryCount;
+	double loadTime;	// seconds spent in loadShaderProgram
+};
+
+//sets up the manager, binaries are kept in binaryDirectory unless it is NULL
+void initShaderManager(struct s_shaderManager *shaders, const char *binaryDirectory);
+//loads, or finds the already loaded, program for the two files. Returns its id or -1 if it doesn't compile.
+int loadShaderProgram(struct s_shaderManager *shaders, const char *vertexPath, const char *fragmentPath);
+//the current gl program for id, it changes when the files are reloaded
+GLuint shaderProgram(const struct s_shaderManager *shaders, int id);
+//starts the thread watching the files for changes
+void watchShaderFiles(struct s_shaderManager *shaders);
+//call once a frame, rebuilds programs whose files changed. Returns how many were swapped, their uniforms need setting again.
+int updateShaderManager(struct s_shaderManager *shaders);
+//stops the watcher and deletes the programs
+void freeShaderManager(struct s_shaderManager *shaders);
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "thread.h"
+
+#ifdef _WIN32
+static DWORD WINAPI threadMain(LPVOID data)
+#else
+static void *threadMain(void *data)
+#endif
+{
+	struct s_thread *thread = data;
+	thread->run(thread->arg);
+	return 0;
+}
+
+int startThread(struct s_thread *thread, void (*run)(void *), void *arg)
+{
+	thread->run = run;
+	thread->arg = arg;
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+	return thread->handle != NULL;
+#else
+	return pthread_create(&thread->handle, NULL, threadMain, thread) == 0;
+#endif
+}
+
+void joinThread(struct s_thread *thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+}
+
+void sleepThread(int milliseconds)
+{
+#ifdef _WIN32
+	Sleep(milliseconds);
+#else
+	usleep((useconds_t)milliseconds * 1000);
+#endif
+}
+
+int cpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+void initMutex(struct s_mutex *mutex)
+{
+#ifdef _WIN32
+	InitializeCriticalSection(&mutex->section);
+#else
+	pthread_mutex_init(&mutex->mutex, NULL);
+#endif
+}
+
+void lockMutex(struct s_mutex *mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection(&mutex->section);
+#else
+	pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void unlockMutex(struct s_mutex *mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&mutex->section);
+#else
+	pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+void freeMutex(struct s_mutex *mutex)
+{
+#ifdef _WIN32
+	DeleteCriticalSection(&mutex->section);
+#else
+	pthread_mutex_destroy(&mutex->mutex);
+#endif
+}
+
+void initCondition(struct s_condition *condition)
+{
+#ifdef _WIN32
+	InitializeConditionVariable(&condition->condition);
+#else
+	pthread_cond_init(&condition->condition, NULL);
+#endif
+}
+
+void waitCondition(struct s_condition *condition, struct s_mutex *mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS(&condition->condition, &mutex->section, INFINITE);
+#else
+	pthread_cond_wait(&condition->condition, &mutex->mutex);
+#endif
+}
+
+void wakeCondition(struct s_condition *condition)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(&condition->condition);
+#else
+	pthread_cond_broadcast(&condition->condition);
+#endif
+}
+
+void freeCondition(struct s_condition *condition)
+{
+#ifdef _WIN32
+	// Win32 condition variables need no cleanup.
+	(void)condition;
+#else
+	pthread_cond_destroy(&condition->condition);
+#endif
+}
+
+unsigned int loadAcquire(const volatile unsigned int *value)
+{
+#ifdef _WIN32
+	unsigned int result = *value;
+	MemoryBarrier();
+	return result;
+#else
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void storeRelease(volatile unsigned int *value, unsigned int newValue)
+{
+#ifdef _WIN32
+	MemoryBarrier();
+	*value = newValue;
+#else
+	__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+unsigned int atomicAdd(volatile unsigned int *value, unsigned int add)
+{
+#ifdef _WIN32
+	return (unsigned int)InterlockedExchangeAdd((volatile LONG *)value, (LONG)add);
+#else
+	return __atomic_fetch_add(value, add, __ATOMIC_SEQ_CST);
+#endif
+}
+
+int compareExchange(volatile unsigned int *value, unsigned int expected, unsigned int newValue)
+{
+#ifdef _WIN32
+	return (unsigned int)InterlockedCompareExchange((volatile LONG *)value, (LONG)newValue, (LONG)expected) == expected;
+#else
+	return __atomic_compare_exchange_n(value, &expected, newValue, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
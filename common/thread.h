@@ -0,0 +1,64 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Thin wrappers over pthreads and win32 threads, just what the examples need.
+struct s_thread {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	void (*run)(void *);
+	void *arg;
+};
+
+struct s_mutex {
+#ifdef _WIN32
+	CRITICAL_SECTION section;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+struct s_condition {
+#ifdef _WIN32
+	CONDITION_VARIABLE condition;
+#else
+	pthread_cond_t condition;
+#endif
+};
+
+//starts run(arg) on a new thread. Returns 0 on failure.
+int startThread(struct s_thread *thread, void (*run)(void *), void *arg);
+//waits for the thread to return
+void joinThread(struct s_thread *thread);
+//sleeps the calling thread
+void sleepThread(int milliseconds);
+//number of cpus the threads can run on, at least 1
+int cpuCount(void);
+void initMutex(struct s_mutex *mutex);
+void lockMutex(struct s_mutex *mutex);
+void unlockMutex(struct s_mutex *mutex);
+void freeMutex(struct s_mutex *mutex);
+void initCondition(struct s_condition *condition);
+//unlocks mutex and sleeps until woken, then locks it again. It can wake for no reason, so wait in a loop on what was wanted.
+void waitCondition(struct s_condition *condition, struct s_mutex *mutex);
+//wakes every thread waiting on the condition
+void wakeCondition(struct s_condition *condition);
+void freeCondition(struct s_condition *condition);
+//reads value, later reads and writes can't move before it. Pairs with storeRelease for handing data between two threads without a lock.
+unsigned int loadAcquire(const volatile unsigned int *value);
+//writes value, earlier reads and writes can't move after it
+void storeRelease(volatile unsigned int *value, unsigned int newValue);
+//adds to value in one step, returns what it was before
+unsigned int atomicAdd(volatile unsigned int *value, unsigned int add);
+//sets value to newValue if it is still expected. Returns 0 if another thread changed it first.
+int compareExchange(volatile unsigned int *value, unsigned int expected, unsigned int newValue);
+
+#endif
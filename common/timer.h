@@ -0,0 +1,7 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+//seconds from a monotonic clock, doesn't need glfw so it also works headless
+double timerNow(void);
+
+#endif
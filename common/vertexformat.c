@@ -0,0 +1,128 @@
+#include <string.h>
+
+#include "vertexformat.h"
+
+void applyVertexLayout(const struct s_vertexLayout *layout, GLuint program)
+{
+	int i;
+
+	for (i = 0; i < layout->attribCount; i++)
+	{
+		const struct s_vertexAttrib *attrib = &layout->attribs[i];
+		GLint location = glGetAttribLocation(program, attrib->name);
+
+		// The linker drops inputs the shaders never read, a layout can still carry them for other programs.
+		if (location < 0)
+		{
+			continue;
+		}
+		glEnableVertexAttribArray(location);
+		if (attrib->integer)
+		{
+			glVertexAttribIPointer(location, attrib->size, attrib->type, layout->stride, (GLvoid*)attrib->offset);
+		}
+		else
+		{
+			glVertexAttribPointer(location, attrib->size, attrib->type, attrib->normalized, layout->stride, (GLvoid*)attrib->offset);
+		}
+		glVertexAttribDivisor(location, layout->divisor);
+	}
+}
+
+GLshort packSnorm16(GLfloat value)
+{
+	if (value <= -1.0f)
+	{
+		return -32767;
+	}
+	if (value >= 1.0f)
+	{
+		return 32767;
+	}
+	return (GLshort)(value * 32767.0f + (value < 0.0f ? -0.5f : 0.5f));
+}
+
+GLhalf packHalf(GLfloat value)
+{
+	unsigned int bits;
+	unsigned int sign;
+	int exponent;
+	unsigned int mantissa;
+
+	memcpy(&bits, &value, sizeof(bits));
+	sign = (bits >> 16) & 0x8000;
+	exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	mantissa = bits & 0x7fffff;
+
+	// Infinity and nan keep their class, nan keeps a mantissa bit so it doesn't turn into infinity.
+	if (((bits >> 23) & 0xff) == 0xff)
+	{
+		return (GLhalf)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+	}
+	if (exponent >= 31)
+	{
+		return (GLhalf)(sign | 0x7c00);
+	}
+	// Too small for a normal half, shift the implicit one into the mantissa and round, or flush to zero.
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return (GLhalf)sign;
+		}
+		mantissa |= 0x800000;
+		unsigned int shift = (unsigned int)(14 - exponent);
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1)))
+		{
+			half++;
+		}
+		return (GLhalf)(sign | half);
+	}
+
+	// Round to nearest even, a carry out of the mantissa correctly bumps the exponent, up to infinity.
+	unsigned int half = sign | (unsigned int)exponent << 10 | mantissa >> 13;
+	unsigned int rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+	return (GLhalf)half;
+}
+
+GLfloat unpackHalf(GLhalf value)
+{
+	unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+	unsigned int exponent = (value >> 10) & 0x1f;
+	unsigned int mantissa = value & 0x3ff;
+	unsigned int bits;
+	GLfloat result;
+
+	if (exponent == 0x1f)
+	{
+		bits = sign | 0x7f800000 | mantissa << 13;
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | (exponent - 15 + 127) << 23 | mantissa << 13;
+	}
+	else if (mantissa == 0)
+	{
+		bits = sign;
+	}
+	else
+	{
+		// Subnormal, normalize it by hand.
+		exponent = 127 - 15 + 1;
+		while ((mantissa & 0x400) == 0)
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | exponent << 23 | (mantissa & 0x3ff) << 13;
+	}
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
@@ -0,0 +1,44 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <stddef.h>
+
+// The vertex formats a pipeline can be built with, picked at compile time with a define such as QUAD_VERTEX_FORMAT.
+#define VERTEX_FORMAT_FLOAT		0	// every attribute as 32 bit floats
+#define VERTEX_FORMAT_COMPACT	1	// positions as normalized shorts, texture coords and sizes as half floats, colors as RGBA8
+
+#define VERTEX_MAX_ATTRIBS	8
+
+// One attribute of a vertex layout, how glVertexAttribPointer should read it from the vertex.
+struct s_vertexAttrib {
+	const char *name;	// input in the vertex shader
+	GLint size;	// components
+	GLenum type;
+	GLboolean normalized;	// integer types read as -1 to 1 or 0 to 1 floats
+	GLboolean integer;	// read with glVertexAttribIPointer, as an int or uint in the shader
+	size_t offset;
+};
+
+// Describes a vertex struct to gl, so the struct and the attribute setup come from one place.
+// Each pipeline keeps its layouts as static const tables next to its vertex struct, so switching formats is a define.
+struct s_vertexLayout {
+	const char *name;
+	GLsizei stride;
+	GLuint divisor;	// 0 for vertices, 1 for per-instance data
+	int attribCount;
+	struct s_vertexAttrib attribs[VERTEX_MAX_ATTRIBS];
+};
+
+//points the attributes of program at the buffer bound to GL_ARRAY_BUFFER, attributes the program doesn't use are skipped
+void applyVertexLayout(const struct s_vertexLayout *layout, GLuint program);
+//a -1 to 1 float as a normalized short, values outside are clamped
+GLshort packSnorm16(GLfloat value);
+//a float as a half float, rounded to nearest
+GLhalf packHalf(GLfloat value);
+//a half float back to a float
+GLfloat unpackHalf(GLhalf value);
+
+#endif